@@ -58,7 +58,40 @@ varnam_set_suggestions_dir (const char *dir);
 VARNAM_EXPORT extern int
 varnam_init(const char *scheme_file, varnam **handle, char **msg);
 
+/**
+ * Same as varnam_init(), but flags controls how the symbols file is opened
+ *
+ * flags          - 0 or a combination of
+ *                  VARNAM_OPEN_READONLY  - Opens the file read only and immutable. No locks are
+ *                                          taken and reads are memory mapped
+ *                  VARNAM_OPEN_IN_MEMORY - Copies the whole file into memory and closes the file
+ *
+ * NOTES
+ *
+ * Use these only for symbols files which are not changing, like the ones installed
+ * on the system. Functions which modifies the symbols file will fail on a read only handle.
+ * Changes made to an in-memory handle are lost when it is destroyed. A read only handle
+ * needs a compiled symbols file. Other files fail with VARNAM_STORAGE_ERROR and msg says why.
+ *
+ * Learnings are stored in a separate file and are not affected by these flags
+ *
+ * RETURN
+ *
+ * Same as varnam_init()
+ **/
+VARNAM_EXPORT extern int
+varnam_init_with_flags(const char *scheme_file, int flags, varnam **handle, char **msg);
 
+
+/**
+ * Initializes a handle for every symbols file in the symbols directory.
+ *
+ * NOTES
+ *
+ * All the handles are opened upfront. Use varnam_registry_create() to list
+ * the schemes and open handles only when they are used
+ *
+ **/
 VARNAM_EXPORT extern varray*
 varnam_get_all_handles();
 
@@ -81,6 +114,10 @@ varnam_get_suggestions_file (varnam *handle);
  *
  * /usr/local/share/varnam/vst, /usr/share/varnam/vst, schemes/
  *
+ * The directory found is indexed on the first call, so later calls don't look through
+ * these locations again. varnam_set_symbols_dir() drops the index. Schemes added to the
+ * directory after it was indexed are still found.
+ *
  * Suggestions file will be searched in the following locations
  *
  * XDG_DATA_HOME/varnam/suggestions, HOME/.local/share/varnam/suggestions
@@ -146,6 +183,35 @@ varnam_register_renderer(
  *   Eg: varnam_config(handle, VARNAM_CONFIG_ENABLE_SUGGESTIONS, "/home/user/.words") - Use words from the file
  *       varnam_config(handle, VARNAM_CONFIG_ENABLE_SUGGESTIONS, NULL) - Turn off suggestions
  *
+ * VARNAM_CONFIG_POOL_HIGH_WATER_MARK
+ *   Objects used internally are pooled and carved out of arenas which are reused across calls.
+ *   This option caps the bytes an arena can hold. When an arena grows past this limit, it is
+ *   released at the start of the next call. Default is 0, which means no limit.
+ *   Eg: varnam_config(handle, VARNAM_CONFIG_POOL_HIGH_WATER_MARK, 1024 * 1024) - Cap at 1MB
+ *
+ * VARNAM_CONFIG_AUTO_TRIM_BYTES
+ *   Sets a target for the memory held by the pools and caches of the handle. When the estimated
+ *   memory goes above this at the end of a call, pooled objects which are not in use are released
+ *   and the least recently used cache entries are evicted till the estimate is back under the
+ *   target. Results of the call stay valid. Default is 0, which turns off automatic trimming.
+ *   Eg: varnam_config(handle, VARNAM_CONFIG_AUTO_TRIM_BYTES, 4 * 1024 * 1024) - Trim above 4MB
+ *
+ * VARNAM_CONFIG_MAX_CANDIDATES
+ *   Caps the number of words varnam_transliterate() returns. Learned words rank first, followed by
+ *   words from the words tokenizer, the symbols based result and suggestions. Once the cap is reached,
+ *   rest of the sources are not looked up. Default is 0, which means no limit.
+ *   Eg: varnam_config(handle, VARNAM_CONFIG_MAX_CANDIDATES, 3) - Return at most 3 words
+ *
+ * VARNAM_CONFIG_ENABLE_TRACING
+ *   Records the wall clock time taken by the public calls and their stages into histograms.
+ *   See varnam_get_timings(). Turning it off releases the histograms. Default is 0.
+ *   Eg: varnam_config(handle, VARNAM_CONFIG_ENABLE_TRACING, 1) - Start recording timings
+ *
+ * VARNAM_CONFIG_ENABLE_PROFILING
+ *   Records what each prepared statement costs. See varnam_get_statement_stats(). Turning it
+ *   off releases the counters. Needs sqlite 3.14.0 or above. Default is 0.
+ *   Eg: varnam_config(handle, VARNAM_CONFIG_ENABLE_PROFILING, 1) - Start profiling statements
+ *
  * RETURN
  *
  * VARNAM_SUCCESS         - Successfull operation
@@ -195,12 +261,159 @@ VARNAM_EXPORT extern int varnam_create_token(
     int buffered
     );
 
+/**
+ * Creates all the tokens in specs
+ *
+ * handle     - Valid varnam instance
+ * specs      - Tokens to create. See vtoken_spec
+ * count      - Number of elements in specs
+ *
+ * NOTES
+ *
+ * Each token is created the way varnam_create_token() does it. Dead consonants are inferred
+ * and duplicates are ignored as per the configuration. Duplicates are looked up in memory
+ * rather than querying the symbols table for every token. Indexes on the symbols table are
+ * built once after all the tokens are inserted.
+ *
+ * All the specs are validated before anything is written. When buffering is already on,
+ * tokens join the pending changes and varnam_flush_buffer() writes them. Otherwise they are
+ * written to disk before returning. On failure, only the tokens from this call are rolled
+ * back. Changes buffered before the call are kept.
+ *
+ * RETURN
+ *
+ * VARNAM_SUCCESS        - On successful execution.
+ * VARNAM_ARGS_ERROR     - If any of the specs are invalid
+ * VARNAM_STORAGE_ERROR  - Any error related to writing to disk.
+ * VARNAM_ERROR          - Other errors
+ **/
+VARNAM_EXPORT extern int
+varnam_create_tokens_bulk(varnam *handle, vtoken_spec *specs, size_t count);
+
 VARNAM_EXPORT extern int
 varnam_transliterate(varnam *handle, const char *input, varray **output);
 
 VARNAM_EXPORT extern int
 varnam_reverse_transliterate(varnam *handle, const char *input, char **result);
 
+/**
+ * Transliterates the input and writes the words into caller provided memory.
+ *
+ * handle - Valid varnam instance
+ * input  - Text to transliterate
+ * buf    - Buffer where the text of the words will be written
+ * cap    - Size of buf in bytes
+ * out    - Array which will receive one vword_span for each word
+ * max      - Number of items out can hold
+ * count    - Number of words written will be set here
+ * required - Bytes buf needs to hold all the words will be set here. Can be NULL
+ *
+ * NOTES
+ *
+ * Words are written in the same order varnam_transliterate() returns them. Text
+ * of each word is null terminated and span's text points into buf. Unlike
+ * varnam_transliterate(), results are not invalidated by the next call on the handle.
+ *
+ * Only complete words are written. When a word don't fit into buf or out is full,
+ * it and the words after it are dropped and VARNAM_TRUNCATED is returned. count is
+ * then set to the number of words available and the spans which were not written have
+ * text set to NULL. Buffers of count spans and required bytes will hold all the words.
+ *
+ * RETURN
+ *
+ * VARNAM_SUCCESS         - All the words are written
+ * VARNAM_TRUNCATED       - Some words were dropped as there is not enough space
+ * VARNAM_ARGS_ERROR      - Invalid arguments
+ * VARNAM_ERROR           - All other errors
+ **/
+VARNAM_EXPORT extern int
+varnam_transliterate_into(varnam *handle, const char *input, char *buf, size_t cap,
+                          vword_span *out, size_t max, size_t *count, size_t *required);
+
+/**
+ * Transliterates all the words in a text.
+ *
+ * handle   - Valid varnam instance
+ * text     - Text to transliterate. This can be a whole document
+ * options  - VARNAM_TEXT_BEST_CANDIDATE or VARNAM_TEXT_ALL_CANDIDATES
+ * segments - Segments of the text will be set here
+ * count    - Number of segments will be set here
+ *
+ * NOTES
+ *
+ * Text is split into words and the text between them. Whitespace, punctuations and
+ * text which is not ASCII are passed through. Each segment has the part of the input
+ * it covers and the words for it, best first. With VARNAM_TEXT_BEST_CANDIDATE, each
+ * segment has only one word. A passed through segment, or a word for which varnam
+ * has nothing to offer, has the text itself as the only word and transliterated
+ * set to 0. So joining the first word of all the segments gives the transliterated text.
+ *
+ * Candidates for a word are remembered across calls. Remembered words are forgotten
+ * when the symbols, learnings or the configuration changes.
+ *
+ * Segments are valid till the next call to this function on the handle.
+ *
+ * RETURN
+ *
+ * VARNAM_SUCCESS         - On successful execution
+ * VARNAM_ARGS_ERROR      - Invalid arguments
+ * VARNAM_ERROR           - All other errors
+ **/
+VARNAM_EXPORT extern int
+varnam_transliterate_text(varnam *handle, const char *text, int options,
+                          vtext_segment **segments, size_t *count);
+
+/**
+ * Reverse transliterates the input and writes the result into caller provided memory.
+ *
+ * handle - Valid varnam instance
+ * input  - Text to reverse transliterate
+ * buf    - Buffer where the result will be written
+ * cap    - Size of buf in bytes
+ * length - Length of the complete result in bytes, excluding the null terminator
+ *
+ * NOTES
+ *
+ * When the result don't fit, buf will have the result cut at a UTF-8 character
+ * boundary and null terminated. length can be used to retry with a bigger buffer.
+ *
+ * RETURN
+ *
+ * VARNAM_SUCCESS         - Result is written completely
+ * VARNAM_TRUNCATED       - buf is too small to hold the result
+ * VARNAM_ARGS_ERROR      - Invalid arguments
+ * VARNAM_ERROR           - All other errors
+ **/
+VARNAM_EXPORT extern int
+varnam_reverse_transliterate_into(varnam *handle, const char *input, char *buf, size_t cap,
+                                  size_t *length);
+
+/**
+ * Reverse transliterates all the words in a text and appends the result to output.
+ *
+ * handle - Valid varnam instance
+ * text   - Text to reverse transliterate. This can be a whole document
+ * output - Result is appended to this. It grows as needed
+ *
+ * NOTES
+ *
+ * ASCII text is copied to output as it is. Rest of the text is reverse transliterated
+ * one word at a time. Characters which are not known to the scheme are left unchanged.
+ *
+ * Reverse transliterated words are remembered across calls, so that frequent words are
+ * processed once. They are forgotten when the symbols or the configuration changes.
+ *
+ * Large documents can be passed in parts, as long as a part don't end in the middle of a word.
+ *
+ * RETURN
+ *
+ * VARNAM_SUCCESS         - On successful execution
+ * VARNAM_ARGS_ERROR      - Invalid arguments
+ * VARNAM_ERROR           - All other errors. Output will have the text till the failed word
+ **/
+VARNAM_EXPORT extern int
+varnam_reverse_transliterate_text(varnam *handle, const char *text, strbuf *output);
+
 /**
  * Varnam will learn the supplied word. It will also learn all possible ways to write
  * the supplied word.
@@ -390,12 +603,229 @@ VARNAM_EXPORT extern int varnam_flush_buffer(
     varnam *handle
     );
 
+/**
+ * Gets information about the memory and caches used by the handle
+ *
+ * handle   - A valid varnam instance
+ * detailed - Computes symbols and words count and bytes used by pools and caches
+ * info     - Output will be written here
+ *
+ * NOTES
+ *
+ * Reports objects and bytes held by each instance pool, entries, bytes and hit ratio
+ * of each in-memory cache, prepared statements and sqlite3_db_status() memory and
+ * page cache hit ratio for the symbols and learnings databases. Computing the details walks all
+ * the pooled objects and cache entries, so prefer detailed = false when this
+ * is called frequently.
+ *
+ * info is allocated by this function and should be freed by the caller.
+ *
+ * RETURN
+ *
+ * VARNAM_SUCCESS       - On successfull execution
+ * VARNAM_ARGS_ERROR    - When handle or info is invalid
+ * VARNAM_ERROR         - Other errors
+ **/
 VARNAM_EXPORT extern int varnam_get_info(
     varnam *handle,
     bool detailed,
     vinfo **info
     );
 
+/**
+ * Releases memory held by the handle
+ *
+ * handle - A valid varnam instance
+ * level  - One of VARNAM_TRIM_XXX
+ *
+ * NOTES
+ *
+ * Pools keep the objects they have handed out and caches keep growing till they are
+ * full. This makes a handle which once processed a large input hold on to that memory.
+ *
+ * VARNAM_TRIM_POOLS
+ *   Releases the pooled objects beyond the most used at once since the last trim.
+ *
+ * VARNAM_TRIM_CACHES
+ *   Trims the pools and evicts the least recently used half of each in-memory cache.
+ *
+ * VARNAM_TRIM_ALL
+ *   Releases all the pooled objects, empties the caches and asks sqlite to release
+ *   the memory it can. The handle is usable afterwards and builds them up again as needed.
+ *
+ * Results returned by earlier calls on the handle are invalid after this. Long running
+ * processes can call this when a handle becomes idle. varnam_get_info() reports the high
+ * water mark of each pool.
+ *
+ * RETURN
+ *
+ * VARNAM_SUCCESS       - On successfull execution
+ * VARNAM_ARGS_ERROR    - When handle or level is invalid
+ **/
+VARNAM_EXPORT extern int varnam_trim(
+    varnam *handle,
+    int level
+    );
+
+/**
+ * Gets the wall clock time taken by a stage since tracing was turned on or last reset
+ *
+ * handle  - A valid varnam instance
+ * stage   - One of VARNAM_STAGE_XXX
+ * timings - Output will be written here
+ *
+ * NOTES
+ *
+ * VARNAM_STAGE_TRANSLITERATE, VARNAM_STAGE_REVERSE_TRANSLITERATE, VARNAM_STAGE_LEARN,
+ * VARNAM_STAGE_TRANSLITERATE_TEXT, VARNAM_STAGE_REVERSE_TRANSLITERATE_TEXT,
+ * VARNAM_STAGE_TRANSLITERATE_INTO and VARNAM_STAGE_REVERSE_TRANSLITERATE_INTO time the
+ * whole call of the function they are named after. Rest are the stages in them, so a slow
+ * call can be put down to one of them. Timings are recorded only when VARNAM_CONFIG_ENABLE_TRACING is on. All
+ * values are zero otherwise.
+ *
+ * Each time is counted in a histogram bucket. Bucket i holds the times upto
+ * varnam_timing_bucket_limit(i) and above the limit of the bucket before it. Percentiles
+ * are the limit of the bucket they fall in, which is within 6.25% of the actual time.
+ *
+ * RETURN
+ *
+ * VARNAM_SUCCESS       - On successfull execution
+ * VARNAM_ARGS_ERROR    - When handle, stage or timings is invalid
+ **/
+VARNAM_EXPORT extern int varnam_get_timings(
+    varnam *handle,
+    int stage,
+    vtimings *timings
+    );
+
+/**
+ * Clears the timings of all the stages. Tracing stays on
+ *
+ * RETURN
+ *
+ * VARNAM_SUCCESS       - On successfull execution
+ * VARNAM_ARGS_ERROR    - When handle is invalid
+ **/
+VARNAM_EXPORT extern int varnam_reset_timings(
+    varnam *handle
+    );
+
+/**
+ * Largest time in microseconds counted in a bucket of vtimings
+ *
+ * RETURN
+ *
+ * Limit of the bucket or -1 when bucket is not between 0 and VARNAM_TIMING_BUCKETS - 1
+ **/
+VARNAM_EXPORT extern long varnam_timing_bucket_limit(
+    int bucket
+    );
+
+/**
+ * Gets what the prepared statements have cost since profiling was turned on or last reset
+ *
+ * handle - A valid varnam instance
+ * stats  - Statements which have run at least once are written here
+ * max    - Number of items stats can hold. VARNAM_STATEMENTS is enough for all of them
+ * count  - Number of items written to stats
+ *
+ * NOTES
+ *
+ * Each of the statements the handle keeps prepared is reported with it's name. Rest of
+ * the statements are added up under "other". Along with the executions, wall clock time
+ * and rows returned, the sqlite3_stmt_status() counters tell whether a statement had to
+ * scan a table, sort or build an automatic index. These grow with the learnings file when
+ * an index is missing.
+ *
+ * A run is timed in microseconds from its first step till the statement is reset. The
+ * profiler times up to VARNAM_RUNNING_STATEMENTS statements running at once. Beyond that,
+ * the time sqlite reports is used, which has millisecond resolution.
+ *
+ * Statements are profiled only when VARNAM_CONFIG_ENABLE_PROFILING is on. Nothing is
+ * written otherwise.
+ *
+ * RETURN
+ *
+ * VARNAM_SUCCESS       - On successfull execution
+ * VARNAM_TRUNCATED     - stats is full. count items are written
+ * VARNAM_ARGS_ERROR    - When handle, stats or count is invalid
+ **/
+VARNAM_EXPORT extern int varnam_get_statement_stats(
+    varnam *handle,
+    vstatement_stats *stats,
+    size_t max,
+    size_t *count
+    );
+
+/**
+ * Clears the statement stats. Profiling stays on
+ *
+ * RETURN
+ *
+ * VARNAM_SUCCESS       - On successfull execution
+ * VARNAM_ARGS_ERROR    - When handle is invalid
+ **/
+VARNAM_EXPORT extern int varnam_reset_statement_stats(
+    varnam *handle
+    );
+
+/**
+ * Sets a function to be called when a statement takes longer than the threshold
+ *
+ * handle       - A valid varnam instance
+ * threshold_us - Statements taking this many microseconds or more are reported
+ * callback     - Gets the statement name, it's SQL and the time it took. NULL removes it
+ *
+ * NOTES
+ *
+ * This works whether profiling is on or not. callback is invoked while the statement is
+ * being reset and should not call into the handle. Needs sqlite 3.14.0 or above.
+ *
+ * RETURN
+ *
+ * VARNAM_SUCCESS       - On successfull execution
+ * VARNAM_ARGS_ERROR    - When handle or threshold_us is invalid
+ * VARNAM_ERROR         - When sqlite doesn't support tracing
+ **/
+VARNAM_EXPORT extern int varnam_set_slow_query_callback(
+    varnam *handle,
+    long threshold_us,
+    void (*callback)(const char *statement, const char *sql, long elapsed_us)
+    );
+
+/**
+ * Writes the figures of the handle to out in the Prometheus text exposition format
+ *
+ * handle - A valid varnam instance
+ * out    - Text is appended to this
+ *
+ * NOTES
+ *
+ * Reports calls and errors of varnam_transliterate(), varnam_reverse_transliterate(),
+ * varnam_transliterate_into(), varnam_reverse_transliterate_into(), varnam_transliterate_text(),
+ * varnam_reverse_transliterate_text(), varnam_learn(), varnam_train(), varnam_learn_from_file(),
+ * varnam_import_learnings_from_file(), varnam_export_words() and varnam_detect_lang_spans().
+ * Other functions are not counted. Also reports hits, misses, evictions and entries of
+ * the in-memory caches, objects and bytes held by the instance pools, words in the
+ * learnings file, sqlite page cache of each database and sqlite memory. When
+ * VARNAM_CONFIG_ENABLE_TRACING is on, timings of the calls and their stages are added as
+ * histograms. Buckets are counted from the timings histogram, so they are within 6.25%.
+ *
+ * Counting is always on and costs an increment per call. Counting the words runs a query
+ * on the learnings file, so this is meant to be called when the host is scraped, not
+ * for every request. Host application serves the text.
+ *
+ * RETURN
+ *
+ * VARNAM_SUCCESS       - On successfull execution
+ * VARNAM_ARGS_ERROR    - When handle or out is invalid
+ * VARNAM_MEMORY_ERROR  - When memory can't be allocated
+ **/
+VARNAM_EXPORT extern int varnam_metrics_render(
+    varnam *handle,
+    strbuf *out
+    );
+
 /**
  * Exports words and patterns to text file(s). This may produce multiple text files depending on the number of words
  *
@@ -452,6 +882,38 @@ VARNAM_EXPORT extern int varnam_detect_lang(
     varnam *handle,
     const char *word);
 
+/**
+ * Splits the text into spans of the same language.
+ *
+ * handle - A valid varnam instance
+ * text   - Text to split. This can be a whole document
+ * out    - Array which will receive the spans in the order they appear in text
+ * max    - Number of items out can hold
+ * count  - Number of spans written will be set here
+ *
+ * NOTES
+ *
+ * Text is read once and it is not copied. Each span has the language code and the
+ * byte offset and length of the span in text. Text which is not in any of the known
+ * languages gets VARNAM_LANG_CODE_UNKNOWN. Spaces, digits, punctuations and joiners
+ * don't start a new span, they stay with the span before them. Spans together
+ * cover the whole text.
+ *
+ * When out is full, remaining text is not processed and VARNAM_TRUNCATED is returned.
+ *
+ * RETURN
+ *
+ * VARNAM_SUCCESS         - All the spans are written
+ * VARNAM_TRUNCATED       - out is not big enough to hold all the spans
+ * VARNAM_ARGS_ERROR      - Invalid arguments
+ **/
+VARNAM_EXPORT extern int varnam_detect_lang_spans(
+    varnam *handle,
+    const char *text,
+    vlang_span *out,
+    size_t max,
+    size_t *count);
+
 /**
  * Checks the specified word is know to varnam
  *
@@ -473,7 +935,221 @@ varnam_create_stemrule(varnam* handle, const char* old_ending, const char* new_e
 VARNAM_EXPORT extern int
 varnam_create_stem_exception(varnam *handle, const char *rule, const char *exception);
 
+/**
+ * Adds a contextual rendering rule to the symbols table. Rules are tried in the order
+ * they were created and the first one matching the token being rendered is used.
+ *
+ * direction        - VARNAM_RULE_TRANSLITERATION or VARNAM_RULE_REVERSE_TRANSLITERATION
+ * token_type       - Type of the token. VARNAM_RULE_ANY matches all types
+ * tag              - Tag of the token. NULL or empty matches all tags
+ * pattern          - Pattern of the token. NULL or empty matches all patterns
+ * previous_type    - Type of the token rendered before. VARNAM_RULE_ANY matches even when there
+ *                    is no previous token. VARNAM_RULE_ANY_PREVIOUS needs one of any type
+ * previous_tag     - Tag of the token rendered before. NULL or empty matches all tags
+ * output           - One of VARNAM_RULE_OUTPUT_*. Part of the token to output
+ * previous_output  - When not VARNAM_RULE_OUTPUT_NONE, output of the previous token is
+ *                    replaced with this part of it. Rule is skipped if the output doesn't
+ *                    end with value1 or value2 of the previous token
+ * suffix           - Text added after the output. Can be NULL
+ *
+ * NOTES
+ *
+ * When a symbols file has rendering rules, they are used instead of the renderer
+ * registered for the scheme
+ *
+ * RETURN
+ *
+ * VARNAM_SUCCESS       - On successfull execution
+ * VARNAM_ARGS_ERROR    - Invalid arguments
+ * VARNAM_ERROR         - Any other errors
+ **/
+VARNAM_EXPORT extern int
+varnam_create_rendering_rule(
+    varnam *handle,
+    int direction,
+    int token_type,
+    const char *tag,
+    const char *pattern,
+    int previous_type,
+    const char *previous_tag,
+    int output,
+    int previous_output,
+    const char *suffix);
+
 VARNAM_EXPORT extern void
 varnam_destroy(varnam *handle);
 
+/**
+ * Creates a pool of handles for a scheme which can be shared between threads
+ *
+ * scheme_id - Scheme identifier, as used with varnam_init_from_id()
+ * size      - Number of handles in the pool
+ * pool      - If successfull, pool will point to the created pool
+ * msg       - If any error happens, this will contain the error message. User has to free this
+ *
+ * NOTES
+ *
+ * A varnam handle can't be used from more than one thread at a time. The pool creates
+ * size handles upfront, all using the same symbols and learnings files, and hands out
+ * each one to one thread at a time using varnam_pool_checkout(). Handles keep their
+ * caches between checkouts.
+ *
+ * The handles open the symbols file with VARNAM_OPEN_READONLY, so they map the same
+ * immutable file and share its pages. The symbols file has to be a compiled one and it
+ * can't be changed through the pool. Each handle is warmed up at creation by preparing
+ * its tokenizer statements. Caches and interned tokens are still kept per handle, so they
+ * grow with the size of the pool.
+ *
+ * Learning from more than one handle at the same time can fail with busy errors from
+ * the learnings file.
+ *
+ * RETURN
+ *
+ * VARNAM_SUCCESS       - Successfully created
+ * VARNAM_ARGS_ERROR    - When arguments are NULL or size is not positive
+ * VARNAM_MEMORY_ERROR  - No sufficient memory
+ * VARNAM_ERROR         - Failed to initialize a handle
+ **/
+VARNAM_EXPORT extern int
+varnam_pool_create(const char *scheme_id, int size, varnam_pool **pool, char **msg);
+
+/**
+ * Same as varnam_pool_create(), but flags controls how each handle opens the symbols
+ * file. See varnam_init_with_flags() for the values
+ *
+ * NOTES
+ *
+ * Pass 0 for handles which can change the symbols file. Each of them then reads the
+ * scheme on its own.
+ *
+ * RETURN
+ *
+ * Same as varnam_pool_create()
+ **/
+VARNAM_EXPORT extern int
+varnam_pool_create_with_flags(const char *scheme_id, int flags, int size, varnam_pool **pool, char **msg);
+
+/**
+ * Takes a handle out of the pool. The handle is owned by the calling thread till it
+ * is given back using varnam_pool_checkin()
+ *
+ * timeout_ms - Milliseconds to wait when all the handles are checked out. 0 returns
+ *              immediately and a negative value waits till a handle is available
+ *
+ * RETURN
+ *
+ * VARNAM_SUCCESS       - handle points to a handle from the pool
+ * VARNAM_TIMEOUT       - No handle became available within timeout_ms
+ * VARNAM_ARGS_ERROR    - When pool or handle is NULL
+ **/
+VARNAM_EXPORT extern int
+varnam_pool_checkout(varnam_pool *pool, long timeout_ms, varnam **handle);
+
+/**
+ * Gives back a handle taken using varnam_pool_checkout()
+ *
+ * RETURN
+ *
+ * VARNAM_SUCCESS       - On successfull execution
+ * VARNAM_ARGS_ERROR    - When handle is not checked out from this pool
+ **/
+VARNAM_EXPORT extern int
+varnam_pool_checkin(varnam_pool *pool, varnam *handle);
+
+/**
+ * Gets the number of checkouts, how many of them waited or timed out and the time spent waiting
+ **/
+VARNAM_EXPORT extern int
+varnam_pool_get_stats(varnam_pool *pool, varnam_pool_stats *stats);
+
+/**
+ * Same as varnam_metrics_render() for all the handles of a pool put together
+ *
+ * NOTES
+ *
+ * Also adds the pool size, available handles, checkouts, waits, timeouts and time spent
+ * waiting. Handles which are checked out are not stopped. Only their call and error
+ * counters are added, which can be a call behind. Timings, caches, instance pools, words
+ * and page cache are read from the handles which are not checked out.
+ **/
+VARNAM_EXPORT extern int
+varnam_pool_metrics_render(varnam_pool *pool, strbuf *out);
+
+/**
+ * Destroys all the handles in the pool, including the ones which are checked out
+ **/
+VARNAM_EXPORT extern void
+varnam_pool_destroy(varnam_pool *pool);
+
+/**
+ * Indexes the symbols files available in symbols_dir. Nothing is opened until it is used
+ *
+ * symbols_dir    - Directory to scan. NULL uses the directory varnam_init_from_id() would use
+ * max_open       - Maximum number of handles kept open. 0 keeps all of them open
+ * registry       - Registry will be written here
+ *
+ * NOTES
+ *
+ * Registry is not thread safe. Use one registry per thread or guard it with a lock
+ *
+ * RETURN
+ *
+ * VARNAM_SUCCESS       - On successfull execution
+ * VARNAM_ARGS_ERROR    - Invalid arguments
+ * VARNAM_ERROR         - Symbols directory can't be read
+ **/
+VARNAM_EXPORT extern int
+varnam_registry_create(const char *symbols_dir, int max_open, varnam_registry **registry);
+
+/**
+ * Lists the schemes in the registry, sorted by identifier. Language code,
+ * display name and schema version of the symbols file are read from it the first
+ * time this is called. Entries are owned by the registry; free the array
+ * using varray_free (schemes, NULL)
+ **/
+VARNAM_EXPORT extern int
+varnam_registry_get_schemes(varnam_registry *registry, varray **schemes);
+
+/**
+ * Gets a handle for scheme_id, opening it with suggestions enabled if it is not open already
+ *
+ * NOTES
+ *
+ * Handle is owned by the registry and should not be destroyed. Give it back using
+ * varnam_registry_release_handle() once it is not needed. When max_open handles are open,
+ * the least recently used one which is not held is destroyed to make room. When all of
+ * them are held, the registry keeps more than max_open handles open till they are released
+ *
+ * RETURN
+ *
+ * VARNAM_SUCCESS       - On successfull execution
+ * VARNAM_ARGS_ERROR    - Invalid arguments
+ * VARNAM_ERROR         - No such scheme. msg will have the details and should be freed
+ **/
+VARNAM_EXPORT extern int
+varnam_registry_get_handle(varnam_registry *registry, const char *scheme_id, varnam **handle, char **msg);
+
+/**
+ * Gives back a handle obtained using varnam_registry_get_handle(). Each call to
+ * varnam_registry_get_handle() should be matched by a call to this function
+ *
+ * NOTES
+ *
+ * Handle can be destroyed by the registry after this to make room for other schemes.
+ *
+ * RETURN
+ *
+ * VARNAM_SUCCESS       - On successfull execution
+ * VARNAM_ARGS_ERROR    - Handle is not held from this registry
+ **/
+VARNAM_EXPORT extern int
+varnam_registry_release_handle(varnam_registry *registry, varnam *handle);
+
+/**
+ * Destroys the registry and all the handles it has opened, including the ones which
+ * are not released yet
+ **/
+VARNAM_EXPORT extern void
+varnam_registry_destroy(varnam_registry *registry);
+
 #endif
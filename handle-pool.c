@@ -0,0 +1,402 @@
+/* handle-pool.c - A set of handles that can be shared between threads
+ *
+ * Copyright (C) Navaneeth.K.N
+ *
+ * This is part of libvarnam. See LICENSE.txt for the license
+ */
+
+#if defined(WIN32) || defined(_WIN32) || defined(__WIN32)
+#define VARNAM_POOL_WIN32
+#else
+/* pthread_cond_timedwait and clock_gettime are not visible with -ansi otherwise */
+#define _POSIX_C_SOURCE 200112L
+#endif
+
+#include <string.h>
+
+#ifdef VARNAM_POOL_WIN32
+#include <windows.h>
+#else
+#include <pthread.h>
+#include <time.h>
+#endif
+
+#include "api.h"
+#include "util.h"
+#include "vtypes.h"
+#include "tracing.h"
+#include "metrics.h"
+#include "symbol-table.h"
+#include "result-codes.h"
+
+/* varnam handles are not thread safe. A pool keeps a fixed number of handles for a
+ * scheme and hands each one to a single thread at a time. Handles keep their caches
+ * between checkouts, so a thread picking one up gets a warm handle */
+struct varnam_pool_t {
+    varnam **handles;
+    varnam **available;  /* handles which are not checked out. Used as a stack */
+    int size;
+    int available_count;
+    varnam_pool_stats stats;
+#ifdef VARNAM_POOL_WIN32
+    CRITICAL_SECTION lock;
+    CONDITION_VARIABLE returned;
+#else
+    pthread_mutex_t lock;
+    pthread_cond_t returned;
+#endif
+};
+
+#ifdef VARNAM_POOL_WIN32
+
+#define pool_lock(p)   EnterCriticalSection (&(p)->lock)
+#define pool_unlock(p) LeaveCriticalSection (&(p)->lock)
+
+/* Waits till a handle is returned or timeout_ms elapses. Negative timeout waits forever */
+static void
+wait_for_handle(varnam_pool *pool, long timeout_ms)
+{
+    SleepConditionVariableCS (&pool->returned, &pool->lock, timeout_ms < 0 ? INFINITE : (DWORD) timeout_ms);
+}
+
+#else
+
+#define pool_lock(p)   pthread_mutex_lock (&(p)->lock)
+#define pool_unlock(p) pthread_mutex_unlock (&(p)->lock)
+
+/* Waits till a handle is returned or timeout_ms elapses. Negative timeout waits forever */
+static void
+wait_for_handle(varnam_pool *pool, long timeout_ms)
+{
+    struct timespec deadline;
+
+    if (timeout_ms < 0) {
+        pthread_cond_wait (&pool->returned, &pool->lock);
+        return;
+    }
+
+    clock_gettime (CLOCK_REALTIME, &deadline);
+    deadline.tv_sec += timeout_ms / 1000;
+    deadline.tv_nsec += (timeout_ms % 1000) * 1000000L;
+    if (deadline.tv_nsec >= 1000000000L) {
+        ++deadline.tv_sec;
+        deadline.tv_nsec -= 1000000000L;
+    }
+
+    pthread_cond_timedwait (&pool->returned, &pool->lock, &deadline);
+}
+
+#endif
+
+static void
+destroy_handles(varnam_pool *pool, int count)
+{
+    int i;
+    for (i = 0; i < count; i++)
+        varnam_destroy (pool->handles[i]);
+}
+
+/* Prepares the tokenizer statements and reads the pages of the symbols file they need,
+ * so that the first checkout of a handle doesn't pay for them */
+static int
+warm_up(varnam *handle)
+{
+    int rc;
+    varray *tokens;
+    vtoken *virama;
+
+    rc = vst_get_virama (handle, &virama);
+    if (rc != VARNAM_SUCCESS)
+        return rc;
+
+    tokens = varray_init ();
+    rc = vst_tokenize (handle, "a", VARNAM_TOKENIZER_PATTERN, VARNAM_MATCH_ALL, tokens);
+    if (rc == VARNAM_SUCCESS) {
+        varray_clear (tokens);
+        rc = vst_tokenize (handle, "a", VARNAM_TOKENIZER_VALUE, VARNAM_MATCH_ALL, tokens);
+    }
+    varray_free (tokens, NULL);
+
+    return rc;
+}
+
+int
+varnam_pool_create(const char *scheme_id, int size, varnam_pool **pool, char **msg)
+{
+    return varnam_pool_create_with_flags (scheme_id, VARNAM_OPEN_READONLY, size, pool, msg);
+}
+
+int
+varnam_pool_create_with_flags(const char *scheme_id, int flags, int size, varnam_pool **pool, char **msg)
+{
+    int rc, i, j;
+    varnam_pool *p;
+    varnam *first = NULL;
+    const char *suggestions_file;
+    strbuf *error;
+
+    if (scheme_id == NULL || size <= 0 || pool == NULL || msg == NULL)
+        return VARNAM_ARGS_ERROR;
+
+    *pool = NULL;
+    *msg = NULL;
+
+    p = (varnam_pool*) xmalloc (sizeof (varnam_pool));
+    if (p == NULL)
+        return VARNAM_MEMORY_ERROR;
+
+    memset (p, 0, sizeof (varnam_pool));
+    p->handles = (varnam**) xmalloc (sizeof (varnam*) * (size_t) size);
+    p->available = (varnam**) xmalloc (sizeof (varnam*) * (size_t) size);
+    if (p->handles == NULL || p->available == NULL) {
+        xfree (p->handles);
+        xfree (p->available);
+        xfree (p);
+        return VARNAM_MEMORY_ERROR;
+    }
+
+    /* Symbols and learnings files are located once. Rest of the handles open the same files.
+       The handle which located them is kept only when no flags are asked for */
+    i = 0;
+    rc = varnam_init_from_id (scheme_id, &first, msg);
+    if (rc == VARNAM_SUCCESS)
+    {
+        if (flags == 0)
+            p->handles[i++] = first;
+
+        suggestions_file = varnam_get_suggestions_file (first);
+        for (; i < size; i++)
+        {
+            rc = varnam_init_with_flags (varnam_get_scheme_file (first), flags, &p->handles[i], msg);
+            if (rc != VARNAM_SUCCESS)
+                break;
+
+            if (suggestions_file == NULL)
+                continue;
+
+            rc = varnam_config (p->handles[i], VARNAM_CONFIG_ENABLE_SUGGESTIONS, suggestions_file);
+            if (rc != VARNAM_SUCCESS) {
+                error = strbuf_init (20);
+                strbuf_add (error, varnam_get_last_error (p->handles[i]));
+                *msg = strbuf_detach (error);
+                varnam_destroy (p->handles[i]);
+                break;
+            }
+        }
+
+        if (flags != 0)
+            varnam_destroy (first);
+    }
+
+    for (j = 0; rc == VARNAM_SUCCESS && j < size; j++)
+    {
+        rc = warm_up (p->handles[j]);
+        if (rc != VARNAM_SUCCESS) {
+            error = strbuf_init (20);
+            strbuf_add (error, varnam_get_last_error (p->handles[j]));
+            *msg = strbuf_detach (error);
+        }
+    }
+
+    if (rc != VARNAM_SUCCESS) {
+        destroy_handles (p, i);
+        xfree (p->handles);
+        xfree (p->available);
+        xfree (p);
+        return rc;
+    }
+
+    for (i = 0; i < size; i++)
+        p->available[i] = p->handles[i];
+
+    p->size = size;
+    p->available_count = size;
+    p->stats.size = size;
+
+#ifdef VARNAM_POOL_WIN32
+    InitializeCriticalSection (&p->lock);
+    InitializeConditionVariable (&p->returned);
+#else
+    pthread_mutex_init (&p->lock, NULL);
+    pthread_cond_init (&p->returned, NULL);
+#endif
+
+    *pool = p;
+    return VARNAM_SUCCESS;
+}
+
+int
+varnam_pool_checkout(varnam_pool *pool, long timeout_ms, varnam **handle)
+{
+    sqlite3_int64 started = 0, waited, remaining;
+    bool waiting = false;
+
+    if (pool == NULL || handle == NULL)
+        return VARNAM_ARGS_ERROR;
+
+    *handle = NULL;
+    pool_lock (pool);
+
+    while (pool->available_count == 0)
+    {
+        if (!waiting) {
+            if (timeout_ms == 0)
+                break;
+            waiting = true;
+            started = monotonic_time_us ();
+            ++pool->stats.waits;
+        }
+
+        remaining = timeout_ms;
+        if (timeout_ms > 0) {
+            remaining = timeout_ms - (monotonic_time_us () - started) / 1000;
+            if (remaining <= 0)
+                break;
+        }
+
+        /* remaining is never more than timeout_ms */
+        wait_for_handle (pool, (long) remaining);
+    }
+
+    if (waiting) {
+        waited = monotonic_time_us () - started;
+        pool->stats.wait_time_total_us += (long) waited;
+        if (waited > pool->stats.wait_time_max_us)
+            pool->stats.wait_time_max_us = (long) waited;
+    }
+
+    if (pool->available_count == 0) {
+        ++pool->stats.timeouts;
+        pool_unlock (pool);
+        return VARNAM_TIMEOUT;
+    }
+
+    *handle = pool->available[--pool->available_count];
+    ++pool->stats.checkouts;
+    pool_unlock (pool);
+
+    return VARNAM_SUCCESS;
+}
+
+int
+varnam_pool_checkin(varnam_pool *pool, varnam *handle)
+{
+    int i;
+    bool owned = false;
+
+    if (pool == NULL || handle == NULL)
+        return VARNAM_ARGS_ERROR;
+
+    pool_lock (pool);
+
+    for (i = 0; i < pool->size; i++)
+    {
+        if (pool->handles[i] == handle)
+            owned = true;
+    }
+
+    for (i = 0; i < pool->available_count; i++)
+    {
+        /* Checked in twice */
+        if (pool->available[i] == handle)
+            owned = false;
+    }
+
+    if (!owned) {
+        pool_unlock (pool);
+        return VARNAM_ARGS_ERROR;
+    }
+
+    pool->available[pool->available_count++] = handle;
+
+#ifdef VARNAM_POOL_WIN32
+    WakeConditionVariable (&pool->returned);
+#else
+    pthread_cond_signal (&pool->returned);
+#endif
+
+    pool_unlock (pool);
+    return VARNAM_SUCCESS;
+}
+
+int
+varnam_pool_get_stats(varnam_pool *pool, varnam_pool_stats *stats)
+{
+    if (pool == NULL || stats == NULL)
+        return VARNAM_ARGS_ERROR;
+
+    pool_lock (pool);
+    *stats = pool->stats;
+    stats->available = pool->available_count;
+    pool_unlock (pool);
+
+    return VARNAM_SUCCESS;
+}
+
+int
+varnam_pool_metrics_render(varnam_pool *pool, strbuf *out)
+{
+    int i, j, rc;
+    bool idle, words_counted = false;
+    vmetrics *metrics;
+    varnam_pool_stats stats;
+
+    if (pool == NULL || out == NULL)
+        return VARNAM_ARGS_ERROR;
+
+    metrics = xmalloc (sizeof (vmetrics));
+    if (metrics == NULL)
+        return VARNAM_MEMORY_ERROR;
+
+    init_metrics (metrics);
+
+    /* Handles which are not checked out can't be picked up while the lock is held, so
+       all of their figures are read. Only the call counters, which are atomic, are read
+       from the rest */
+    pool_lock (pool);
+    for (i = 0; i < pool->size; i++)
+    {
+        idle = false;
+        for (j = 0; j < pool->available_count; j++)
+        {
+            if (pool->available[j] == pool->handles[i])
+                idle = true;
+        }
+
+        collect_metrics (pool->handles[i], idle, metrics);
+
+        /* All the handles share the learnings file */
+        if (idle && !words_counted) {
+            collect_words_count (pool->handles[i], metrics);
+            words_counted = true;
+        }
+    }
+
+    stats = pool->stats;
+    stats.available = pool->available_count;
+    pool_unlock (pool);
+
+    rc = render_metrics (metrics, &stats, out);
+    xfree (metrics);
+    return rc;
+}
+
+void
+varnam_pool_destroy(varnam_pool *pool)
+{
+    if (pool == NULL)
+        return;
+
+    destroy_handles (pool, pool->size);
+
+#ifdef VARNAM_POOL_WIN32
+    DeleteCriticalSection (&pool->lock);
+#else
+    pthread_mutex_destroy (&pool->lock);
+    pthread_cond_destroy (&pool->returned);
+#endif
+
+    xfree (pool->handles);
+    xfree (pool->available);
+    xfree (pool);
+}
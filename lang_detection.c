@@ -6,47 +6,49 @@
  */
 
 
+#include <string.h>
+
 #include "langcodes.h"
 #include "vutf8.h"
+#include "result-codes.h"
 #include "vtypes.h"
 #include "util.h"
+#include "metrics.h"
 
 #define NON_JOINER 0x200C
 #define JOINER     0x200D
 
-typedef struct codepoint_range {
-    int start;
-    int end;
-    int language_code;
-} cpr;
-
-static cpr ranges[] = {
-    {0x0900, 0x097F, VARNAM_LANG_CODE_HI},
-    {0x0980, 0x09FF, VARNAM_LANG_CODE_BN},
-    {0x0A80, 0x0AFF, VARNAM_LANG_CODE_GU},
-    {0x0B00, 0x0B7F, VARNAM_LANG_CODE_OR},
-    {0x0B80, 0x0BFF, VARNAM_LANG_CODE_TA},
-    {0x0C00, 0x0C7F, VARNAM_LANG_CODE_TE},
-    {0x0C80, 0x0CFF, VARNAM_LANG_CODE_KN},
-    {0x0D00, 0x0D7F, VARNAM_LANG_CODE_ML},
-    {0x0A00, 0x0A7F, VARNAM_LANG_CODE_PA},
-    {0x0900, 0x097F, VARNAM_LANG_CODE_MR},
+#define NO_BREAK_SPACE            0x00A0
+#define DANDA                     0x0964
+#define DOUBLE_DANDA              0x0965
+#define GENERAL_PUNCTUATION_START 0x2000
+#define GENERAL_PUNCTUATION_END   0x206F
+
+/* Supported scripts are in 128 codepoint blocks from U+0900 to U+0D7F. Language of a
+ * codepoint is looked up using its block. Marathi shares the Devanagari block with Hindi
+ * and is reported as Hindi */
+#define FIRST_BLOCK_START 0x0900
+#define LAST_BLOCK_END    0x0D7F
+
+static const int block_languages[] = {
+    VARNAM_LANG_CODE_HI,    /* 0900 - 097F */
+    VARNAM_LANG_CODE_BN,    /* 0980 - 09FF */
+    VARNAM_LANG_CODE_PA,    /* 0A00 - 0A7F */
+    VARNAM_LANG_CODE_GU,    /* 0A80 - 0AFF */
+    VARNAM_LANG_CODE_OR,    /* 0B00 - 0B7F */
+    VARNAM_LANG_CODE_TA,    /* 0B80 - 0BFF */
+    VARNAM_LANG_CODE_TE,    /* 0C00 - 0C7F */
+    VARNAM_LANG_CODE_KN,    /* 0C80 - 0CFF */
+    VARNAM_LANG_CODE_ML     /* 0D00 - 0D7F */
 };
 
 static int
 get_language(int codepoint)
 {
-    int i;
-    cpr range;
-    
-    for (i = 0; i < ARRAY_SIZE(ranges); i++)
-    {
-        range = ranges[i];
-        if (codepoint >= range.start && codepoint <= range.end)
-            return range.language_code;
-    }
+    if (codepoint < FIRST_BLOCK_START || codepoint > LAST_BLOCK_END)
+        return VARNAM_LANG_CODE_UNKNOWN;
 
-    return VARNAM_LANG_CODE_UNKNOWN;
+    return block_languages[(codepoint - FIRST_BLOCK_START) >> 7];
 }
 
 static bool
@@ -60,30 +62,102 @@ should_skip (int codepoint)
     return false;
 }
 
+/* Decodes the character at text. Returns the number of bytes it takes and sets
+ * codepoint. Codepoint will be UTF8_ERROR for malformed sequences, which takes one byte */
+static size_t
+read_character(const unsigned char *text, size_t length, int *codepoint)
+{
+    size_t size, i;
+    int c;
+
+    if (text[0] < 0x80) {
+        *codepoint = text[0];
+        return 1;
+    }
+
+    if (text[0] >= 0xC2 && text[0] <= 0xDF) {
+        size = 2;
+        c = text[0] & 0x1F;
+    }
+    else if (text[0] >= 0xE0 && text[0] <= 0xEF) {
+        size = 3;
+        c = text[0] & 0x0F;
+    }
+    else if (text[0] >= 0xF0 && text[0] <= 0xF4) {
+        size = 4;
+        c = text[0] & 0x07;
+    }
+    else {
+        *codepoint = UTF8_ERROR;
+        return 1;
+    }
+
+    if (size > length) {
+        *codepoint = UTF8_ERROR;
+        return 1;
+    }
+
+    for (i = 1; i < size; i++)
+    {
+        if ((text[i] & 0xC0) != 0x80) {
+            *codepoint = UTF8_ERROR;
+            return 1;
+        }
+        c = (c << 6) | (text[i] & 0x3F);
+    }
+
+    /* Overlong forms, surrogates and codepoints after U+10FFFF */
+    if ((size == 3 && c < 0x800) || (size == 4 && (c < 0x10000 || c > 0x10FFFF)) ||
+        (c >= 0xD800 && c <= 0xDFFF)) {
+        *codepoint = UTF8_ERROR;
+        return 1;
+    }
+
+    *codepoint = c;
+    return size;
+}
+
+/* ASCII characters other than letters don't belong to a script. They stay with
+ * the span around them, same as joiners. So do no-break space, general punctuation
+ * like curly quotes and dashes, and the dandas, which are in the Devanagari block
+ * but are used by other Indic scripts too */
+static bool
+is_neutral(int codepoint)
+{
+    if (should_skip (codepoint))
+        return true;
+
+    if (codepoint < 0x80)
+        return !((codepoint >= 'a' && codepoint <= 'z') || (codepoint >= 'A' && codepoint <= 'Z'));
+
+    switch (codepoint) {
+    case NO_BREAK_SPACE:
+    case DANDA:
+    case DOUBLE_DANDA:
+        return true;
+    };
+
+    return codepoint >= GENERAL_PUNCTUATION_START && codepoint <= GENERAL_PUNCTUATION_END;
+}
+
 int
 varnam_detect_lang(varnam *handle, const char *input)
 {
-    strbuf *word;
-    utf8_decoder decoder;
+    const unsigned char *text;
+    size_t length, offset = 0;
     int codepoint, language = VARNAM_LANG_CODE_UNKNOWN, prev_language = 0;
-    
-    if (handle == NULL || input == NULL) {
-        return VARNAM_LANG_CODE_UNKNOWN;
-    }
-
-    word = get_pooled_string (handle);
-    strbuf_add (word, input);
 
-    if (strbuf_is_blank (word)) {
+    if (handle == NULL || input == NULL) {
         return VARNAM_LANG_CODE_UNKNOWN;
     }
 
-    utf8_decode_init (word->buffer, (int) word->length, &decoder);
+    text = (const unsigned char*) input;
+    length = strlen (input);
 
-    for (;;)
+    while (offset < length)
     {
-        codepoint = utf8_decode_next (&decoder);
-        if (codepoint == UTF8_END || codepoint == UTF8_ERROR)
+        offset += read_character (text + offset, length - offset, &codepoint);
+        if (codepoint == UTF8_ERROR)
             break;
 
         if (should_skip(codepoint))
@@ -93,7 +167,7 @@ varnam_detect_lang(varnam *handle, const char *input)
 
         if (language == VARNAM_LANG_CODE_UNKNOWN)
             return VARNAM_LANG_CODE_UNKNOWN;
-        
+
         if (prev_language != 0 && language != prev_language) {
             /* Looks like characters from multiple languages are mixed */
             return VARNAM_LANG_CODE_UNKNOWN;
@@ -103,3 +177,82 @@ varnam_detect_lang(varnam *handle, const char *input)
 
     return language;
 }
+
+static int
+detect_lang_spans(const char *text, vlang_span *out, size_t max, size_t *count)
+{
+    const unsigned char *bytes;
+    size_t length, offset = 0, size, span_start = 0;
+    int codepoint, language, current = 0;
+
+    *count = 0;
+    bytes = (const unsigned char*) text;
+    length = strlen (text);
+
+    while (offset < length)
+    {
+        if (bytes[offset] < 0x80 && current == VARNAM_LANG_CODE_UNKNOWN)
+        {
+            /* ASCII can't end a span of unknown text. Skipping the whole run */
+            size = utf8_ascii_run (text + offset, length - offset);
+            offset += size > 0 ? size : 1;
+            continue;
+        }
+
+        size = read_character (bytes + offset, length - offset, &codepoint);
+        if (codepoint != UTF8_ERROR && is_neutral (codepoint)) {
+            offset += size;
+            continue;
+        }
+
+        language = codepoint == UTF8_ERROR ? VARNAM_LANG_CODE_UNKNOWN : get_language (codepoint);
+        if (current == 0) {
+            /* Neutral characters at the start goes with the first span */
+            current = language;
+        }
+        else if (language != current)
+        {
+            if (*count == max)
+                return VARNAM_TRUNCATED;
+
+            out[*count].language = current;
+            out[*count].offset = span_start;
+            out[*count].length = offset - span_start;
+            ++(*count);
+
+            current = language;
+            span_start = offset;
+        }
+
+        offset += size;
+    }
+
+    if (length > 0)
+    {
+        if (*count == max)
+            return VARNAM_TRUNCATED;
+
+        out[*count].language = current == 0 ? VARNAM_LANG_CODE_UNKNOWN : current;
+        out[*count].offset = span_start;
+        out[*count].length = length - span_start;
+        ++(*count);
+    }
+
+    return VARNAM_SUCCESS;
+}
+
+int
+varnam_detect_lang_spans(varnam *handle, const char *text, vlang_span *out, size_t max, size_t *count)
+{
+    int rc;
+
+    if (handle == NULL || text == NULL || count == NULL)
+        return VARNAM_ARGS_ERROR;
+
+    if (out == NULL && max > 0)
+        return VARNAM_ARGS_ERROR;
+
+    rc = detect_lang_spans (text, out, max, count);
+    count_call (handle, VARNAM_CALL_DETECT_LANG_SPANS, rc == VARNAM_TRUNCATED ? VARNAM_SUCCESS : rc);
+    return rc;
+}
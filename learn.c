@@ -15,6 +15,8 @@
 #include "result-codes.h"
 #include "symbol-table.h"
 #include "words-table.h"
+#include "tracing.h"
+#include "metrics.h"
 #include "deps/parson.h"
 
 static bool
@@ -50,9 +52,10 @@ sanitize_word (varnam *handle, const char *word)
     int i;
     bool is_special = false;
     strbuf *string, *to_remove;
+    strbuf_sso to_remove_buffer;
 
     string = get_pooled_string (handle);
-    to_remove = get_pooled_string (handle);
+    to_remove = strbuf_sso_init (&to_remove_buffer);
 
     strbuf_add (string, word);
 
@@ -78,6 +81,7 @@ sanitize_word (varnam *handle, const char *word)
     }
 
     strbuf_remove_from_last (string, strbuf_to_s (to_remove));
+    strbuf_sso_release (&to_remove_buffer);
     language_specific_sanitization (string);
 
     /* Remove trailing ZWNJ and leading ZWJ */
@@ -344,6 +348,7 @@ stem(varnam *handle, const char *word, varray *stem_results)
 {
     int rc;
     strbuf *word_copy, *suffix, *new_ending, *temp;
+    strbuf_sso word_copy_buffer, suffix_buffer, new_ending_buffer, temp_buffer;
     char *end_char;
 
     rc = vst_has_stemrules(handle);
@@ -353,12 +358,13 @@ stem(varnam *handle, const char *word, varray *stem_results)
     else if(rc == VARNAM_ERROR)
         return VARNAM_ERROR;
     
-    word_copy = get_pooled_string(handle);
-    suffix = get_pooled_string(handle);
-    temp = get_pooled_string(handle);
-    new_ending = get_pooled_string(handle);
+    word_copy = strbuf_sso_init(&word_copy_buffer);
+    suffix = strbuf_sso_init(&suffix_buffer);
+    temp = strbuf_sso_init(&temp_buffer);
+    new_ending = strbuf_sso_init(&new_ending_buffer);
     strbuf_add(word_copy, word);
 
+    rc = VARNAM_SUCCESS;
     while(word_copy->length > 0)
     {
         /*the next character of word_buffer should go 
@@ -384,8 +390,11 @@ stem(varnam *handle, const char *word, varray *stem_results)
                 continue;
             }
 
-            else if(rc != VARNAM_STEMRULE_MISS && rc != VARNAM_SUCCESS)
-                return VARNAM_ERROR;
+            else if(rc != VARNAM_STEMRULE_MISS && rc != VARNAM_SUCCESS) {
+                free(end_char);
+                rc = VARNAM_ERROR;
+                break;
+            }
 
             strbuf_add(word_copy, strbuf_to_s(new_ending));
             /*Creating a vword using Word()
@@ -400,13 +409,19 @@ stem(varnam *handle, const char *word, varray *stem_results)
         {
             free(end_char);
             set_last_error(handle, "stemrule query failed");
-            return VARNAM_ERROR;
+            rc = VARNAM_ERROR;
+            break;
         }
 
         free(end_char);
     }
 
-    return VARNAM_SUCCESS;
+    strbuf_sso_release(&word_copy_buffer);
+    strbuf_sso_release(&suffix_buffer);
+    strbuf_sso_release(&temp_buffer);
+    strbuf_sso_release(&new_ending_buffer);
+
+    return rc == VARNAM_ERROR ? VARNAM_ERROR : VARNAM_SUCCESS;
 }
 
 static int
@@ -461,14 +476,11 @@ varnam_learn_internal(varnam *handle, const char *word, int confidence)
                                       confidence);
 }
 
-int
-varnam_learn(varnam *handle, const char *word)
+static int
+learn_word(varnam *handle, const char *word)
 {
     int rc,i;
     varray *stem_results;
-    #ifdef _RECORD_EXEC_TIME
-        V_BEGIN_TIMING
-    #endif
 
     reset_pool (handle);
 
@@ -502,12 +514,24 @@ varnam_learn(varnam *handle, const char *word)
     if (rc != VARNAM_SUCCESS)
         return rc;
 
-#ifdef _RECORD_EXEC_TIME
-    V_REPORT_TIME_TAKEN("varnam_learn")
-#endif
     return VARNAM_SUCCESS;
 }
 
+int
+varnam_learn(varnam *handle, const char *word)
+{
+    int rc;
+    vtrace trace;
+
+    trace_start (handle, &trace);
+    rc = learn_word (handle, word);
+    trace_end (handle, VARNAM_STAGE_LEARN, &trace);
+    count_call (handle, VARNAM_CALL_LEARN, rc);
+    trim_to_memory_target (handle);
+
+    return rc;
+}
+
 int
 varnam_delete_word(varnam *handle, const char *word)
 {
@@ -520,12 +544,12 @@ varnam_delete_word(varnam *handle, const char *word)
     return vwt_delete_word (handle, word);
 }
 
-int
-varnam_learn_from_file(varnam *handle,
-                       const char *filepath,
-                       vlearn_status *status,
-                       void (*callback)(varnam *handle, const char *word, int status_code, void *object),
-                       void *object)
+static int
+learn_from_file(varnam *handle,
+                const char *filepath,
+                vlearn_status *status,
+                void (*callback)(varnam *handle, const char *word, int status_code, void *object),
+                void *object)
 {
     int rc;
     int rc2;            
@@ -625,11 +649,28 @@ varnam_learn_from_file(varnam *handle,
         varnam_log (handle, "Failed to check file integrity");
     }
 
-
+    trim_to_memory_target (handle);
     fclose (infile);
     return rc;
 }
 
+int
+varnam_learn_from_file(varnam *handle,
+                       const char *filepath,
+                       vlearn_status *status,
+                       void (*callback)(varnam *handle, const char *word, int status_code, void *object),
+                       void *object)
+{
+    int rc;
+
+    if (handle == NULL || filepath == NULL)
+        return VARNAM_ARGS_ERROR;
+
+    rc = learn_from_file (handle, filepath, status, callback, object);
+    count_call (handle, VARNAM_CALL_LEARN_FROM_FILE, rc);
+    return rc;
+}
+
 
 int
 varnam_compact_learnings_file(varnam *handle)
@@ -638,8 +679,8 @@ varnam_compact_learnings_file(varnam *handle)
   return vwt_compact_file (handle);
 }
 
-int
-varnam_train(varnam *handle, const char *pattern, const char *word)
+static int
+train(varnam *handle, const char *pattern, const char *word)
 {
     int rc;
     sqlite3_int64 word_id;
@@ -666,10 +707,23 @@ varnam_train(varnam *handle, const char *pattern, const char *word)
     return VARNAM_SUCCESS;
 }
 
+int
+varnam_train(varnam *handle, const char *pattern, const char *word)
+{
+    int rc;
+
+    rc = train (handle, pattern, word);
+    count_call (handle, VARNAM_CALL_TRAIN, rc);
+    trim_to_memory_target (handle);
+    return rc;
+}
+
 int
 varnam_export_words(varnam* handle, int words_per_file, const char* out_dir, int export_type,
     void (*callback)(int total_words, int processed, const char *current_word))
 {
+    int rc;
+
     if (handle == NULL || out_dir == NULL || words_per_file <= 0) {
         return VARNAM_ARGS_ERROR;
     }
@@ -677,9 +731,12 @@ varnam_export_words(varnam* handle, int words_per_file, const char* out_dir, int
     reset_pool (handle);
 
     if (export_type == VARNAM_EXPORT_FULL)
-        return vwt_full_export (handle, words_per_file, out_dir, callback);
+        rc = vwt_full_export (handle, words_per_file, out_dir, callback);
     else
-        return vwt_export_words (handle, words_per_file, out_dir, callback);
+        rc = vwt_export_words (handle, words_per_file, out_dir, callback);
+
+    count_call (handle, VARNAM_CALL_EXPORT_WORDS, rc);
+    return rc;
 }
 
 static int
@@ -714,6 +771,9 @@ import_words (varnam* handle, const char* filepath)
 		for (i = 0; i < json_array_get_count(words); i++) {
 			word = json_array_get_object (words, i);
 			wordString = json_object_get_string(word, "word");
+			if (wordString == NULL || !is_utf8 (wordString)) {
+				continue;
+			}
 
 			/* Making sure word contains only allowed token for the current scheme */
 			sanitized_word = sanitize_word (handle, wordString);
@@ -760,14 +820,11 @@ cleanup:
 
 
 
-int
-varnam_import_learnings_from_file(varnam *handle, const char *filepath)
+static int
+import_learnings(varnam *handle, const char *filepath)
 {
     int rc;
 
-    if (handle == NULL || filepath == NULL)
-        return VARNAM_ARGS_ERROR;
-
     reset_pool (handle);
 
     rc = vwt_optimize_for_huge_transaction(handle);
@@ -802,9 +859,23 @@ varnam_import_learnings_from_file(varnam *handle, const char *filepath)
         return rc;
     }
 
+    trim_to_memory_target (handle);
     return VARNAM_SUCCESS;
 }
 
+int
+varnam_import_learnings_from_file(varnam *handle, const char *filepath)
+{
+    int rc;
+
+    if (handle == NULL || filepath == NULL)
+        return VARNAM_ARGS_ERROR;
+
+    rc = import_learnings (handle, filepath);
+    count_call (handle, VARNAM_CALL_IMPORT_LEARNINGS, rc);
+    return rc;
+}
+
 int
 varnam_is_known_word(varnam* handle, const char* word)
 {
@@ -41,11 +41,12 @@ lru_key_exists (vcache_entry **cache, char *key)
     return 0;
 }
 
-void
+int
 lru_add_to_cache (vcache_entry **cache, char *key, void *value, vcache_value_free_cb cb)
 {
     vcache_entry *entry, *tmp_entry;
     strbuf *keyCopy;
+    int evicted = 0;
     entry = malloc(sizeof(vcache_entry));
     keyCopy = strbuf_init (16);
     strbuf_add (keyCopy, key);
@@ -64,8 +65,52 @@ lru_add_to_cache (vcache_entry **cache, char *key, void *value, vcache_value_fre
                 entry->cb (entry->value);
             }
             free(entry);
+            ++evicted;
             break;
         }
     }
+
+    return evicted;
+}
+
+
+void
+lru_cache_info (vcache_entry **cache, size_t (*value_size)(void*), vcache_info *info)
+{
+    vcache_entry *entry, *tmp_entry;
+
+    info->entries = (int) HASH_COUNT(*cache);
+    info->bytes = 0;
+    if (*cache == NULL)
+        return;
+
+    info->bytes = HASH_OVERHEAD(hh, *cache);
+    HASH_ITER(hh, *cache, entry, tmp_entry) {
+        info->bytes += sizeof (vcache_entry) + strlen (entry->key) + 1;
+        if (value_size != NULL && entry->value != NULL)
+            info->bytes += value_size (entry->value);
+    }
 }
 
+int
+lru_trim_cache (vcache_entry **cache, int keep)
+{
+    vcache_entry *entry, *tmp_entry;
+    int evicted = 0;
+
+    HASH_ITER(hh, *cache, entry, tmp_entry) {
+        /* loop is based on insertion order, so the oldest items are deleted first */
+        if ((int) HASH_COUNT(*cache) <= keep)
+            break;
+
+        HASH_DELETE(hh, *cache, entry);
+        free(entry->key);
+        if (entry->cb != NULL) {
+            entry->cb (entry->value);
+        }
+        free(entry);
+        ++evicted;
+    }
+
+    return evicted;
+}
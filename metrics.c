@@ -0,0 +1,369 @@
+/* metrics.c - Aggregate figures of handles and pools in Prometheus text format
+ *
+ * Copyright (C) Navaneeth.K.N
+ *
+ * This is part of libvarnam. See LICENSE.txt for the license
+ */
+
+#include <stdio.h>
+#include <string.h>
+
+#if defined(WIN32) || defined(_WIN32) || defined(__WIN32)
+#include <windows.h>
+#endif
+
+#include "api.h"
+#include "util.h"
+#include "vtypes.h"
+#include "varray.h"
+#include "result-codes.h"
+#include "words-table.h"
+#include "metrics.h"
+
+static const char *call_names[VARNAM_CALLS] = {
+    "varnam_transliterate",
+    "varnam_reverse_transliterate",
+    "varnam_learn",
+    "varnam_train",
+    "varnam_transliterate_text",
+    "varnam_reverse_transliterate_text",
+    "varnam_transliterate_into",
+    "varnam_reverse_transliterate_into",
+    "varnam_learn_from_file",
+    "varnam_import_learnings_from_file",
+    "varnam_export_words",
+    "varnam_detect_lang_spans"
+};
+
+static const char *stage_names[VARNAM_STAGES] = {
+    "transliterate",
+    "reverse_transliterate",
+    "learn",
+    "symbols_tokenize",
+    "best_match",
+    "words_tokenize",
+    "render",
+    "suggestions",
+    "transliterate_text",
+    "reverse_transliterate_text",
+    "transliterate_into",
+    "reverse_transliterate_into"
+};
+
+static const char *cache_names[METRICS_CACHES] = {
+    "tokens",
+    "no_matches",
+    "tokenization_possibility",
+    "stems",
+    "words_memo",
+    "rtl_memo"
+};
+
+static const char *instance_pool_names[METRICS_INSTANCE_POOLS] = {
+    "tokens",
+    "arrays",
+    "strings",
+    "words"
+};
+
+static const char *database_names[METRICS_DATABASES] = {
+    "symbols",
+    "learnings"
+};
+
+/* Upper bounds of the exported histogram buckets in microseconds. Timings are kept in
+ * finer buckets, which are added up into these */
+static const long histogram_bounds[] = {
+    100, 250, 500, 1000, 2500, 5000, 10000, 25000, 50000,
+    100000, 250000, 500000, 1000000, 2500000, 5000000, 10000000
+};
+
+/* Call counters are updated by the thread using the handle and read by the one rendering
+ * pool metrics, which doesn't wait for the handle to be checked in */
+#if defined(WIN32) || defined(_WIN32) || defined(__WIN32)
+#define atomic_increment(counter) InterlockedIncrement (counter)
+#define atomic_read(counter)      InterlockedCompareExchange (counter, 0, 0)
+#elif defined(__GNUC__)
+#define atomic_increment(counter) __sync_fetch_and_add (counter, 1)
+#define atomic_read(counter)      __sync_fetch_and_add (counter, 0)
+#else
+#define atomic_increment(counter) (++*(counter))
+#define atomic_read(counter)      (*(counter))
+#endif
+
+void
+count_call(varnam *handle, int call, int rc)
+{
+    (void) atomic_increment (&v_->calls[call]);
+    if (rc != VARNAM_SUCCESS)
+        (void) atomic_increment (&v_->errors[call]);
+}
+
+void
+init_metrics(vmetrics *metrics)
+{
+    memset (metrics, 0, sizeof (vmetrics));
+    metrics->words = -1;
+}
+
+static void
+add_cache(vcache_metrics *info, vcache_entry **cache, vcache_stats *stats)
+{
+    info->hits += stats->hits;
+    info->misses += stats->misses;
+    info->evictions += stats->evictions;
+    info->entries += (int) HASH_COUNT (*cache);
+}
+
+static void
+add_instance_pool(vpool_info *info, vpool *pool)
+{
+    vpool_info pool_info;
+
+    vpool_get_info (pool, NULL, &pool_info);
+    info->objects += pool_info.objects;
+    info->in_use += pool_info.in_use;
+    info->bytes += pool_info.bytes;
+}
+
+static void
+add_page_cache(long *bytes, sqlite3 *db)
+{
+    int current, highwater;
+
+    if (db == NULL)
+        return;
+
+    sqlite3_db_status (db, SQLITE_DBSTATUS_CACHE_USED, &current, &highwater, 0);
+    *bytes += current;
+}
+
+static void
+add_timings(vtimings *total, vtimings *timings)
+{
+    int i;
+
+    if (timings->count == 0)
+        return;
+
+    if (total->count == 0 || timings->min_us < total->min_us)
+        total->min_us = timings->min_us;
+    if (timings->max_us > total->max_us)
+        total->max_us = timings->max_us;
+
+    total->count += timings->count;
+    total->total_us += timings->total_us;
+    for (i = 0; i < VARNAM_TIMING_BUCKETS; i++)
+        total->buckets[i] += timings->buckets[i];
+}
+
+void
+collect_metrics(varnam *handle, bool idle, vmetrics *metrics)
+{
+    int i;
+
+    ++metrics->handles;
+    for (i = 0; i < VARNAM_CALLS; i++)
+    {
+        metrics->calls[i] += atomic_read (&v_->calls[i]);
+        metrics->errors[i] += atomic_read (&v_->errors[i]);
+    }
+
+    /* Timings and caches of a handle in use can change or be freed while they are read */
+    if (!idle)
+        return;
+
+    if (v_->timings != NULL)
+    {
+        metrics->timed = true;
+        for (i = 0; i < VARNAM_STAGES; i++)
+            add_timings (&metrics->timings[i], &v_->timings[i]);
+    }
+
+    add_cache (&metrics->caches[0], &v_->tokens_cache, &v_->tokens_cache_stats);
+    add_cache (&metrics->caches[1], &v_->noMatchesCache, &v_->no_matches_cache_stats);
+    add_cache (&metrics->caches[2], &v_->tokenizationPossibility, &v_->tokenization_possibility_stats);
+    add_cache (&metrics->caches[3], &v_->cached_stems, &v_->cached_stems_stats);
+    add_cache (&metrics->caches[4], &v_->words_memo, &v_->words_memo_stats);
+    add_cache (&metrics->caches[5], &v_->rtl_memo, &v_->rtl_memo_stats);
+
+    add_instance_pool (&metrics->instance_pools[0], v_->tokens_pool);
+    add_instance_pool (&metrics->instance_pools[1], v_->arrays_pool);
+    add_instance_pool (&metrics->instance_pools[2], v_->strings_pool);
+    add_instance_pool (&metrics->instance_pools[3], v_->words_pool);
+
+    add_page_cache (&metrics->page_cache_bytes[0], v_->db);
+    add_page_cache (&metrics->page_cache_bytes[1], v_->known_words);
+    add_page_cache (&metrics->page_cache_bytes[1], v_->known_words_reader);
+}
+
+void
+collect_words_count(varnam *handle, vmetrics *metrics)
+{
+    int words;
+
+    if (v_->known_words == NULL)
+        return;
+
+    if (vwt_get_words_count (handle, false, &words) == VARNAM_SUCCESS)
+        metrics->words = words;
+}
+
+static void
+add_header(strbuf *out, const char *name, const char *type, const char *help)
+{
+    strbuf_addf (out, "# HELP %s %s\n", name, help);
+    strbuf_addf (out, "# TYPE %s %s\n", name, type);
+}
+
+/* Adds a sample. label can be NULL for metrics without labels */
+static void
+add_sample(strbuf *out, const char *name, const char *label, const char *label_value, long value)
+{
+    char number[32];
+
+    sprintf (number, "%ld", value);
+    if (label == NULL)
+        strbuf_addf (out, "%s %s\n", name, number);
+    else
+        strbuf_addf (out, "%s{%s=\"%s\"} %s\n", name, label, label_value, number);
+}
+
+static void
+format_seconds(char *buffer, long us)
+{
+    sprintf (buffer, "%ld.%06ld", us / 1000000L, us % 1000000L);
+}
+
+static void
+add_histogram(strbuf *out, const char *stage, vtimings *timings)
+{
+    char bound[32], value[32];
+    long seen = 0;
+    int i, bucket = 0;
+
+    for (i = 0; i < (int) ARRAY_SIZE (histogram_bounds); i++)
+    {
+        for (; bucket < VARNAM_TIMING_BUCKETS && varnam_timing_bucket_limit (bucket) <= histogram_bounds[i]; bucket++)
+            seen += timings->buckets[bucket];
+
+        format_seconds (bound, histogram_bounds[i]);
+        sprintf (value, "%ld", seen);
+        strbuf_addf (out, "varnam_stage_duration_seconds_bucket{stage=\"%s\",le=\"%s\"} %s\n", stage, bound, value);
+    }
+
+    sprintf (value, "%ld", timings->count);
+    strbuf_addf (out, "varnam_stage_duration_seconds_bucket{stage=\"%s\",le=\"+Inf\"} %s\n", stage, value);
+    format_seconds (value, timings->total_us);
+    strbuf_addf (out, "varnam_stage_duration_seconds_sum{stage=\"%s\"} %s\n", stage, value);
+    sprintf (value, "%ld", timings->count);
+    strbuf_addf (out, "varnam_stage_duration_seconds_count{stage=\"%s\"} %s\n", stage, value);
+}
+
+int
+render_metrics(vmetrics *metrics, varnam_pool_stats *pool, strbuf *out)
+{
+    int i;
+    char value[32];
+
+    add_header (out, "varnam_handles", "gauge", "Handles these figures are added up from");
+    add_sample (out, "varnam_handles", NULL, NULL, metrics->handles);
+
+    add_header (out, "varnam_calls_total", "counter", "Calls to the public functions");
+    for (i = 0; i < VARNAM_CALLS; i++)
+        add_sample (out, "varnam_calls_total", "function", call_names[i], metrics->calls[i]);
+
+    add_header (out, "varnam_errors_total", "counter", "Calls to the public functions which failed");
+    for (i = 0; i < VARNAM_CALLS; i++)
+        add_sample (out, "varnam_errors_total", "function", call_names[i], metrics->errors[i]);
+
+    if (metrics->timed)
+    {
+        add_header (out, "varnam_stage_duration_seconds", "histogram",
+                    "Wall clock time taken by the public calls and their stages");
+        for (i = 0; i < VARNAM_STAGES; i++)
+            add_histogram (out, stage_names[i], &metrics->timings[i]);
+    }
+
+    add_header (out, "varnam_cache_hits_total", "counter", "Lookups served by an in-memory cache");
+    for (i = 0; i < METRICS_CACHES; i++)
+        add_sample (out, "varnam_cache_hits_total", "cache", cache_names[i], metrics->caches[i].hits);
+
+    add_header (out, "varnam_cache_misses_total", "counter", "Lookups an in-memory cache couldn't serve");
+    for (i = 0; i < METRICS_CACHES; i++)
+        add_sample (out, "varnam_cache_misses_total", "cache", cache_names[i], metrics->caches[i].misses);
+
+    add_header (out, "varnam_cache_evictions_total", "counter",
+                "Entries dropped from an in-memory cache to make room or release memory");
+    for (i = 0; i < METRICS_CACHES; i++)
+        add_sample (out, "varnam_cache_evictions_total", "cache", cache_names[i], metrics->caches[i].evictions);
+
+    add_header (out, "varnam_cache_entries", "gauge", "Entries in an in-memory cache");
+    for (i = 0; i < METRICS_CACHES; i++)
+        add_sample (out, "varnam_cache_entries", "cache", cache_names[i], metrics->caches[i].entries);
+
+    add_header (out, "varnam_instance_pool_objects", "gauge", "Objects held by an instance pool");
+    for (i = 0; i < METRICS_INSTANCE_POOLS; i++)
+        add_sample (out, "varnam_instance_pool_objects", "pool", instance_pool_names[i],
+                    metrics->instance_pools[i].objects);
+
+    add_header (out, "varnam_instance_pool_bytes", "gauge", "Bytes held by an instance pool");
+    for (i = 0; i < METRICS_INSTANCE_POOLS; i++)
+        add_sample (out, "varnam_instance_pool_bytes", "pool", instance_pool_names[i],
+                    (long) metrics->instance_pools[i].bytes);
+
+    if (metrics->words >= 0)
+    {
+        add_header (out, "varnam_words", "gauge", "Words in the learnings file");
+        add_sample (out, "varnam_words", NULL, NULL, metrics->words);
+    }
+
+    add_header (out, "varnam_db_page_cache_bytes", "gauge", "Bytes used by the sqlite page cache of a database");
+    for (i = 0; i < METRICS_DATABASES; i++)
+        add_sample (out, "varnam_db_page_cache_bytes", "db", database_names[i], metrics->page_cache_bytes[i]);
+
+    add_header (out, "varnam_sqlite_memory_bytes", "gauge", "Memory used by sqlite in this process");
+    add_sample (out, "varnam_sqlite_memory_bytes", NULL, NULL, (long) sqlite3_memory_used ());
+
+    if (pool == NULL)
+        return VARNAM_SUCCESS;
+
+    add_header (out, "varnam_pool_size", "gauge", "Handles in the pool");
+    add_sample (out, "varnam_pool_size", NULL, NULL, pool->size);
+    add_header (out, "varnam_pool_available", "gauge", "Handles which are not checked out");
+    add_sample (out, "varnam_pool_available", NULL, NULL, pool->available);
+    add_header (out, "varnam_pool_checkouts_total", "counter", "Handles checked out");
+    add_sample (out, "varnam_pool_checkouts_total", NULL, NULL, pool->checkouts);
+    add_header (out, "varnam_pool_waits_total", "counter", "Checkouts which had to wait for a handle");
+    add_sample (out, "varnam_pool_waits_total", NULL, NULL, pool->waits);
+    add_header (out, "varnam_pool_timeouts_total", "counter", "Checkouts which timed out");
+    add_sample (out, "varnam_pool_timeouts_total", NULL, NULL, pool->timeouts);
+    add_header (out, "varnam_pool_wait_seconds_total", "counter", "Time spent waiting for a handle");
+    format_seconds (value, pool->wait_time_total_us);
+    strbuf_addf (out, "varnam_pool_wait_seconds_total %s\n", value);
+
+    return VARNAM_SUCCESS;
+}
+
+int
+varnam_metrics_render(varnam *handle, strbuf *out)
+{
+    int rc;
+    vmetrics *metrics;
+
+    if (handle == NULL || out == NULL)
+        return VARNAM_ARGS_ERROR;
+
+    /* Histograms make this too large for the stack */
+    metrics = xmalloc (sizeof (vmetrics));
+    if (metrics == NULL)
+        return VARNAM_MEMORY_ERROR;
+
+    init_metrics (metrics);
+    collect_metrics (handle, true, metrics);
+    collect_words_count (handle, metrics);
+
+    rc = render_metrics (metrics, NULL, out);
+    xfree (metrics);
+    return rc;
+}
@@ -0,0 +1,60 @@
+/* metrics.h - Aggregate figures of handles and pools in Prometheus text format
+ *
+ * Copyright (C) Navaneeth.K.N
+ *
+ * This is part of libvarnam. See LICENSE.txt for the license
+ */
+
+#ifndef VARNAM_METRICS_H_INCLUDED_180126
+#define VARNAM_METRICS_H_INCLUDED_180126
+
+#include "vtypes.h"
+#include "util.h"
+
+#define METRICS_CACHES 6
+#define METRICS_INSTANCE_POOLS 4
+#define METRICS_DATABASES 2
+
+/* Lookups and entries of a cache, added across handles */
+typedef struct {
+    int entries;
+    long hits;
+    long misses;
+    long evictions;
+} vcache_metrics;
+
+/* Figures of one or more handles added together */
+typedef struct varnam_metrics_t {
+    int handles;
+    long calls[VARNAM_CALLS];
+    long errors[VARNAM_CALLS];
+    vtimings timings[VARNAM_STAGES];
+    bool timed;                  /* at least one handle has tracing on */
+    vcache_metrics caches[METRICS_CACHES];
+    vpool_info instance_pools[METRICS_INSTANCE_POOLS];
+    long page_cache_bytes[METRICS_DATABASES];
+    int words;                   /* -1 when no learnings file is open */
+} vmetrics;
+
+/* Counts a call to a public function and whether it failed */
+void
+count_call(varnam *handle, int call, int rc);
+
+void
+init_metrics(vmetrics *metrics);
+
+/* Adds the counters of handle to metrics. Timings, caches, instance pools and databases
+ * are read only when idle is true, since they can't be read while another thread uses
+ * the handle. Call and error counters are read atomically */
+void
+collect_metrics(varnam *handle, bool idle, vmetrics *metrics);
+
+/* Counts the learned words into metrics. Handle should not be in use elsewhere */
+void
+collect_words_count(varnam *handle, vmetrics *metrics);
+
+/* Writes metrics, and pool when it is not NULL, to out */
+int
+render_metrics(vmetrics *metrics, varnam_pool_stats *pool, strbuf *out);
+
+#endif
@@ -14,8 +14,11 @@
 #include "../result-codes.h"
 #include "../symbol-table.h"
 
-#define RENDER_VALUE2_TAG "render_value2"
-#define CHIL_TAG "chill"
+/* Tokens these renderers handle. Rest are rendered without calling them */
+const unsigned int ml_unicode_tl_types = 1u << VARNAM_TOKEN_VOWEL;
+const unsigned int ml_unicode_tl_tags = 1u << VARNAM_TAG_RENDER_VALUE2;
+const unsigned int ml_unicode_rtl_types = 0;
+const unsigned int ml_unicode_rtl_tags = 1u << VARNAM_TAG_CHILL;
 
 int
 ml_unicode_renderer(varnam *handle,
@@ -23,29 +26,24 @@ ml_unicode_renderer(varnam *handle,
                     vtoken *current,
                     strbuf *output)
 {
-    int rc;
-    vtoken *virama;
     bool removed;
 
-    rc = vst_get_virama (handle, &virama);
-    if (rc) return rc;
-
     if (previous != NULL && current->type == VARNAM_TOKEN_VOWEL && strcmp(current->pattern, "r") == 0)
     {
         strbuf_add (output, current->value3);
         return VARNAM_SUCCESS;
     }
 
-    if (strcmp(current->tag, RENDER_VALUE2_TAG) == 0 && previous != NULL)
+    if (current->tag_id == VARNAM_TAG_RENDER_VALUE2 && previous != NULL)
     {
 #ifdef _VARNAM_VERBOSE
-        varnam_debug (handle, "ml-unicode-renderer - Found %s tag", RENDER_VALUE2_TAG);
+        varnam_debug (handle, "ml-unicode-renderer - Found %s tag", current->tag);
 #endif
         strbuf_add(output, current->value2);
         return VARNAM_SUCCESS;
     }
 
-    if (current->type == VARNAM_TOKEN_VOWEL && previous != NULL && strcmp(previous->tag, CHIL_TAG) == 0)
+    if (current->type == VARNAM_TOKEN_VOWEL && previous != NULL && previous->tag_id == VARNAM_TAG_CHILL)
     {
         removed = strbuf_remove_from_last (output, previous->value1);
         if (!removed) {
@@ -69,7 +67,7 @@ ml_unicode_rtl_renderer(varnam *handle,
                         vtoken *current,
                         strbuf *output)
 {
-    if (strcmp(current->tag, CHIL_TAG) == 0) {
+    if (current->tag_id == VARNAM_TAG_CHILL) {
         strbuf_add (output, current->pattern);
         strbuf_add (output, "_");
         return VARNAM_SUCCESS;
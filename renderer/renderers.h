@@ -12,6 +12,9 @@
 #include "../vtypes.h"
 #include "../util.h"
 
+extern const unsigned int ml_unicode_tl_types, ml_unicode_tl_tags;
+extern const unsigned int ml_unicode_rtl_types, ml_unicode_rtl_tags;
+
 int
 ml_unicode_renderer(varnam *handle,
                     vtoken *previous,
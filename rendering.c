@@ -7,6 +7,7 @@
 
 
 #include <assert.h>
+#include <stdlib.h>
 #include <string.h>
 
 #include "symbol-table.h"
@@ -17,8 +18,10 @@
 #include "vword.h"
 #include "api.h"
 
+/* Renderer for the scheme is looked up once and kept in the handle. Registering a renderer
+ * or changing the scheme details makes it look up again */
 static vtoken_renderer*
-get_renderer(varnam *handle)
+find_renderer(varnam *handle)
 {
     vtoken_renderer *r;
     int i, rc;
@@ -47,115 +50,409 @@ get_renderer(varnam *handle)
     return NULL;
 }
 
-/* Resolves the tokens.
- * tokens will be a single dimensional array where each item is vtoken instances
+/* Rules are loaded into a flat array. Masks of the token types and tags each
+ * direction has rules for let tokens without rules skip the lookup */
+static void
+load_rendering_rules(varnam *handle)
+{
+    vrendering_rule *rule;
+    int i, rc;
+
+    vst_destroy_rendering_rules (v_->rendering_rules, v_->rendering_rules_count);
+    v_->rendering_rules = NULL;
+    v_->rendering_rules_count = 0;
+    memset (v_->rules_types, 0, sizeof (v_->rules_types));
+    memset (v_->rules_tags, 0, sizeof (v_->rules_tags));
+
+    rc = vst_load_rendering_rules (handle, &v_->rendering_rules, &v_->rendering_rules_count);
+    if (rc != VARNAM_SUCCESS) {
+        varnam_log (handle, "Failed to load rendering rules. Custom rendering will be unavailable");
+        return;
+    }
+
+    for (i = 0; i < v_->rendering_rules_count; i++)
+    {
+        rule = &v_->rendering_rules[i];
+        if (rule->direction != VARNAM_RULE_TRANSLITERATION && rule->direction != VARNAM_RULE_REVERSE_TRANSLITERATION)
+            continue;
+
+        if (rule->token_type != VARNAM_RULE_ANY)
+            v_->rules_types[rule->direction] |= 1u << rule->token_type;
+        else if (rule->tag[0] != '\0')
+            v_->rules_tags[rule->direction] |= 1u << rule->tag_id;
+        else
+            v_->rules_types[rule->direction] = VARNAM_RENDER_ALL;
+    }
+}
+
+static vtoken_renderer*
+get_renderer(varnam *handle)
+{
+    if (!v_->renderer_resolved) {
+        v_->renderer = find_renderer (handle);
+        load_rendering_rules (handle);
+        v_->renderer_resolved = 1;
+    }
+
+    return v_->renderer;
+}
+
+static bool
+renders(unsigned int types, unsigned int tags, vtoken *token)
+{
+    return (types & (1u << token->type)) != 0 || (tags & (1u << token->tag_id)) != 0;
+}
+
+static bool
+tag_matches(int tag_id, const char *tag, vtoken *token)
+{
+    if (tag_id != VARNAM_TAG_OTHER)
+        return token->tag_id == tag_id;
+    return strcmp (token->tag, tag) == 0;
+}
+
+static bool
+rule_matches(vrendering_rule *rule, vtoken *previous, vtoken *current)
+{
+    if (rule->token_type != VARNAM_RULE_ANY && rule->token_type != current->type)
+        return false;
+
+    if (rule->tag[0] != '\0' && !tag_matches (rule->tag_id, rule->tag, current))
+        return false;
+
+    if (rule->pattern[0] != '\0' && strcmp (rule->pattern, current->pattern) != 0)
+        return false;
+
+    if (rule->previous_type == VARNAM_RULE_ANY && rule->previous_tag[0] == '\0')
+        return true;
+
+    if (previous == NULL)
+        return false;
+
+    if (rule->previous_type > 0 && rule->previous_type != previous->type)
+        return false;
+
+    if (rule->previous_tag[0] != '\0' && !tag_matches (rule->previous_tag_id, rule->previous_tag, previous))
+        return false;
+
+    return true;
+}
+
+static const char*
+rule_output(vtoken *token, int output)
+{
+    switch (output)
+    {
+        case VARNAM_RULE_OUTPUT_VALUE1:
+            return token->value1;
+        case VARNAM_RULE_OUTPUT_VALUE2:
+            return token->value2;
+        case VARNAM_RULE_OUTPUT_VALUE3:
+            return token->value3;
+        case VARNAM_RULE_OUTPUT_PATTERN:
+            return token->pattern;
+    }
+    return "";
+}
+
+/* Removes the previous token from the end of output. It is there in one of its values
+ * when transliterating and as its pattern when reverse transliterating */
+static bool
+remove_previous_output(int direction, vtoken *previous, strbuf *output)
+{
+    if (direction == VARNAM_RULE_REVERSE_TRANSLITERATION)
+        return strbuf_remove_from_last (output, previous->pattern);
+
+    return strbuf_remove_from_last (output, previous->value1) ||
+           strbuf_remove_from_last (output, previous->value2);
+}
+
+/* Renders current using the first matching rule. Returns false when no rule applies */
+static bool
+apply_rendering_rules(varnam *handle, int direction, vtoken *previous, vtoken *current, strbuf *output)
+{
+    vrendering_rule *rule;
+    int i;
+
+    for (i = 0; i < v_->rendering_rules_count; i++)
+    {
+        rule = &v_->rendering_rules[i];
+        if (rule->direction != direction || !rule_matches (rule, previous, current))
+            continue;
+
+        if (rule->previous_output != VARNAM_RULE_OUTPUT_NONE)
+        {
+            if (previous == NULL || !remove_previous_output (direction, previous, output))
+                continue;
+            strbuf_add (output, rule_output (previous, rule->previous_output));
+        }
+
+        strbuf_add (output, rule_output (current, rule->output));
+        strbuf_add (output, rule->suffix);
+        return true;
+    }
+
+    return false;
+}
+
+/* Renders a single token and appends the output to string.
+ * previous is the token rendered before this one. It will be updated so that
+ * the same variable can be passed in when rendering the next token. This lets
+ * callers extend an already rendered prefix without rendering it again.
  */
 int
-resolve_tokens(varnam *handle,
-               varray *tokens,
-               vword **word)
+resolve_token(varnam *handle,
+              vtoken *token,
+              vtoken **previous,
+              strbuf *string)
 {
-    vtoken *virama, *token = NULL, *previous = NULL;
-    strbuf *string;
+    vtoken *virama;
     vtoken_renderer *r;
-    int rc, i;
+    int rc;
 
     assert(handle);
+    assert(token);
+
+    if (token->type == VARNAM_TOKEN_NON_JOINER) {
+        *previous = NULL;
+        return VARNAM_SUCCESS;
+    }
 
     rc = vst_get_virama (handle, &virama);
     if (rc)
         return rc;
 
-    string = get_pooled_string (handle);
-    for(i = 0; i < varray_length(tokens); i++)
-    {
-        token = varray_get (tokens, i);
-
-        if (token->type == VARNAM_TOKEN_NON_JOINER) {
-            previous = NULL;
-            continue;
-        }
-
 #ifdef _VARNAM_VERBOSE
-        printf ("Token %s, %d\n", token->pattern, token->type);
+    printf ("Token %s, %d\n", token->pattern, token->type);
 #endif
 
-        r = get_renderer (handle);
-        if (r != NULL)
-        {
-            rc = r->tl (handle, previous, token, string);
-            if (rc == VARNAM_ERROR)
-                return rc;
-            if (rc == VARNAM_SUCCESS)
-                continue;
-        }
+    /* Rules in the symbols table take over from the scheme's renderer */
+    r = get_renderer (handle);
+    if (v_->rendering_rules_count > 0)
+    {
+        if (renders (v_->rules_types[VARNAM_RULE_TRANSLITERATION], v_->rules_tags[VARNAM_RULE_TRANSLITERATION], token) &&
+            apply_rendering_rules (handle, VARNAM_RULE_TRANSLITERATION, *previous, token, string))
+            return VARNAM_SUCCESS;
+    }
+    else if (r != NULL && renders (r->tl_types, r->tl_tags, token))
+    {
+        rc = r->tl (handle, *previous, token, string);
+        if (rc == VARNAM_ERROR)
+            return rc;
+        if (rc == VARNAM_SUCCESS)
+            return VARNAM_SUCCESS;
+    }
 
-        if (token->type == VARNAM_TOKEN_VIRAMA)
-        {
-            /* we are resolving a virama. If the output ends with a virama already, add a
-               ZWNJ to it, so that following character will not be combined.
-               if output not ends with virama, add a virama and ZWNJ */
-            if(strbuf_endswith (string, virama->value1)) {
-                strbuf_add (string, ZWNJ());
-            }
-            else {
-                strbuf_add (string, virama->value1);
-                strbuf_add (string, ZWNJ());
-            }
+    if (token->type == VARNAM_TOKEN_VIRAMA)
+    {
+        /* we are resolving a virama. If the output ends with a virama already, add a
+           ZWNJ to it, so that following character will not be combined.
+           if output not ends with virama, add a virama and ZWNJ */
+        if(strbuf_endswith (string, virama->value1)) {
+            strbuf_add (string, ZWNJ());
         }
-        else if(token->type == VARNAM_TOKEN_VOWEL)
-        {
-            if(virama && strbuf_endswith(string, virama->value1)) {
-                /* removing the virama and adding dependent vowel value */
-                strbuf_remove_from_last(string, virama->value1);
-                if(token->value2[0] != '\0') {
-                    strbuf_add(string, token->value2);
-                }
-            }
-            else if(previous != NULL && previous->type != VARNAM_TOKEN_OTHER) {
+        else {
+            strbuf_add (string, virama->value1);
+            strbuf_add (string, ZWNJ());
+        }
+    }
+    else if(token->type == VARNAM_TOKEN_VOWEL)
+    {
+        if(virama && strbuf_endswith(string, virama->value1)) {
+            /* removing the virama and adding dependent vowel value */
+            strbuf_remove_from_last(string, virama->value1);
+            if(token->value2[0] != '\0') {
                 strbuf_add(string, token->value2);
             }
-            else {
-                strbuf_add(string, token->value1);
-            }
         }
-        else if (token->type == VARNAM_TOKEN_NUMBER)
-        {
-            if (v_->config_use_indic_digits)
-                strbuf_add (string, token->value1);
-            else
-                strbuf_add (string, token->pattern);
+        else if(*previous != NULL && (*previous)->type != VARNAM_TOKEN_OTHER) {
+            strbuf_add(string, token->value2);
         }
         else {
             strbuf_add(string, token->value1);
         }
+    }
+    else if (token->type == VARNAM_TOKEN_NUMBER)
+    {
+        if (v_->config_use_indic_digits)
+            strbuf_add (string, token->value1);
+        else
+            strbuf_add (string, token->pattern);
+    }
+    else {
+        strbuf_add(string, token->value1);
+    }
+
+    *previous = token;
+    return VARNAM_SUCCESS;
+}
+
+/* Resolves the tokens.
+ * tokens will be a single dimensional array where each item is vtoken instances
+ */
+int
+resolve_tokens(varnam *handle,
+               varray *tokens,
+               vword **word)
+{
+    vtoken *previous = NULL;
+    strbuf *string;
+    strbuf_sso string_buffer;
+    int rc = VARNAM_SUCCESS, i;
+
+    assert(handle);
+
+    /* The word copies the rendered text. So the scratch string can stay inline */
+    string = strbuf_sso_init (&string_buffer);
+    for(i = 0; i < varray_length(tokens); i++)
+    {
+        rc = resolve_token (handle, varray_get (tokens, i), &previous, string);
+        if (rc)
+            break;
+    }
+
+    if (rc == VARNAM_SUCCESS)
+        *word = get_pooled_word (handle, strbuf_to_s (string), 1);
+
+    strbuf_sso_release (&string_buffer);
+    return rc;
+}
+
+void
+render_memo_init(vrender_memo *memo)
+{
+    memset (memo, 0, sizeof (vrender_memo));
+}
+
+/* Tokens are same if they are the same symbol. Tokens made for the text which is not in
+ * the symbols table don't have an id and are compared by identity */
+static bool
+same_token(vtoken *left, vtoken *right)
+{
+    if (left == right)
+        return true;
+
+    return left->id > 0 && left->id == right->id;
+}
+
+static int
+grow_render_memo(varnam *handle, vrender_memo *memo, int length)
+{
+    strbuf **rendered;
+    vtoken **tokens, **previous;
+    int i;
+
+    if (length < memo->allocated)
+        return VARNAM_SUCCESS;
+
+    rendered = realloc (memo->rendered, sizeof (strbuf*) * (size_t) (length + 1));
+    if (rendered == NULL)
+        return VARNAM_MEMORY_ERROR;
+    memo->rendered = rendered;
+
+    previous = realloc (memo->previous, sizeof (vtoken*) * (size_t) (length + 1));
+    if (previous == NULL)
+        return VARNAM_MEMORY_ERROR;
+    memo->previous = previous;
+
+    tokens = realloc (memo->tokens, sizeof (vtoken*) * (size_t) (length + 1));
+    if (tokens == NULL)
+        return VARNAM_MEMORY_ERROR;
+    memo->tokens = tokens;
+
+    for (i = memo->allocated; i <= length; i++)
+    {
+        memo->rendered[i] = get_pooled_string (handle);
+        memo->previous[i] = NULL;
+        memo->tokens[i] = NULL;
+    }
+
+    memo->allocated = length + 1;
+    return VARNAM_SUCCESS;
+}
 
-        previous = token;
+/*
+ * Same as resolve_tokens(), but tokens which are common with the start of the last array
+ * rendered with this memo are not rendered again. Renderers can change the text rendered
+ * for earlier tokens, so each position keeps its own copy of the text instead of a length.
+ */
+int
+resolve_tokens_from_memo(varnam *handle,
+                         vrender_memo *memo,
+                         varray *tokens,
+                         vword **word)
+{
+    vtoken *token;
+    int rc, length, common, i;
+
+    assert (handle);
+    assert (memo);
+
+    length = varray_length (tokens);
+    rc = grow_render_memo (handle, memo, length);
+    if (rc)
+        return rc;
+
+    for (common = 0; common < memo->depth && common < length; common++)
+    {
+        if (!same_token (memo->tokens[common], varray_get (tokens, common)))
+            break;
     }
 
-    *word = get_pooled_word (handle, strbuf_to_s (string), 1);
+    /* Anything after the common prefix is stale from here */
+    memo->depth = common;
+    for (i = common; i < length; i++)
+    {
+        token = varray_get (tokens, i);
+        strbuf_clear (memo->rendered[i + 1]);
+        strbuf_add (memo->rendered[i + 1], strbuf_to_s (memo->rendered[i]));
+        memo->previous[i + 1] = memo->previous[i];
+
+        rc = resolve_token (handle, token, &memo->previous[i + 1], memo->rendered[i + 1]);
+        if (rc)
+            return rc;
+
+        memo->tokens[i] = token;
+        memo->depth = i + 1;
+    }
+
+    *word = get_pooled_word (handle, strbuf_to_s (memo->rendered[length]), 1);
     return VARNAM_SUCCESS;
 }
 
+void
+render_memo_release(varnam *handle,
+                    vrender_memo *memo)
+{
+    int i;
+
+    for (i = 0; i < memo->allocated; i++)
+        return_string_to_pool (handle, memo->rendered[i]);
+
+    xfree (memo->rendered);
+    xfree (memo->previous);
+    xfree (memo->tokens);
+    render_memo_init (memo);
+}
+
 /*
  * Resolve tokens for reverse transliteration. tokens will be multidimensional array
  */
 int
-resolve_rtl_tokens(varnam *handle,
+render_rtl_tokens(varnam *handle,
                   varray *all_tokens,
-                  char **output)
+                  strbuf *rtl)
 {
     int rc, i, j;
     vtoken_renderer *r;
-    strbuf *rtl;
     vtoken *token = NULL, *previous = NULL;
     varray *tokens;
 
     assert (handle);
     assert (all_tokens);
-
-    rtl = get_pooled_string (handle);
     assert (rtl);
+
+    r = get_renderer (handle);
     for (i = 0; i < varray_length (all_tokens); i++)
     {
         tokens = varray_get (all_tokens, i);
@@ -165,8 +462,15 @@ resolve_rtl_tokens(varnam *handle,
             token = varray_get (tokens, j);
             assert (token);
 
-            r = get_renderer (handle);
-            if (r != NULL)
+            if (v_->rendering_rules_count > 0)
+            {
+                if (renders (v_->rules_types[VARNAM_RULE_REVERSE_TRANSLITERATION], v_->rules_tags[VARNAM_RULE_REVERSE_TRANSLITERATION], token) &&
+                    apply_rendering_rules (handle, VARNAM_RULE_REVERSE_TRANSLITERATION, previous, token, rtl)) {
+                    previous = token;
+                    break;
+                }
+            }
+            else if (r != NULL && renders (r->rtl_types, r->rtl_tags, token))
             {
                 rc = r->rtl (handle, previous, token, rtl);
                 if (rc == VARNAM_ERROR)
@@ -193,6 +497,21 @@ resolve_rtl_tokens(varnam *handle,
     }
 
     strbuf_remove_from_last (rtl, "_");
+    return VARNAM_SUCCESS;
+}
+
+int
+resolve_rtl_tokens(varnam *handle,
+                  varray *all_tokens,
+                  char **output)
+{
+    int rc;
+    strbuf *rtl;
+
+    rtl = get_pooled_string (handle);
+    rc = render_rtl_tokens (handle, all_tokens, rtl);
+    if (rc)
+        return rc;
 
     *output = rtl->buffer;
     return VARNAM_SUCCESS;
@@ -12,11 +12,48 @@
 #ifndef RENDERING_H_INCLUDED_200624
 #define RENDERING_H_INCLUDED_200624
 
+int
+resolve_token(varnam *handle,
+              vtoken *token,
+              vtoken **previous,
+              strbuf *string);
+
 int
 resolve_tokens(varnam *handle,
                varray *tokens,
                vword **word);
 
+/* Keeps the text rendered after each token of the last token array given to
+ * resolve_tokens_from_memo(), so that the next array renders only the tokens after the
+ * prefix it shares with the last one */
+typedef struct vrender_memo_t
+{
+    int depth;          /* number of tokens rendered for the last array */
+    int allocated;
+    vtoken **tokens;    /* tokens[d] is the token at position d in the last array */
+    strbuf **rendered;  /* rendered[d] holds the text for the first d tokens */
+    vtoken **previous;  /* previous[d] is the previous token after rendering first d tokens */
+} vrender_memo;
+
+void
+render_memo_init(vrender_memo *memo);
+
+int
+resolve_tokens_from_memo(varnam *handle,
+                         vrender_memo *memo,
+                         varray *tokens,
+                         vword **word);
+
+void
+render_memo_release(varnam *handle,
+                    vrender_memo *memo);
+
+/* Appends the reverse transliteration of all_tokens to rtl */
+int
+render_rtl_tokens(varnam *handle,
+                  varray *all_tokens,
+                  strbuf *rtl);
+
 int
 resolve_rtl_tokens(varnam *handle,
                   varray *tokens,
@@ -20,5 +20,7 @@
 #define VARNAM_INVALID_CONFIG             7
 #define VARNAM_STEMRULE_HIT				  8
 #define VARNAM_STEMRULE_MISS 			  9
+#define VARNAM_TRUNCATED                 10
+#define VARNAM_TIMEOUT                   11
 
 #endif
@@ -15,21 +15,35 @@
 #include "util.h"
 #include "varray.h"
 
-static int grow_buffer(struct strbuf *string)
+/* Makes sure string can hold required bytes, including the null terminator.
+ * Grows by 1.5x so that repeated appends are amortized. A borrowed buffer is
+ * copied to a new heap allocation instead of being reallocated */
+static int ensure_capacity(struct strbuf *string, size_t required)
 {
 	char *tmp;
 	size_t toallocate;
 
 	assert(string != NULL);
 
-	if (string->allocated < 2) {
-		toallocate = 2;
+	if (string->allocated >= required)
+		return 1;
+
+	toallocate = string->allocated < 2 ? 2 : string->allocated;
+	while (toallocate < required) {
+		toallocate = toallocate + (toallocate / 2);
+	}
+
+	if (string->borrowed) {
+		tmp = (char*) malloc(toallocate);
+		if (tmp) {
+			memcpy(tmp, string->buffer, string->length + 1);
+			string->borrowed = 0;
+		}
 	}
 	else {
-		toallocate = string->allocated + (string->allocated / 2);
+		tmp = (char*) realloc(string->buffer, toallocate);
 	}
 
-	tmp = (char*) realloc(string->buffer, toallocate);
 	if(tmp) {
 		string->buffer = tmp;
 		string->allocated = toallocate;
@@ -40,13 +54,10 @@ static int grow_buffer(struct strbuf *string)
 
 int strbuf_addc(struct strbuf *string, char c)
 {
-	size_t space_available;
-
 	assert(string != NULL);
 
-	space_available = string->allocated - string->length;
-	if(space_available <= 1) {
-		if(!grow_buffer(string)) {
+	if(string->allocated - string->length <= 1) {
+		if(!ensure_capacity(string, string->length + 2)) {
 			return 0;
 		}
 	}
@@ -63,9 +74,52 @@ struct strbuf *strbuf_init(size_t initial_buf_size)
 	string->buffer = (char*) xmalloc(initial_buf_size);
 	string->buffer[0] = '\0';
 	string->allocated = initial_buf_size;
+	string->borrowed = 0;
 	return string;
 }
 
+/* Initializes a strbuf which uses the inline buffer of sso. The returned
+ * pointer can be used with all strbuf functions except strbuf_destroy and
+ * strbuf_detach. Call strbuf_sso_release once done */
+struct strbuf *strbuf_sso_init(strbuf_sso *sso)
+{
+	assert(sso != NULL);
+
+	sso->inline_buffer[0] = '\0';
+	sso->str.buffer = sso->inline_buffer;
+	sso->str.length = 0;
+	sso->str.allocated = VARNAM_SSO_SIZE;
+	sso->str.borrowed = 1;
+	return &sso->str;
+}
+
+/* Frees the heap buffer if the string has spilled out of the inline buffer */
+/* Initializes string to write into buffer, which can hold size bytes. size should
+ * be at least 1. Like the sso buffer, buffer is left behind when string outgrows it */
+struct strbuf *strbuf_init_borrowed(struct strbuf *string, char *buffer, size_t size)
+{
+	assert(string != NULL);
+	assert(buffer != NULL && size > 0);
+
+	buffer[0] = '\0';
+	string->buffer = buffer;
+	string->length = 0;
+	string->allocated = size;
+	string->borrowed = 1;
+	return string;
+}
+
+void strbuf_sso_release(strbuf_sso *sso)
+{
+	if (sso == NULL)
+		return;
+
+	if (!sso->str.borrowed)
+		xfree(sso->str.buffer);
+
+	strbuf_sso_init(sso);
+}
+
 struct strbuf* strbuf_create_from(const char* value)
 {
 	size_t len = strlen(value);
@@ -80,29 +134,31 @@ int strbuf_is_eq(struct strbuf *string, const char *value)
 	return strcmp(strbuf_to_s(string), value) == 0;
 }
 
-int strbuf_add(struct strbuf *string, const char *c)
+static int append_bytes(struct strbuf *string, const char *c, size_t length)
 {
-	if(string == NULL || c == NULL) return 0;
+	if(!ensure_capacity(string, string->length + length + 1))
+		return 0;
 
-	while(*c != '\0') {
-		if(!strbuf_addc(string, *c++))
-			return 0;
-	}
+	memcpy(string->buffer + string->length, c, length);
+	string->length += length;
+	string->buffer[string->length] = '\0';
 
 	return 1;
 }
 
-int strbuf_add_bytes(struct strbuf *string, const char *c, int bytes_to_read)
+int strbuf_add(struct strbuf *string, const char *c)
 {
-	int i;
+	if(string == NULL || c == NULL) return 0;
+
+	return append_bytes(string, c, strlen(c));
+}
 
+int strbuf_add_bytes(struct strbuf *string, const char *c, int bytes_to_read)
+{
 	if (c == NULL || *c == '\0') return 0;
-	for (i = 0; i < bytes_to_read; i++)
-	{
-		strbuf_addc (string, c[i]);
-	}
+	if (bytes_to_read <= 0) return 1;
 
-	return 1;
+	return append_bytes(string, c, (size_t) bytes_to_read);
 }
 
 int strbuf_addln(struct strbuf *string, const char *c)
@@ -366,6 +422,7 @@ char* strbuf_detach(struct strbuf *string)
 {
 	char *buffer;
 	assert(string);
+	assert(!string->borrowed);
 	buffer = string->buffer;
 	xfree(string);
 	return buffer;
@@ -480,7 +537,11 @@ struct strbuf* get_pooled_string(varnam *handle)
 	string = vpool_get (v_->strings_pool);
 	if (string == NULL)
 	{
-		string = strbuf_init (20);
+		string = vpool_alloc (v_->strings_pool, sizeof (strbuf));
+		string->buffer = (char*) xmalloc (20);
+		string->allocated = 20;
+		string->length = 0;
+		string->borrowed = 0;
 		vpool_add (v_->strings_pool, string);
 	}
 
@@ -497,4 +558,13 @@ return_string_to_pool (varnam *handle, strbuf* string)
 	vpool_return (v_->strings_pool, string);
 }
 
+/* Pooled strings live in the pool's arena. Only the buffer is freed */
+void
+destroy_pooled_string (void *s)
+{
+	strbuf *string = (strbuf*) s;
+	if (string != NULL)
+		xfree (string->buffer);
+}
+
 
@@ -7,7 +7,9 @@
 
 
 #include <string.h>
+#include <stdlib.h>
 #include <assert.h>
+#include <limits.h>
 
 #include "symbol-table.h"
 #include "util.h"
@@ -16,8 +18,17 @@
 #include "api.h"
 #include "token.h"
 
+/* Indexes on the symbols table. Creating tokens in bulk drops them and builds them once at the end */
+#define SYMBOLS_INDEXES \
+        "create index if not exists index_pattern on symbols (pattern);" \
+        "create index if not exists index_value1 on symbols (value1);" \
+        "create index if not exists index_value2 on symbols (value2);" \
+        "create index if not exists index_value3 on symbols (value3);"
+
+static const char *persist_token_sql = "insert into symbols (type, pattern, value1, value2, value3, tag, match_type, priority, accept_condition) values (?1, trim(?2), trim(?3), trim(?4), trim(?5), trim(?6), ?7, ?8, ?9);";
+
 int
-ensure_schema_exists(varnam *handle, char **msg)
+ensure_schema_exists(varnam *handle, int flags, char **msg)
 {
     const char *sql =
         "pragma page_size=4096;"
@@ -28,21 +39,44 @@ ensure_schema_exists(varnam *handle, char **msg)
 
     const char *indexes =
         "create index if not exists index_metadata on metadata (key);"
-        "create index if not exists index_pattern on symbols (pattern);"
-        "create index if not exists index_value1 on symbols (value1);"
-        "create index if not exists index_value2 on symbols (value2);"
-        "create index if not exists index_value3 on symbols (value3);";
+        SYMBOLS_INDEXES;
 
     char *zErrMsg = 0;
     int rc;
+    sqlite3_stmt *stmt;
+    bool stamped = false;
 
     assert(handle);
     assert(handle->internal->db);
 
+    /* Compiled symbols files are stamped with the schema version. Read only and in-memory
+       handles skip the schema for them. Writable files still go through it, so that tables
+       and indexes added without a version bump are created in older files */
+    if (flags & (VARNAM_OPEN_READONLY | VARNAM_OPEN_IN_MEMORY))
+    {
+        rc = sqlite3_prepare_v2 (v_->db, "pragma user_version;", -1, &stmt, NULL);
+        if (rc == SQLITE_OK && sqlite3_step (stmt) == SQLITE_ROW)
+            stamped = sqlite3_column_int (stmt, 0) == VARNAM_SCHEMA_SYMBOLS_VERSION;
+        sqlite3_finalize (stmt);
+    }
+
+    if (stamped)
+        return VARNAM_SUCCESS;
+
+    /* The schema can't be created on a read only connection */
+    if (flags & VARNAM_OPEN_READONLY) {
+        set_last_error (handle, "%s is not a compiled symbols file. It has no schema version stamped, so it can't be opened read only", handle->scheme_file);
+        if (msg != NULL)
+            asprintf (msg, "%s\n", varnam_get_last_error (handle));
+        return VARNAM_STORAGE_ERROR;
+    }
+
     rc = sqlite3_exec(v_->db, sql, NULL, 0, &zErrMsg);
     if( rc != SQLITE_OK ){
         set_last_error (handle, "Failed to initialize output file : %s", zErrMsg);
         sqlite3_free(zErrMsg);
+        if (msg != NULL)
+            asprintf (msg, "%s\n", varnam_get_last_error (handle));
         return VARNAM_STORAGE_ERROR;
     }
 
@@ -50,6 +84,8 @@ ensure_schema_exists(varnam *handle, char **msg)
     if( rc != SQLITE_OK ){
         set_last_error (handle, "Failed to generate indexes : %s", zErrMsg);
         sqlite3_free(zErrMsg);
+        if (msg != NULL)
+            asprintf (msg, "%s\n", varnam_get_last_error (handle));
         return VARNAM_STORAGE_ERROR;
     }
 
@@ -256,6 +292,19 @@ vst_make_prefix_tree (varnam *handle)
     return VARNAM_SUCCESS;
 }
 
+static int
+skip_duplicate(varnam *handle, const char *pattern, const char *value1)
+{
+    if (handle->internal->config_ignore_duplicate_tokens)
+    {
+        varnam_log (handle, "%s => %s is already available. Ignoring duplicate tokens", pattern, value1);
+        return VARNAM_SUCCESS;
+    }
+
+    set_last_error (handle, "There is already a match available for '%s => %s'. Duplicate entries are not allowed", pattern, value1);
+    return VARNAM_ERROR;
+}
+
 int
 vst_persist_token(
     varnam *handle,
@@ -271,7 +320,6 @@ vst_persist_token(
 {
     int rc, persisted;
     sqlite3 *db; sqlite3_stmt *stmt;
-    const char *sql = "insert into symbols (type, pattern, value1, value2, value3, tag, match_type, priority, accept_condition) values (?1, trim(?2), trim(?3), trim(?4), trim(?5), trim(?6), ?7, ?8, ?9);";
 
     assert(handle); assert(pattern); assert(value1); assert(token_type);
 
@@ -280,20 +328,11 @@ vst_persist_token(
         return rc;
 
     if (persisted)
-    {
-        if (handle->internal->config_ignore_duplicate_tokens)
-        {
-            varnam_log (handle, "%s => %s is already available. Ignoring duplicate tokens", pattern, value1);
-            return VARNAM_SUCCESS;
-        }
-
-        set_last_error (handle, "There is already a match available for '%s => %s'. Duplicate entries are not allowed", pattern, value1);
-        return VARNAM_ERROR;
-    }
+        return skip_duplicate (handle, pattern, value1);
 
     db = handle->internal->db;
 
-    rc = sqlite3_prepare_v2( db, sql, -1, &stmt, NULL );
+    rc = sqlite3_prepare_v2( db, persist_token_sql, -1, &stmt, NULL );
     if(rc != SQLITE_OK)
     {
         set_last_error (handle, "Failed to initialize statement : %s", sqlite3_errmsg(db));
@@ -324,6 +363,323 @@ vst_persist_token(
     return VARNAM_SUCCESS;
 }
 
+/* Keys of the tokens in the symbols table. Duplicates of the tokens created in bulk are
+ * looked up here rather than querying the table for each token. The keys follow
+ * already_persisted(), pattern for exact matches and pattern with value1 for the rest */
+typedef struct {
+    char *key;
+    UT_hash_handle hh;
+} vst_bulk_key;
+
+struct vst_bulk_t {
+    sqlite3_stmt *insert;
+    vst_bulk_key *exact;
+    vst_bulk_key *pairs;
+};
+
+/* Skips the spaces around text the way trim() in sqlite does */
+static const char*
+trim_spaces(const char *text, size_t *length)
+{
+    size_t len;
+
+    while (*text == ' ')
+        text++;
+
+    len = strlen (text);
+    while (len > 0 && text[len - 1] == ' ')
+        len--;
+
+    *length = len;
+    return text;
+}
+
+/* Writes pattern and value1 separated by a NUL into key. value1 is NULL for exact keys */
+static size_t
+make_bulk_key(char *key, const char *pattern, size_t pattern_len, const char *value1, size_t value1_len)
+{
+    memcpy (key, pattern, pattern_len);
+    if (value1 == NULL)
+        return pattern_len;
+
+    key[pattern_len] = '\0';
+    memcpy (key + pattern_len + 1, value1, value1_len);
+    return pattern_len + 1 + value1_len;
+}
+
+static bool
+has_bulk_key(vst_bulk_key *keys, const char *pattern, size_t pattern_len, const char *value1, size_t value1_len)
+{
+    char key[VARNAM_SYMBOL_MAX * 2 + 2];
+    size_t key_len;
+    vst_bulk_key *item = NULL;
+
+    assert (pattern_len + value1_len + 1 < sizeof (key));
+
+    key_len = make_bulk_key (key, pattern, pattern_len, value1, value1_len);
+    if (key_len > UINT_MAX)
+        return false;
+
+    HASH_FIND (hh, keys, key, (unsigned) key_len, item);
+    return item != NULL;
+}
+
+static int
+add_bulk_key(vst_bulk_key **keys, const char *pattern, size_t pattern_len, const char *value1, size_t value1_len)
+{
+    size_t key_len;
+    vst_bulk_key *item = NULL;
+
+    key_len = value1 == NULL ? pattern_len : pattern_len + 1 + value1_len;
+    if (key_len > UINT_MAX)
+        return VARNAM_ERROR;
+
+    item = xmalloc (sizeof (vst_bulk_key));
+    if (item == NULL)
+        return VARNAM_MEMORY_ERROR;
+
+    item->key = xmalloc (key_len + 1);
+    if (item->key == NULL) {
+        xfree (item);
+        return VARNAM_MEMORY_ERROR;
+    }
+
+    make_bulk_key (item->key, pattern, pattern_len, value1, value1_len);
+    HASH_ADD_KEYPTR (hh, *keys, item->key, (unsigned) key_len, item);
+    return VARNAM_SUCCESS;
+}
+
+static void
+destroy_bulk_keys(vst_bulk_key **keys)
+{
+    vst_bulk_key *item, *tmp;
+
+    HASH_ITER (hh, *keys, item, tmp) {
+        HASH_DEL (*keys, item);
+        xfree (item->key);
+        xfree (item);
+    }
+}
+
+/* Remembers a token so that later tokens in the same bulk can be checked against it */
+static int
+remember_bulk_token(vst_bulk *bulk, const char *pattern, size_t pattern_len, const char *value1, size_t value1_len, int match_type)
+{
+    int rc;
+
+    if (match_type == VARNAM_MATCH_EXACT && !has_bulk_key (bulk->exact, pattern, pattern_len, NULL, 0))
+    {
+        rc = add_bulk_key (&bulk->exact, pattern, pattern_len, NULL, 0);
+        if (rc != VARNAM_SUCCESS)
+            return rc;
+    }
+
+    if (has_bulk_key (bulk->pairs, pattern, pattern_len, value1, value1_len))
+        return VARNAM_SUCCESS;
+
+    return add_bulk_key (&bulk->pairs, pattern, pattern_len, value1, value1_len);
+}
+
+static int
+prepare_bulk(varnam *handle, vst_bulk **output)
+{
+    int rc;
+    char *zErrMsg;
+    const char *pattern, *value1;
+    sqlite3_stmt *stmt;
+    vst_bulk *bulk;
+    const char *drop_indexes =
+        "drop index if exists index_pattern;"
+        "drop index if exists index_value1;"
+        "drop index if exists index_value2;"
+        "drop index if exists index_value3;";
+
+    *output = NULL;
+
+    bulk = xmalloc (sizeof (vst_bulk));
+    if (bulk == NULL)
+        return VARNAM_MEMORY_ERROR;
+
+    bulk->insert = NULL;
+    bulk->exact = NULL;
+    bulk->pairs = NULL;
+
+    rc = sqlite3_prepare_v2 (v_->db, "select pattern, value1, match_type from symbols;", -1, &stmt, NULL);
+    if (rc != SQLITE_OK) {
+        set_last_error (handle, "Failed to read existing tokens : %s", sqlite3_errmsg (v_->db));
+        sqlite3_finalize (stmt);
+        vst_bulk_destroy (bulk);
+        return VARNAM_ERROR;
+    }
+
+    rc = VARNAM_SUCCESS;
+    while (rc == VARNAM_SUCCESS && sqlite3_step (stmt) == SQLITE_ROW)
+    {
+        pattern = (const char*) sqlite3_column_text (stmt, 0);
+        value1 = (const char*) sqlite3_column_text (stmt, 1);
+        rc = remember_bulk_token (bulk,
+            pattern == NULL ? "" : pattern, (size_t) sqlite3_column_bytes (stmt, 0),
+            value1 == NULL ? "" : value1, (size_t) sqlite3_column_bytes (stmt, 1),
+            sqlite3_column_int (stmt, 2));
+    }
+    sqlite3_finalize (stmt);
+
+    if (rc != VARNAM_SUCCESS) {
+        vst_bulk_destroy (bulk);
+        return rc;
+    }
+
+    rc = sqlite3_exec (v_->db, drop_indexes, NULL, 0, &zErrMsg);
+    if (rc != SQLITE_OK) {
+        set_last_error (handle, "Failed to drop indexes : %s", zErrMsg);
+        sqlite3_free (zErrMsg);
+        vst_bulk_destroy (bulk);
+        return VARNAM_STORAGE_ERROR;
+    }
+
+    rc = sqlite3_prepare_v2 (v_->db, persist_token_sql, -1, &bulk->insert, NULL);
+    if (rc != SQLITE_OK) {
+        set_last_error (handle, "Failed to initialize statement : %s", sqlite3_errmsg (v_->db));
+        vst_bulk_destroy (bulk);
+        return VARNAM_ERROR;
+    }
+
+    *output = bulk;
+    return VARNAM_SUCCESS;
+}
+
+/* Changes made in bulk are kept in a savepoint so that a failure rolls back only
+ * them and not the changes buffered before */
+int
+vst_bulk_begin(varnam *handle, vst_bulk **output)
+{
+    int rc;
+    char *zErrMsg;
+
+    assert (handle);
+    assert (v_->vst_buffering);
+
+    *output = NULL;
+
+    rc = sqlite3_exec (v_->db, "SAVEPOINT bulk;", NULL, 0, &zErrMsg);
+    if (rc != SQLITE_OK) {
+        set_last_error (handle, "Failed to start bulk changes : %s", zErrMsg);
+        sqlite3_free (zErrMsg);
+        return VARNAM_STORAGE_ERROR;
+    }
+
+    rc = prepare_bulk (handle, output);
+    if (rc != VARNAM_SUCCESS)
+        vst_bulk_discard_changes (handle);
+
+    return rc;
+}
+
+int
+vst_bulk_persist_token(
+    varnam *handle,
+    vst_bulk *bulk,
+    const char *pattern,
+    const char *value1,
+    const char *value2,
+    const char *value3,
+    const char *tag,
+    int token_type,
+    int match_type,
+    int priority,
+    int accept_condition)
+{
+    int rc;
+    bool persisted;
+    size_t pattern_len, value1_len;
+    const char *trimmed_pattern, *trimmed_value1;
+    sqlite3_stmt *stmt = bulk->insert;
+
+    assert(handle); assert(pattern); assert(value1); assert(token_type);
+
+    trimmed_pattern = trim_spaces (pattern, &pattern_len);
+    trimmed_value1 = trim_spaces (value1, &value1_len);
+
+    if (match_type == VARNAM_MATCH_EXACT)
+        persisted = has_bulk_key (bulk->exact, trimmed_pattern, pattern_len, NULL, 0);
+    else
+        persisted = has_bulk_key (bulk->pairs, trimmed_pattern, pattern_len, trimmed_value1, value1_len);
+
+    if (persisted)
+        return skip_duplicate (handle, pattern, value1);
+
+    sqlite3_bind_int (stmt, 1, token_type);
+    sqlite3_bind_text(stmt, 2, pattern,    -1, NULL);
+    sqlite3_bind_text(stmt, 3, value1,     -1, NULL);
+    sqlite3_bind_text(stmt, 4, value2 == NULL ? "" : value2, -1, NULL);
+    sqlite3_bind_text(stmt, 5, value3 == NULL ? "" : value3, -1, NULL);
+    sqlite3_bind_text(stmt, 6, tag == NULL ? "" : tag, -1, NULL);
+    sqlite3_bind_int (stmt, 7, match_type);
+    sqlite3_bind_int (stmt, 8, priority);
+    sqlite3_bind_int (stmt, 9, accept_condition);
+
+    rc = sqlite3_step (stmt);
+    sqlite3_clear_bindings (stmt);
+    sqlite3_reset (stmt);
+    if (rc != SQLITE_DONE)
+    {
+        set_last_error (handle, "Failed to persist token : %s", sqlite3_errmsg (v_->db));
+        return VARNAM_ERROR;
+    }
+
+    return remember_bulk_token (bulk, trimmed_pattern, pattern_len, trimmed_value1, value1_len, match_type);
+}
+
+int
+vst_bulk_finish(varnam *handle, vst_bulk *bulk)
+{
+    int rc;
+    char *zErrMsg;
+
+    assert (handle); assert (bulk);
+
+    rc = sqlite3_exec (v_->db, SYMBOLS_INDEXES, NULL, 0, &zErrMsg);
+    if (rc != SQLITE_OK) {
+        set_last_error (handle, "Failed to generate indexes : %s", zErrMsg);
+        sqlite3_free (zErrMsg);
+        return VARNAM_STORAGE_ERROR;
+    }
+
+    rc = sqlite3_exec (v_->db, "RELEASE bulk;", NULL, 0, &zErrMsg);
+    if (rc != SQLITE_OK) {
+        set_last_error (handle, "Failed to finish bulk changes : %s", zErrMsg);
+        sqlite3_free (zErrMsg);
+        return VARNAM_STORAGE_ERROR;
+    }
+
+    return VARNAM_SUCCESS;
+}
+
+int
+vst_bulk_discard_changes(varnam *handle)
+{
+    char *zErrMsg = NULL;
+
+    assert (handle);
+
+    /* Like vst_discard_changes(), this keeps the last error set by the failure */
+    sqlite3_exec (v_->db, "ROLLBACK TO bulk; RELEASE bulk;", NULL, 0, &zErrMsg);
+    sqlite3_free (zErrMsg);
+    return VARNAM_SUCCESS;
+}
+
+void
+vst_bulk_destroy(vst_bulk *bulk)
+{
+    if (bulk == NULL)
+        return;
+
+    sqlite3_finalize (bulk->insert);
+    destroy_bulk_keys (&bulk->exact);
+    destroy_bulk_keys (&bulk->pairs);
+    xfree (bulk);
+}
+
 int
 vst_persist_stemrule(varnam *handle, const char* old_ending, const char* new_ending)
 {
@@ -374,6 +730,170 @@ vst_persist_stemrule(varnam *handle, const char* old_ending, const char* new_end
     return VARNAM_SUCCESS;
 }
 
+int
+vst_persist_rendering_rule(varnam *handle, vrendering_rule *rule)
+{
+    sqlite3 *db;
+    sqlite3_stmt *stmt;
+    char *zErrMsg = 0;
+    int rc;
+    const char *table = "create table if not exists rendering_rules (id INTEGER PRIMARY KEY AUTOINCREMENT, direction INTEGER, token_type INTEGER, tag TEXT, pattern TEXT, previous_type INTEGER, previous_tag TEXT, output INTEGER, previous_output INTEGER, suffix TEXT);";
+    const char *sql = "insert into rendering_rules (direction, token_type, tag, pattern, previous_type, previous_tag, output, previous_output, suffix) values (?1, ?2, ?3, ?4, ?5, ?6, ?7, ?8, ?9);";
+
+    db = handle->internal->db;
+
+    rc = sqlite3_exec (db, table, NULL, 0, &zErrMsg);
+    if (rc != SQLITE_OK)
+    {
+        set_last_error (handle, "Failed to create rendering rules table : %s", zErrMsg);
+        sqlite3_free (zErrMsg);
+        return VARNAM_STORAGE_ERROR;
+    }
+
+    rc = sqlite3_prepare_v2 (db, sql, -1, &stmt, NULL);
+    if (rc != SQLITE_OK)
+    {
+        set_last_error (handle, "Failed to prepare statement : %s", sqlite3_errmsg(db));
+        sqlite3_finalize (stmt);
+        return VARNAM_ERROR;
+    }
+
+    sqlite3_bind_int (stmt, 1, rule->direction);
+    sqlite3_bind_int (stmt, 2, rule->token_type);
+    sqlite3_bind_text (stmt, 3, rule->tag, -1, NULL);
+    sqlite3_bind_text (stmt, 4, rule->pattern, -1, NULL);
+    sqlite3_bind_int (stmt, 5, rule->previous_type);
+    sqlite3_bind_text (stmt, 6, rule->previous_tag, -1, NULL);
+    sqlite3_bind_int (stmt, 7, rule->output);
+    sqlite3_bind_int (stmt, 8, rule->previous_output);
+    sqlite3_bind_text (stmt, 9, rule->suffix, -1, NULL);
+
+    rc = sqlite3_step (stmt);
+    if (rc != SQLITE_DONE)
+    {
+        set_last_error (handle, "Failed to persist rendering rule : %s", sqlite3_errmsg(db));
+        sqlite3_finalize (stmt);
+        return VARNAM_ERROR;
+    }
+
+    sqlite3_finalize (stmt);
+    return VARNAM_SUCCESS;
+}
+
+static const char*
+column_text(sqlite3_stmt *stmt, int column)
+{
+    const unsigned char *value = sqlite3_column_text (stmt, column);
+    return value == NULL ? "" : (const char*) value;
+}
+
+/* Copies the strings of the rule into one allocation owned by rule->text */
+static int
+load_rule_text(vrendering_rule *rule, sqlite3_stmt *stmt)
+{
+    const char *tag, *pattern, *previous_tag, *suffix;
+    size_t tag_len, pattern_len, previous_tag_len, suffix_len;
+    char *text;
+
+    tag = column_text (stmt, 2);
+    pattern = column_text (stmt, 3);
+    previous_tag = column_text (stmt, 5);
+    suffix = column_text (stmt, 8);
+    tag_len = strlen (tag) + 1;
+    pattern_len = strlen (pattern) + 1;
+    previous_tag_len = strlen (previous_tag) + 1;
+    suffix_len = strlen (suffix) + 1;
+
+    text = xmalloc (tag_len + pattern_len + previous_tag_len + suffix_len);
+    if (text == NULL)
+        return VARNAM_MEMORY_ERROR;
+
+    rule->text = text;
+    rule->tag = memcpy (text, tag, tag_len);
+    text += tag_len;
+    rule->pattern = memcpy (text, pattern, pattern_len);
+    text += pattern_len;
+    rule->previous_tag = memcpy (text, previous_tag, previous_tag_len);
+    text += previous_tag_len;
+    rule->suffix = memcpy (text, suffix, suffix_len);
+    return VARNAM_SUCCESS;
+}
+
+void
+vst_destroy_rendering_rules(vrendering_rule *rules, int count)
+{
+    int i;
+
+    for (i = 0; i < count; i++)
+        xfree (rules[i].text);
+    xfree (rules);
+}
+
+int
+vst_load_rendering_rules(varnam *handle, vrendering_rule **rules, int *count)
+{
+    sqlite3 *db;
+    sqlite3_stmt *stmt;
+    vrendering_rule *loaded = NULL, *rule;
+    int rc, allocated = 0, n = 0;
+
+    db = handle->internal->db;
+    *rules = NULL;
+    *count = 0;
+
+    rc = sqlite3_prepare_v2 (db, "select direction, token_type, tag, pattern, previous_type, previous_tag, output, previous_output, suffix from rendering_rules order by id;", -1, &stmt, NULL);
+    if (rc != SQLITE_OK)
+    {
+        /* no rendering_rules table */
+        sqlite3_finalize (stmt);
+        return VARNAM_SUCCESS;
+    }
+
+    while ((rc = sqlite3_step (stmt)) == SQLITE_ROW)
+    {
+        if (n == allocated)
+        {
+            allocated = allocated == 0 ? 8 : allocated * 2;
+            rule = (vrendering_rule*) realloc (loaded, sizeof (vrendering_rule) * (size_t) allocated);
+            if (rule == NULL) {
+                vst_destroy_rendering_rules (loaded, n);
+                sqlite3_finalize (stmt);
+                return VARNAM_MEMORY_ERROR;
+            }
+            loaded = rule;
+        }
+
+        rule = &loaded[n];
+        if (load_rule_text (rule, stmt) != VARNAM_SUCCESS) {
+            vst_destroy_rendering_rules (loaded, n);
+            sqlite3_finalize (stmt);
+            return VARNAM_MEMORY_ERROR;
+        }
+
+        n++;
+        rule->direction = sqlite3_column_int (stmt, 0);
+        rule->token_type = sqlite3_column_int (stmt, 1);
+        rule->previous_type = sqlite3_column_int (stmt, 4);
+        rule->output = sqlite3_column_int (stmt, 6);
+        rule->previous_output = sqlite3_column_int (stmt, 7);
+        rule->tag_id = get_tag_id (rule->tag);
+        rule->previous_tag_id = get_tag_id (rule->previous_tag);
+    }
+
+    if (rc != SQLITE_DONE)
+    {
+        set_last_error (handle, "Failed to load rendering rules : %s", sqlite3_errmsg(db));
+        vst_destroy_rendering_rules (loaded, n);
+        sqlite3_finalize (stmt);
+        return VARNAM_ERROR;
+    }
+
+    sqlite3_finalize (stmt);
+    *rules = loaded;
+    *count = n;
+    return VARNAM_SUCCESS;
+}
+
 int 
 vst_persist_stem_exception(varnam *handle, const char *rule, const char *exception)
 {
@@ -695,7 +1215,7 @@ prepare_tokenization_stmt (varnam *handle, int tokenize_using, int match_type, s
     case VARNAM_TOKENIZER_PATTERN:
         if (v_->tokenize_using_pattern == NULL)
         {
-            rc = sqlite3_prepare_v2( v_->db, "select id, type, match_type, pattern, value1, value2, value3, tag, priority, accept_condition, flags from symbols where pattern = ?1 and match_type = 1;",
+            rc = sqlite3_prepare_v2( v_->db, "select id, type, match_type, pattern, value1, value2, value3, tag, priority, accept_condition, flags from symbols where pattern = ?1 and match_type = 1 order by priority desc, id asc;",
                                      -1, &v_->tokenize_using_pattern, NULL );
             if (rc != SQLITE_OK) {
                 set_last_error (handle, "Failed to tokenize : %s", sqlite3_errmsg(v_->db));
@@ -743,6 +1263,7 @@ static int
 read_all_tokens_and_add_to_array (varnam *handle, const char *lookup, int tokenize_using, int match_type, varray **tokens, bool *tokensAvailable)
 {
     vtoken *tok = 0;
+    vtoken_entry **interned;
     bool initialized = false;
     int rc;
     sqlite3_stmt *stmt = 0;
@@ -751,6 +1272,11 @@ read_all_tokens_and_add_to_array (varnam *handle, const char *lookup, int tokeni
     rc = prepare_tokenization_stmt (handle, tokenize_using, match_type, &stmt);
     if (rc) return rc;
 
+    if (tokenize_using == VARNAM_TOKENIZER_PATTERN)
+        interned = &v_->interned_pattern_tokens;
+    else
+        interned = &v_->interned_value_tokens;
+
     sqlite3_bind_text (stmt, 1, lookup, -1, NULL);
     if (match_type != VARNAM_MATCH_ALL)
     {
@@ -761,18 +1287,25 @@ read_all_tokens_and_add_to_array (varnam *handle, const char *lookup, int tokeni
         rc = sqlite3_step (stmt);
         if (rc == SQLITE_ROW)
         {
-            tok = Token (
-                    sqlite3_column_int( stmt, 0 ),
-                    sqlite3_column_int( stmt, 1 ),
-                    sqlite3_column_int( stmt, 2 ),
-                    (const char*) sqlite3_column_text( stmt, 3 ),
-                    (const char*) sqlite3_column_text( stmt, 4 ),
-                    (const char*) sqlite3_column_text( stmt, 5 ),
-                    (const char*) sqlite3_column_text( stmt, 6 ),
-                    (const char*) sqlite3_column_text( stmt, 7 ),
-                    sqlite3_column_int( stmt, 8 ),
-                    sqlite3_column_int( stmt, 9 ),
-                    sqlite3_column_int( stmt, 10 ));
+            /* Same symbol will be returned for many lookups. It is materialized
+             * only the first time it is seen */
+            tok = find_interned_token (interned, sqlite3_column_int( stmt, 0 ));
+            if (tok == NULL)
+            {
+                tok = Token (
+                        sqlite3_column_int( stmt, 0 ),
+                        sqlite3_column_int( stmt, 1 ),
+                        sqlite3_column_int( stmt, 2 ),
+                        (const char*) sqlite3_column_text( stmt, 3 ),
+                        (const char*) sqlite3_column_text( stmt, 4 ),
+                        (const char*) sqlite3_column_text( stmt, 5 ),
+                        (const char*) sqlite3_column_text( stmt, 6 ),
+                        (const char*) sqlite3_column_text( stmt, 7 ),
+                        sqlite3_column_int( stmt, 8 ),
+                        sqlite3_column_int( stmt, 9 ),
+                        sqlite3_column_int( stmt, 10 ));
+                intern_token (interned, tok);
+            }
             assert (tok);
             if (!initialized) {
                 *tokens = varray_init ();
@@ -807,6 +1340,7 @@ can_find_more_matches(varnam *handle, varray *tokens, struct strbuf *lookup, int
     char candidate[500];
     vtoken *token;
     strbuf *cacheKey;
+    strbuf_sso cacheKeyBuffer;
 
     assert (tokenize_using == VARNAM_TOKENIZER_PATTERN
         || tokenize_using == VARNAM_TOKENIZER_VALUE);
@@ -829,13 +1363,16 @@ can_find_more_matches(varnam *handle, varray *tokens, struct strbuf *lookup, int
         return VARNAM_SUCCESS;
     }
 
-    cacheKey = get_pooled_string (handle);
+    cacheKey = strbuf_sso_init (&cacheKeyBuffer);
     strbuf_addf (cacheKey, "%s%d", strbuf_to_s (lookup), tokenize_using);
     cachedEntry = lru_find_in_cache (&v_->tokenizationPossibility, strbuf_to_s (cacheKey));
     if (cachedEntry) {
+        ++v_->tokenization_possibility_stats.hits;
         *possible = *cachedEntry;
+        strbuf_sso_release (&cacheKeyBuffer);
         return VARNAM_SUCCESS;
     }
+    ++v_->tokenization_possibility_stats.misses;
 
     switch (tokenize_using)
     {
@@ -846,6 +1383,7 @@ can_find_more_matches(varnam *handle, varray *tokens, struct strbuf *lookup, int
                                      -1, &v_->can_find_more_matches_using_pattern, NULL );
             if (rc != SQLITE_OK) {
                 set_last_error (handle, "Failed to prepare query for possible tokens detection : %s", sqlite3_errmsg(v_->db));
+                strbuf_sso_release (&cacheKeyBuffer);
                 return VARNAM_ERROR;
             }
         }
@@ -858,6 +1396,7 @@ can_find_more_matches(varnam *handle, varray *tokens, struct strbuf *lookup, int
                                      -1, &v_->can_find_more_matches_using_value, NULL );
             if (rc != SQLITE_OK) {
                 set_last_error (handle, "Failed to prepare query for possible tokens detection : %s", sqlite3_errmsg(v_->db));
+                strbuf_sso_release (&cacheKeyBuffer);
                 return VARNAM_ERROR;
             }
         }
@@ -880,18 +1419,90 @@ can_find_more_matches(varnam *handle, varray *tokens, struct strbuf *lookup, int
 
     /* caching for future use */
     if (*possible)
-        lru_add_to_cache (&v_->tokenizationPossibility, strbuf_to_s (cacheKey), &possibleToFindMatches, NULL);
+        v_->tokenization_possibility_stats.evictions += lru_add_to_cache (&v_->tokenizationPossibility, strbuf_to_s (cacheKey), &possibleToFindMatches, NULL);
     else
-        lru_add_to_cache (&v_->tokenizationPossibility, strbuf_to_s (cacheKey), &notPossibleToFindMatches, NULL);
+        v_->tokenization_possibility_stats.evictions += lru_add_to_cache (&v_->tokenizationPossibility, strbuf_to_s (cacheKey), &notPossibleToFindMatches, NULL);
 
-    return VARNAM_SUCCESS;;
+    strbuf_sso_release (&cacheKeyBuffer);
+    return VARNAM_SUCCESS;
 }
 
+/* Tokens in the cached array are interned. So only the array is freed */
 static void
 destroy_tokens_cb (void *value)
 {
     varray *array = value;
-    varray_free (array, &destroy_token);
+    varray_free (array, NULL);
+}
+
+/* Interned tokens and the caches built from them are copies of the symbols table. Creating
+ * tokens or flushing them, which rewrites the flags, makes them stale. Tokens are never held
+ * across calls, so they are dropped before the first lookup after the table has changed */
+static void
+refresh_interned_tokens (varnam *handle)
+{
+    int changes = sqlite3_total_changes (v_->db);
+
+    if (changes == v_->interned_symbols_changes)
+        return;
+
+    v_->tokens_cache_stats.evictions += lru_trim_cache (&v_->tokens_cache, 0);
+    v_->no_matches_cache_stats.evictions += lru_trim_cache (&v_->noMatchesCache, 0);
+    v_->tokenization_possibility_stats.evictions += lru_trim_cache (&v_->tokenizationPossibility, 0);
+    destroy_interned_tokens (&v_->interned_pattern_tokens);
+    destroy_interned_tokens (&v_->interned_value_tokens);
+    v_->interned_symbols_changes = changes;
+}
+
+static void
+mark_referenced_token (vtoken_entry **table, vtoken *token)
+{
+    vtoken_entry *entry;
+
+    HASH_FIND_INT (*table, &token->id, entry);
+    if (entry != NULL && entry->token == token)
+        entry->referenced = 1;
+}
+
+static void
+release_unreferenced (vtoken_entry **table)
+{
+    vtoken_entry *entry, *tmp;
+
+    HASH_ITER (hh, *table, entry, tmp)
+    {
+        if (entry->referenced) {
+            entry->referenced = 0;
+            continue;
+        }
+
+        HASH_DEL (*table, entry);
+        destroy_token (entry->token);
+        xfree (entry);
+    }
+}
+
+void
+vst_release_unreferenced_tokens (varnam *handle)
+{
+    int i;
+    vcache_entry *cached, *tmp;
+    varray *tokens;
+    vtoken *token;
+
+    HASH_ITER (hh, v_->tokens_cache, cached, tmp)
+    {
+        tokens = cached->value;
+        for (i = 0; i < varray_length (tokens); i++)
+        {
+            token = varray_get (tokens, i);
+            mark_referenced_token (&v_->interned_pattern_tokens, token);
+            mark_referenced_token (&v_->interned_value_tokens, token);
+        }
+    }
+
+    release_unreferenced (&v_->interned_pattern_tokens);
+    release_unreferenced (&v_->interned_value_tokens);
 }
 
 int
@@ -900,16 +1511,18 @@ vst_tokenize (varnam *handle, const char *input, int tokenize_using, int match_t
     int rc, bytes_read = 0, matchpos = 0;
     const unsigned char *ustring; const char *inputcopy;
     struct strbuf *lookup, *cacheKey;
+    strbuf_sso lookupBuffer, cacheKeyBuffer;
     vtoken *token;
     varray *tokens = NULL, *cachedEntry = NULL, *tmpTokens = NULL;
     bool possibility, tokensAvailable = false;
 
     if (input == NULL || *input == '\0') return VARNAM_SUCCESS;
 
+    refresh_interned_tokens (handle);
     varray_clear (result);
     inputcopy = input;
-    lookup = get_pooled_string (handle);
-    cacheKey = get_pooled_string (handle);
+    lookup = strbuf_sso_init (&lookupBuffer);
+    cacheKey = strbuf_sso_init (&cacheKeyBuffer);
 
     while (*inputcopy != '\0')
     {
@@ -922,41 +1535,46 @@ vst_tokenize (varnam *handle, const char *input, int tokenize_using, int match_t
 
         cachedEntry = lru_find_in_cache (&v_->tokens_cache, strbuf_to_s (cacheKey)); 
         if (cachedEntry != NULL) {
+            ++v_->tokens_cache_stats.hits;
             tokens = get_pooled_array (handle);
             varray_copy (cachedEntry, tokens);
             assert (varray_length (tokens) > 0);
             tokensAvailable = true;
         }
         else if (lru_key_exists (&v_->noMatchesCache, strbuf_to_s (cacheKey))){
+            ++v_->tokens_cache_stats.misses;
+            ++v_->no_matches_cache_stats.hits;
             tokensAvailable = false;
         }
         else {
+            ++v_->tokens_cache_stats.misses;
+            ++v_->no_matches_cache_stats.misses;
             rc = read_all_tokens_and_add_to_array (handle,
                     strbuf_to_s (lookup),
                     tokenize_using,
                     match_type,
                     &tmpTokens, &tokensAvailable);
-            if (rc) return rc;
+            if (rc) goto done;
             if (tokensAvailable) {
                 assert (varray_length (tmpTokens) > 0);
-                lru_add_to_cache (&v_->tokens_cache, strbuf_to_s (cacheKey), tmpTokens, destroy_tokens_cb);
+                v_->tokens_cache_stats.evictions += lru_add_to_cache (&v_->tokens_cache, strbuf_to_s (cacheKey), tmpTokens, destroy_tokens_cb);
                 tokens = get_pooled_array (handle);
                 varray_copy (tmpTokens, tokens);
             }
             else {
                 /* this caching speeds up lookup which are not exists */
-                lru_add_to_cache (&v_->noMatchesCache, strbuf_to_s (cacheKey), NULL, NULL);
+                v_->no_matches_cache_stats.evictions += lru_add_to_cache (&v_->noMatchesCache, strbuf_to_s (cacheKey), NULL, NULL);
             }
         }
 
         if (tokensAvailable) {
             matchpos = bytes_read;
             rc = can_find_more_matches (handle, tokens, lookup, tokenize_using, &possibility);
-            if (rc) return rc;
+            if (rc) goto done;
         }
         else {
             rc = can_find_more_matches (handle, NULL, lookup, tokenize_using, &possibility);
-            if (rc) return rc;
+            if (rc) goto done;
         }
 
         if (tokens == NULL || varray_is_empty (tokens))
@@ -984,7 +1602,12 @@ vst_tokenize (varnam *handle, const char *input, int tokenize_using, int match_t
         inputcopy = input;
     }
 
-    return VARNAM_SUCCESS;
+    rc = VARNAM_SUCCESS;
+
+done:
+    strbuf_sso_release (&lookupBuffer);
+    strbuf_sso_release (&cacheKeyBuffer);
+    return rc;
 }
 
 int
@@ -1030,6 +1653,7 @@ vst_get_last_syllable (varnam *handle, strbuf *string, strbuf *syllable)
     sqlite3_stmt *stmt;
     const char *sql = "select type from symbols where value1 = ?1";
     strbuf *temp;
+    strbuf_sso tempBuffer;
 
     db = handle->internal->db;
 
@@ -1045,7 +1669,7 @@ vst_get_last_syllable (varnam *handle, strbuf *string, strbuf *syllable)
     }
     
     stmt = v_->get_last_syllable;
-    temp = get_pooled_string(handle);
+    temp = strbuf_sso_init(&tempBuffer);
     strbuf_clear(syllable);
 
     while(!flag)
@@ -1057,6 +1681,7 @@ vst_get_last_syllable (varnam *handle, strbuf *string, strbuf *syllable)
             strbuf_clear(string);
             strbuf_add(string, strbuf_to_s(syllable));
             set_last_error(handle, "ending is null");
+            strbuf_sso_release(&tempBuffer);
             return VARNAM_ERROR;
         }
 
@@ -1080,6 +1705,7 @@ vst_get_last_syllable (varnam *handle, strbuf *string, strbuf *syllable)
             set_last_error (handle, "Failed : %s", sqlite3_errmsg(db));
             sqlite3_reset (stmt);
             free(ending);
+            strbuf_sso_release(&tempBuffer);
             return VARNAM_ERROR;
         }
 
@@ -1093,6 +1719,7 @@ vst_get_last_syllable (varnam *handle, strbuf *string, strbuf *syllable)
         {
             free(ending);
             set_last_error(handle, "vst_get_last_syllable : could not remove last character");
+            strbuf_sso_release(&tempBuffer);
             return VARNAM_ERROR;
         }
 
@@ -1102,6 +1729,7 @@ vst_get_last_syllable (varnam *handle, strbuf *string, strbuf *syllable)
 
     /*Restoring the string*/
     strbuf_add(string, strbuf_to_s(syllable));
+    strbuf_sso_release(&tempBuffer);
    
     return VARNAM_SUCCESS;
 }
@@ -1112,23 +1740,23 @@ vst_get_stem(varnam* handle, strbuf* old_ending, strbuf *new_ending)
     sqlite3 *db;
     sqlite3_stmt *stmt;
     strbuf *cachedEntry=NULL;
-    strbuf *cacheKey=NULL;
     strbuf *val_buf=NULL;
     int rc;
     const char *sql="select new_ending from stemrules where old_ending = ?1;";
 
     db = handle->internal->db;
 
-    cacheKey = get_pooled_string (handle);
-    strbuf_addf (cacheKey, "%s", strbuf_to_s (old_ending));
-    cachedEntry = lru_find_in_cache(&v_->cached_stems, strbuf_to_s(cacheKey));
+    cachedEntry = lru_find_in_cache(&v_->cached_stems, strbuf_to_s(old_ending));
     if(cachedEntry != NULL)
     {
+        ++v_->cached_stems_stats.hits;
         strbuf_clear(new_ending);
         strbuf_add(new_ending, strbuf_to_s(cachedEntry));
         return VARNAM_STEMRULE_HIT;
     }
 
+    ++v_->cached_stems_stats.misses;
+
     if(v_->get_stemrule == NULL)
     {
         rc = sqlite3_prepare_v2(db, sql, -1, &v_->get_stemrule, NULL);
@@ -1155,7 +1783,7 @@ vst_get_stem(varnam* handle, strbuf* old_ending, strbuf *new_ending)
         val_buf = strbuf_init(8);
         strbuf_add(val_buf, strbuf_to_s(new_ending));
 
-        lru_add_to_cache(&v_->cached_stems, (const char*)strbuf_to_s(old_ending), val_buf, strbuf_destroy);
+        v_->cached_stems_stats.evictions += lru_add_to_cache(&v_->cached_stems, (const char*)strbuf_to_s(old_ending), val_buf, strbuf_destroy);
         return VARNAM_STEMRULE_HIT;
     }
     else if(rc == SQLITE_DONE)
@@ -1251,13 +1879,13 @@ vst_stamp_version (varnam *handle)
     sql = strbuf_init (30);
     strbuf_addf (sql, "PRAGMA user_version=%d;", VARNAM_SCHEMA_SYMBOLS_VERSION);
     rc = sqlite3_exec(v_->db, strbuf_to_s (sql), NULL, 0, &zErrMsg);
+    strbuf_destroy (sql);
     if( rc != SQLITE_OK ){
         set_last_error (handle, "Failed to stamp schema version : %s", zErrMsg);
         sqlite3_free(zErrMsg);
         return VARNAM_STORAGE_ERROR;
     }
 
-    strbuf_destroy (sql);
     return VARNAM_SUCCESS;
 }
 
@@ -1292,3 +1920,24 @@ destroy_all_statements(struct varnam_internal* v)
     sqlite3_finalize (v->persist_stemrule);
     sqlite3_finalize (v->persist_stem_exception);
 }
+
+int
+vst_get_symbols_count(varnam *handle, int *count)
+{
+    int rc;
+    sqlite3_stmt *stmt;
+
+    *count = 0;
+    rc = sqlite3_prepare_v2 (v_->db, "select count(*) from symbols;", -1, &stmt, NULL);
+    if (rc != SQLITE_OK) {
+        set_last_error (handle, "Failed to get symbols count : %s", sqlite3_errmsg(v_->db));
+        return VARNAM_ERROR;
+    }
+
+    rc = sqlite3_step (stmt);
+    if (rc == SQLITE_ROW)
+        *count = sqlite3_column_int (stmt, 0);
+
+    sqlite3_finalize (stmt);
+    return VARNAM_SUCCESS;
+}
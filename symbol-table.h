@@ -14,10 +14,11 @@
 #include "varray.h"
 
 /**
- * checks the schema availability. this function will create it when necessary
+ * checks the schema availability. this function will create it when necessary.
+ * flags are the ones the symbols file is opened with
  **/
 int
-ensure_schema_exists(varnam *handle, char **msg);
+ensure_schema_exists(varnam *handle, int flags, char **msg);
 
 /**
  * Starts buffering
@@ -41,12 +42,56 @@ vst_persist_token(
     int priority,
     int accept_condition);
 
+/* Creates tokens in bulk. Begin should be called while buffering. It drops the indexes on
+ * symbols and finish builds them again. Destroy releases the bulk in either case. Tokens are
+ * persisted like vst_persist_token() does */
+typedef struct vst_bulk_t vst_bulk;
+
+int
+vst_bulk_begin(varnam *handle, vst_bulk **bulk);
+
+int
+vst_bulk_persist_token(
+    varnam *handle,
+    vst_bulk *bulk,
+    const char *pattern,
+    const char *value1,
+    const char *value2,
+    const char *value3,
+    const char *tag,
+    int token_type,
+    int match_type,
+    int priority,
+    int accept_condition);
+
+int
+vst_bulk_finish(varnam *handle, vst_bulk *bulk);
+
+/* Rolls back the changes made since vst_bulk_begin(). Call it after destroying a bulk which
+ * failed to finish */
+int
+vst_bulk_discard_changes(varnam *handle);
+
+void
+vst_bulk_destroy(vst_bulk *bulk);
+
 int
 vst_persist_stemrule(varnam *handle, const char* old_ending, const char* new_ending);
 
 int 
 vst_persist_stem_exception(varnam *handle, const char *rule, const char *exception);
 
+int
+vst_persist_rendering_rule(varnam *handle, vrendering_rule *rule);
+
+/* Reads all the rendering rules in the order they were created. Symbols files
+   compiled before rendering rules were supported have none */
+int
+vst_load_rendering_rules(varnam *handle, vrendering_rule **rules, int *count);
+
+void
+vst_destroy_rendering_rules(vrendering_rule *rules, int count);
+
 /**
  * Flushes changes to disk
  **/
@@ -89,6 +134,10 @@ destroy_all_statements(struct varnam_internal* vi);
 int
 vst_make_prefix_tree (varnam *handle);
 
+/* Releases the interned tokens which are not in the tokens cache. Called after the cache is trimmed */
+void
+vst_release_unreferenced_tokens (varnam *handle);
+
 int
 vst_has_stemrules (varnam *handle);
 
@@ -107,4 +156,7 @@ vst_stamp_version (varnam *handle);
 int
 vst_load_scheme_details(varnam *handle, vscheme_details *output);
 
+int
+vst_get_symbols_count(varnam *handle, int *count);
+
 #endif
@@ -148,6 +148,220 @@ START_TEST (initialize_using_lang_code)
 }
 END_TEST
 
+START_TEST (handle_pool_checkout_and_checkin)
+{
+  int rc;
+  char *errMsg = NULL;
+  varnam_pool *pool;
+  varnam *first, *second, *third;
+  varnam_pool_stats stats;
+  varray *words;
+  strbuf *metrics;
+  vinfo *info;
+
+  rc = varnam_pool_create ("ml", 2, &pool, &errMsg);
+  assert_success (rc);
+
+  rc = varnam_pool_checkout (pool, 0, &first);
+  assert_success (rc);
+  rc = varnam_pool_checkout (pool, 0, &second);
+  assert_success (rc);
+  ck_assert (first != second);
+  ck_assert_str_eq (varnam_get_scheme_file (first), varnam_get_scheme_file (second));
+
+  /* handles are warmed up when the pool is created */
+  rc = varnam_get_info (second, false, &info);
+  assert_success (rc);
+  ck_assert (info->interned_tokens > 0);
+  free (info);
+
+  /* and can't change the symbols file */
+  rc = varnam_create_stemrule (second, "ം", "ത്തിൽ");
+  ck_assert_int_ne (rc, VARNAM_SUCCESS);
+
+  rc = varnam_transliterate (second, "varnam", &words);
+  assert_success (rc);
+
+  /* pool is exhausted */
+  rc = varnam_pool_checkout (pool, 10, &third);
+  ck_assert_int_eq (rc, VARNAM_TIMEOUT);
+  ck_assert (third == NULL);
+
+  assert_success (varnam_pool_checkin (pool, first));
+  ck_assert_int_eq (varnam_pool_checkin (pool, first), VARNAM_ARGS_ERROR);
+
+  rc = varnam_pool_checkout (pool, -1, &third);
+  assert_success (rc);
+  ck_assert (third == first);
+
+  rc = varnam_pool_get_stats (pool, &stats);
+  assert_success (rc);
+  ck_assert_int_eq (stats.size, 2);
+  ck_assert_int_eq (stats.available, 0);
+  ck_assert_int_eq (stats.checkouts, 3);
+  ck_assert_int_eq (stats.waits, 1);
+  ck_assert_int_eq (stats.timeouts, 1);
+  ck_assert (stats.wait_time_max_us > 0);
+
+  /* Counters of the handles in use are added up too */
+  metrics = strbuf_init (1024);
+  assert_success (varnam_pool_metrics_render (pool, metrics));
+  ck_assert (strstr (strbuf_to_s (metrics), "varnam_handles 2\n") != NULL);
+  ck_assert (strstr (strbuf_to_s (metrics), "varnam_calls_total{function=\"varnam_transliterate\"} 1\n") != NULL);
+  ck_assert (strstr (strbuf_to_s (metrics), "varnam_pool_available 0\n") != NULL);
+  ck_assert (strstr (strbuf_to_s (metrics), "varnam_pool_timeouts_total 1\n") != NULL);
+
+  assert_success (varnam_pool_checkin (pool, second));
+  assert_success (varnam_pool_checkin (pool, third));
+
+  strbuf_clear (metrics);
+  assert_success (varnam_pool_metrics_render (pool, metrics));
+  ck_assert (strstr (strbuf_to_s (metrics), "varnam_pool_available 2\n") != NULL);
+  ck_assert (strstr (strbuf_to_s (metrics), "varnam_instance_pool_objects{pool=\"arrays\"} 0\n") == NULL);
+  strbuf_destroy (metrics);
+
+  varnam_pool_destroy (pool);
+}
+END_TEST
+
+static void
+assert_transliterates_like_default (int flags)
+{
+  int rc;
+  char *msg = NULL;
+  varnam *handle, *expected_handle;
+  varray *words, *expected;
+  vword *word;
+
+  rc = varnam_init ("../schemes/ml.vst", &expected_handle, &msg);
+  assert_success (rc);
+  rc = varnam_init_with_flags ("../schemes/ml.vst", flags, &handle, &msg);
+  assert_success (rc);
+
+  rc = varnam_transliterate (expected_handle, "malayalam", &expected);
+  assert_success (rc);
+  rc = varnam_transliterate (handle, "malayalam", &words);
+  assert_success (rc);
+  ck_assert_int_eq (varray_length (words), varray_length (expected));
+  word = varray_get (words, 0);
+  ck_assert_str_eq (word->text, ((vword*) varray_get (expected, 0))->text);
+
+  if (flags & VARNAM_OPEN_READONLY) {
+    rc = varnam_create_stemrule (handle, "ം", "ത്തിൽ");
+    ck_assert_int_ne (rc, VARNAM_SUCCESS);
+  }
+
+  varnam_destroy (handle);
+  varnam_destroy (expected_handle);
+}
+
+START_TEST (init_readonly_and_in_memory)
+{
+  assert_transliterates_like_default (VARNAM_OPEN_READONLY);
+  assert_transliterates_like_default (VARNAM_OPEN_IN_MEMORY);
+}
+END_TEST
+
+START_TEST (init_readonly_and_in_memory_failures)
+{
+  int rc;
+  char *msg = NULL;
+  varnam *handle;
+
+  rc = varnam_init_with_flags ("output/nonexistent.vst", VARNAM_OPEN_IN_MEMORY, &handle, &msg);
+  ck_assert_int_eq (rc, VARNAM_STORAGE_ERROR);
+  ck_assert (msg != NULL);
+  ck_assert (strstr (msg, "not an error") == NULL);
+  free (msg);
+
+  /* a file which has never been compiled isn't stamped */
+  remove ("output/unstamped.vst");
+  rc = varnam_init ("output/unstamped.vst", &handle, &msg);
+  assert_success (rc);
+  varnam_destroy (handle);
+
+  msg = NULL;
+  rc = varnam_init_with_flags ("output/unstamped.vst", VARNAM_OPEN_READONLY, &handle, &msg);
+  ck_assert_int_eq (rc, VARNAM_STORAGE_ERROR);
+  ck_assert (handle == NULL);
+  ck_assert (msg != NULL);
+  ck_assert (strstr (msg, "not a compiled symbols file") != NULL);
+  free (msg);
+}
+END_TEST
+
+START_TEST (registry_opens_schemes_lazily)
+{
+  int rc, exitcode;
+  char *errMsg = NULL;
+  varnam_registry *registry;
+  varnam *first, *second, *again;
+  varray *schemes, *words;
+  vscheme_entry *scheme;
+
+  exitcode = system ("rm -rf output/registry && mkdir -p output/registry && "
+                     "cp ../schemes/ml.vst output/registry/ml.vst && cp ../schemes/ml.vst output/registry/ml-copy.vst");
+  ck_assert_int_eq (exitcode, 0);
+
+  rc = varnam_registry_create ("output/registry", 1, &registry);
+  assert_success (rc);
+
+  rc = varnam_registry_get_schemes (registry, &schemes);
+  assert_success (rc);
+  ck_assert_int_eq (varray_length (schemes), 2);
+  scheme = varray_get (schemes, 0);
+  ck_assert_str_eq (scheme->identifier, "ml");
+  ck_assert_str_eq (scheme->langCode, "ml");
+  ck_assert_int_eq (scheme->schemaVersion, VARNAM_SCHEMA_SYMBOLS_VERSION);
+  ck_assert_int_eq (scheme->isOpen, 0);
+  scheme = varray_get (schemes, 1);
+  ck_assert_str_eq (scheme->identifier, "ml-copy");
+  varray_free (schemes, NULL);
+
+  rc = varnam_registry_get_handle (registry, "ml", &first, &errMsg);
+  assert_success (rc);
+  rc = varnam_registry_get_handle (registry, "ml", &again, &errMsg);
+  assert_success (rc);
+  ck_assert (first == again);
+  assert_success (varnam_registry_release_handle (registry, first));
+  assert_success (varnam_registry_release_handle (registry, again));
+  ck_assert_int_eq (varnam_registry_release_handle (registry, first), VARNAM_ARGS_ERROR);
+
+  /* only one handle is kept open and "ml" is released, so this closes "ml" */
+  rc = varnam_registry_get_handle (registry, "ml-copy", &second, &errMsg);
+  assert_success (rc);
+  ck_assert (second != NULL);
+
+  rc = varnam_registry_get_schemes (registry, &schemes);
+  assert_success (rc);
+  ck_assert_int_eq (((vscheme_entry*) varray_get (schemes, 0))->isOpen, 0);
+  ck_assert_int_eq (((vscheme_entry*) varray_get (schemes, 1))->isOpen, 1);
+  varray_free (schemes, NULL);
+
+  /* "ml-copy" is held, so it stays open along with "ml" */
+  rc = varnam_registry_get_handle (registry, "ml", &first, &errMsg);
+  assert_success (rc);
+  rc = varnam_transliterate (second, "a", &words);
+  assert_success (rc);
+
+  /* releasing brings the open handles back to one */
+  assert_success (varnam_registry_release_handle (registry, second));
+  rc = varnam_registry_get_schemes (registry, &schemes);
+  assert_success (rc);
+  ck_assert_int_eq (((vscheme_entry*) varray_get (schemes, 0))->isOpen, 1);
+  ck_assert_int_eq (((vscheme_entry*) varray_get (schemes, 1))->isOpen, 0);
+  varray_free (schemes, NULL);
+  assert_success (varnam_registry_release_handle (registry, first));
+
+  rc = varnam_registry_get_handle (registry, "xx", &again, &errMsg);
+  ck_assert_int_eq (rc, VARNAM_ERROR);
+  ck_assert (errMsg != NULL);
+  free (errMsg);
+
+  varnam_registry_destroy (registry);
+}
+END_TEST
+
 START_TEST (initialize_using_lang_code_custom_symbols_dir)
 {
   int rc;
@@ -261,6 +475,10 @@ TCase* get_initialization_tests()
     tcase_add_test (tcase, enable_suggestions);
     tcase_add_test (tcase, normal_init);
     tcase_add_test (tcase, initialize_using_lang_code);
+    tcase_add_test (tcase, handle_pool_checkout_and_checkin);
+    tcase_add_test (tcase, registry_opens_schemes_lazily);
+    tcase_add_test (tcase, init_readonly_and_in_memory);
+    tcase_add_test (tcase, init_readonly_and_in_memory_failures);
     tcase_add_test (tcase, initialize_using_lang_code_custom_symbols_dir);
     tcase_add_test (tcase, initialize_using_invalid_lang_code);
     tcase_add_test (tcase, initialize_on_writeprotected_location);
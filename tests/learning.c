@@ -74,6 +74,25 @@ START_TEST (words_with_unknown_letters_should_be_rejected)
 }
 END_TEST
 
+START_TEST (words_with_invalid_encoding_should_be_rejected)
+{
+    int rc;
+
+    /* Encoding is checked in blocks. These have the bad byte after the first block */
+    rc = varnam_learn (varnam_instance, "kakhakhakhakhakhakha\x7f");
+    ck_assert_int_eq (rc, VARNAM_ERROR);
+    ck_assert_str_eq (varnam_get_last_error (varnam_instance), "Incorrect encoding. Expected UTF-8 string");
+
+    rc = varnam_learn (varnam_instance, "kakhakhakhakhakhakha\xb4");
+    ck_assert_int_eq (rc, VARNAM_ERROR);
+    ck_assert_str_eq (varnam_get_last_error (varnam_instance), "Incorrect encoding. Expected UTF-8 string");
+
+    rc = varnam_learn (varnam_instance, "കഖകഖകഖ\xe0\xb4");
+    ck_assert_int_eq (rc, VARNAM_ERROR);
+    ck_assert_str_eq (varnam_get_last_error (varnam_instance), "Incorrect encoding. Expected UTF-8 string");
+}
+END_TEST
+
 START_TEST (basic_learning)
 {
     int rc;
@@ -113,6 +132,86 @@ START_TEST (confidence_should_get_updated_for_existing_words)
 }
 END_TEST
 
+START_TEST (transliteration_candidates_are_deduplicated_and_capped)
+{
+    int rc;
+    varray* words;
+    vword* word;
+
+    rc = varnam_learn (varnam_instance, "കഖ");
+    assert_success (rc);
+
+    /* learned word and the symbols result are same */
+    rc = varnam_transliterate (varnam_instance, "kakha", &words);
+    assert_success (rc);
+    ck_assert_int_eq (varray_length (words), 1);
+
+    rc = varnam_config (varnam_instance, VARNAM_CONFIG_MAX_CANDIDATES, 1);
+    assert_success (rc);
+
+    rc = varnam_transliterate (varnam_instance, "kagha", &words);
+    assert_success (rc);
+    ck_assert_int_eq (varray_length (words), 1);
+    word = varray_get (words, 0);
+    ck_assert_str_eq (word->text, "കഖ");
+
+    rc = varnam_config (varnam_instance, VARNAM_CONFIG_MAX_CANDIDATES, -1);
+    ck_assert_int_eq (rc, VARNAM_ARGS_ERROR);
+}
+END_TEST
+
+START_TEST (words_tokenizer_candidates_sharing_a_prefix)
+{
+    int rc;
+    varray* words;
+    vword* word;
+
+    rc = varnam_learn (varnam_instance, "കാ");
+    assert_success (rc);
+    rc = varnam_learn (varnam_instance, "കഅ");
+    assert_success (rc);
+
+    /* Both words match 'kaa' and start with the same token. Each of them
+     * should be rendered on its own after the common part */
+    rc = varnam_transliterate (varnam_instance, "kaakha", &words);
+    assert_success (rc);
+    ck_assert_int_eq (varray_length (words), 2);
+    word = varray_get (words, 0);
+    ck_assert_str_eq (word->text, "കാഖ");
+    word = varray_get (words, 1);
+    ck_assert_str_eq (word->text, "കഖ");
+}
+END_TEST
+
+START_TEST (transliteration_reads_learnings_while_a_write_is_pending)
+{
+    int rc;
+    varray* words;
+    vword* word;
+    sqlite3 *writer;
+
+    rc = varnam_learn (varnam_instance, "കഖ");
+    assert_success (rc);
+    ck_assert (varnam_instance->internal->known_words_reader != NULL);
+
+    rc = varnam_config (varnam_instance, VARNAM_CONFIG_MAX_CANDIDATES, 1);
+    assert_success (rc);
+
+    /* uncommitted changes are not visible while transliterating */
+    writer = varnam_instance->internal->known_words;
+    rc = sqlite3_exec (writer, "BEGIN IMMEDIATE; delete from patterns_content; delete from words;", NULL, NULL, NULL);
+    ck_assert_int_eq (rc, SQLITE_OK);
+
+    rc = varnam_transliterate (varnam_instance, "kagha", &words);
+    assert_success (rc);
+    word = varray_get (words, 0);
+    ck_assert_str_eq (word->text, "കഖ");
+
+    rc = sqlite3_exec (writer, "ROLLBACK;", NULL, NULL, NULL);
+    ck_assert_int_eq (rc, SQLITE_OK);
+}
+END_TEST
+
 START_TEST (words_with_repeating_characters_will_not_be_learned)
 {
     int rc;
@@ -190,10 +289,14 @@ TCase* get_learning_tests()
     tcase_add_checked_fixture (tcase, enable_suggestions, NULL);
     tcase_add_test (tcase, starting_and_trailing_special_chars_should_be_removed);
     tcase_add_test (tcase, words_with_unknown_letters_should_be_rejected);
+    tcase_add_test (tcase, words_with_invalid_encoding_should_be_rejected);
     tcase_add_test (tcase, basic_learning);
     tcase_add_test (tcase, words_with_repeating_characters_will_not_be_learned);
     tcase_add_test (tcase, numbers_will_be_ignored_while_learning);
     tcase_add_test (tcase, confidence_should_get_updated_for_existing_words);
+    tcase_add_test (tcase, transliteration_candidates_are_deduplicated_and_capped);
+    tcase_add_test (tcase, transliteration_reads_learnings_while_a_write_is_pending);
+    tcase_add_test (tcase, words_tokenizer_candidates_sharing_a_prefix);
     tcase_add_test (tcase, is_known_word);
     tcase_add_test (tcase, learn_from_multiple_open_handles);
     return tcase;
@@ -22,7 +22,7 @@ setup_test_data()
 	char *filename = get_unique_filename();
 
 	reinitialize_varnam_instance(filename);
-	ensure_schema_exists(varnam_instance, msg);
+	ensure_schema_exists(varnam_instance, 0, msg);
 }
 
 int
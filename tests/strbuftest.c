@@ -152,6 +152,30 @@ START_TEST (get_each_character_should_be_unicode_aware)
 }
 END_TEST
 
+START_TEST (sso_string_spills_to_heap_when_inline_buffer_is_full)
+{
+    int i;
+    strbuf_sso sso;
+    strbuf *string = strbuf_sso_init (&sso);
+
+    strbuf_add (string, "മലയാളം");
+    ck_assert_str_eq ("മലയാളം", strbuf_to_s (string));
+    ck_assert (strbuf_to_s (string) == sso.inline_buffer);
+
+    for (i = 0; i < VARNAM_SSO_SIZE; i++)
+        strbuf_addc (string, 'a');
+
+    ck_assert (strbuf_to_s (string) != sso.inline_buffer);
+    ck_assert_int_eq (strlen ("മലയാളം") + VARNAM_SSO_SIZE, string->length);
+    ck_assert (strbuf_endswith (string, "aaaa"));
+    ck_assert (strncmp ("മലയാളം", strbuf_to_s (string), strlen ("മലയാളം")) == 0);
+
+    strbuf_sso_release (&sso);
+    ck_assert (strbuf_to_s (string) == sso.inline_buffer);
+    ck_assert_int_eq (0, string->length);
+}
+END_TEST
+
 TCase* get_strbuf_tests()
 {
     TCase* tcase = tcase_create("strbuf");
@@ -165,5 +189,6 @@ TCase* get_strbuf_tests()
     tcase_add_test (tcase, addfln_should_add_newline);
     tcase_add_test (tcase, get_each_character);
     tcase_add_test (tcase, get_each_character_should_be_unicode_aware);
+    tcase_add_test (tcase, sso_string_spills_to_heap_when_inline_buffer_is_full);
     return tcase;
 }
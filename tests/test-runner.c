@@ -54,6 +54,7 @@ int main(int argc, char **argv)
 
     commandline = suite_create ("commandline");
     suite_add_tcase (commandline, get_varnamc_tests());
+    suite_add_tcase (commandline, get_varnamd_tests());
 
     runner = srunner_create (suite);
     srunner_add_suite (runner, util);
@@ -59,5 +59,6 @@ TCase* get_export_tests();
 TCase* get_token_creation_tests();
 TCase* get_varnamc_tests();
 TCase* get_stemmer_tests();
+TCase* get_varnamd_tests();
 
 #endif
@@ -6,7 +6,11 @@
 
 
 #include <check.h>
+#include <stdlib.h>
+#include <string.h>
 #include "testcases.h"
+#include "../token.h"
+#include "../varray.h"
 
 static void 
 setup_data()
@@ -114,6 +118,756 @@ START_TEST (indic_digit_rendering)
 }
 END_TEST
 
+START_TEST (transliteration_with_pool_high_water_mark)
+{
+    int rc, i;
+    vword* word;
+    varray *words;
+
+    rc = varnam_config (varnam_instance, VARNAM_CONFIG_POOL_HIGH_WATER_MARK, 1);
+    assert_success (rc);
+
+    for (i = 0; i < 3; i++)
+    {
+        rc = varnam_transliterate (varnam_instance, "aek", &words);
+        assert_success (rc);
+        ck_assert_int_eq (varray_length (words), 1);
+        word = varray_get (words, 0);
+        ck_assert_str_eq (word->text, "a-value1e-value2k-value1");
+    }
+
+    rc = varnam_config (varnam_instance, VARNAM_CONFIG_POOL_HIGH_WATER_MARK, -1);
+    ck_assert_int_eq (rc, VARNAM_ARGS_ERROR);
+}
+END_TEST
+
+START_TEST (transliteration_into_caller_buffer)
+{
+    int rc;
+    char buf[100];
+    vword_span spans[5];
+    size_t count, required;
+
+    rc = varnam_transliterate_into (varnam_instance, "aek", buf, sizeof (buf), spans, 5, &count, &required);
+    assert_success (rc);
+    ck_assert_int_eq (count, 1);
+    ck_assert_str_eq (spans[0].text, "a-value1e-value2k-value1");
+    ck_assert_int_eq (spans[0].length, strlen ("a-value1e-value2k-value1"));
+    ck_assert_int_eq (required, strlen ("a-value1e-value2k-value1") + 1);
+
+    /* result should outlive the next call on the handle */
+    rc = varnam_transliterate_into (varnam_instance, "aaa", buf + 50, 50, spans + 1, 4, &count, NULL);
+    assert_success (rc);
+    ck_assert_str_eq (spans[0].text, "a-value1e-value2k-value1");
+    ck_assert_str_eq (spans[1].text, "aa-value1a-value2");
+
+    /* sizes needed are reported, so that the buffers can be allocated once */
+    rc = varnam_transliterate_into (varnam_instance, "aek", buf, 10, spans, 5, &count, &required);
+    ck_assert_int_eq (rc, VARNAM_TRUNCATED);
+    ck_assert_int_eq (count, 1);
+    ck_assert (spans[0].text == NULL);
+    ck_assert_int_eq (required, strlen ("a-value1e-value2k-value1") + 1);
+
+    rc = varnam_transliterate_into (varnam_instance, "aek", buf, required, spans, count, &count, &required);
+    assert_success (rc);
+    ck_assert_str_eq (spans[0].text, "a-value1e-value2k-value1");
+
+    rc = varnam_transliterate_into (varnam_instance, "aek", NULL, 0, NULL, 0, &count, &required);
+    ck_assert_int_eq (rc, VARNAM_TRUNCATED);
+    ck_assert_int_eq (count, 1);
+    ck_assert_int_eq (required, strlen ("a-value1e-value2k-value1") + 1);
+}
+END_TEST
+
+START_TEST (transliterate_text_with_words_memo)
+{
+    int rc;
+    vtext_segment *segments;
+    size_t count;
+    long evictions;
+    vinfo *info;
+
+    rc = varnam_transliterate_text (varnam_instance, "aek, aaa aek\n", VARNAM_TEXT_BEST_CANDIDATE, &segments, &count);
+    assert_success (rc);
+    ck_assert_int_eq ((int) count, 6);
+
+    ck_assert_str_eq (segments[0].text, "aek");
+    ck_assert_int_eq (segments[0].transliterated, 1);
+    ck_assert_int_eq (segments[0].count, 1);
+    ck_assert_str_eq (segments[0].words[0].text, "a-value1e-value2k-value1");
+
+    ck_assert_str_eq (segments[1].text, ", ");
+    ck_assert_int_eq (segments[1].transliterated, 0);
+    ck_assert_str_eq (segments[1].words[0].text, ", ");
+
+    ck_assert_str_eq (segments[2].words[0].text, "aa-value1a-value2");
+    ck_assert_str_eq (segments[4].words[0].text, "a-value1e-value2k-value1");
+    ck_assert_str_eq (segments[5].text, "\n");
+
+    /* second 'aek' is served from the memo */
+    rc = varnam_get_info (varnam_instance, true, &info);
+    assert_success (rc);
+    ck_assert_int_eq (info->words_memo.entries, 2);
+    ck_assert (info->words_memo.hit_ratio > 0.33 && info->words_memo.hit_ratio < 0.34);
+    /* bytes include the remembered words */
+    ck_assert (info->words_memo.bytes >= 2 * (sizeof (vcache_entry) + sizeof (memo_words) + sizeof (int)) +
+               strlen ("aek") + strlen ("aaa") + 2 +
+               strlen ("a-value1e-value2k-value1") + strlen ("aa-value1a-value2") + 2);
+    evictions = info->words_memo.evictions;
+    free (info);
+
+    /* memo is forgotten when the symbols change */
+    rc = varnam_create_token (varnam_instance, "kk", "kk-value1", "", "", "",
+            VARNAM_TOKEN_CONSONANT, VARNAM_MATCH_EXACT, 0, 0, 0);
+    assert_success (rc);
+
+    rc = varnam_transliterate_text (varnam_instance, "aek", VARNAM_TEXT_ALL_CANDIDATES, &segments, &count);
+    assert_success (rc);
+    ck_assert_int_eq ((int) count, 1);
+    ck_assert_str_eq (segments[0].words[0].text, "a-value1e-value2k-value1");
+
+    rc = varnam_get_info (varnam_instance, false, &info);
+    assert_success (rc);
+    ck_assert_int_eq (info->words_memo.entries, 1);
+    ck_assert (info->words_memo.hit_ratio > 0.24 && info->words_memo.hit_ratio < 0.26);
+    /* forgotten words are counted as evicted */
+    ck_assert_int_eq (info->words_memo.evictions, evictions + 2);
+    free (info);
+
+    /* configuration which doesn't change the words keeps the memo */
+    rc = varnam_config (varnam_instance, VARNAM_CONFIG_ENABLE_TRACING, 1);
+    assert_success (rc);
+    rc = varnam_config (varnam_instance, VARNAM_CONFIG_POOL_HIGH_WATER_MARK, 1024);
+    assert_success (rc);
+    rc = varnam_config (varnam_instance, VARNAM_CONFIG_USE_INDIC_DIGITS, 0);
+    assert_success (rc);
+    rc = varnam_get_info (varnam_instance, false, &info);
+    assert_success (rc);
+    ck_assert_int_eq (info->words_memo.entries, 1);
+    free (info);
+
+    rc = varnam_config (varnam_instance, VARNAM_CONFIG_USE_INDIC_DIGITS, 1);
+    assert_success (rc);
+    rc = varnam_get_info (varnam_instance, false, &info);
+    assert_success (rc);
+    ck_assert_int_eq (info->words_memo.entries, 0);
+    free (info);
+
+    rc = varnam_transliterate_text (varnam_instance, "aek", 5, &segments, &count);
+    ck_assert_int_eq (rc, VARNAM_ARGS_ERROR);
+}
+END_TEST
+
+START_TEST (reverse_transliteration_into_caller_buffer)
+{
+    int rc;
+    char buf[100];
+    size_t length;
+
+    rc = varnam_reverse_transliterate_into (varnam_instance, "a-value1k-value1", buf, sizeof (buf), &length);
+    assert_success (rc);
+    ck_assert_str_eq (buf, "ak");
+    ck_assert_int_eq (length, 2);
+
+    rc = varnam_reverse_transliterate_into (varnam_instance, "a-value1k-value1", buf, 2, &length);
+    ck_assert_int_eq (rc, VARNAM_TRUNCATED);
+    ck_assert_int_eq (length, 2);
+    ck_assert_str_eq (buf, "a");
+
+    rc = varnam_reverse_transliterate_into (varnam_instance, "a-value1k-value1", buf, 3, &length);
+    assert_success (rc);
+    ck_assert_str_eq (buf, "ak");
+
+    rc = varnam_reverse_transliterate_into (varnam_instance, "a-value1k-value1", NULL, 0, &length);
+    ck_assert_int_eq (rc, VARNAM_TRUNCATED);
+    ck_assert_int_eq (length, 2);
+}
+END_TEST
+
+START_TEST (reverse_transliterate_text_with_memo)
+{
+    int rc;
+    strbuf *output;
+    vinfo *info;
+
+    rc = varnam_create_token (varnam_instance, "ka", "ക", "", "", "",
+            VARNAM_TOKEN_CONSONANT, VARNAM_MATCH_EXACT, 0, 0, 0);
+    assert_success (rc);
+    rc = varnam_create_token (varnam_instance, "kha", "ഖ", "", "", "",
+            VARNAM_TOKEN_CONSONANT, VARNAM_MATCH_EXACT, 0, 0, 0);
+    assert_success (rc);
+
+    output = strbuf_init (8);
+    rc = varnam_reverse_transliterate_text (varnam_instance, "കഖ, abc\nഖ കഖ", output);
+    assert_success (rc);
+    ck_assert_str_eq (strbuf_to_s (output), "kakha, abc\nkha kakha");
+
+    /* output is appended to */
+    rc = varnam_reverse_transliterate_text (varnam_instance, " ഖ", output);
+    assert_success (rc);
+    ck_assert_str_eq (strbuf_to_s (output), "kakha, abc\nkha kakha kha");
+
+    rc = varnam_get_info (varnam_instance, false, &info);
+    assert_success (rc);
+    ck_assert_int_eq (info->rtl_memo.entries, 2);
+    ck_assert (info->rtl_memo.hit_ratio > 0.49 && info->rtl_memo.hit_ratio < 0.51);
+    free (info);
+
+    rc = varnam_reverse_transliterate_text (varnam_instance, "ഖ", NULL);
+    ck_assert_int_eq (rc, VARNAM_ARGS_ERROR);
+    strbuf_destroy (output);
+}
+END_TEST
+
+START_TEST (info_reports_pools_and_caches)
+{
+    int rc;
+    varray *words;
+    vinfo *info;
+
+    rc = varnam_get_info (NULL, false, &info);
+    ck_assert_int_eq (rc, VARNAM_ARGS_ERROR);
+
+    rc = varnam_transliterate (varnam_instance, "aek", &words);
+    assert_success (rc);
+    rc = varnam_transliterate (varnam_instance, "aek", &words);
+    assert_success (rc);
+
+    rc = varnam_get_info (varnam_instance, true, &info);
+    assert_success (rc);
+    ck_assert_int_eq (info->symbols, 8);
+    ck_assert (info->strings_pool.objects > 0);
+    ck_assert (info->strings_pool.bytes > 0);
+    ck_assert_int_eq (info->arrays_in_memory, info->arrays_pool.objects);
+    ck_assert (info->tokens_cache.entries > 0);
+    ck_assert (info->tokens_cache.bytes > 0);
+    ck_assert (info->tokens_cache.hit_ratio > 0 && info->tokens_cache.hit_ratio < 1);
+    ck_assert (info->interned_tokens > 0);
+    ck_assert (info->symbols_db.prepared_statements > 0);
+    ck_assert (info->sqlite_memory_used > 0);
+    free (info);
+}
+END_TEST
+
+START_TEST (trim_releases_pools_and_caches)
+{
+    int rc;
+    varray *words;
+    vinfo *info;
+
+    rc = varnam_trim (varnam_instance, 0);
+    ck_assert_int_eq (rc, VARNAM_ARGS_ERROR);
+
+    rc = varnam_transliterate (varnam_instance, "aek", &words);
+    assert_success (rc);
+
+    rc = varnam_trim (varnam_instance, VARNAM_TRIM_POOLS);
+    assert_success (rc);
+    rc = varnam_get_info (varnam_instance, false, &info);
+    assert_success (rc);
+    ck_assert (info->strings_pool.objects > 0);
+    ck_assert_int_eq (info->strings_pool.high_water, 0);
+    free (info);
+
+    rc = varnam_trim (varnam_instance, VARNAM_TRIM_ALL);
+    assert_success (rc);
+    rc = varnam_get_info (varnam_instance, false, &info);
+    assert_success (rc);
+    ck_assert_int_eq (info->strings_pool.objects, 0);
+    ck_assert_int_eq (info->tokens_cache.entries, 0);
+    ck_assert_int_eq (info->interned_tokens, 0);
+    free (info);
+
+    rc = varnam_config (varnam_instance, VARNAM_CONFIG_AUTO_TRIM_BYTES, 1);
+    assert_success (rc);
+    rc = varnam_transliterate (varnam_instance, "aek", &words);
+    assert_success (rc);
+    rc = varnam_transliterate (varnam_instance, "aek", &words);
+    assert_success (rc);
+    ck_assert_int_eq (varray_length (words), 1);
+    ck_assert_str_eq (((vword*) varray_get (words, 0))->text, "a-value1e-value2k-value1");
+}
+END_TEST
+
+static int
+cached_entries(vinfo *info)
+{
+    return info->tokens_cache.entries + info->no_matches_cache.entries +
+           info->tokenization_possibility_cache.entries + info->stems_cache.entries +
+           info->words_memo.entries + info->rtl_memo.entries;
+}
+
+/* Same estimate the handle uses for VARNAM_CONFIG_AUTO_TRIM_BYTES */
+static size_t
+estimated_memory(varnam *handle, vinfo *info)
+{
+    return vpool_arena_size (handle->internal->tokens_pool) +
+           vpool_arena_size (handle->internal->arrays_pool) +
+           vpool_arena_size (handle->internal->strings_pool) +
+           vpool_arena_size (handle->internal->words_pool) +
+           (size_t) cached_entries (info) * (sizeof (vcache_entry) + VARNAM_CACHE_ENTRY_ESTIMATE);
+}
+
+START_TEST (auto_trim_stops_at_the_target)
+{
+    int rc, i, entries;
+    size_t memory, target;
+    varray *words;
+    vinfo *info;
+    static const char *inputs[] = {"a", "aa", "e", "k", "kh", "khae", "kaa", "aek"};
+
+    rc = varnam_trim (varnam_instance, VARNAM_TRIM_ALL);
+    assert_success (rc);
+    for (i = 0; i < (int) (sizeof (inputs) / sizeof (inputs[0])); i++) {
+        rc = varnam_transliterate (varnam_instance, inputs[i], &words);
+        assert_success (rc);
+    }
+
+    rc = varnam_get_info (varnam_instance, false, &info);
+    assert_success (rc);
+    entries = cached_entries (info);
+    memory = estimated_memory (varnam_instance, info);
+    free (info);
+    ck_assert (entries > 2);
+
+    /* Under the target, nothing is evicted */
+    rc = varnam_config (varnam_instance, VARNAM_CONFIG_AUTO_TRIM_BYTES, (int) memory);
+    assert_success (rc);
+    rc = varnam_transliterate (varnam_instance, "aek", &words);
+    assert_success (rc);
+    rc = varnam_get_info (varnam_instance, false, &info);
+    assert_success (rc);
+    ck_assert_int_eq (cached_entries (info), entries);
+    free (info);
+
+    /* Just over the target, only the surplus is evicted */
+    target = memory - 2 * (sizeof (vcache_entry) + VARNAM_CACHE_ENTRY_ESTIMATE);
+    rc = varnam_config (varnam_instance, VARNAM_CONFIG_AUTO_TRIM_BYTES, (int) target);
+    assert_success (rc);
+    rc = varnam_transliterate (varnam_instance, "aek", &words);
+    assert_success (rc);
+    rc = varnam_get_info (varnam_instance, false, &info);
+    assert_success (rc);
+    ck_assert_int_eq (cached_entries (info), entries - 2);
+    ck_assert (estimated_memory (varnam_instance, info) <= target);
+    free (info);
+
+    /* Results of the call which trimmed are intact */
+    ck_assert_int_eq (varray_length (words), 1);
+    ck_assert_str_eq (((vword*) varray_get (words, 0))->text, "a-value1e-value2k-value1");
+
+    rc = varnam_config (varnam_instance, VARNAM_CONFIG_AUTO_TRIM_BYTES, 0);
+    assert_success (rc);
+}
+END_TEST
+
+static int
+consonant_renderer(varnam *handle, vtoken *previous, vtoken *current, strbuf *output)
+{
+    if (current->type != VARNAM_TOKEN_CONSONANT)
+        return VARNAM_PARTIAL_RENDERING;
+
+    strbuf_add (output, "C");
+    return VARNAM_SUCCESS;
+}
+
+START_TEST (detect_lang_spans_in_a_document)
+{
+    int rc;
+    size_t count;
+    vlang_span spans[4];
+    const char *text = "ഞാൻ 2 മണിക്ക് വരാം. see you नमस्ते";
+
+    ck_assert_int_eq (varnam_detect_lang (varnam_instance, "മലയാളം"), VARNAM_LANG_CODE_ML);
+    ck_assert_int_eq (varnam_detect_lang (varnam_instance, "मलयालम"), VARNAM_LANG_CODE_HI);
+    ck_assert_int_eq (varnam_detect_lang (varnam_instance, "മലയാളം मलयालम"), VARNAM_LANG_CODE_UNKNOWN);
+
+    rc = varnam_detect_lang_spans (varnam_instance, text, spans, 4, &count);
+    assert_success (rc);
+    ck_assert_int_eq ((int) count, 3);
+
+    /* digits, spaces and punctuations stay with the span before them */
+    ck_assert_int_eq (spans[0].language, VARNAM_LANG_CODE_ML);
+    ck_assert_int_eq ((int) spans[0].offset, 0);
+    ck_assert_int_eq ((int) spans[0].length, (int) (strstr (text, "see") - text));
+
+    ck_assert_int_eq (spans[1].language, VARNAM_LANG_CODE_UNKNOWN);
+    ck_assert_int_eq ((int) spans[1].offset, (int) (strstr (text, "see") - text));
+
+    ck_assert_int_eq (spans[2].language, VARNAM_LANG_CODE_HI);
+    ck_assert_int_eq ((int) spans[2].offset, (int) (strstr (text, "नमस्ते") - text));
+    ck_assert_int_eq ((int) (spans[2].offset + spans[2].length), (int) strlen (text));
+
+    rc = varnam_detect_lang_spans (varnam_instance, text, spans, 2, &count);
+    ck_assert_int_eq (rc, VARNAM_TRUNCATED);
+    ck_assert_int_eq ((int) count, 2);
+
+    rc = varnam_detect_lang_spans (varnam_instance, "", spans, 4, &count);
+    assert_success (rc);
+    ck_assert_int_eq ((int) count, 0);
+
+    /* danda is in the Devanagari block, but doesn't break a Bengali span */
+    rc = varnam_detect_lang_spans (varnam_instance, "অ।ব", spans, 4, &count);
+    assert_success (rc);
+    ck_assert_int_eq ((int) count, 1);
+    ck_assert_int_eq (spans[0].language, VARNAM_LANG_CODE_BN);
+
+    /* curly quotes and no-break space stay with the span before them */
+    text = "“മലയാളം”\xc2\xa0‘नमस्ते’";
+    rc = varnam_detect_lang_spans (varnam_instance, text, spans, 4, &count);
+    assert_success (rc);
+    ck_assert_int_eq ((int) count, 2);
+    ck_assert_int_eq (spans[0].language, VARNAM_LANG_CODE_ML);
+    ck_assert_int_eq ((int) spans[0].offset, 0);
+    ck_assert_int_eq (spans[1].language, VARNAM_LANG_CODE_HI);
+    ck_assert_int_eq ((int) spans[1].offset, (int) (strstr (text, "नमस्ते") - text));
+    ck_assert_int_eq ((int) (spans[1].offset + spans[1].length), (int) strlen (text));
+}
+END_TEST
+
+START_TEST (renderer_registered_after_transliteration_is_used)
+{
+    int rc;
+    varray *words;
+    vscheme_details details;
+
+    memset (&details, 0, sizeof (details));
+    details.identifier = "test-renderer";
+    rc = varnam_set_scheme_details (varnam_instance, &details);
+    assert_success (rc);
+
+    rc = varnam_transliterate (varnam_instance, "aek", &words);
+    assert_success (rc);
+    ck_assert_str_eq (((vword*) varray_get (words, 0))->text, "a-value1e-value2k-value1");
+
+    rc = varnam_register_renderer (varnam_instance, "test-renderer", &consonant_renderer, &consonant_renderer);
+    assert_success (rc);
+
+    rc = varnam_transliterate (varnam_instance, "aek", &words);
+    assert_success (rc);
+    ck_assert_str_eq (((vword*) varray_get (words, 0))->text, "a-value1e-value2C");
+}
+END_TEST
+
+START_TEST (rendering_rules_from_symbols_table)
+{
+    int rc;
+    varray *words;
+    char *output;
+
+    rc = varnam_transliterate (varnam_instance, "ka", &words);
+    assert_success (rc);
+    ck_assert_str_eq (((vword*) varray_get (words, 0))->text, "k-value1a-value2");
+
+    rc = varnam_create_rendering_rule (varnam_instance, VARNAM_RULE_TRANSLITERATION, VARNAM_TOKEN_VOWEL, NULL, NULL,
+                                       VARNAM_TOKEN_CONSONANT, NULL, VARNAM_RULE_OUTPUT_VALUE2, VARNAM_RULE_OUTPUT_VALUE2, NULL);
+    assert_success (rc);
+    rc = varnam_create_rendering_rule (varnam_instance, VARNAM_RULE_REVERSE_TRANSLITERATION, VARNAM_RULE_ANY, NULL, "k",
+                                       VARNAM_RULE_ANY, NULL, VARNAM_RULE_OUTPUT_PATTERN, VARNAM_RULE_OUTPUT_NONE, "_");
+    assert_success (rc);
+    rc = varnam_create_rendering_rule (varnam_instance, VARNAM_RULE_TRANSLITERATION, VARNAM_TOKEN_CONSONANT, NULL, NULL,
+                                       VARNAM_RULE_ANY, NULL, 10, VARNAM_RULE_OUTPUT_NONE, NULL);
+    ck_assert_int_eq (rc, VARNAM_ARGS_ERROR);
+
+    /* previous token is replaced */
+    rc = varnam_transliterate (varnam_instance, "ka", &words);
+    assert_success (rc);
+    ck_assert_str_eq (((vword*) varray_get (words, 0))->text, "k-value2a-value2");
+
+    /* there is no previous token */
+    rc = varnam_transliterate (varnam_instance, "ak", &words);
+    assert_success (rc);
+    ck_assert_str_eq (((vword*) varray_get (words, 0))->text, "a-value1k-value1");
+
+    rc = varnam_reverse_transliterate (varnam_instance, "k-value1e-value1", &output);
+    assert_success (rc);
+    ck_assert_str_eq (output, "k_e");
+
+    /* previous token is rendered as its pattern when reverse transliterating */
+    rc = varnam_create_rendering_rule (varnam_instance, VARNAM_RULE_REVERSE_TRANSLITERATION, VARNAM_TOKEN_VOWEL, NULL, "aa",
+                                       VARNAM_TOKEN_CONSONANT, NULL, VARNAM_RULE_OUTPUT_PATTERN, VARNAM_RULE_OUTPUT_VALUE2, NULL);
+    assert_success (rc);
+    rc = varnam_reverse_transliterate (varnam_instance, "kh-value1aa-value1", &output);
+    assert_success (rc);
+    ck_assert_str_eq (output, "kh-value2aa");
+}
+END_TEST
+
+START_TEST (tracing_records_stage_timings)
+{
+    int rc, i;
+    varray *words;
+    char *output;
+    vtimings timings;
+    vtext_segment *segments;
+    vword_span spans[4];
+    char buf[256];
+    size_t count;
+
+    rc = varnam_get_timings (varnam_instance, VARNAM_STAGES, &timings);
+    ck_assert_int_eq (rc, VARNAM_ARGS_ERROR);
+
+    rc = varnam_transliterate (varnam_instance, "aek", &words);
+    assert_success (rc);
+    rc = varnam_get_timings (varnam_instance, VARNAM_STAGE_TRANSLITERATE, &timings);
+    assert_success (rc);
+    ck_assert_int_eq (timings.count, 0);
+
+    rc = varnam_config (varnam_instance, VARNAM_CONFIG_ENABLE_TRACING, 1);
+    assert_success (rc);
+
+    for (i = 0; i < 3; i++) {
+        rc = varnam_transliterate (varnam_instance, "aek", &words);
+        assert_success (rc);
+    }
+    rc = varnam_reverse_transliterate (varnam_instance, "a-value1", &output);
+    assert_success (rc);
+
+    rc = varnam_get_timings (varnam_instance, VARNAM_STAGE_TRANSLITERATE, &timings);
+    assert_success (rc);
+    ck_assert_int_eq (timings.count, 3);
+    ck_assert (timings.min_us <= timings.p50_us);
+    ck_assert (timings.p50_us <= timings.p99_us);
+    ck_assert (timings.p99_us <= timings.max_us);
+    ck_assert (timings.total_us >= timings.max_us);
+
+    rc = varnam_get_timings (varnam_instance, VARNAM_STAGE_BEST_MATCH, &timings);
+    assert_success (rc);
+    ck_assert_int_eq (timings.count, 3);
+
+    rc = varnam_get_timings (varnam_instance, VARNAM_STAGE_SYMBOLS_TOKENIZE, &timings);
+    assert_success (rc);
+    ck_assert_int_eq (timings.count, 4);
+
+    rc = varnam_get_timings (varnam_instance, VARNAM_STAGE_REVERSE_TRANSLITERATE, &timings);
+    assert_success (rc);
+    ck_assert_int_eq (timings.count, 1);
+
+    /* text and _into calls have stages of their own */
+    rc = varnam_transliterate_text (varnam_instance, "aek aek", VARNAM_TEXT_BEST_CANDIDATE, &segments, &count);
+    assert_success (rc);
+    rc = varnam_transliterate_into (varnam_instance, "aek", buf, sizeof (buf), spans, 4, &count, NULL);
+    assert_success (rc);
+
+    rc = varnam_get_timings (varnam_instance, VARNAM_STAGE_TRANSLITERATE_TEXT, &timings);
+    assert_success (rc);
+    ck_assert_int_eq (timings.count, 1);
+
+    rc = varnam_get_timings (varnam_instance, VARNAM_STAGE_TRANSLITERATE_INTO, &timings);
+    assert_success (rc);
+    ck_assert_int_eq (timings.count, 1);
+
+    rc = varnam_get_timings (varnam_instance, VARNAM_STAGE_TRANSLITERATE, &timings);
+    assert_success (rc);
+    ck_assert_int_eq (timings.count, 3);
+
+    rc = varnam_reset_timings (varnam_instance);
+    assert_success (rc);
+    rc = varnam_get_timings (varnam_instance, VARNAM_STAGE_TRANSLITERATE, &timings);
+    assert_success (rc);
+    ck_assert_int_eq (timings.count, 0);
+
+    rc = varnam_config (varnam_instance, VARNAM_CONFIG_ENABLE_TRACING, 0);
+    assert_success (rc);
+}
+END_TEST
+
+START_TEST (timing_buckets_cover_all_times)
+{
+    int i;
+
+    ck_assert_int_eq (varnam_timing_bucket_limit (-1), -1);
+    ck_assert_int_eq (varnam_timing_bucket_limit (VARNAM_TIMING_BUCKETS), -1);
+    ck_assert_int_eq (varnam_timing_bucket_limit (0), 0);
+    ck_assert_int_eq (varnam_timing_bucket_limit (31), 31);
+    ck_assert_int_eq (varnam_timing_bucket_limit (32), 33);
+    ck_assert_int_eq (varnam_timing_bucket_limit (VARNAM_TIMING_BUCKETS - 1), 2147483647L);
+
+    for (i = 1; i < VARNAM_TIMING_BUCKETS; i++)
+        ck_assert (varnam_timing_bucket_limit (i) > varnam_timing_bucket_limit (i - 1));
+}
+END_TEST
+
+static int slow_queries = 0;
+
+static void
+count_slow_query(const char *statement, const char *sql, long elapsed_us)
+{
+    ck_assert (statement != NULL);
+    ck_assert (sql != NULL);
+    ck_assert (elapsed_us >= 0);
+    ++slow_queries;
+}
+
+START_TEST (profiling_reports_statement_costs)
+{
+    int rc;
+    size_t i, count;
+    long executions = 0, rows = 0, vm_steps = 0, total_us = 0;
+    varray *words;
+    vstatement_stats stats[VARNAM_STATEMENTS];
+    bool tokenize_seen = false;
+
+    rc = varnam_get_statement_stats (varnam_instance, stats, VARNAM_STATEMENTS, &count);
+    assert_success (rc);
+    ck_assert_int_eq (count, 0);
+
+    rc = varnam_config (varnam_instance, VARNAM_CONFIG_ENABLE_PROFILING, 1);
+    assert_success (rc);
+    rc = varnam_set_slow_query_callback (varnam_instance, 0, &count_slow_query);
+    assert_success (rc);
+
+    rc = varnam_transliterate (varnam_instance, "kaek", &words);
+    assert_success (rc);
+
+    rc = varnam_get_statement_stats (varnam_instance, stats, VARNAM_STATEMENTS, &count);
+    assert_success (rc);
+    ck_assert (count > 0);
+    for (i = 0; i < count; i++)
+    {
+        if (strcmp (stats[i].name, "tokenize_using_pattern") == 0)
+            tokenize_seen = true;
+        executions += stats[i].executions;
+        rows += stats[i].rows;
+        vm_steps += stats[i].vm_steps;
+        total_us += stats[i].total_us;
+    }
+    ck_assert (tokenize_seen);
+    ck_assert (rows > 0);
+    ck_assert (vm_steps > 0);
+    /* each of these runs well under a millisecond */
+    ck_assert (total_us > 0);
+    ck_assert_int_eq (slow_queries, executions);
+
+    rc = varnam_get_statement_stats (varnam_instance, stats, 0, &count);
+    ck_assert_int_eq (rc, VARNAM_TRUNCATED);
+
+    rc = varnam_set_slow_query_callback (varnam_instance, 0, NULL);
+    assert_success (rc);
+    rc = varnam_reset_statement_stats (varnam_instance);
+    assert_success (rc);
+    rc = varnam_get_statement_stats (varnam_instance, stats, VARNAM_STATEMENTS, &count);
+    assert_success (rc);
+    ck_assert_int_eq (count, 0);
+
+    slow_queries = 0;
+    rc = varnam_transliterate (varnam_instance, "kaeka", &words);
+    assert_success (rc);
+    ck_assert_int_eq (slow_queries, 0);
+
+    rc = varnam_config (varnam_instance, VARNAM_CONFIG_ENABLE_PROFILING, 0);
+    assert_success (rc);
+    rc = varnam_get_statement_stats (varnam_instance, stats, VARNAM_STATEMENTS, &count);
+    assert_success (rc);
+    ck_assert_int_eq (count, 0);
+}
+END_TEST
+
+START_TEST (metrics_rendered_in_prometheus_format)
+{
+    int rc;
+    varray *words;
+    char *output;
+    vlang_span spans[1];
+    size_t count;
+    strbuf *metrics = strbuf_init (1024);
+
+    rc = varnam_metrics_render (NULL, metrics);
+    ck_assert_int_eq (rc, VARNAM_ARGS_ERROR);
+
+    rc = varnam_config (varnam_instance, VARNAM_CONFIG_ENABLE_TRACING, 1);
+    assert_success (rc);
+    rc = varnam_transliterate (varnam_instance, "aek", &words);
+    assert_success (rc);
+    rc = varnam_transliterate (varnam_instance, "aek", &words);
+    assert_success (rc);
+    rc = varnam_reverse_transliterate (varnam_instance, "a-value1", &output);
+    assert_success (rc);
+    rc = varnam_detect_lang_spans (varnam_instance, "abc", spans, 1, &count);
+    assert_success (rc);
+    rc = varnam_trim (varnam_instance, VARNAM_TRIM_ALL);
+    assert_success (rc);
+
+    rc = varnam_metrics_render (varnam_instance, metrics);
+    assert_success (rc);
+    ck_assert (strstr (strbuf_to_s (metrics), "# TYPE varnam_calls_total counter\n") != NULL);
+    ck_assert (strstr (strbuf_to_s (metrics), "varnam_calls_total{function=\"varnam_transliterate\"} 2\n") != NULL);
+    ck_assert (strstr (strbuf_to_s (metrics), "varnam_calls_total{function=\"varnam_reverse_transliterate\"} 1\n") != NULL);
+    ck_assert (strstr (strbuf_to_s (metrics), "varnam_errors_total{function=\"varnam_transliterate\"} 0\n") != NULL);
+    ck_assert (strstr (strbuf_to_s (metrics), "varnam_calls_total{function=\"varnam_detect_lang_spans\"} 1\n") != NULL);
+    ck_assert (strstr (strbuf_to_s (metrics), "varnam_calls_total{function=\"varnam_transliterate_into\"} 0\n") != NULL);
+    ck_assert (strstr (strbuf_to_s (metrics), "varnam_stage_duration_seconds_bucket{stage=\"transliterate\",le=\"+Inf\"} 2\n") != NULL);
+    ck_assert (strstr (strbuf_to_s (metrics), "varnam_stage_duration_seconds_count{stage=\"transliterate\"} 2\n") != NULL);
+    ck_assert (strstr (strbuf_to_s (metrics), "varnam_cache_entries{cache=\"tokens\"} 0\n") != NULL);
+    /* Trimming everything evicted the cached tokens */
+    ck_assert (strstr (strbuf_to_s (metrics), "varnam_cache_evictions_total{cache=\"tokens\"} 0\n") == NULL);
+    ck_assert (strstr (strbuf_to_s (metrics), "varnam_sqlite_memory_bytes ") != NULL);
+
+    rc = varnam_config (varnam_instance, VARNAM_CONFIG_ENABLE_TRACING, 0);
+    assert_success (rc);
+    strbuf_clear (metrics);
+    rc = varnam_metrics_render (varnam_instance, metrics);
+    assert_success (rc);
+    ck_assert (strstr (strbuf_to_s (metrics), "varnam_stage_duration_seconds") == NULL);
+    strbuf_destroy (metrics);
+}
+END_TEST
+
+START_TEST (lattice_gives_best_paths_first)
+{
+    vtoken a, b, c, d, e;
+    varray *positions, *path;
+    vlattice lattice;
+    strbuf *rendered = strbuf_init (20);
+    const char *expected[] = {"bce", "bde", "ace", "ade"};
+    int i, rc, paths = 0;
+    bool found;
+
+    initialize_token (&a, 1, VARNAM_TOKEN_VOWEL, VARNAM_MATCH_EXACT, "a", "a", NULL, NULL, NULL, 0, 0, 0);
+    initialize_token (&b, 2, VARNAM_TOKEN_VOWEL, VARNAM_MATCH_EXACT, "b", "b", NULL, NULL, NULL, 5, 0, 0);
+    initialize_token (&c, 3, VARNAM_TOKEN_VOWEL, VARNAM_MATCH_EXACT, "c", "c", NULL, NULL, NULL, 1, 0, 0);
+    initialize_token (&d, 4, VARNAM_TOKEN_VOWEL, VARNAM_MATCH_EXACT, "d", "d", NULL, NULL, NULL, 1, 0, 0);
+    initialize_token (&e, 5, VARNAM_TOKEN_VOWEL, VARNAM_MATCH_EXACT, "e", "e", NULL, NULL, NULL, 0, 0, 0);
+
+    positions = varray_init ();
+    for (i = 0; i < 4; i++)
+        varray_push (positions, varray_init ());
+    varray_push (varray_get (positions, 0), &a);
+    varray_push (varray_get (positions, 0), &b);
+    varray_push (varray_get (positions, 1), &c);
+    varray_push (varray_get (positions, 1), &d);
+    /* Position 2 has no alternatives and is left out */
+    varray_push (varray_get (positions, 3), &e);
+
+    rc = lattice_init (&lattice, positions);
+    assert_success (rc);
+
+    path = varray_init ();
+    for (;;)
+    {
+        rc = lattice_next (&lattice, path, &found);
+        assert_success (rc);
+        if (!found)
+            break;
+
+        ck_assert_int_lt (paths, 4);
+        strbuf_clear (rendered);
+        for (i = 0; i < varray_length (path); i++)
+            strbuf_add (rendered, ((vtoken*) varray_get (path, i))->value1);
+        ck_assert_str_eq (expected[paths], strbuf_to_s (rendered));
+        ++paths;
+    }
+    ck_assert_int_eq (4, paths);
+
+    lattice_release (&lattice);
+    for (i = 0; i < varray_length (positions); i++)
+        varray_free (varray_get (positions, i), NULL);
+    varray_free (positions, NULL);
+    varray_free (path, NULL);
+    strbuf_destroy (rendered);
+}
+END_TEST
+
 TCase* get_transliteration_tests()
 {
     TCase* tcase = tcase_create("transliteration");
@@ -123,5 +877,21 @@ TCase* get_transliteration_tests()
     tcase_add_test (tcase, dependent_vowel_rendering);
     tcase_add_test (tcase, cancellation_character_should_force_independent_vowel_form);
     tcase_add_test (tcase, indic_digit_rendering);
+    tcase_add_test (tcase, transliteration_with_pool_high_water_mark);
+    tcase_add_test (tcase, transliteration_into_caller_buffer);
+    tcase_add_test (tcase, reverse_transliteration_into_caller_buffer);
+    tcase_add_test (tcase, transliterate_text_with_words_memo);
+    tcase_add_test (tcase, reverse_transliterate_text_with_memo);
+    tcase_add_test (tcase, info_reports_pools_and_caches);
+    tcase_add_test (tcase, trim_releases_pools_and_caches);
+    tcase_add_test (tcase, auto_trim_stops_at_the_target);
+    tcase_add_test (tcase, detect_lang_spans_in_a_document);
+    tcase_add_test (tcase, tracing_records_stage_timings);
+    tcase_add_test (tcase, timing_buckets_cover_all_times);
+    tcase_add_test (tcase, profiling_reports_statement_costs);
+    tcase_add_test (tcase, metrics_rendered_in_prometheus_format);
+    tcase_add_test (tcase, lattice_gives_best_paths_first);
+    tcase_add_test (tcase, renderer_registered_after_transliteration_is_used);
+    tcase_add_test (tcase, rendering_rules_from_symbols_table);
     return tcase;
 }
@@ -0,0 +1,206 @@
+/* varnamd_tests.c - smoke tests for the varnamd daemon
+ *
+ * Copyright (C) Navaneeth.K.N
+ *
+ * This is part of libvarnam. See LICENSE.txt for the license
+ */
+
+#define _POSIX_C_SOURCE 200112L
+
+#include <check.h>
+#include "testcases.h"
+
+#ifdef VARNAMD_PATH
+
+#include <errno.h>
+#include <fcntl.h>
+#include <signal.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <sys/time.h>
+#include <sys/types.h>
+#include <sys/un.h>
+#include <sys/wait.h>
+#include <unistd.h>
+#include "../varnam.h"
+
+#define VARNAMD_SOCKET "output/varnamd.sock"
+
+static pid_t daemon_pid = -1;
+
+static void
+sleep_ms(long ms)
+{
+    struct timeval timeout;
+
+    timeout.tv_sec = ms / 1000;
+    timeout.tv_usec = (ms % 1000) * 1000;
+    select (0, NULL, NULL, NULL, &timeout);
+}
+
+/* Starts varnamd with one worker. Scheme and learnings are kept under output/varnamd */
+static void
+start_daemon()
+{
+    int exitcode, waited, log;
+
+    exitcode = system ("mkdir -p output/varnamd/varnam/vst && cp ../schemes/ml.vst output/varnamd/varnam/vst/ml.vst");
+    ck_assert_int_eq (0, exitcode);
+    unlink (VARNAMD_SOCKET);
+
+    daemon_pid = fork ();
+    ck_assert (daemon_pid >= 0);
+    if (daemon_pid == 0) {
+        log = open ("output/varnamd.log", O_WRONLY | O_CREAT | O_TRUNC, 0644);
+        if (log >= 0) {
+            dup2 (log, 1);
+            dup2 (log, 2);
+        }
+        setenv ("XDG_DATA_HOME", "output/varnamd", 1);
+        execl (VARNAMD_PATH, "varnamd", "ml", VARNAMD_SOCKET, "1", (char*) NULL);
+        _exit (127);
+    }
+
+    for (waited = 0; waited < 10000 && !file_exist (VARNAMD_SOCKET); waited += 50)
+        sleep_ms (50);
+    ck_assert_msg (file_exist (VARNAMD_SOCKET), "varnamd didn't start. See output/varnamd.log");
+}
+
+/* Returns 1 if the daemon exits within timeout_ms after SIGTERM */
+static int
+stop_daemon(long timeout_ms)
+{
+    long waited;
+    int status;
+
+    kill (daemon_pid, SIGTERM);
+    for (waited = 0; waited < timeout_ms; waited += 50)
+    {
+        if (waitpid (daemon_pid, &status, WNOHANG) == daemon_pid)
+            return WIFEXITED (status) && WEXITSTATUS (status) == 0;
+        sleep_ms (50);
+    }
+
+    kill (daemon_pid, SIGKILL);
+    waitpid (daemon_pid, &status, 0);
+    return 0;
+}
+
+static int
+connect_to_daemon()
+{
+    int fd;
+    struct sockaddr_un address;
+    struct timeval timeout;
+
+    fd = socket (AF_UNIX, SOCK_STREAM, 0);
+    ck_assert (fd >= 0);
+
+    memset (&address, 0, sizeof (address));
+    address.sun_family = AF_UNIX;
+    strcpy (address.sun_path, VARNAMD_SOCKET);
+    ck_assert_int_eq (0, connect (fd, (struct sockaddr*) &address, sizeof (address)));
+
+    /* A client which is not served fails the test instead of hanging it */
+    timeout.tv_sec = 5;
+    timeout.tv_usec = 0;
+    setsockopt (fd, SOL_SOCKET, SO_RCVTIMEO, &timeout, sizeof (timeout));
+
+    return fd;
+}
+
+static int
+read_fully(int fd, unsigned char *buffer, size_t length)
+{
+    ssize_t n;
+
+    while (length > 0)
+    {
+        n = read (fd, buffer, length);
+        if (n <= 0)
+            return 0;
+        buffer += n;
+        length -= (size_t) n;
+    }
+
+    return 1;
+}
+
+/* Sends a transliteration request and returns the status of the response, -1 if there is none */
+static int
+transliterate_on(int fd, const char *input)
+{
+    unsigned char message[4096];
+    size_t length = strlen (input);
+
+    message[0] = 0;
+    message[1] = 0;
+    message[2] = 0;
+    message[3] = (unsigned char) (length + 2);
+    message[4] = 1;
+    message[5] = 0;
+    memcpy (message + 6, input, length);
+    if (write (fd, message, length + 6) != (ssize_t) (length + 6))
+        return -1;
+
+    if (!read_fully (fd, message, 5))
+        return -1;
+
+    length = ((size_t) message[0] << 24) | ((size_t) message[1] << 16) | ((size_t) message[2] << 8) | message[3];
+    if (length < 1 || length - 1 > sizeof (message) || !read_fully (fd, message + 5, length - 1))
+        return -1;
+
+    return message[4];
+}
+
+START_TEST (idle_client_does_not_hold_the_only_worker)
+{
+    int first, second;
+
+    signal (SIGPIPE, SIG_IGN);
+    start_daemon ();
+
+    first = connect_to_daemon ();
+    second = connect_to_daemon ();
+
+    ck_assert_int_eq (VARNAM_SUCCESS, transliterate_on (first, "malayalam"));
+    ck_assert_int_eq (VARNAM_SUCCESS, transliterate_on (second, "varnam"));
+    ck_assert_int_eq (VARNAM_SUCCESS, transliterate_on (first, "navaneeth"));
+
+    ck_assert_msg (stop_daemon (5000), "varnamd didn't stop");
+    close (first);
+    close (second);
+}
+END_TEST
+
+START_TEST (stops_while_clients_are_connected)
+{
+    int first, second;
+
+    signal (SIGPIPE, SIG_IGN);
+    start_daemon ();
+
+    first = connect_to_daemon ();
+    second = connect_to_daemon ();
+    ck_assert_int_eq (VARNAM_SUCCESS, transliterate_on (first, "malayalam"));
+
+    ck_assert_msg (stop_daemon (5000), "varnamd didn't stop");
+    ck_assert_int_eq (-1, transliterate_on (second, "varnam"));
+
+    close (first);
+    close (second);
+}
+END_TEST
+
+#endif
+
+TCase* get_varnamd_tests()
+{
+    TCase* tcase = tcase_create("varnamd");
+#ifdef VARNAMD_PATH
+    tcase_add_test (tcase, idle_client_does_not_hold_the_only_worker);
+    tcase_add_test (tcase, stops_while_clients_are_connected);
+#endif
+    return tcase;
+}
@@ -11,6 +11,7 @@
 #include <stdio.h>
 #include <string.h>
 #include "../varnam.h"
+#include "../symbol-table.h"
 #include <check.h>
 #include "testcases.h"
 
@@ -237,6 +238,159 @@ START_TEST (maxlength_check)
 }
 END_TEST
 
+static bool
+has_token(int token_type, const char *pattern, const char *value1)
+{
+    int rc, i;
+    varray *tokens;
+    vtoken *token;
+
+    rc = varnam_get_all_tokens (varnam_instance, token_type, &tokens);
+    assert_success (rc);
+
+    for (i = 0; i < varray_length (tokens); i++) {
+        token = varray_get (tokens, i);
+        if (strcmp (token->pattern, pattern) == 0 && strcmp (token->value1, value1) == 0)
+            return true;
+    }
+
+    return false;
+}
+
+START_TEST (create_tokens_in_bulk)
+{
+    int rc;
+    varray *words;
+    vword *word;
+    vtoken_spec specs[] = {
+        {"~", "്", "", "", "", VARNAM_TOKEN_VIRAMA, VARNAM_MATCH_EXACT, 0, 0},
+        {"ka", "ക", "", "", "", VARNAM_TOKEN_CONSONANT, VARNAM_MATCH_EXACT, 0, 0},
+        {"pa", "പ", NULL, NULL, NULL, VARNAM_TOKEN_CONSONANT, VARNAM_MATCH_EXACT, 0, 0},
+        {"ka", "ഖ", "", "", "", VARNAM_TOKEN_CONSONANT, VARNAM_MATCH_POSSIBILITY, 0, 0},
+        {"_", "", "", "", "", VARNAM_TOKEN_NON_JOINER, VARNAM_MATCH_EXACT, 0, 0}
+    };
+    vtoken_spec duplicates[] = {
+        {"ma", "മ", "", "", "", VARNAM_TOKEN_CONSONANT, VARNAM_MATCH_EXACT, 0, 0},
+        {"ka ", "ക", "", "", "", VARNAM_TOKEN_CONSONANT, VARNAM_MATCH_EXACT, 0, 0}
+    };
+
+    varnam_config (varnam_instance, VARNAM_CONFIG_USE_DEAD_CONSONANTS, 1);
+    varnam_config (varnam_instance, VARNAM_CONFIG_IGNORE_DUPLICATE_TOKEN, 0);
+
+    rc = varnam_create_tokens_bulk (varnam_instance, specs, ARRAY_SIZE (specs));
+    assert_success (rc);
+
+    ck_assert (has_token (VARNAM_TOKEN_DEAD_CONSONANT, "k", "ക്"));
+    ck_assert (has_token (VARNAM_TOKEN_DEAD_CONSONANT, "p", "പ്"));
+    ck_assert (has_token (VARNAM_TOKEN_CONSONANT, "ka", "ഖ"));
+
+    rc = varnam_transliterate (varnam_instance, "pa", &words);
+    assert_success (rc);
+    word = varray_get (words, 0);
+    ck_assert_str_eq (word->text, "പ");
+
+    /* ka clashes with the token created above. Nothing from the batch should be persisted */
+    rc = varnam_create_tokens_bulk (varnam_instance, duplicates, ARRAY_SIZE (duplicates));
+    ck_assert_int_eq (VARNAM_ERROR, rc);
+    ck_assert (!has_token (VARNAM_TOKEN_CONSONANT, "ma", "മ"));
+
+    rc = varnam_config (varnam_instance, VARNAM_CONFIG_IGNORE_DUPLICATE_TOKEN, 1);
+    assert_success (rc);
+
+    rc = varnam_create_tokens_bulk (varnam_instance, duplicates, ARRAY_SIZE (duplicates));
+    assert_success (rc);
+    ck_assert (has_token (VARNAM_TOKEN_CONSONANT, "ma", "മ"));
+}
+END_TEST
+
+START_TEST (create_tokens_in_bulk_finds_duplicates_in_batch)
+{
+    int rc;
+    vtoken_spec specs[] = {
+        {"pattern", "value1", "", "", "", VARNAM_TOKEN_VOWEL, VARNAM_MATCH_POSSIBILITY, 0, 0},
+        {"pattern", "value11", "", "", "", VARNAM_TOKEN_VOWEL, VARNAM_MATCH_POSSIBILITY, 0, 0},
+        {" pattern", "value1 ", "", "", "", VARNAM_TOKEN_VOWEL, VARNAM_MATCH_POSSIBILITY, 0, 0}
+    };
+    vtoken_spec buffered[] = {
+        {"b", "value1", "", "", "", VARNAM_TOKEN_VOWEL, VARNAM_MATCH_EXACT, 0, 0}
+    };
+    vtoken_spec clashing[] = {
+        {"c", "value1", "", "", "", VARNAM_TOKEN_VOWEL, VARNAM_MATCH_EXACT, 0, 0},
+        {"b", "value2", "", "", "", VARNAM_TOKEN_VOWEL, VARNAM_MATCH_EXACT, 0, 0}
+    };
+
+    varnam_config (varnam_instance, VARNAM_CONFIG_IGNORE_DUPLICATE_TOKEN, 0);
+
+    rc = varnam_create_tokens_bulk (varnam_instance, specs, ARRAY_SIZE (specs));
+    ck_assert_int_eq (VARNAM_ERROR, rc);
+    ck_assert (!has_token (VARNAM_TOKEN_VOWEL, "pattern", "value1"));
+
+    rc = varnam_create_tokens_bulk (varnam_instance, specs, 2);
+    assert_success (rc);
+
+    /* Invalid specs are reported before anything is written */
+    specs[0].pattern = "a";
+    specs[1].match_type = 10;
+    rc = varnam_create_tokens_bulk (varnam_instance, specs, 2);
+    ck_assert_int_eq (VARNAM_ARGS_ERROR, rc);
+    ck_assert (!has_token (VARNAM_TOKEN_VOWEL, "a", "value1"));
+
+    /* Buffered changes are left for varnam_flush_buffer() */
+    rc = varnam_create_token (varnam_instance, "a", "value1", "", "", "", VARNAM_TOKEN_VOWEL, VARNAM_MATCH_EXACT, 0, 0, 1);
+    assert_success (rc);
+    rc = varnam_create_tokens_bulk (varnam_instance, buffered, ARRAY_SIZE (buffered));
+    assert_success (rc);
+
+    /* A failed bulk rolls back only its own tokens */
+    rc = varnam_create_tokens_bulk (varnam_instance, clashing, ARRAY_SIZE (clashing));
+    ck_assert_int_eq (VARNAM_ERROR, rc);
+    rc = varnam_flush_buffer (varnam_instance);
+    assert_success (rc);
+    ck_assert (has_token (VARNAM_TOKEN_VOWEL, "a", "value1"));
+    ck_assert (has_token (VARNAM_TOKEN_VOWEL, "b", "value1"));
+    ck_assert (!has_token (VARNAM_TOKEN_VOWEL, "c", "value1"));
+}
+END_TEST
+
+static int
+first_token_flags(const char *input)
+{
+    int rc;
+    varray *result, *tokens;
+    vtoken *token;
+
+    result = varray_init ();
+    rc = vst_tokenize (varnam_instance, input, VARNAM_TOKENIZER_PATTERN, VARNAM_MATCH_ALL, result);
+    assert_success (rc);
+    tokens = varray_get (result, 0);
+    token = varray_get (tokens, 0);
+    varray_free (result, NULL);
+    return token->flags;
+}
+
+START_TEST (flags_are_refreshed_after_flushing_new_symbols)
+{
+    int rc;
+    varray *words;
+
+    rc = varnam_create_token (varnam_instance, "a", "a-value1", "a-value2", "", "", VARNAM_TOKEN_VOWEL, VARNAM_MATCH_EXACT, 1, 0, 0);
+    assert_success (rc);
+    rc = varnam_flush_buffer (varnam_instance);
+    assert_success (rc);
+    ck_assert_int_eq (first_token_flags ("a") & VARNAM_TOKEN_FLAGS_MORE_MATCHES_FOR_PATTERN, 0);
+
+    rc = varnam_create_token (varnam_instance, "ab", "ab-value1", "ab-value2", "", "", VARNAM_TOKEN_VOWEL, VARNAM_MATCH_EXACT, 1, 0, 0);
+    assert_success (rc);
+    rc = varnam_flush_buffer (varnam_instance);
+    assert_success (rc);
+    ck_assert (first_token_flags ("a") & VARNAM_TOKEN_FLAGS_MORE_MATCHES_FOR_PATTERN);
+
+    rc = varnam_transliterate (varnam_instance, "ab", &words);
+    assert_success (rc);
+    ck_assert_str_eq (((vword*) varray_get (words, 0))->text, "ab-value1");
+}
+END_TEST
+
 TCase* get_token_creation_tests()
 {
     TCase* tcase = tcase_create("transliteration");
@@ -251,5 +405,8 @@ TCase* get_token_creation_tests()
     tcase_add_test (tcase, only_valid_matchtypes);
     tcase_add_test (tcase, maxlength_check);
     tcase_add_test (tcase, prefix_tree);
+    tcase_add_test (tcase, create_tokens_in_bulk);
+    tcase_add_test (tcase, create_tokens_in_bulk_finds_duplicates_in_batch);
+    tcase_add_test (tcase, flags_are_refreshed_after_flushing_new_symbols);
     return tcase;
 }
@@ -5,6 +5,8 @@
  * This is part of libvarnam. See LICENSE.txt for the license
  */
 
+#include <assert.h>
+#include <stdlib.h>
 #include <string.h>
 #include "token.h"
 #include "vtypes.h"
@@ -12,6 +14,31 @@
 #include "varray.h"
 #include "result-codes.h"
 
+static const char *known_tags[] = {
+    "",
+    NULL,   /* VARNAM_TAG_OTHER */
+    "render_value2",
+    "chill"
+};
+
+/* Maps a tag to one of VARNAM_TAG_* */
+int
+get_tag_id (const char *tag)
+{
+    int i;
+
+    if (tag == NULL || *tag == '\0')
+        return VARNAM_TAG_NONE;
+
+    for (i = VARNAM_TAG_RENDER_VALUE2; i < ARRAY_SIZE (known_tags); i++)
+    {
+        if (strcmp (tag, known_tags[i]) == 0)
+            return i;
+    }
+
+    return VARNAM_TAG_OTHER;
+}
+
 void
 initialize_token (vtoken *tok,
                   int id,
@@ -49,6 +76,8 @@ initialize_token (vtoken *tok,
         strncpy( tok->tag, tag, VARNAM_SYMBOL_MAX);
     else
         tok->tag[0] = '\0';
+
+    tok->tag_id = get_tag_id (tok->tag);
 }
 
 struct token*
@@ -90,54 +119,248 @@ get_pooled_token (
     tok = vpool_get (v_->tokens_pool);
     if (tok == NULL)
     {
-        tok = Token (id, type, match_type, pattern, value1, value2, value3, tag, priority, accept_condition, flags);
+        tok = vpool_alloc (v_->tokens_pool, sizeof (vtoken));
         vpool_add (v_->tokens_pool, tok);
     }
-    else
-        initialize_token (tok, id, type, match_type, pattern, value1, value2, value3, tag, priority, accept_condition, flags);
+
+    initialize_token (tok, id, type, match_type, pattern, value1, value2, value3, tag, priority, accept_condition, flags);
 
     return tok;
 }
 
-varray*
-product_tokens(varnam *handle, varray *tokens)
+/* A path in the lattice is kept as an int array. Offsets of the alternative taken at
+ * each position follows the header */
+#define NODE_COST     0
+#define NODE_LAST     1     /* last position which was moved. Only positions from here are moved */
+#define NODE_SEQUENCE 2     /* paths with same cost are taken in the order they are found */
+#define NODE_HEADER   3
+
+static bool
+node_before(int *left, int *right)
 {
-    int array_cnt, *offsets, i, last_array_offset;
-    varray *product, *array, *tmp;
+    if (left[NODE_COST] != right[NODE_COST])
+        return left[NODE_COST] < right[NODE_COST];
 
-    array_cnt = varray_length (tokens);
-    offsets = xmalloc(sizeof(int) * (size_t) array_cnt);
-    product = get_pooled_array (handle);
+    return left[NODE_SEQUENCE] < right[NODE_SEQUENCE];
+}
 
-    varray_clear (product);
-    for (i = 0; i < array_cnt; i++) offsets[i] = 0;
+static int
+lattice_push(vlattice *lattice, int *node)
+{
+    int **heap, i, parent;
 
+    if (lattice->heap_length == lattice->heap_allocated)
+    {
+        lattice->heap_allocated = lattice->heap_allocated == 0 ? 16 : lattice->heap_allocated * 2;
+        heap = realloc (lattice->heap, sizeof (int*) * (size_t) lattice->heap_allocated);
+        if (heap == NULL)
+            return VARNAM_MEMORY_ERROR;
+        lattice->heap = heap;
+    }
+
+    node[NODE_SEQUENCE] = lattice->sequence++;
+    i = lattice->heap_length++;
+    while (i > 0)
+    {
+        parent = (i - 1) / 2;
+        if (!node_before (node, lattice->heap[parent]))
+            break;
+        lattice->heap[i] = lattice->heap[parent];
+        i = parent;
+    }
+
+    lattice->heap[i] = node;
+    return VARNAM_SUCCESS;
+}
+
+static int*
+lattice_pop(vlattice *lattice)
+{
+    int *top, *last, i, child;
+
+    if (lattice->heap_length == 0)
+        return NULL;
+
+    top = lattice->heap[0];
+    last = lattice->heap[--lattice->heap_length];
+    i = 0;
     for (;;)
     {
-        array = get_pooled_array (handle);
-        for (i = 0; i < array_cnt; i++) {
-            tmp = varray_get (tokens, i);
-            varray_push (array, varray_get (tmp, offsets[i]));
-        }
+        child = 2 * i + 1;
+        if (child >= lattice->heap_length)
+            break;
+        if (child + 1 < lattice->heap_length && node_before (lattice->heap[child + 1], lattice->heap[child]))
+            ++child;
+        if (!node_before (lattice->heap[child], last))
+            break;
+        lattice->heap[i] = lattice->heap[child];
+        i = child;
+    }
+
+    if (lattice->heap_length > 0)
+        lattice->heap[i] = last;
+
+    return top;
+}
+
+static int*
+new_node(vlattice *lattice)
+{
+    return xmalloc (sizeof (int) * (size_t) (lattice->length + NODE_HEADER));
+}
+
+int
+lattice_init(vlattice *lattice, varray *positions)
+{
+    int i, j, k, count, alternatives = 0, best, cost, tmp;
+    varray *position;
+    vtoken *token;
+    int *node;
 
-        varray_push (product, array);
+    memset (lattice, 0, sizeof (vlattice));
+    lattice->positions = positions;
+    lattice->length = varray_length (positions);
+
+    for (i = 0; i < lattice->length; i++)
+    {
+        position = varray_get (positions, i);
+        alternatives += varray_length (position);
+    }
 
-        last_array_offset = array_cnt - 1;
-        offsets[last_array_offset]++;
+    lattice->first = xmalloc (sizeof (int) * (size_t) (lattice->length + 1));
+    lattice->order = xmalloc (sizeof (int) * (size_t) (alternatives + 1));
+    lattice->cost = xmalloc (sizeof (int) * (size_t) (alternatives + 1));
+    node = new_node (lattice);
+    if (lattice->first == NULL || lattice->order == NULL || lattice->cost == NULL || node == NULL) {
+        xfree (node);
+        lattice_release (lattice);
+        return VARNAM_MEMORY_ERROR;
+    }
+
+    k = 0;
+    for (i = 0; i < lattice->length; i++)
+    {
+        position = varray_get (positions, i);
+        count = varray_length (position);
+        lattice->first[i] = k;
+        if (count == 0)
+            continue; /* Positions without alternatives are left out of the paths */
+
+        best = ((vtoken*) varray_get (position, 0))->priority;
+        for (j = 1; j < count; j++)
+        {
+            token = varray_get (position, j);
+            if (token->priority > best)
+                best = token->priority;
+        }
 
-        while (offsets[last_array_offset] == varray_length ((varray*) varray_get (tokens, last_array_offset)))
+        /* Insertion sort keeps alternatives with the same priority in the given order.
+           Positions are small and mostly sorted already */
+        for (j = 0; j < count; j++)
         {
-            offsets[last_array_offset] = 0;
+            token = varray_get (position, j);
+            cost = best - token->priority;
+            for (tmp = k + j; tmp > k && lattice->cost[tmp - 1] > cost; tmp--)
+            {
+                lattice->order[tmp] = lattice->order[tmp - 1];
+                lattice->cost[tmp] = lattice->cost[tmp - 1];
+            }
+            lattice->order[tmp] = j;
+            lattice->cost[tmp] = cost;
+        }
+
+        k += count;
+    }
+    lattice->first[lattice->length] = k;
+
+    node[NODE_COST] = 0;
+    node[NODE_LAST] = 0;
+    for (i = 0; i < lattice->length; i++) {
+        node[NODE_HEADER + i] = 0;
+        if (lattice->first[i + 1] > lattice->first[i])
+            node[NODE_COST] += lattice->cost[lattice->first[i]];
+    }
+
+    if (lattice_push (lattice, node) != VARNAM_SUCCESS) {
+        xfree (node);
+        lattice_release (lattice);
+        return VARNAM_MEMORY_ERROR;
+    }
+
+    return VARNAM_SUCCESS;
+}
+
+int
+lattice_next(vlattice *lattice, varray *path, bool *found)
+{
+    int *node, *next, i, offset, position_length, rc = VARNAM_SUCCESS;
 
-            if (--last_array_offset < 0) goto finished;
+    *found = false;
+    varray_clear (path);
+    node = lattice_pop (lattice);
+    if (node == NULL)
+        return VARNAM_SUCCESS;
 
-            offsets[last_array_offset]++;
+    for (i = 0; i < lattice->length; i++)
+    {
+        if (lattice->first[i + 1] == lattice->first[i])
+            continue;
+        offset = node[NODE_HEADER + i];
+        varray_push (path, varray_get (varray_get (lattice->positions, i),
+                                       lattice->order[lattice->first[i] + offset]));
+    }
+
+    /* Each path is found only once, by moving one of the positions after the last
+       moved one to its next alternative */
+    for (i = node[NODE_LAST]; i < lattice->length; i++)
+    {
+        offset = node[NODE_HEADER + i];
+        position_length = lattice->first[i + 1] - lattice->first[i];
+        if (offset + 1 >= position_length)
+            continue;
+
+        next = new_node (lattice);
+        if (next == NULL) {
+            rc = VARNAM_MEMORY_ERROR;
+            break;
+        }
+
+        memcpy (next, node, sizeof (int) * (size_t) (lattice->length + NODE_HEADER));
+        next[NODE_HEADER + i] = offset + 1;
+        next[NODE_LAST] = i;
+        next[NODE_COST] += lattice->cost[lattice->first[i] + offset + 1] - lattice->cost[lattice->first[i] + offset];
+        if (lattice_push (lattice, next) != VARNAM_SUCCESS) {
+            xfree (next);
+            rc = VARNAM_MEMORY_ERROR;
+            break;
         }
     }
 
-finished:
-    xfree (offsets);
-    return product;
+    xfree (node);
+
+    /* Paths after this one would be missing, so none of them are given */
+    if (rc != VARNAM_SUCCESS) {
+        varray_clear (path);
+        return rc;
+    }
+
+    *found = true;
+    return VARNAM_SUCCESS;
+}
+
+void
+lattice_release(vlattice *lattice)
+{
+    int i;
+
+    for (i = 0; i < lattice->heap_length; i++)
+        xfree (lattice->heap[i]);
+
+    xfree (lattice->heap);
+    xfree (lattice->first);
+    xfree (lattice->order);
+    xfree (lattice->cost);
+    memset (lattice, 0, sizeof (vlattice));
 }
 
 void
@@ -149,3 +372,42 @@ destroy_token(void *token)
     }
 }
 
+
+vtoken*
+find_interned_token (vtoken_entry **table, int id)
+{
+    vtoken_entry *entry;
+
+    HASH_FIND_INT (*table, &id, entry);
+    if (entry == NULL)
+        return NULL;
+
+    return entry->token;
+}
+
+void
+intern_token (vtoken_entry **table, vtoken *token)
+{
+    vtoken_entry *entry;
+
+    assert (token);
+    entry = xmalloc (sizeof (vtoken_entry));
+    entry->id = token->id;
+    entry->token = token;
+    entry->referenced = 0;
+    HASH_ADD_INT (*table, id, entry);
+}
+
+void
+destroy_interned_tokens (vtoken_entry **table)
+{
+    vtoken_entry *entry, *tmp;
+
+    HASH_ITER (hh, *table, entry, tmp)
+    {
+        HASH_DEL (*table, entry);
+        destroy_token (entry->token);
+        xfree (entry);
+    }
+    *table = NULL;
+}
@@ -16,6 +16,9 @@
 struct token*
 token_new();
 
+int
+get_tag_id (const char *tag);
+
 void
 initialize_token (vtoken *tok,
                   int id,
@@ -47,10 +50,48 @@ get_pooled_token (
     int priority,
     int accept_condition, int flags);
 
-varray*
-product_tokens(varnam *handle, varray *tokens);
+/* Alternatives for each position of a tokenized input, as vst_tokenize() gives them.
+ * Paths through the lattice are taken best first and only when asked for, so a few
+ * best paths of a long input don't cost all of its combinations. A path costs the sum
+ * of how far each of its tokens is below the best priority at that position. Positions
+ * without alternatives are left out of the paths.
+ * Learned statistics are not part of the cost. Confidence is kept for whole words in
+ * the words table and tokens have nothing learned about them, so paths are ranked on
+ * the priorities from the scheme alone */
+typedef struct vtoken_lattice_t {
+    varray *positions;  /* varray of varray of vtoken*. Not owned by the lattice */
+    int length;         /* number of positions */
+    int *first;         /* order and cost of the alternatives of position i starts at first[i] */
+    int *order;         /* alternatives of each position, cheapest first */
+    int *cost;
+    int **heap;         /* paths found but not taken yet */
+    int heap_length;
+    int heap_allocated;
+    int sequence;
+} vlattice;
+
+int
+lattice_init(vlattice *lattice, varray *positions);
+
+/* Fills path with the tokens of the next best path. found is false when all the paths
+ * are taken. Returns VARNAM_MEMORY_ERROR when the paths after this one can't be kept */
+int
+lattice_next(vlattice *lattice, varray *path, bool *found);
+
+void
+lattice_release(vlattice *lattice);
 
 void
 destroy_token(void *token);
 
+/* Returns the interned token for the symbol id or NULL if it is not interned yet */
+vtoken*
+find_interned_token (vtoken_entry **table, int id);
+
+void
+intern_token (vtoken_entry **table, vtoken *token);
+
+void
+destroy_interned_tokens (vtoken_entry **table);
+
 #endif
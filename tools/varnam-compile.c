@@ -0,0 +1,432 @@
+/* varnam-compile.c - Builds a symbols table from a list of tokens
+ *
+ * Copyright (C) Navaneeth.K.N
+ *
+ * This is part of libvarnam. See LICENSE.txt for the license
+ */
+
+/*
+ * varnam-compile writes a symbols file (vst) with varnam_create_tokens_bulk(),
+ * without going through ruby. Scheme files are ruby programs and can't be read
+ * here, so the input is the flat list of tokens a scheme file expands to.
+ *
+ * Usage : varnam-compile tokens-file output-file
+ *
+ * Fields are separated by tabs. Empty lines and lines starting with # are skipped.
+ *
+ * Token lines
+ *   type match pattern value1 [value2 [value3 [tag [priority [accept-if]]]]]
+ *
+ *   type      - vowel, consonant, dead_consonant, consonant_vowel, number, symbol,
+ *               anusvara, visarga, virama, other, non_joiner, joiner or period
+ *   match     - exact or possibility
+ *   priority  - low, normal, high or a number. Default is normal
+ *   accept-if - all, starts_with, in_between, ends_with or a number. Default is all
+ *
+ * Directive lines start with @ and are named after the functions in scheme files.
+ * Options apply to the tokens that follow them.
+ *   @infer_dead_consonants on|off
+ *   @ignore_duplicates on|off
+ *   @stemrules old-ending new-ending
+ *   @exceptions_stem stem exception
+ *   @language_code code, @identifier id, @display_name name, @author name
+ *   @stable on|off
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "../varnam.h"
+
+#define COMPILE_MAX_LINE    1024
+#define COMPILE_MAX_FIELDS  9
+
+/* Indexed by VARNAM_TOKEN_XXX */
+static const char *token_types[] = {
+    "", "vowel", "consonant", "dead_consonant", "consonant_vowel", "number", "symbol",
+    "anusvara", "visarga", "virama", "other", "non_joiner", "joiner", "period"
+};
+
+/* Indexed by VARNAM_TOKEN_ACCEPT_XXX */
+static const char *accept_conditions[] = {
+    "all", "starts_with", "in_between", "ends_with"
+};
+
+/* Tokens read since the last time they were created. Fields of a spec point into
+   the copy of the line it was read from */
+struct pending_tokens {
+    vtoken_spec *specs;
+    char **lines;
+    size_t count;
+    size_t allocated;
+};
+
+struct compilation {
+    varnam *handle;
+    const char *file;
+    int line_number;
+    struct pending_tokens pending;
+    char *details[4];   /* language code, identifier, display name and author */
+    int stable;
+    size_t created;
+};
+
+static void
+report(struct compilation *c, const char *message, const char *detail)
+{
+    fprintf (stderr, "%s:%d: %s%s\n", c->file, c->line_number, message, detail == NULL ? "" : detail);
+}
+
+static char*
+copy_text(const char *text)
+{
+    char *copy = malloc (strlen (text) + 1);
+    if (copy != NULL)
+        strcpy (copy, text);
+    return copy;
+}
+
+static int
+find_name(const char **names, int count, const char *name)
+{
+    int i;
+    for (i = 0; i < count; i++)
+    {
+        if (strcmp (names[i], name) == 0)
+            return i;
+    }
+    return -1;
+}
+
+static int
+parse_switch(struct compilation *c, const char *value, int *output)
+{
+    if (strcmp (value, "on") == 0)
+        *output = 1;
+    else if (strcmp (value, "off") == 0)
+        *output = 0;
+    else {
+        report (c, "Expected on or off, found ", value);
+        return 0;
+    }
+    return 1;
+}
+
+/* Splits line at tabs in place. Empty fields are kept */
+static int
+split_fields(char *line, char **fields, int max)
+{
+    int count = 0;
+    char *end;
+
+    end = line + strlen (line);
+    while (end > line && (end[-1] == '\n' || end[-1] == '\r'))
+        *--end = '\0';
+
+    fields[count++] = line;
+    while ((line = strchr (line, '\t')) != NULL)
+    {
+        if (count == max)
+            return max + 1;
+        *line++ = '\0';
+        fields[count++] = line;
+    }
+
+    return count;
+}
+
+static void
+clear_pending(struct pending_tokens *pending)
+{
+    size_t i;
+    for (i = 0; i < pending->count; i++)
+        free (pending->lines[i]);
+    pending->count = 0;
+}
+
+/* Creates the tokens read so far in one go */
+static int
+create_pending(struct compilation *c)
+{
+    int rc;
+
+    if (c->pending.count == 0)
+        return 1;
+
+    rc = varnam_create_tokens_bulk (c->handle, c->pending.specs, c->pending.count);
+    if (rc != VARNAM_SUCCESS) {
+        report (c, "Failed to create tokens read till here. ", varnam_get_last_error (c->handle));
+        return 0;
+    }
+
+    c->created += c->pending.count;
+    clear_pending (&c->pending);
+    return 1;
+}
+
+static int
+add_token(struct compilation *c, char *line)
+{
+    int count, type, match_type, priority = VARNAM_TOKEN_PRIORITY_NORMAL, accept_condition = VARNAM_TOKEN_ACCEPT_ALL;
+    char *fields[COMPILE_MAX_FIELDS], *copy, *end;
+    struct pending_tokens *pending = &c->pending;
+    vtoken_spec *spec;
+
+    copy = copy_text (line);
+    if (copy == NULL)
+        return 0;
+
+    count = split_fields (copy, fields, COMPILE_MAX_FIELDS);
+    if (count < 4 || count > COMPILE_MAX_FIELDS) {
+        report (c, "Expected type, match, pattern, value1 and optionally value2, value3, tag, priority and accept-if", NULL);
+        free (copy);
+        return 0;
+    }
+
+    type = find_name (token_types, (int) ARRAY_SIZE (token_types), fields[0]);
+    if (type <= 0) {
+        report (c, "Unknown token type ", fields[0]);
+        free (copy);
+        return 0;
+    }
+
+    if (strcmp (fields[1], "exact") == 0)
+        match_type = VARNAM_MATCH_EXACT;
+    else if (strcmp (fields[1], "possibility") == 0)
+        match_type = VARNAM_MATCH_POSSIBILITY;
+    else {
+        report (c, "Match should be exact or possibility, found ", fields[1]);
+        free (copy);
+        return 0;
+    }
+
+    if (count > 7 && fields[7][0] != '\0')
+    {
+        if (strcmp (fields[7], "low") == 0)
+            priority = VARNAM_TOKEN_PRIORITY_LOW;
+        else if (strcmp (fields[7], "high") == 0)
+            priority = VARNAM_TOKEN_PRIORITY_HIGH;
+        else if (strcmp (fields[7], "normal") != 0) {
+            priority = (int) strtol (fields[7], &end, 10);
+            if (*end != '\0') {
+                report (c, "Priority should be low, normal, high or a number, found ", fields[7]);
+                free (copy);
+                return 0;
+            }
+        }
+    }
+
+    if (count > 8 && fields[8][0] != '\0')
+    {
+        accept_condition = find_name (accept_conditions, (int) ARRAY_SIZE (accept_conditions), fields[8]);
+        if (accept_condition < 0) {
+            accept_condition = (int) strtol (fields[8], &end, 10);
+            if (*end != '\0') {
+                report (c, "accept-if should be all, starts_with, in_between, ends_with or a number, found ", fields[8]);
+                free (copy);
+                return 0;
+            }
+        }
+    }
+
+    if (pending->count == pending->allocated)
+    {
+        pending->allocated = pending->allocated == 0 ? 256 : pending->allocated * 2;
+        pending->specs = realloc (pending->specs, sizeof (vtoken_spec) * pending->allocated);
+        pending->lines = realloc (pending->lines, sizeof (char*) * pending->allocated);
+        if (pending->specs == NULL || pending->lines == NULL) {
+            free (copy);
+            return 0;
+        }
+    }
+
+    spec = &pending->specs[pending->count];
+    spec->type = type;
+    spec->match_type = match_type;
+    spec->pattern = fields[2];
+    spec->value1 = fields[3];
+    spec->value2 = count > 4 ? fields[4] : "";
+    spec->value3 = count > 5 ? fields[5] : "";
+    spec->tag = count > 6 ? fields[6] : "";
+    spec->priority = priority;
+    spec->accept_condition = accept_condition;
+    pending->lines[pending->count++] = copy;
+
+    return 1;
+}
+
+static int
+apply_directive(struct compilation *c, char *line)
+{
+    int count, value, rc = VARNAM_SUCCESS, i;
+    char *fields[3];
+    const char *details[] = {"@language_code", "@identifier", "@display_name", "@author"};
+
+    count = split_fields (line, fields, 3);
+
+    for (i = 0; i < (int) ARRAY_SIZE (details); i++)
+    {
+        if (strcmp (fields[0], details[i]) != 0)
+            continue;
+
+        if (count != 2) {
+            report (c, "Expected a value for ", fields[0]);
+            return 0;
+        }
+
+        free (c->details[i]);
+        c->details[i] = copy_text (fields[1]);
+        return c->details[i] != NULL;
+    }
+
+    if (strcmp (fields[0], "@infer_dead_consonants") == 0 || strcmp (fields[0], "@ignore_duplicates") == 0 ||
+            strcmp (fields[0], "@stable") == 0)
+    {
+        if (count != 2) {
+            report (c, "Expected on or off for ", fields[0]);
+            return 0;
+        }
+
+        if (!parse_switch (c, fields[1], &value))
+            return 0;
+
+        if (strcmp (fields[0], "@stable") == 0) {
+            c->stable = value;
+            return 1;
+        }
+
+        /* Tokens read so far are created with the earlier setting */
+        if (!create_pending (c))
+            return 0;
+
+        if (strcmp (fields[0], "@infer_dead_consonants") == 0)
+            rc = varnam_config (c->handle, VARNAM_CONFIG_USE_DEAD_CONSONANTS, value);
+        else
+            rc = varnam_config (c->handle, VARNAM_CONFIG_IGNORE_DUPLICATE_TOKEN, value);
+    }
+    else if (strcmp (fields[0], "@stemrules") == 0 || strcmp (fields[0], "@exceptions_stem") == 0)
+    {
+        if (count != 3) {
+            report (c, "Expected two values for ", fields[0]);
+            return 0;
+        }
+
+        if (strcmp (fields[0], "@stemrules") == 0)
+            rc = varnam_create_stemrule (c->handle, fields[1], fields[2]);
+        else
+            rc = varnam_create_stem_exception (c->handle, fields[1], fields[2]);
+    }
+    else {
+        report (c, "Unknown directive ", fields[0]);
+        return 0;
+    }
+
+    if (rc != VARNAM_SUCCESS) {
+        report (c, "", varnam_get_last_error (c->handle));
+        return 0;
+    }
+
+    return 1;
+}
+
+static int
+set_scheme_details(struct compilation *c)
+{
+    int rc;
+    char compiled_date[64];
+    time_t now;
+    vscheme_details details;
+
+    now = time (NULL);
+    strftime (compiled_date, sizeof (compiled_date), "%Y-%m-%d %H:%M:%S", localtime (&now));
+
+    details.langCode = c->details[0];
+    details.identifier = c->details[1];
+    details.displayName = c->details[2];
+    details.author = c->details[3];
+    details.compiledDate = compiled_date;
+    details.isStable = c->stable;
+
+    rc = varnam_set_scheme_details (c->handle, &details);
+    if (rc != VARNAM_SUCCESS) {
+        fprintf (stderr, "Failed to set scheme details. %s\n", varnam_get_last_error (c->handle));
+        return 0;
+    }
+
+    return 1;
+}
+
+static int
+compile(struct compilation *c, FILE *input)
+{
+    char line[COMPILE_MAX_LINE];
+
+    while (fgets (line, sizeof (line), input) != NULL)
+    {
+        ++c->line_number;
+
+        if (strchr (line, '\n') == NULL && !feof (input)) {
+            report (c, "Line is too long", NULL);
+            return 0;
+        }
+
+        if (line[0] == '#' || line[strspn (line, " \t\r\n")] == '\0')
+            continue;
+
+        if (line[0] == '@') {
+            if (!apply_directive (c, line))
+                return 0;
+        }
+        else if (!add_token (c, line))
+            return 0;
+    }
+
+    return create_pending (c) && set_scheme_details (c);
+}
+
+int main(int argc, char **argv)
+{
+    int rc, i, compiled;
+    char *msg;
+    FILE *input;
+    struct compilation c;
+
+    if (argc != 3) {
+        printf ("Usage : %s tokens-file output-file\n", argv[0]);
+        return 1;
+    }
+
+    input = fopen (argv[1], "r");
+    if (input == NULL) {
+        printf ("Can't open %s\n", argv[1]);
+        return 1;
+    }
+
+    memset (&c, 0, sizeof (c));
+    c.file = argv[1];
+
+    remove (argv[2]);
+    rc = varnam_init (argv[2], &c.handle, &msg);
+    if (rc != VARNAM_SUCCESS) {
+        printf ("Initialization failed. %s\n", msg);
+        fclose (input);
+        return 1;
+    }
+
+    printf ("Building %s\n", argv[2]);
+    compiled = compile (&c, input);
+    if (compiled)
+        printf ("Created %lu tokens\n", (unsigned long) c.created);
+
+    fclose (input);
+    varnam_destroy (c.handle);
+    clear_pending (&c.pending);
+    free (c.pending.specs);
+    free (c.pending.lines);
+    for (i = 0; i < (int) ARRAY_SIZE (c.details); i++)
+        free (c.details[i]);
+
+    return compiled ? 0 : 1;
+}
@@ -0,0 +1,719 @@
+/* varnamd.c - Serves transliteration requests over a unix domain socket
+ *
+ * Copyright (C) Navaneeth.K.N
+ *
+ * This is part of libvarnam. See LICENSE.txt for the license
+ */
+
+/*
+ * varnamd keeps a fixed set of worker threads and a pool of warm varnam handles,
+ * so that processes on the same host can share one set of caches instead of
+ * initializing varnam themselves. The main thread polls the listener and all the
+ * idle connections. A connection with a pending request is handed to a worker,
+ * which serves that one request with a handle checked out from the pool and gives
+ * the connection back to the main thread. So a client which keeps its connection
+ * open doesn't hold a worker. Learning goes through a single writer thread, which
+ * owns the only handle that writes to the learnings file.
+ *
+ * Usage : varnamd scheme-id socket-path [workers]
+ *
+ * All integers on the wire are unsigned and in network byte order.
+ *
+ * Request  : u32 length, u8 operation, u8 argument, input text (length - 2 bytes)
+ * Response : u32 length, u8 status, body (length - 1 bytes)
+ *
+ * status is one of the VARNAM_XXX result codes. When it is not VARNAM_SUCCESS,
+ * body is the error message. Otherwise body depends on the operation.
+ *
+ * VARNAMD_TRANSLITERATE, VARNAMD_SUGGEST
+ *   u16 count, followed by count words. Each word is u32 confidence, u16 length and the text.
+ *   For VARNAMD_SUGGEST, argument is the maximum number of words to return. 0 means no limit.
+ * VARNAMD_REVERSE_TRANSLITERATE
+ *   The reverse transliterated text
+ * VARNAMD_LEARN
+ *   Empty
+ */
+
+#define _POSIX_C_SOURCE 200112L
+
+#include <errno.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <pthread.h>
+#include <signal.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <sys/time.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+#include "../varnam.h"
+
+#define VARNAMD_TRANSLITERATE          1
+#define VARNAMD_REVERSE_TRANSLITERATE  2
+#define VARNAMD_LEARN                  3
+#define VARNAMD_SUGGEST                4
+
+#define VARNAMD_DEFAULT_WORKERS        4
+#define VARNAMD_MAX_WORKERS            64
+#define VARNAMD_MAX_REQUEST            (64 * 1024)
+#define VARNAMD_MAX_RESPONSE           (256 * 1024)
+#define VARNAMD_PENDING_CONNECTIONS    64
+#define VARNAMD_MAX_CONNECTIONS        256
+#define VARNAMD_IO_TIMEOUT_SECONDS     5
+#define VARNAMD_QUEUE_SIZE             (VARNAMD_MAX_CONNECTIONS + VARNAMD_MAX_WORKERS)
+
+/* Messages on the notification pipe, other than a connection to poll again */
+#define VARNAMD_CONNECTION_CLOSED      -1
+#define VARNAMD_WAKE_UP                -2
+
+/* Connections with a pending request, waiting for a worker. A negative fd asks the worker to exit.
+   Open connections are limited to VARNAMD_MAX_CONNECTIONS, so this never fills up */
+struct connection_queue {
+    int fds[VARNAMD_QUEUE_SIZE];
+    int head, count;
+    pthread_mutex_t lock;
+    pthread_cond_t not_empty;
+    pthread_cond_t not_full;
+};
+
+/* A word handed to the writer. The worker waits until the writer marks it completed */
+struct learn_request {
+    const char *word;
+    int rc;
+    int completed;
+    char *error;
+    size_t error_size;
+    struct learn_request *next;
+};
+
+struct learn_queue {
+    struct learn_request *head, *tail;
+    int stopping;
+    pthread_mutex_t lock;
+    pthread_cond_t pending;
+    pthread_cond_t done;
+};
+
+struct worker {
+    pthread_t thread;
+    unsigned char request[VARNAMD_MAX_REQUEST + 1];
+    unsigned char response[VARNAMD_MAX_RESPONSE];
+    size_t response_length;
+};
+
+static struct connection_queue connections;
+static struct learn_queue learnings;
+static varnam_pool *handles = NULL;
+static volatile sig_atomic_t stopping = 0;
+
+/* Workers give connections back to the main thread through this pipe */
+static int notifications[2] = { -1, -1 };
+
+static void
+notify(int message)
+{
+    ssize_t n;
+
+    do {
+        n = write (notifications[1], &message, sizeof (message));
+    } while (n < 0 && errno == EINTR);
+}
+
+static void
+handle_signal(int signum)
+{
+    int saved_errno = errno;
+
+    (void) signum;
+    stopping = 1;
+    notify (VARNAMD_WAKE_UP);
+    errno = saved_errno;
+}
+
+static void
+push_connection(int fd)
+{
+    pthread_mutex_lock (&connections.lock);
+    while (connections.count == VARNAMD_QUEUE_SIZE)
+        pthread_cond_wait (&connections.not_full, &connections.lock);
+
+    connections.fds[(connections.head + connections.count) % VARNAMD_QUEUE_SIZE] = fd;
+    ++connections.count;
+    pthread_cond_signal (&connections.not_empty);
+    pthread_mutex_unlock (&connections.lock);
+}
+
+static int
+pop_connection()
+{
+    int fd;
+
+    pthread_mutex_lock (&connections.lock);
+    while (connections.count == 0)
+        pthread_cond_wait (&connections.not_empty, &connections.lock);
+
+    fd = connections.fds[connections.head];
+    connections.head = (connections.head + 1) % VARNAMD_QUEUE_SIZE;
+    --connections.count;
+    pthread_cond_signal (&connections.not_full);
+    pthread_mutex_unlock (&connections.lock);
+
+    return fd;
+}
+
+static int
+read_fully(int fd, unsigned char *buffer, size_t length)
+{
+    ssize_t n;
+
+    while (length > 0)
+    {
+        n = read (fd, buffer, length);
+        if (n < 0 && errno == EINTR)
+            continue;
+        if (n <= 0)
+            return 0;
+        buffer += n;
+        length -= (size_t) n;
+    }
+
+    return 1;
+}
+
+static int
+write_fully(int fd, const unsigned char *buffer, size_t length)
+{
+    ssize_t n;
+
+    while (length > 0)
+    {
+        n = write (fd, buffer, length);
+        if (n < 0 && errno == EINTR)
+            continue;
+        if (n <= 0)
+            return 0;
+        buffer += n;
+        length -= (size_t) n;
+    }
+
+    return 1;
+}
+
+static unsigned long
+get_u32(const unsigned char *p)
+{
+    return ((unsigned long) p[0] << 24) | ((unsigned long) p[1] << 16) |
+           ((unsigned long) p[2] << 8) | (unsigned long) p[3];
+}
+
+static void
+put_u32(unsigned char *p, unsigned long value)
+{
+    p[0] = (unsigned char) ((value >> 24) & 0xff);
+    p[1] = (unsigned char) ((value >> 16) & 0xff);
+    p[2] = (unsigned char) ((value >> 8) & 0xff);
+    p[3] = (unsigned char) (value & 0xff);
+}
+
+static void
+put_u16(unsigned char *p, size_t value)
+{
+    p[0] = (unsigned char) ((value >> 8) & 0xff);
+    p[1] = (unsigned char) (value & 0xff);
+}
+
+/* Response starts after the length prefix and status byte. Returns 0 when there is no space */
+static int
+append(struct worker *w, const void *data, size_t length)
+{
+    if (length > VARNAMD_MAX_RESPONSE - w->response_length)
+        return 0;
+
+    memcpy (w->response + w->response_length, data, length);
+    w->response_length += length;
+    return 1;
+}
+
+static void
+set_status(struct worker *w, int status, const char *message)
+{
+    w->response[4] = (unsigned char) status;
+    w->response_length = 5;
+    if (message != NULL)
+        append (w, message, strlen (message));
+}
+
+static void
+write_words(struct worker *w, varray *words)
+{
+    int i;
+    size_t count = 0, length, count_offset;
+    unsigned char header[6];
+    vword *word;
+
+    count_offset = w->response_length;
+    w->response_length += 2;
+
+    for (i = 0; i < varray_length (words) && count < 0xffff; i++)
+    {
+        word = varray_get (words, i);
+        length = strlen (word->text);
+        if (length > 0xffff)
+            continue;
+
+        put_u32 (header, (unsigned long) word->confidence);
+        put_u16 (header + 4, length);
+        if (!append (w, header, sizeof (header)) || !append (w, word->text, length)) {
+            set_status (w, VARNAM_TRUNCATED, "Response is too large");
+            return;
+        }
+        ++count;
+    }
+
+    put_u16 (w->response + count_offset, count);
+}
+
+static int
+learn(const char *word, char *error, size_t error_size)
+{
+    struct learn_request request;
+
+    request.word = word;
+    request.rc = VARNAM_ERROR;
+    request.completed = 0;
+    request.error = error;
+    request.error_size = error_size;
+    request.next = NULL;
+
+    pthread_mutex_lock (&learnings.lock);
+    if (learnings.tail == NULL)
+        learnings.head = &request;
+    else
+        learnings.tail->next = &request;
+    learnings.tail = &request;
+    pthread_cond_signal (&learnings.pending);
+
+    while (!request.completed)
+        pthread_cond_wait (&learnings.done, &learnings.lock);
+    pthread_mutex_unlock (&learnings.lock);
+
+    return request.rc;
+}
+
+static void
+process_request(struct worker *w, varnam *handle, int operation, int argument, const char *input)
+{
+    int rc;
+    varray *words;
+    char *output;
+    char error[256];
+
+    set_status (w, VARNAM_SUCCESS, NULL);
+
+    switch (operation)
+    {
+    case VARNAMD_TRANSLITERATE:
+    case VARNAMD_SUGGEST:
+        varnam_config (handle, VARNAM_CONFIG_MAX_CANDIDATES,
+                       operation == VARNAMD_SUGGEST ? argument : 0);
+        rc = varnam_transliterate (handle, input, &words);
+        if (rc != VARNAM_SUCCESS) {
+            set_status (w, rc, varnam_get_last_error (handle));
+            return;
+        }
+        write_words (w, words);
+        break;
+    case VARNAMD_REVERSE_TRANSLITERATE:
+        rc = varnam_reverse_transliterate (handle, input, &output);
+        if (rc != VARNAM_SUCCESS) {
+            set_status (w, rc, varnam_get_last_error (handle));
+            return;
+        }
+        if (!append (w, output, strlen (output)))
+            set_status (w, VARNAM_TRUNCATED, "Response is too large");
+        break;
+    case VARNAMD_LEARN:
+        rc = learn (input, error, sizeof (error));
+        if (rc != VARNAM_SUCCESS)
+            set_status (w, rc, error);
+        break;
+    default:
+        set_status (w, VARNAM_ARGS_ERROR, "Unknown operation");
+    }
+}
+
+/* Serves one request on fd. Returns 0 when the connection should be closed */
+static int
+serve_request(struct worker *w, int fd)
+{
+    int rc;
+    unsigned char header[6];
+    size_t length;
+    varnam *handle;
+
+    if (!read_fully (fd, header, 4))
+        return 0;
+
+    length = (size_t) get_u32 (header);
+    if (length < 2 || length - 2 > VARNAMD_MAX_REQUEST)
+        return 0;
+
+    if (!read_fully (fd, header + 4, 2) || !read_fully (fd, w->request, length - 2))
+        return 0;
+    w->request[length - 2] = '\0';
+
+    /* There are as many handles as workers, so this doesn't wait */
+    rc = varnam_pool_checkout (handles, -1, &handle);
+    if (rc != VARNAM_SUCCESS)
+        set_status (w, rc, "No handles available");
+    else {
+        process_request (w, handle, header[4], header[5], (const char*) w->request);
+        varnam_pool_checkin (handles, handle);
+    }
+
+    put_u32 (w->response, (unsigned long) (w->response_length - 4));
+    return write_fully (fd, w->response, w->response_length);
+}
+
+static void*
+worker_main(void *arg)
+{
+    int fd;
+    struct worker *w = (struct worker*) arg;
+
+    for (;;)
+    {
+        fd = pop_connection ();
+        if (fd < 0)
+            break;
+
+        if (serve_request (w, fd))
+            notify (fd);
+        else {
+            close (fd);
+            notify (VARNAMD_CONNECTION_CLOSED);
+        }
+    }
+
+    return NULL;
+}
+
+static void*
+writer_main(void *arg)
+{
+    int rc;
+    varnam *handle = (varnam*) arg;
+    struct learn_request *request;
+
+    pthread_mutex_lock (&learnings.lock);
+    for (;;)
+    {
+        while (learnings.head == NULL && !learnings.stopping)
+            pthread_cond_wait (&learnings.pending, &learnings.lock);
+
+        if (learnings.head == NULL)
+            break;
+
+        request = learnings.head;
+        learnings.head = request->next;
+        if (learnings.head == NULL)
+            learnings.tail = NULL;
+
+        /* Words are learned one at a time. Workers keep serving while this runs */
+        pthread_mutex_unlock (&learnings.lock);
+        rc = varnam_learn (handle, request->word);
+        if (rc != VARNAM_SUCCESS) {
+            strncpy (request->error, varnam_get_last_error (handle), request->error_size - 1);
+            request->error[request->error_size - 1] = '\0';
+        }
+        pthread_mutex_lock (&learnings.lock);
+
+        request->rc = rc;
+        request->completed = 1;
+        pthread_cond_broadcast (&learnings.done);
+    }
+    pthread_mutex_unlock (&learnings.lock);
+
+    return NULL;
+}
+
+static int
+open_socket(const char *path)
+{
+    int fd;
+    struct sockaddr_un address;
+
+    if (strlen (path) >= sizeof (address.sun_path)) {
+        fprintf (stderr, "Socket path is too long : %s\n", path);
+        return -1;
+    }
+
+    fd = socket (AF_UNIX, SOCK_STREAM, 0);
+    if (fd < 0) {
+        perror ("socket");
+        return -1;
+    }
+
+    memset (&address, 0, sizeof (address));
+    address.sun_family = AF_UNIX;
+    strcpy (address.sun_path, path);
+    unlink (path);
+
+    if (bind (fd, (struct sockaddr*) &address, sizeof (address)) != 0 || listen (fd, VARNAMD_PENDING_CONNECTIONS) != 0) {
+        perror ("bind");
+        close (fd);
+        return -1;
+    }
+
+    return fd;
+}
+
+static int
+init_handle(const char *scheme_id, varnam **handle)
+{
+    int rc;
+    char *msg;
+
+    rc = varnam_init_from_id (scheme_id, handle, &msg);
+    if (rc != VARNAM_SUCCESS) {
+        fprintf (stderr, "Initialization failed. %s\n", msg);
+        free (msg);
+    }
+
+    return rc;
+}
+
+/* A client which sends half a request or stops reading can't hold a worker for longer than this */
+static void
+set_timeouts(int fd)
+{
+    struct timeval timeout;
+
+    timeout.tv_sec = VARNAMD_IO_TIMEOUT_SECONDS;
+    timeout.tv_usec = 0;
+    setsockopt (fd, SOL_SOCKET, SO_RCVTIMEO, &timeout, sizeof (timeout));
+    setsockopt (fd, SOL_SOCKET, SO_SNDTIMEO, &timeout, sizeof (timeout));
+}
+
+/* Polled by the main thread. First one is the listener, second one the notification pipe
+   and the rest are idle connections */
+static struct pollfd polled[VARNAMD_MAX_CONNECTIONS + 2];
+static nfds_t polled_count = 2;
+static int open_connections = 0;
+
+static void
+watch(int fd)
+{
+    polled[polled_count].fd = fd;
+    polled[polled_count].events = POLLIN;
+    polled[polled_count].revents = 0;
+    ++polled_count;
+}
+
+static void
+close_idle_connections()
+{
+    nfds_t i;
+
+    for (i = 2; i < polled_count; i++)
+    {
+        close (polled[i].fd);
+        --open_connections;
+    }
+    polled_count = 2;
+}
+
+/* Reads everything workers have sent so far. Read end of the pipe is non blocking */
+static void
+receive_notifications()
+{
+    int messages[64];
+    ssize_t n;
+    size_t i;
+
+    for (;;)
+    {
+        n = read (notifications[0], messages, sizeof (messages));
+        if (n < 0 && errno == EINTR)
+            continue;
+        if (n <= 0)
+            return;
+
+        for (i = 0; i < (size_t) n / sizeof (int); i++)
+        {
+            if (messages[i] >= 0)
+                watch (messages[i]);
+            else if (messages[i] == VARNAMD_CONNECTION_CLOSED)
+                --open_connections;
+        }
+    }
+}
+
+static void
+accept_connection(int listener)
+{
+    int fd;
+
+    fd = accept (listener, NULL, NULL);
+    if (fd < 0)
+        return;
+
+    if (open_connections == VARNAMD_MAX_CONNECTIONS) {
+        close (fd);
+        return;
+    }
+
+    set_timeouts (fd);
+    watch (fd);
+    ++open_connections;
+}
+
+int main(int argc, char **argv)
+{
+    int i, rc, listener, worker_count = VARNAMD_DEFAULT_WORKERS, started = 0;
+    nfds_t n;
+    char *msg;
+    varnam *writer_handle = NULL;
+    pthread_t writer;
+    struct worker *workers;
+    struct sigaction action;
+    sigset_t blocked, previous;
+
+    if (argc < 3 || argc > 4) {
+        printf ("Usage : %s scheme-id socket-path [workers]\n", argv[0]);
+        return 1;
+    }
+
+    if (argc == 4) {
+        worker_count = atoi (argv[3]);
+        if (worker_count < 1 || worker_count > VARNAMD_MAX_WORKERS) {
+            printf ("Workers should be between 1 and %d\n", VARNAMD_MAX_WORKERS);
+            return 1;
+        }
+    }
+
+    workers = calloc ((size_t) worker_count, sizeof (struct worker));
+    if (workers == NULL)
+        return 1;
+
+    /* Handles only read the symbols file. Opening it read only lets all of them share the mapped scheme */
+    rc = varnam_pool_create_with_flags (argv[1], VARNAM_OPEN_READONLY, worker_count, &handles, &msg);
+    if (rc != VARNAM_SUCCESS) {
+        fprintf (stderr, "Initialization failed. %s\n", msg == NULL ? "" : msg);
+        free (msg);
+        return 1;
+    }
+
+    if (init_handle (argv[1], &writer_handle) != VARNAM_SUCCESS)
+        return 1;
+
+    listener = open_socket (argv[2]);
+    if (listener < 0)
+        return 1;
+
+    if (pipe (notifications) != 0) {
+        perror ("pipe");
+        return 1;
+    }
+    fcntl (notifications[0], F_SETFL, O_NONBLOCK);
+
+    memset (&action, 0, sizeof (action));
+    action.sa_handler = &handle_signal;
+    sigemptyset (&action.sa_mask);
+    sigaction (SIGINT, &action, NULL);
+    sigaction (SIGTERM, &action, NULL);
+    action.sa_handler = SIG_IGN;
+    sigaction (SIGPIPE, &action, NULL);
+
+    pthread_mutex_init (&connections.lock, NULL);
+    pthread_cond_init (&connections.not_empty, NULL);
+    pthread_cond_init (&connections.not_full, NULL);
+    pthread_mutex_init (&learnings.lock, NULL);
+    pthread_cond_init (&learnings.pending, NULL);
+    pthread_cond_init (&learnings.done, NULL);
+
+    /* Threads inherit the signal mask. Only the main thread should be interrupted by these */
+    sigemptyset (&blocked);
+    sigaddset (&blocked, SIGINT);
+    sigaddset (&blocked, SIGTERM);
+    pthread_sigmask (SIG_BLOCK, &blocked, &previous);
+
+    if (pthread_create (&writer, NULL, &writer_main, writer_handle) != 0) {
+        fprintf (stderr, "Failed to start the learnings writer\n");
+        return 1;
+    }
+
+    for (i = 0; i < worker_count; i++)
+    {
+        if (pthread_create (&workers[i].thread, NULL, &worker_main, &workers[i]) != 0)
+            break;
+        ++started;
+    }
+
+    pthread_sigmask (SIG_SETMASK, &previous, NULL);
+
+    printf ("varnamd %s serving %s on %s with %d workers\n", varnam_version (), argv[1], argv[2], started);
+    fflush (stdout);
+
+    polled[0].fd = listener;
+    polled[0].events = POLLIN;
+    polled[1].fd = notifications[0];
+    polled[1].events = POLLIN;
+
+    while (!stopping && started > 0)
+    {
+        if (poll (polled, polled_count, -1) < 0) {
+            if (errno == EINTR)
+                continue;
+            perror ("poll");
+            break;
+        }
+
+        /* A connection with a pending request is not polled till the worker gives it back */
+        for (n = 2; n < polled_count;)
+        {
+            if (polled[n].revents == 0) {
+                ++n;
+                continue;
+            }
+            push_connection (polled[n].fd);
+            polled[n] = polled[--polled_count];
+        }
+
+        if (polled[1].revents != 0)
+            receive_notifications ();
+
+        if (polled[0].revents != 0)
+            accept_connection (listener);
+    }
+
+    close (listener);
+    unlink (argv[2]);
+
+    /* Clients which are connected but not waiting for a response are not waited for. Workers
+       finish the requests they have and the connections they give back are closed after they exit */
+    close_idle_connections ();
+    for (i = 0; i < started; i++)
+        push_connection (-1);
+    for (i = 0; i < started; i++)
+        pthread_join (workers[i].thread, NULL);
+    receive_notifications ();
+    close_idle_connections ();
+
+    pthread_mutex_lock (&learnings.lock);
+    learnings.stopping = 1;
+    pthread_cond_signal (&learnings.pending);
+    pthread_mutex_unlock (&learnings.lock);
+    pthread_join (writer, NULL);
+
+    varnam_pool_destroy (handles);
+    varnam_destroy (writer_handle);
+    close (notifications[0]);
+    close (notifications[1]);
+    free (workers);
+
+    return 0;
+}
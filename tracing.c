@@ -0,0 +1,489 @@
+/* tracing.c - Timings of the stages of public calls and cost of sqlite statements
+ *
+ * Copyright (C) Navaneeth.K.N
+ *
+ * This is part of libvarnam. See LICENSE.txt for the license
+ */
+
+#if defined(WIN32) || defined(_WIN32) || defined(__WIN32)
+#define VARNAM_TRACING_WIN32
+#else
+/* clock_gettime is not visible with -ansi otherwise */
+#define _POSIX_C_SOURCE 200112L
+#endif
+
+#include <stddef.h>
+#include <string.h>
+
+#ifdef VARNAM_TRACING_WIN32
+#include <windows.h>
+#else
+#include <time.h>
+#endif
+
+#include "api.h"
+#include "util.h"
+#include "vtypes.h"
+#include "tracing.h"
+#include "result-codes.h"
+
+/* Timings are kept in log-linear buckets like HDR histograms. Times below 32us get a
+ * bucket each. Above that, each power of two is split into 16 buckets, which keeps
+ * a time within 6.25% of its bucket. Times above 2^31us (~35 minutes) go to the last
+ * bucket */
+#define EXACT_BUCKETS     32
+#define SUB_BUCKET_BITS   4
+#define SUB_BUCKETS       (1 << SUB_BUCKET_BITS)
+#define FIRST_POWER       5   /* EXACT_BUCKETS == 1 << FIRST_POWER */
+#define LAST_POWER        30
+
+#ifdef VARNAM_TRACING_WIN32
+
+sqlite3_int64
+monotonic_time_us()
+{
+    LARGE_INTEGER counter, frequency;
+    QueryPerformanceCounter (&counter);
+    QueryPerformanceFrequency (&frequency);
+    return (sqlite3_int64) (counter.QuadPart / frequency.QuadPart * 1000000 +
+                            counter.QuadPart % frequency.QuadPart * 1000000 / frequency.QuadPart);
+}
+
+#else
+
+sqlite3_int64
+monotonic_time_us()
+{
+    struct timespec now;
+    clock_gettime (CLOCK_MONOTONIC, &now);
+    return (sqlite3_int64) now.tv_sec * 1000000 + now.tv_nsec / 1000;
+}
+
+#endif
+
+static int
+bucket_for(long us)
+{
+    int power = FIRST_POWER;
+
+    if (us < EXACT_BUCKETS)
+        return us < 0 ? 0 : (int) us;
+
+    while (power < LAST_POWER && (us >> (power + 1)) != 0)
+        ++power;
+
+    if ((us >> (power + 1)) != 0)
+        return VARNAM_TIMING_BUCKETS - 1;
+
+    return EXACT_BUCKETS + (power - FIRST_POWER) * SUB_BUCKETS +
+        (int) ((us >> (power - SUB_BUCKET_BITS)) & (SUB_BUCKETS - 1));
+}
+
+long
+varnam_timing_bucket_limit(int bucket)
+{
+    int power, sub_bucket;
+
+    if (bucket < 0 || bucket >= VARNAM_TIMING_BUCKETS)
+        return -1;
+
+    if (bucket < EXACT_BUCKETS)
+        return bucket;
+
+    power = (bucket - EXACT_BUCKETS) / SUB_BUCKETS + FIRST_POWER;
+    sub_bucket = (bucket - EXACT_BUCKETS) % SUB_BUCKETS;
+    return ((long) (SUB_BUCKETS + sub_bucket) << (power - SUB_BUCKET_BITS)) +
+        (1L << (power - SUB_BUCKET_BITS)) - 1;
+}
+
+void
+trace_start(varnam *handle, vtrace *trace)
+{
+    trace->enabled = v_->timings != NULL;
+    trace->started = trace->enabled ? monotonic_time_us () : 0;
+}
+
+void
+trace_end(varnam *handle, int stage, vtrace *trace)
+{
+    long taken;
+    vtimings *timings;
+
+    /* Tracing may have been turned on in the middle of the stage */
+    if (!trace->enabled || v_->timings == NULL)
+        return;
+
+    /* A single stage taking more than LONG_MAX microseconds is not expected */
+    taken = (long) (monotonic_time_us () - trace->started);
+    timings = &v_->timings[stage];
+
+    if (timings->count == 0 || taken < timings->min_us)
+        timings->min_us = taken;
+    if (taken > timings->max_us)
+        timings->max_us = taken;
+
+    ++timings->count;
+    timings->total_us += taken;
+    ++timings->buckets[bucket_for (taken)];
+}
+
+int
+enable_tracing(varnam *handle, int enable)
+{
+    if (!enable) {
+        destroy_tracing (handle);
+        return VARNAM_SUCCESS;
+    }
+
+    if (v_->timings != NULL)
+        return VARNAM_SUCCESS;
+
+    v_->timings = xmalloc (sizeof (vtimings) * VARNAM_STAGES);
+    if (v_->timings == NULL)
+        return VARNAM_MEMORY_ERROR;
+
+    memset (v_->timings, 0, sizeof (vtimings) * VARNAM_STAGES);
+    return VARNAM_SUCCESS;
+}
+
+void
+destroy_tracing(varnam *handle)
+{
+    xfree (v_->timings);
+    v_->timings = NULL;
+}
+
+/* Upper limit of the bucket where the given fraction of the calls are done */
+static long
+percentile(vtimings *timings, double fraction)
+{
+    long wanted, seen = 0;
+    int i;
+
+    wanted = (long) (fraction * (double) timings->count);
+    if ((double) wanted < fraction * (double) timings->count)
+        ++wanted;
+
+    for (i = 0; i < VARNAM_TIMING_BUCKETS; i++)
+    {
+        seen += timings->buckets[i];
+        if (seen >= wanted)
+            break;
+    }
+
+    /* Bucket limit can be more than what was actually seen */
+    if (varnam_timing_bucket_limit (i) > timings->max_us)
+        return timings->max_us;
+
+    return varnam_timing_bucket_limit (i);
+}
+
+int
+varnam_get_timings(varnam *handle, int stage, vtimings *timings)
+{
+    if (handle == NULL || timings == NULL || stage < 0 || stage >= VARNAM_STAGES)
+        return VARNAM_ARGS_ERROR;
+
+    if (v_->timings == NULL) {
+        memset (timings, 0, sizeof (vtimings));
+        return VARNAM_SUCCESS;
+    }
+
+    *timings = v_->timings[stage];
+    if (timings->count > 0) {
+        timings->p50_us = percentile (timings, 0.5);
+        timings->p90_us = percentile (timings, 0.9);
+        timings->p99_us = percentile (timings, 0.99);
+        timings->p999_us = percentile (timings, 0.999);
+    }
+
+    return VARNAM_SUCCESS;
+}
+
+int
+varnam_reset_timings(varnam *handle)
+{
+    if (handle == NULL)
+        return VARNAM_ARGS_ERROR;
+
+    if (v_->timings != NULL)
+        memset (v_->timings, 0, sizeof (vtimings) * VARNAM_STAGES);
+
+    return VARNAM_SUCCESS;
+}
+
+/* Statements kept by the handle. Anything else is counted as "other" */
+static const struct {
+    const char *name;
+    size_t offset;
+} statements[VARNAM_STATEMENTS - 1] = {
+    {"tokenize_using_pattern", offsetof (struct varnam_internal, tokenize_using_pattern)},
+    {"tokenize_using_value", offsetof (struct varnam_internal, tokenize_using_value)},
+    {"tokenize_using_value_and_match_type", offsetof (struct varnam_internal, tokenize_using_value_and_match_type)},
+    {"can_find_more_matches_using_pattern", offsetof (struct varnam_internal, can_find_more_matches_using_pattern)},
+    {"can_find_more_matches_using_value", offsetof (struct varnam_internal, can_find_more_matches_using_value)},
+    {"learn_word", offsetof (struct varnam_internal, learn_word)},
+    {"learn_pattern", offsetof (struct varnam_internal, learn_pattern)},
+    {"get_word", offsetof (struct varnam_internal, get_word)},
+    {"get_suggestions", offsetof (struct varnam_internal, get_suggestions)},
+    {"get_best_match", offsetof (struct varnam_internal, get_best_match)},
+    {"get_matches_for_word", offsetof (struct varnam_internal, get_matches_for_word)},
+    {"possible_to_find_matches", offsetof (struct varnam_internal, possible_to_find_matches)},
+    {"update_confidence", offsetof (struct varnam_internal, update_confidence)},
+    {"update_learned_flag", offsetof (struct varnam_internal, update_learned_flag)},
+    {"delete_pattern", offsetof (struct varnam_internal, delete_pattern)},
+    {"delete_word", offsetof (struct varnam_internal, delete_word)},
+    {"export_words", offsetof (struct varnam_internal, export_words)},
+    {"learned_words_count", offsetof (struct varnam_internal, learned_words_count)},
+    {"all_words_count", offsetof (struct varnam_internal, all_words_count)},
+    {"get_stemrule", offsetof (struct varnam_internal, get_stemrule)},
+    {"get_last_syllable", offsetof (struct varnam_internal, get_last_syllable)},
+    {"check_exception", offsetof (struct varnam_internal, check_exception)},
+    {"persist_stemrule", offsetof (struct varnam_internal, persist_stemrule)},
+    {"persist_stem_exception", offsetof (struct varnam_internal, persist_stem_exception)}
+};
+
+#define OTHER_STATEMENT (VARNAM_STATEMENTS - 1)
+
+static int
+statement_index(varnam *handle, sqlite3_stmt *stmt)
+{
+    int i;
+    sqlite3_stmt *kept;
+
+    for (i = 0; i < OTHER_STATEMENT; i++)
+    {
+        memcpy (&kept, (char*) v_ + statements[i].offset, sizeof (sqlite3_stmt*));
+        if (kept == stmt)
+            return i;
+    }
+
+    return OTHER_STATEMENT;
+}
+
+static const char*
+statement_name(int index)
+{
+    return index == OTHER_STATEMENT ? "other" : statements[index].name;
+}
+
+#if SQLITE_VERSION_NUMBER >= 3014000
+
+/* Notes when the statement starts running. sqlite reports the time of a run from a clock
+ * with millisecond resolution, so it is timed here instead */
+static void
+statement_started(varnam *handle, sqlite3_stmt *stmt)
+{
+    int i, slot = -1;
+
+    for (i = 0; i < VARNAM_RUNNING_STATEMENTS; i++)
+    {
+        if (v_->running_statements[i].stmt == stmt) {
+            slot = i;
+            break;
+        }
+        if (slot == -1 && v_->running_statements[i].stmt == NULL)
+            slot = i;
+    }
+
+    if (slot == -1)
+        return;
+
+    v_->running_statements[slot].stmt = stmt;
+    v_->running_statements[slot].started = monotonic_time_us ();
+}
+
+/* Microseconds the statement took. reported_ns is used when the start was not noted */
+static long
+statement_elapsed_us(varnam *handle, sqlite3_stmt *stmt, sqlite3_int64 reported_ns)
+{
+    int i;
+
+    for (i = 0; i < VARNAM_RUNNING_STATEMENTS; i++)
+    {
+        if (v_->running_statements[i].stmt == stmt) {
+            v_->running_statements[i].stmt = NULL;
+            return (long) (monotonic_time_us () - v_->running_statements[i].started);
+        }
+    }
+
+    return (long) (reported_ns / 1000);
+}
+
+static int
+profile_statement(unsigned int type, void *context, void *p, void *x)
+{
+    varnam *handle = context;
+    sqlite3_stmt *stmt = p;
+    vstatement_stats *stats = NULL;
+    long elapsed_us;
+    int index;
+
+    if (type == SQLITE_TRACE_STMT) {
+        statement_started (handle, stmt);
+        return 0;
+    }
+
+    index = statement_index (handle, stmt);
+    if (v_->statement_stats != NULL)
+        stats = &v_->statement_stats[index];
+
+    if (type == SQLITE_TRACE_ROW) {
+        if (stats != NULL)
+            ++stats->rows;
+        return 0;
+    }
+
+    elapsed_us = statement_elapsed_us (handle, stmt, *(sqlite3_int64*) x);
+    if (stats != NULL)
+    {
+        /* Counters are reset after each run, so they add up even when the statement
+           is finalized and prepared again */
+        ++stats->executions;
+        stats->total_us += elapsed_us;
+        stats->fullscan_steps += sqlite3_stmt_status (stmt, SQLITE_STMTSTATUS_FULLSCAN_STEP, 1);
+        stats->sorts += sqlite3_stmt_status (stmt, SQLITE_STMTSTATUS_SORT, 1);
+        stats->autoindexes += sqlite3_stmt_status (stmt, SQLITE_STMTSTATUS_AUTOINDEX, 1);
+        stats->vm_steps += sqlite3_stmt_status (stmt, SQLITE_STMTSTATUS_VM_STEP, 1);
+    }
+
+    if (v_->slow_query_callback != NULL && elapsed_us >= v_->slow_query_threshold_us)
+        v_->slow_query_callback (statement_name (index), sqlite3_sql (stmt), elapsed_us);
+
+    return 0;
+}
+
+static void
+trace_connection(varnam *handle, sqlite3 *db, unsigned int mask)
+{
+    if (db == NULL)
+        return;
+
+    if (mask == 0)
+        sqlite3_trace_v2 (db, 0, NULL, NULL);
+    else
+        sqlite3_trace_v2 (db, mask, &profile_statement, handle);
+}
+
+void
+install_statement_profiler(varnam *handle)
+{
+    unsigned int mask = 0;
+
+    if (v_->statement_stats != NULL)
+        mask |= SQLITE_TRACE_STMT | SQLITE_TRACE_PROFILE | SQLITE_TRACE_ROW;
+    if (v_->slow_query_callback != NULL)
+        mask |= SQLITE_TRACE_STMT | SQLITE_TRACE_PROFILE;
+
+    memset (v_->running_statements, 0, sizeof (v_->running_statements));
+
+    trace_connection (handle, v_->db, mask);
+    trace_connection (handle, v_->known_words, mask);
+    trace_connection (handle, v_->known_words_reader, mask);
+}
+
+#define PROFILER_AVAILABLE 1
+
+#else
+
+void
+install_statement_profiler(varnam *handle)
+{
+}
+
+#define PROFILER_AVAILABLE 0
+
+#endif
+
+int
+enable_profiling(varnam *handle, int enable)
+{
+    if (!enable) {
+        destroy_profiling (handle);
+        install_statement_profiler (handle);
+        return VARNAM_SUCCESS;
+    }
+
+    if (!PROFILER_AVAILABLE) {
+        set_last_error (handle, "Profiling needs sqlite 3.14.0 or above");
+        return VARNAM_ERROR;
+    }
+
+    if (v_->statement_stats == NULL)
+    {
+        v_->statement_stats = xmalloc (sizeof (vstatement_stats) * VARNAM_STATEMENTS);
+        if (v_->statement_stats == NULL)
+            return VARNAM_MEMORY_ERROR;
+
+        memset (v_->statement_stats, 0, sizeof (vstatement_stats) * VARNAM_STATEMENTS);
+    }
+
+    install_statement_profiler (handle);
+    return VARNAM_SUCCESS;
+}
+
+void
+destroy_profiling(varnam *handle)
+{
+    xfree (v_->statement_stats);
+    v_->statement_stats = NULL;
+}
+
+int
+varnam_get_statement_stats(varnam *handle, vstatement_stats *stats, size_t max, size_t *count)
+{
+    int i;
+
+    if (handle == NULL || count == NULL || (stats == NULL && max > 0))
+        return VARNAM_ARGS_ERROR;
+
+    *count = 0;
+    if (v_->statement_stats == NULL)
+        return VARNAM_SUCCESS;
+
+    for (i = 0; i < VARNAM_STATEMENTS; i++)
+    {
+        if (v_->statement_stats[i].executions == 0)
+            continue;
+
+        if (*count == max)
+            return VARNAM_TRUNCATED;
+
+        stats[*count] = v_->statement_stats[i];
+        stats[*count].name = statement_name (i);
+        ++(*count);
+    }
+
+    return VARNAM_SUCCESS;
+}
+
+int
+varnam_reset_statement_stats(varnam *handle)
+{
+    if (handle == NULL)
+        return VARNAM_ARGS_ERROR;
+
+    if (v_->statement_stats != NULL)
+        memset (v_->statement_stats, 0, sizeof (vstatement_stats) * VARNAM_STATEMENTS);
+
+    return VARNAM_SUCCESS;
+}
+
+int
+varnam_set_slow_query_callback(varnam *handle, long threshold_us,
+                               void (*callback)(const char *statement, const char *sql, long elapsed_us))
+{
+    if (handle == NULL || threshold_us < 0)
+        return VARNAM_ARGS_ERROR;
+
+    if (callback != NULL && !PROFILER_AVAILABLE) {
+        set_last_error (handle, "Slow query callback needs sqlite 3.14.0 or above");
+        return VARNAM_ERROR;
+    }
+
+    v_->slow_query_callback = callback;
+    v_->slow_query_threshold_us = threshold_us;
+    install_statement_profiler (handle);
+
+    return VARNAM_SUCCESS;
+}
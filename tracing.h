@@ -0,0 +1,49 @@
+/* tracing.h - Timings of the stages of public calls and cost of sqlite statements
+ *
+ * Copyright (C) Navaneeth.K.N
+ *
+ * This is part of libvarnam. See LICENSE.txt for the license
+ */
+
+#ifndef VARNAM_TRACING_H_INCLUDED_180126
+#define VARNAM_TRACING_H_INCLUDED_180126
+
+#include "vtypes.h"
+#include "util.h"
+
+/* Wall clock time in microseconds which only goes forward. Not related to the calendar time.
+ * It is 64 bit since the time since boot doesn't fit in a 32 bit long */
+sqlite3_int64
+monotonic_time_us();
+
+/* A stage being timed. started is meaningful only when enabled */
+typedef struct {
+    bool enabled;
+    sqlite3_int64 started;
+} vtrace;
+
+/* Notes when a stage starts, if tracing is on. Pass trace to trace_end() once the stage is over */
+void
+trace_start(varnam *handle, vtrace *trace);
+
+void
+trace_end(varnam *handle, int stage, vtrace *trace);
+
+int
+enable_tracing(varnam *handle, int enable);
+
+void
+destroy_tracing(varnam *handle);
+
+int
+enable_profiling(varnam *handle, int enable);
+
+void
+destroy_profiling(varnam *handle);
+
+/* Connects the statement profiler to the databases which are open. Called again when
+ * a database is opened later */
+void
+install_statement_profiler(varnam *handle);
+
+#endif
@@ -6,6 +6,7 @@
  */
 
 
+#include <stdlib.h>
 #include <string.h>
 #include <assert.h>
 
@@ -20,6 +21,8 @@
 #include "token.h"
 #include "vword.h"
 #include "rendering.h"
+#include "tracing.h"
+#include "metrics.h"
 
 /* Flattens the multi dimensional array all_tokens */
 static varray*
@@ -43,72 +46,118 @@ flatten(varnam *handle, varray *all_tokens)
     return tokens;
 }
 
-int
-varnam_transliterate(varnam *handle, const char *input, varray **output)
+/* Collects the candidates for input into the handle's candidate set. Caller resets the pools */
+static int
+collect_candidates(varnam *handle, const char *input)
 {
     int rc, i;
-    varray *words = 0, *tokens = 0;
+    varray *tokens = 0;
     varray *all_tokens = 0; /* This will be multidimensional array */
-    vword *word, *word1;
-
-#ifdef _RECORD_EXEC_TIME
-    V_BEGIN_TIMING
-#endif
-
-    if(handle == NULL || input == NULL)
-        return VARNAM_ARGS_ERROR;
-
-    reset_pool(handle);
-
-    all_tokens = get_pooled_array (handle);
-    rc = vst_tokenize (handle, input, VARNAM_TOKENIZER_PATTERN, VARNAM_MATCH_EXACT, all_tokens);
-    if (rc)
-        return rc;
-
-    /* all_tokens will be a multidimensional array. Flattening it before resolving */
-    tokens = flatten (handle, all_tokens);
-    rc = resolve_tokens (handle, tokens, &word);
-    if (rc)
-        return rc;
+    vword *word;
+    vcandidates *candidates;
+    vrender_memo memo;
+    vtrace trace;
 
-    if (words == NULL) {
-        words = get_pooled_array (handle);
-    }
+    /* Sources are added in the order they rank. Once the candidates are full,
+     * rest of the sources are not looked up */
+    candidates = &v_->candidates;
+    reset_candidates (candidates, v_->config_max_candidates);
 
-    rc = vwt_get_best_match (handle, input, words);
+    trace_start (handle, &trace);
+    rc = vwt_get_best_match (handle, input, candidates);
+    trace_end (handle, VARNAM_STAGE_BEST_MATCH, &trace);
     if (rc)
         return rc;
 
-    if (varray_length (words) == 0 && strlen(input) > 2)
+    all_tokens = get_pooled_array (handle);
+    if (candidates->count == 0 && strlen(input) > 2)
     {
         /* We don't have any best match for the input. In this case, varnam does
          * it's best to provide suggestions by doing a tokenization on words table */
+        trace_start (handle, &trace);
         rc = vwt_tokenize_pattern (handle, input, all_tokens);
+        trace_end (handle, VARNAM_STAGE_WORDS_TOKENIZE, &trace);
         if (rc) return rc;
 
-        for (i = 0; i < varray_length (all_tokens); i++)
+        /* Alternatives usually start with the same tokens. The memo renders only the
+         * part where an alternative differs from the one before it */
+        trace_start (handle, &trace);
+        render_memo_init (&memo);
+        for (i = 0; i < varray_length (all_tokens) && !candidates_full (candidates); i++)
         {
             tokens = varray_get (all_tokens, i);
-            rc = resolve_tokens (handle, tokens, &word1);
-            if (rc) return rc;
+            rc = resolve_tokens_from_memo (handle, &memo, tokens, &word);
+            if (rc) break;
 
-            if (!varray_exists (words, word1, &word_equals))
-                varray_push (words, word1);
+            add_candidate (candidates, word, VARNAM_CANDIDATE_WORDS_TOKENIZER);
         }
+        render_memo_release (handle, &memo);
+        trace_end (handle, VARNAM_STAGE_RENDER, &trace);
+        if (rc) return rc;
+    }
+
+    if (!candidates_full (candidates))
+    {
+        trace_start (handle, &trace);
+        rc = vst_tokenize (handle, input, VARNAM_TOKENIZER_PATTERN, VARNAM_MATCH_EXACT, all_tokens);
+        trace_end (handle, VARNAM_STAGE_SYMBOLS_TOKENIZE, &trace);
+        if (rc)
+            return rc;
+
+        /* all_tokens will be a multidimensional array. Flattening it before resolving */
+        trace_start (handle, &trace);
+        tokens = flatten (handle, all_tokens);
+        rc = resolve_tokens (handle, tokens, &word);
+        trace_end (handle, VARNAM_STAGE_RENDER, &trace);
+        if (rc)
+            return rc;
+
+        add_candidate (candidates, word, VARNAM_CANDIDATE_SYMBOLS);
     }
 
-    if (!varray_exists (words, word, &word_equals))
-        varray_push (words, word);
+    trace_start (handle, &trace);
+    rc = vwt_get_suggestions (handle, input, candidates);
+    trace_end (handle, VARNAM_STAGE_SUGGESTIONS, &trace);
+    return rc;
+}
+
+/* Collects the candidates for input into words. Caller resets the pools */
+static int
+transliterate_word(varnam *handle, const char *input, varray *words)
+{
+    int rc;
 
-    rc = vwt_get_suggestions (handle, input, words);
+    rc = collect_candidates (handle, input);
+    if (rc)
+        return rc;
+
+    candidates_to_array (&v_->candidates, words);
+    return VARNAM_SUCCESS;
+}
+
+int
+varnam_transliterate(varnam *handle, const char *input, varray **output)
+{
+    int rc;
+    varray *words;
+    vtrace trace;
+
+    if(handle == NULL || input == NULL)
+        return VARNAM_ARGS_ERROR;
+
+    trace_start (handle, &trace);
+    reset_pool(handle);
+
+    words = get_pooled_array (handle);
+    rc = transliterate_word (handle, input, words);
+    trace_end (handle, VARNAM_STAGE_TRANSLITERATE, &trace);
+    count_call (handle, VARNAM_CALL_TRANSLITERATE, rc);
+    trim_to_memory_target (handle);
     if (rc)
         return rc;
 
     *output = words;
 
-#ifdef _RECORD_EXEC_TIME
-    V_REPORT_TIME_TAKEN("varnam_transliterate")
-#endif
 #ifdef _VARNAM_VERBOSE
     printf("Transliterating %s\n", input);
 #endif
@@ -122,30 +171,577 @@ varnam_reverse_transliterate(varnam *handle,
 {
     int rc;
     varray *result;
-
-#ifdef _RECORD_EXEC_TIME
-    V_BEGIN_TIMING
-#endif
+    vtrace trace, stage_trace;
 
     if(handle == NULL || input == NULL)
         return VARNAM_ARGS_ERROR;
 
+    trace_start (handle, &trace);
     reset_pool (handle);
 
     result = get_pooled_array (handle);
+    trace_start (handle, &stage_trace);
     rc = vst_tokenize (handle, input, VARNAM_TOKENIZER_VALUE, VARNAM_MATCH_EXACT, result);
+    trace_end (handle, VARNAM_STAGE_SYMBOLS_TOKENIZE, &stage_trace);
+    if (rc == VARNAM_SUCCESS) {
+        trace_start (handle, &stage_trace);
+        rc = resolve_rtl_tokens (handle, result, output);
+        trace_end (handle, VARNAM_STAGE_RENDER, &stage_trace);
+    }
+
+    trace_end (handle, VARNAM_STAGE_REVERSE_TRANSLITERATE, &trace);
+    count_call (handle, VARNAM_CALL_REVERSE_TRANSLITERATE, rc);
+    trim_to_memory_target (handle);
+    if (rc)
+        return rc;
+
+    varnam_debug (handle, "Reverse transliterating %s = %s", input, *output);
+
+    return VARNAM_SUCCESS;
+}
+
+/* Writes the ranked candidates into buf and out, as many as fit, in order */
+static int
+write_candidates(vcandidates *candidates, char *buf, size_t cap, vword_span *out, size_t max,
+                 size_t *count, size_t *required)
+{
+    int i;
+    size_t offset = 0, length;
+    bool fits = true;
+    vword *word;
+
+    *required = 0;
+    for (i = 0; i < candidates->count; i++)
+    {
+        word = ((vcandidate*) varray_get (candidates->entries, i))->word;
+        length = strlen (word->text);
+        *required += length + 1;
+
+        fits = fits && *count < max && length + 1 <= cap - offset;
+        if (!fits)
+            continue;
+
+        memcpy (buf + offset, word->text, length + 1);
+        out[*count].text = buf + offset;
+        out[*count].length = length;
+        out[*count].confidence = word->confidence;
+        offset += length + 1;
+        ++(*count);
+    }
+
+    if (*count == (size_t) candidates->count)
+        return VARNAM_SUCCESS;
+
+    /* Caller can size the buffers using these */
+    for (i = (int) *count; i < (int) max && i < candidates->count; i++)
+        out[i].text = NULL;
+    *count = (size_t) candidates->count;
+    return VARNAM_TRUNCATED;
+}
+
+int
+varnam_transliterate_into(varnam *handle, const char *input, char *buf, size_t cap,
+                          vword_span *out, size_t max, size_t *count, size_t *required)
+{
+    int rc;
+    size_t needed;
+    vtrace trace;
+
+    if (handle == NULL || input == NULL || count == NULL)
+        return VARNAM_ARGS_ERROR;
+
+    if ((buf == NULL && cap > 0) || (out == NULL && max > 0))
+        return VARNAM_ARGS_ERROR;
+
+    *count = 0;
+    if (required != NULL)
+        *required = 0;
+
+    /* Words are copied once, from the ranked candidates straight into buf */
+    trace_start (handle, &trace);
+    reset_pool (handle);
+    rc = collect_candidates (handle, input);
+    if (rc == VARNAM_SUCCESS)
+    {
+        sort_candidates (&v_->candidates);
+        rc = write_candidates (&v_->candidates, buf, cap, out, max, count, &needed);
+        if (required != NULL)
+            *required = needed;
+    }
+
+    trace_end (handle, VARNAM_STAGE_TRANSLITERATE_INTO, &trace);
+    count_call (handle, VARNAM_CALL_TRANSLITERATE_INTO, rc == VARNAM_TRUNCATED ? VARNAM_SUCCESS : rc);
+    trim_to_memory_target (handle);
+    return rc;
+}
+
+int
+varnam_reverse_transliterate_into(varnam *handle, const char *input, char *buf, size_t cap,
+                                  size_t *length)
+{
+    int rc;
+    varray *tokens;
+    strbuf borrowed, *output;
+    size_t to_copy;
+    vtrace trace;
+
+    if (handle == NULL || input == NULL || length == NULL)
+        return VARNAM_ARGS_ERROR;
+
+    if (buf == NULL && cap > 0)
+        return VARNAM_ARGS_ERROR;
+
+    *length = 0;
+    trace_start (handle, &trace);
+    reset_pool (handle);
+
+    /* Result is rendered straight into buf. It moves to the heap only when buf is too small */
+    if (cap > 0)
+        output = strbuf_init_borrowed (&borrowed, buf, cap);
+    else
+        output = get_pooled_string (handle);
+
+    tokens = get_pooled_array (handle);
+    rc = vst_tokenize (handle, input, VARNAM_TOKENIZER_VALUE, VARNAM_MATCH_EXACT, tokens);
+    if (rc == VARNAM_SUCCESS)
+        rc = render_rtl_tokens (handle, tokens, output);
+
+    if (rc == VARNAM_SUCCESS)
+    {
+        *length = output->length;
+        if (cap == 0)
+            rc = VARNAM_TRUNCATED;
+        else if (!output->borrowed && output->length < cap)
+            memcpy (buf, output->buffer, output->length + 1);
+        else if (!output->borrowed)
+        {
+            /* Backing off to the start of the UTF-8 character which didn't fit */
+            to_copy = cap - 1;
+            while (to_copy > 0 && (output->buffer[to_copy] & 0xC0) == 0x80)
+                --to_copy;
+
+            memcpy (buf, output->buffer, to_copy);
+            buf[to_copy] = '\0';
+            rc = VARNAM_TRUNCATED;
+        }
+    }
+
+    if (output == &borrowed && !borrowed.borrowed)
+        xfree (borrowed.buffer);
+
+    trace_end (handle, VARNAM_STAGE_REVERSE_TRANSLITERATE_INTO, &trace);
+    count_call (handle, VARNAM_CALL_REVERSE_TRANSLITERATE_INTO, rc == VARNAM_TRUNCATED ? VARNAM_SUCCESS : rc);
+    trim_to_memory_target (handle);
+    return rc;
+}
+
+/* Characters which end a word in varnam_transliterate_text(). These and whitespace
+ * are passed through as they are */
+static const char text_delimiters[] = ",.;:!?\"'()[]{}<>-";
+
+#define TEXT_BLOCK_SIZE 65536
+
+static bool
+is_word_character(unsigned char c)
+{
+    if (c <= 0x20 || c >= 0x7F)
+        return false;
+
+    return strchr (text_delimiters, c) == NULL;
+}
+
+static void
+release_text_blocks(varnam *handle)
+{
+    int i;
+
+    if (v_->text_blocks == NULL)
+        return;
+
+    for (i = 0; i < varray_length (v_->text_blocks); i++)
+        xfree (varray_get (v_->text_blocks, i));
+
+    varray_clear (v_->text_blocks);
+    v_->text_block_used = v_->text_block_size = 0;
+}
+
+static void*
+text_alloc(varnam *handle, size_t size)
+{
+    char *block;
+
+    /* Keeps the word arrays aligned */
+    size = (size + sizeof (void*) - 1) / sizeof (void*) * sizeof (void*);
+
+    if (v_->text_blocks == NULL)
+        v_->text_blocks = varray_init ();
+
+    if (varray_length (v_->text_blocks) == 0 || v_->text_block_used + size > v_->text_block_size)
+    {
+        v_->text_block_size = size > TEXT_BLOCK_SIZE ? size : TEXT_BLOCK_SIZE;
+        block = xmalloc (v_->text_block_size);
+        if (block == NULL)
+            return NULL;
+
+        varray_push (v_->text_blocks, block);
+        v_->text_block_used = 0;
+    }
+
+    block = varray_get (v_->text_blocks, varray_length (v_->text_blocks) - 1);
+    v_->text_block_used += size;
+    return block + v_->text_block_used - size;
+}
+
+static char*
+text_copy(varnam *handle, const char *text, size_t length)
+{
+    char *copy = text_alloc (handle, length + 1);
+    if (copy == NULL)
+        return NULL;
+
+    memcpy (copy, text, length);
+    copy[length] = '\0';
+    return copy;
+}
+
+static vtext_segment*
+add_text_segment(varnam *handle, size_t *count)
+{
+    vtext_segment *segments;
+    size_t allocated;
+
+    if (*count == v_->text_segments_allocated)
+    {
+        allocated = v_->text_segments_allocated == 0 ? 16 : v_->text_segments_allocated * 2;
+        segments = realloc (v_->text_segments, sizeof (vtext_segment) * allocated);
+        if (segments == NULL)
+            return NULL;
+
+        v_->text_segments = segments;
+        v_->text_segments_allocated = allocated;
+    }
+
+    return &v_->text_segments[(*count)++];
+}
+
+/* Text which is not transliterated is the only word of its segment */
+static int
+pass_through(varnam *handle, char *input, vtext_segment *segment)
+{
+    segment->text = input;
+    segment->transliterated = 0;
+    segment->count = 1;
+    segment->words = text_alloc (handle, sizeof (vword));
+    if (segment->words == NULL)
+        return VARNAM_MEMORY_ERROR;
+
+    segment->words[0].text = input;
+    segment->words[0].confidence = 0;
+    return VARNAM_SUCCESS;
+}
+
+/* Confidences and then the null terminated texts follows the header in the same allocation */
+#define memo_confidences(m) ((int*) ((m) + 1))
+#define memo_texts(m) ((char*) (memo_confidences (m) + (m)->count))
+
+static memo_words*
+to_memo_words(varray *words)
+{
+    memo_words *memo;
+    vword *word;
+    size_t size, length;
+    char *text;
+    int i;
+
+    size = sizeof (memo_words);
+    for (i = 0; i < varray_length (words); i++)
+    {
+        word = varray_get (words, i);
+        size += sizeof (int) + strlen (word->text) + 1;
+    }
+
+    memo = xmalloc (size);
+    if (memo == NULL)
+        return NULL;
+
+    memo->count = (size_t) varray_length (words);
+    memo->size = size;
+    text = memo_texts (memo);
+    for (i = 0; i < varray_length (words); i++)
+    {
+        word = varray_get (words, i);
+        length = strlen (word->text) + 1;
+        memo_confidences (memo)[i] = word->confidence;
+        memcpy (text, word->text, length);
+        text += length;
+    }
+
+    return memo;
+}
+
+static int
+learnings_data_version(varnam *handle)
+{
+    sqlite3_stmt *stmt;
+    int version = 0;
+
+    if (v_->known_words == NULL)
+        return 0;
+
+    if (sqlite3_prepare_v2 (v_->known_words, "pragma data_version;", -1, &stmt, NULL) != SQLITE_OK)
+        return -1;
+
+    if (sqlite3_step (stmt) == SQLITE_ROW)
+        version = sqlite3_column_int (stmt, 0);
+
+    sqlite3_finalize (stmt);
+    return version;
+}
+
+/* Configuration changes clears the words memo. Changes made to the symbols and
+ * learnings, including the ones from other connections, are found here */
+static void
+check_words_memo(varnam *handle)
+{
+    int symbols_changes, learnings_changes, data_version;
+
+    symbols_changes = sqlite3_total_changes (v_->db);
+    learnings_changes = v_->known_words == NULL ? 0 : sqlite3_total_changes (v_->known_words);
+    data_version = learnings_data_version (handle);
+
+    if (symbols_changes == v_->words_memo_symbols_changes &&
+        learnings_changes == v_->words_memo_learnings_changes &&
+        data_version == v_->words_memo_data_version)
+        return;
+
+    v_->words_memo_stats.evictions += lru_trim_cache (&v_->words_memo, 0);
+    v_->words_memo_symbols_changes = symbols_changes;
+    v_->words_memo_learnings_changes = learnings_changes;
+    v_->words_memo_data_version = data_version;
+}
+
+static int
+add_word_segment(varnam *handle, char *input, int options, vtext_segment *segment)
+{
+    int rc, i;
+    varray *words;
+    memo_words *memo;
+    const char *text;
+    size_t count;
+
+    memo = lru_find_in_cache (&v_->words_memo, input);
+    if (memo != NULL) {
+        ++v_->words_memo_stats.hits;
+    }
+    else
+    {
+        ++v_->words_memo_stats.misses;
+        reset_pool (handle);
+        words = get_pooled_array (handle);
+        rc = transliterate_word (handle, input, words);
+        if (rc)
+            return rc;
+
+        memo = to_memo_words (words);
+        if (memo == NULL)
+            return VARNAM_MEMORY_ERROR;
+
+        v_->words_memo_stats.evictions += lru_add_to_cache (&v_->words_memo, input, memo, &xfree);
+    }
+
+    count = memo->count;
+    if (count > 1 && options != VARNAM_TEXT_ALL_CANDIDATES)
+        count = 1;
+
+    if (count == 0)
+        return pass_through (handle, input, segment);
+
+    segment->text = input;
+    segment->transliterated = 1;
+    segment->count = (int) count;
+    segment->words = text_alloc (handle, sizeof (vword) * count);
+    if (segment->words == NULL)
+        return VARNAM_MEMORY_ERROR;
+
+    text = memo_texts (memo);
+    for (i = 0; i < (int) count; i++)
+    {
+        segment->words[i].text = text_copy (handle, text, strlen (text));
+        if (segment->words[i].text == NULL)
+            return VARNAM_MEMORY_ERROR;
+
+        segment->words[i].confidence = memo_confidences (memo)[i];
+        text += strlen (text) + 1;
+    }
+
+    return VARNAM_SUCCESS;
+}
+
+static int
+transliterate_text(varnam *handle, const char *text, int options,
+                   vtext_segment **segments, size_t *count)
+{
+    int rc;
+    const unsigned char *start, *end;
+    bool word;
+    char *input;
+    vtext_segment *segment;
+
+    if (handle == NULL || text == NULL || segments == NULL || count == NULL)
+        return VARNAM_ARGS_ERROR;
+
+    if (options != VARNAM_TEXT_BEST_CANDIDATE && options != VARNAM_TEXT_ALL_CANDIDATES) {
+        set_last_error (handle, "Invalid options for transliterating text");
+        return VARNAM_ARGS_ERROR;
+    }
+
+    *segments = NULL;
+    *count = 0;
+    release_text_blocks (handle);
+    check_words_memo (handle);
+
+    start = (const unsigned char*) text;
+    while (*start != '\0')
+    {
+        /* A segment is a run of word characters or a run of everything else */
+        word = is_word_character (*start);
+        for (end = start + 1; *end != '\0' && is_word_character (*end) == word; end++);
+
+        input = text_copy (handle, (const char*) start, (size_t) (end - start));
+        segment = add_text_segment (handle, count);
+        if (input == NULL || segment == NULL)
+            return VARNAM_MEMORY_ERROR;
+
+        if (word)
+            rc = add_word_segment (handle, input, options, segment);
+        else
+            rc = pass_through (handle, input, segment);
+
+        if (rc) {
+            *count = 0;
+            return rc;
+        }
+
+        start = end;
+    }
+
+    *segments = v_->text_segments;
+    return VARNAM_SUCCESS;
+}
+
+int
+varnam_transliterate_text(varnam *handle, const char *text, int options,
+                          vtext_segment **segments, size_t *count)
+{
+    int rc;
+    vtrace trace;
+
+    if (handle == NULL)
+        return VARNAM_ARGS_ERROR;
+
+    trace_start (handle, &trace);
+    rc = transliterate_text (handle, text, options, segments, count);
+    trace_end (handle, VARNAM_STAGE_TRANSLITERATE_TEXT, &trace);
+    count_call (handle, VARNAM_CALL_TRANSLITERATE_TEXT, rc);
+    trim_to_memory_target (handle);
+    return rc;
+}
+
+/* Reverse transliterates a word and appends it to output. Results are kept in
+ * the reverse transliteration memo */
+static int
+reverse_transliterate_word(varnam *handle, char *word, strbuf *output)
+{
+    int rc;
+    char *result;
+    varray *tokens;
+    strbuf *copy;
+
+    result = lru_find_in_cache (&v_->rtl_memo, word);
+    if (result != NULL) {
+        ++v_->rtl_memo_stats.hits;
+        strbuf_add (output, result);
+        return VARNAM_SUCCESS;
+    }
+
+    ++v_->rtl_memo_stats.misses;
+    reset_pool (handle);
+
+    tokens = get_pooled_array (handle);
+    rc = vst_tokenize (handle, word, VARNAM_TOKENIZER_VALUE, VARNAM_MATCH_EXACT, tokens);
     if (rc)
         return rc;
 
-    rc = resolve_rtl_tokens (handle, result, output);
+    rc = resolve_rtl_tokens (handle, tokens, &result);
     if (rc)
         return rc;
 
-    varnam_debug (handle, "Reverse transliterating %s = %s", input, *output);
+    copy = strbuf_init (strlen (result) + 1);
+    strbuf_add (copy, result);
+    v_->rtl_memo_stats.evictions += lru_add_to_cache (&v_->rtl_memo, word, strbuf_detach (copy), &xfree);
 
-#ifdef _RECORD_EXEC_TIME
-    V_REPORT_TIME_TAKEN("varnam_reverse_transliterate")
-#endif
+    strbuf_add (output, result);
+    return VARNAM_SUCCESS;
+}
 
+static int
+reverse_transliterate_text(varnam *handle, const char *text, strbuf *output)
+{
+    int rc;
+    const char *start, *end;
+    strbuf *word;
+    strbuf_sso word_buffer;
+
+    if (handle == NULL || text == NULL || output == NULL)
+        return VARNAM_ARGS_ERROR;
+
+    if (sqlite3_total_changes (v_->db) != v_->rtl_memo_symbols_changes) {
+        v_->rtl_memo_stats.evictions += lru_trim_cache (&v_->rtl_memo, 0);
+        v_->rtl_memo_symbols_changes = sqlite3_total_changes (v_->db);
+    }
+
+    word = strbuf_sso_init (&word_buffer);
+    start = text;
+    while (*start != '\0')
+    {
+        /* ASCII text is not in the script of any scheme. It is copied as it is */
+        for (end = start; *end != '\0' && (unsigned char) *end < 0x80; end++);
+        if (end > start)
+            strbuf_add_bytes (output, start, (int) (end - start));
+
+        if (*end == '\0')
+            break;
+
+        for (start = end; *end != '\0' && (unsigned char) *end >= 0x80; end++);
+        strbuf_clear (word);
+        strbuf_add_bytes (word, start, (int) (end - start));
+
+        rc = reverse_transliterate_word (handle, word->buffer, output);
+        if (rc) {
+            strbuf_sso_release (&word_buffer);
+            return rc;
+        }
+
+        start = end;
+    }
+
+    strbuf_sso_release (&word_buffer);
     return VARNAM_SUCCESS;
 }
+
+int
+varnam_reverse_transliterate_text(varnam *handle, const char *text, strbuf *output)
+{
+    int rc;
+    vtrace trace;
+
+    if (handle == NULL)
+        return VARNAM_ARGS_ERROR;
+
+    trace_start (handle, &trace);
+    rc = reverse_transliterate_text (handle, text, output);
+    trace_end (handle, VARNAM_STAGE_REVERSE_TRANSLITERATE_TEXT, &trace);
+    count_call (handle, VARNAM_CALL_REVERSE_TRANSLITERATE_TEXT, rc);
+    trim_to_memory_target (handle);
+    return rc;
+}
@@ -16,6 +16,11 @@
 #include "util.h"
 #include "vtypes.h"
 
+#if defined(__SSE2__) || defined(_M_X64)
+#define VARNAM_UTF8_SSE2
+#include <emmintrin.h>
+#endif
+
 /**
  * substr(str,start,length,output) writes length characters of str beginning with start to substring.
  * start is is 1-indexed and string should be valid UTF8.
@@ -171,24 +176,81 @@ void varnam_log(varnam* handle, const char *format, ...)
   }
 }
 
+/* Printable ASCII, tab, line feed and carriage return are the single byte
+ * characters which is_utf8() accepts */
+#define is_plain_ascii(b) ((0x20 <= (b) && (b) <= 0x7E) || (b) == 0x09 || (b) == 0x0A || (b) == 0x0D)
+
+/**
+ * Returns the number of bytes at the start of string which are plain ASCII. Romanized
+ * input and most of the lines in a words file are plain ASCII for long runs, so they are
+ * checked a block at a time. A block which has a tab, a line break or a non ASCII byte
+ * is checked byte by byte.
+ **/
+size_t
+utf8_ascii_run(const char *string, size_t length)
+{
+  const unsigned char *bytes = (const unsigned char*) string;
+  size_t i = 0, end;
+#ifdef VARNAM_UTF8_SSE2
+  __m128i block, rejected;
+  const __m128i space = _mm_set1_epi8 (0x20), del = _mm_set1_epi8 (0x7F);
+#define ASCII_BLOCK_SIZE 16
+#else
+  unsigned long block, del;
+  const unsigned long ones = ~0UL / 255, highs = (~0UL / 255) * 0x80;
+#define ASCII_BLOCK_SIZE sizeof (unsigned long)
+#endif
+
+  while (i < length)
+  {
+    for (; i + ASCII_BLOCK_SIZE <= length; i += ASCII_BLOCK_SIZE)
+    {
+#ifdef VARNAM_UTF8_SSE2
+      /* Bytes with the high bit set are negative. So they are less than a space too */
+      block = _mm_loadu_si128 ((const __m128i*) (const void*) (bytes + i));
+      rejected = _mm_or_si128 (_mm_cmplt_epi8 (block, space), _mm_cmpeq_epi8 (block, del));
+      if (_mm_movemask_epi8 (rejected) != 0)
+        break;
+#else
+      memcpy (&block, bytes + i, sizeof (block));
+      del = block ^ (ones * 0x7F);
+      if ((block & highs) != 0 ||
+          ((block - ones * 0x20) & ~block & highs) != 0 ||
+          ((del - ones) & ~del & highs) != 0)
+        break;
+#endif
+    }
+
+    end = i + ASCII_BLOCK_SIZE < length ? i + ASCII_BLOCK_SIZE : length;
+    for (; i < end; i++)
+    {
+      if (!is_plain_ascii (bytes[i]))
+        return i;
+    }
+  }
+
+  return i;
+#undef ASCII_BLOCK_SIZE
+}
+
 bool is_utf8(const char *string)
 {
   const unsigned char * bytes;
+  const char *end;
   if(!string)
     return 0;
 
+  end = string + strlen (string);
   bytes = (const unsigned char*) string;
   while(*bytes)
   {
-    if(     (/* ASCII */
-          bytes[0] == 0x09 ||
-          bytes[0] == 0x0A ||
-          bytes[0] == 0x0D ||
-          (0x20 <= bytes[0] && bytes[0] <= 0x7E)
-          )
-      ) {
-      bytes += 1;
-      continue;
+    if (*bytes < 0x80)
+    {
+      bytes += utf8_ascii_run ((const char*) bytes, (size_t) (end - (const char*) bytes));
+      if (*bytes == '\0')
+        break;
+      if (*bytes < 0x80)
+        return 0;
     }
 
     if(     (/* non-overlong 2-byte */
@@ -45,18 +45,6 @@
     while(head != NULL) {                                          \
         current = head->next; free(head); head = current;}         \
 
-#ifdef _RECORD_EXEC_TIME
-    #include <time.h>
-#endif
-
-#define V_BEGIN_TIMING \
-    clock_t start; double diff;                   \
-    start = clock();                              \
-
-#define V_REPORT_TIME_TAKEN(s) \
-    diff = (double)(clock() - start) / (double) CLOCKS_PER_SEC;         \
-    printf ("%s - %f secs\n", s, diff);                                 \
-
 /* Cmake will define varnam_EXPORTS on Windows when it
 configures to build a shared library. If you are going to use
 another build system on windows or create the visual studio
@@ -143,13 +131,27 @@ typedef struct strbuf {
     char *buffer;          /* null terminated buffer */
     size_t length;         /* length of the string in bytes excluding null terminator */
     size_t allocated;      /* total memory allocated */
+    int borrowed;          /* buffer is not owned by this strbuf. it is copied to the heap before growing */
 } strbuf;
 
+/* Strings on the tokenizer, stemmer and rendering paths are mostly a few
+ * syllables long. strbuf_sso keeps them in an inline buffer, usually on the
+ * caller's stack, and moves to the heap only when the string outgrows it */
+#define VARNAM_SSO_SIZE 64
+
+typedef struct strbuf_sso {
+    strbuf str;
+    char inline_buffer[VARNAM_SSO_SIZE];
+} strbuf_sso;
+
 void varnam_debug(varnam *handle, const char *format, ...);
 void varnam_log(varnam *handle, const char *format, ...);
 
 VARNAM_EXPORT struct strbuf* strbuf_create_from(const char* value);
 VARNAM_EXPORT struct strbuf *strbuf_init(size_t initial_buf_size);
+VARNAM_EXPORT struct strbuf *strbuf_sso_init(strbuf_sso *sso);
+VARNAM_EXPORT void strbuf_sso_release(strbuf_sso *sso);
+VARNAM_EXPORT struct strbuf *strbuf_init_borrowed(struct strbuf *string, char *buffer, size_t size);
 VARNAM_EXPORT int strbuf_addc(struct strbuf *string, char c);
 VARNAM_EXPORT int strbuf_add(struct strbuf *string, const char *c);
 VARNAM_EXPORT int strbuf_add_bytes(struct strbuf *string, const char *c, int bytes_to_read);
@@ -173,12 +175,14 @@ VARNAM_EXPORT char* portable_strdup(const char*);
 VARNAM_EXPORT struct varray_t* strbuf_split(strbuf *string, varnam *handle, char delim);
 VARNAM_EXPORT struct strbuf* get_pooled_string(varnam *handle);
 VARNAM_EXPORT void return_string_to_pool (varnam *handle, strbuf* string);
+VARNAM_EXPORT void destroy_pooled_string (void *string);
 
 VARNAM_EXPORT void *xmalloc(size_t size);
 VARNAM_EXPORT void xfree (void *ptr);
 
 void set_last_error(varnam *handle, const char *format, ...);
 bool is_utf8(const char *string);
+size_t utf8_ascii_run(const char *string, size_t length);
 const char *ZWNJ();
 const char *ZWJ();
 char *trimwhitespace(char *str);
@@ -191,12 +195,23 @@ bool is_path_exists(const char *pathname);
 void*
 lru_find_in_cache (vcache_entry **cache, char *key);
 
-void
+/* Returns the number of entries evicted to make room */
+int
 lru_add_to_cache (vcache_entry **cache, char *key, void *value, vcache_value_free_cb cb);
 
 int
 lru_key_exists (vcache_entry **cache, char *key);
 
+/* Evicts the least recently used entries till the cache holds at most keep entries.
+ * Returns the number of entries evicted */
+int
+lru_trim_cache (vcache_entry **cache, int keep);
+
+/* Fills entries and bytes used by the cache. value_size returns the bytes used
+ * by a cached value and can be NULL when values don't own any memory */
+void
+lru_cache_info (vcache_entry **cache, size_t (*value_size)(void*), vcache_info *info);
+
 /* Constants */
 #define MAX_PATH_LENGTH 4096
 #define MAX_PATTERN_LENGTH 20
@@ -4,9 +4,16 @@
  * This is part of libvarnam. See LICENSE.txt for the license
  */
 
+#include <limits.h>
 #include <string.h>
 #include <stdarg.h>
 
+#if defined(WIN32) || defined(_WIN32) || defined(__WIN32)
+#include <windows.h>
+#else
+#include <pthread.h>
+#endif
+
 #include "varray.h"
 #include "api.h"
 #include "vtypes.h"
@@ -15,6 +22,7 @@
 #include "symbol-table.h"
 #include "words-table.h"
 #include "token.h"
+#include "tracing.h"
 #include "vword.h"
 #include "renderer/renderers.h"
 #include "deps/tinydir.h"
@@ -25,6 +33,31 @@ strbuf *varnam_symbols_dir = NULL;
 static vcorpus_details*
 corpus_details_new();
 
+static int
+register_renderer(varnam *handle, const char *scheme_id,
+                  int (*tl)(varnam *handle, vtoken *previous, vtoken *current,  strbuf *output),
+                  int (*rtl)(varnam *handle, vtoken *previous, vtoken *current,  strbuf *output));
+
+static int
+set_renderer_dispatch(varnam *handle, const char *scheme_id,
+                      unsigned int tl_types, unsigned int tl_tags,
+                      unsigned int rtl_types, unsigned int rtl_tags);
+
+/* Index of the symbols directory used by varnam_init_from_id(). It is made on first use
+ * and dropped when the symbols directory is changed. Handles can be initialized from
+ * more than one thread, so it is guarded by a lock */
+static varnam_registry *symbols_dir_index = NULL;
+
+#if defined(WIN32) || defined(_WIN32) || defined(__WIN32)
+static SRWLOCK symbols_dir_index_lock = SRWLOCK_INIT;
+#define lock_symbols_dir_index()   AcquireSRWLockExclusive (&symbols_dir_index_lock)
+#define unlock_symbols_dir_index() ReleaseSRWLockExclusive (&symbols_dir_index_lock)
+#else
+static pthread_mutex_t symbols_dir_index_lock = PTHREAD_MUTEX_INITIALIZER;
+#define lock_symbols_dir_index()   pthread_mutex_lock (&symbols_dir_index_lock)
+#define unlock_symbols_dir_index() pthread_mutex_unlock (&symbols_dir_index_lock)
+#endif
+
 void
 varnam_set_symbols_dir (const char *dir)
 {
@@ -33,6 +66,11 @@ varnam_set_symbols_dir (const char *dir)
     }
     strbuf_clear (varnam_symbols_dir);
     strbuf_add (varnam_symbols_dir, dir);
+
+    lock_symbols_dir_index ();
+    varnam_registry_destroy (symbols_dir_index);
+    symbols_dir_index = NULL;
+    unlock_symbols_dir_index ();
 }
 
 strbuf*
@@ -62,6 +100,10 @@ initialize_internal()
     if(vi) {
         vi->virama = NULL;
         vi->renderers = NULL;
+        vi->renderer = NULL;
+        vi->renderer_resolved = 0;
+        vi->rendering_rules = NULL;
+        vi->rendering_rules_count = 0;
         vi->last_error = strbuf_init(100);
         vi->log_level = VARNAM_LOG_DEFAULT;
         vi->log_callback = NULL;
@@ -81,12 +123,16 @@ initialize_internal()
         vi->config_use_dead_consonants = 0;
         vi->config_ignore_duplicate_tokens = 1;
         vi->config_use_indic_digits = 0;
+        vi->config_pool_high_water_mark = 0;
+        vi->config_auto_trim_bytes = 0;
+        vi->config_max_candidates = 0;
         vi->_config_mostly_learning_new_words = 0;
 
         vi->stemrules_count = -1;
 
         /* suggestions */
         vi->known_words = NULL;
+        vi->known_words_reader = NULL;
 
         /* instance pool */
         vi->tokens_pool = NULL;
@@ -128,6 +174,35 @@ initialize_internal()
         vi->noMatchesCache = NULL;
         vi->tokenizationPossibility = NULL;
         vi->cached_stems = NULL;
+        vi->tokens_cache_stats.hits = vi->tokens_cache_stats.misses = vi->tokens_cache_stats.evictions = 0;
+        vi->no_matches_cache_stats.hits = vi->no_matches_cache_stats.misses = vi->no_matches_cache_stats.evictions = 0;
+        vi->tokenization_possibility_stats.hits = vi->tokenization_possibility_stats.misses = vi->tokenization_possibility_stats.evictions = 0;
+        vi->cached_stems_stats.hits = vi->cached_stems_stats.misses = vi->cached_stems_stats.evictions = 0;
+        vi->words_memo = NULL;
+        vi->words_memo_stats.hits = vi->words_memo_stats.misses = vi->words_memo_stats.evictions = 0;
+        vi->words_memo_symbols_changes = vi->words_memo_learnings_changes = -1;
+        vi->words_memo_data_version = -1;
+        vi->rtl_memo = NULL;
+        vi->rtl_memo_stats.hits = vi->rtl_memo_stats.misses = vi->rtl_memo_stats.evictions = 0;
+        vi->rtl_memo_symbols_changes = -1;
+        vi->text_segments = NULL;
+        vi->text_segments_allocated = 0;
+        vi->text_blocks = NULL;
+        memset (vi->calls, 0, sizeof (vi->calls));
+        memset (vi->errors, 0, sizeof (vi->errors));
+        vi->timings = NULL;
+        vi->statement_stats = NULL;
+        vi->slow_query_callback = NULL;
+        vi->slow_query_threshold_us = 0;
+        memset (vi->running_statements, 0, sizeof (vi->running_statements));
+        vi->text_block_used = vi->text_block_size = 0;
+        vi->interned_pattern_tokens = NULL;
+        vi->interned_value_tokens = NULL;
+        vi->interned_symbols_changes = -1;
+        vi->candidates.index = NULL;
+        vi->candidates.entries = NULL;
+        vi->candidates.count = 0;
+        vi->candidates.limit = 0;
 
 				vi->scheme_details = NULL;
 				vi->corpus_details = corpus_details_new();
@@ -135,8 +210,104 @@ initialize_internal()
     return vi;
 }
 
+/* Symbols files installed on the system don't change. Opening them as immutable skips
+ * locking and change detection. Path is escaped since it is passed as an URI */
+static int
+open_symbols_readonly(const char *scheme_file, sqlite3 **db)
+{
+    strbuf *uri;
+    const char *c;
+    int rc;
+
+    uri = strbuf_init (50);
+    strbuf_add (uri, "file:");
+    for (c = scheme_file; *c != '\0'; c++)
+    {
+        if (*c == '%' || *c == '?' || *c == '#')
+            strbuf_addf (uri, "%%%02X", (unsigned char) *c);
+        else if (*c == '\\')
+            strbuf_addc (uri, '/');
+        else
+            strbuf_addc (uri, *c);
+    }
+    strbuf_add (uri, "?immutable=1");
+
+    rc = sqlite3_open_v2 (strbuf_to_s (uri), db, SQLITE_OPEN_READONLY | SQLITE_OPEN_NOMUTEX | SQLITE_OPEN_URI, NULL);
+    strbuf_destroy (uri);
+    return rc;
+}
+
+/* Copies the whole symbols file into an in-memory database so that lookups never touch the disk.
+ * On failure, msg says why */
+static int
+load_symbols_into_memory(const char *scheme_file, sqlite3 **db, char **msg)
+{
+    sqlite3 *file_db;
+    sqlite3_backup *backup;
+    int rc, finish_rc;
+
+    rc = sqlite3_open_v2 (":memory:", db, SQLITE_OPEN_READWRITE | SQLITE_OPEN_NOMUTEX, NULL);
+    if (rc != SQLITE_OK)
+        return rc;
+
+    rc = open_symbols_readonly (scheme_file, &file_db);
+    if (rc != SQLITE_OK) {
+        asprintf (msg, "Can't open %s: %s\n", scheme_file, sqlite3_errmsg (file_db));
+        sqlite3_close (file_db);
+        return rc;
+    }
+
+    backup = sqlite3_backup_init (*db, "main", file_db, "main");
+    if (backup == NULL) {
+        rc = sqlite3_errcode (*db);
+        asprintf (msg, "Can't load %s into memory: %s\n", scheme_file, sqlite3_errmsg (*db));
+        sqlite3_close (file_db);
+        return rc;
+    }
+
+    rc = sqlite3_backup_step (backup, -1);
+    finish_rc = sqlite3_backup_finish (backup);
+    if (rc == SQLITE_DONE)
+        rc = finish_rc;
+
+    if (rc != SQLITE_OK)
+        asprintf (msg, "Can't load %s into memory: %s\n", scheme_file, sqlite3_errmsg (*db));
+
+    sqlite3_close (file_db);
+    return rc;
+}
+
+static int
+open_symbols_file(const char *scheme_file, int flags, sqlite3 **db, char **msg)
+{
+    int rc;
+    strbuf *sql;
+
+    if (flags & VARNAM_OPEN_IN_MEMORY)
+        return load_symbols_into_memory (scheme_file, db, msg);
+
+    if (flags & VARNAM_OPEN_READONLY) {
+        rc = open_symbols_readonly (scheme_file, db);
+        if (rc == SQLITE_OK) {
+            sql = strbuf_init (30);
+            strbuf_addf (sql, "pragma mmap_size=%d;", VARNAM_SYMBOLS_MMAP_SIZE);
+            sqlite3_exec (*db, strbuf_to_s (sql), NULL, NULL, NULL);
+            strbuf_destroy (sql);
+        }
+        return rc;
+    }
+
+    return sqlite3_open (scheme_file, db);
+}
+
 int
 varnam_init(const char *scheme_file, varnam **handle, char **msg)
+{
+    return varnam_init_with_flags (scheme_file, 0, handle, msg);
+}
+
+int
+varnam_init_with_flags(const char *scheme_file, int flags, varnam **handle, char **msg)
 {
     int rc;
     varnam *c = NULL;
@@ -173,20 +344,24 @@ varnam_init(const char *scheme_file, varnam **handle, char **msg)
     strncpy(c->scheme_file, scheme_file, filename_length + 1);
     c->internal = vi;
 
-    rc = sqlite3_open(scheme_file, &vi->db);
+    rc = open_symbols_file (scheme_file, flags, &vi->db, msg);
     if( rc ) {
-        asprintf(msg, "Can't open %s: %s\n", scheme_file, sqlite3_errmsg(vi->db));
+        if (*msg == NULL)
+            asprintf(msg, "Can't open %s: %s\n", scheme_file, sqlite3_errmsg(vi->db));
         varnam_destroy (c);
         return VARNAM_STORAGE_ERROR;
     }
 
-    rc = ensure_schema_exists(c, msg);
+    rc = ensure_schema_exists(c, flags, msg);
     if (rc != VARNAM_SUCCESS) {
         varnam_destroy (c);
         return rc;
     }
 
-    rc = varnam_register_renderer (c, "ml-unicode", &ml_unicode_renderer, &ml_unicode_rtl_renderer);
+    rc = register_renderer (c, "ml-unicode", &ml_unicode_renderer, &ml_unicode_rtl_renderer);
+    if (rc == VARNAM_SUCCESS)
+        rc = set_renderer_dispatch (c, "ml-unicode", ml_unicode_tl_types, ml_unicode_tl_tags,
+                                    ml_unicode_rtl_types, ml_unicode_rtl_tags);
     if (rc != VARNAM_SUCCESS) {
         varnam_destroy (c);
         return rc;
@@ -346,26 +521,13 @@ find_learnings_file_path (const char *langCode)
   return path;
 }
 
-int
-varnam_init_from_id(const char *schemeIdentifier, varnam **handle, char **errorMessage)
+/* Initializes a handle for symbols_file and enables suggestions from the learnings file of the scheme */
+static int
+init_with_learnings(const char *symbols_file, const char *schemeIdentifier, varnam **handle, char **errorMessage)
 {
-  strbuf *symbolsFilePath, *learningsFilePath, *error;
+  strbuf *learningsFilePath, *error;
   int rc;
 
-  if (schemeIdentifier == NULL)
-    return VARNAM_ARGS_ERROR;
-
-  *handle = NULL;
-  *errorMessage = NULL;
-
-  symbolsFilePath = find_symbols_file_path (schemeIdentifier);
-  if (symbolsFilePath == NULL) {
-    error = strbuf_init (20);
-    strbuf_addf (error, "Failed to find symbols file for: %s", schemeIdentifier);
-    *errorMessage = strbuf_detach (error);
-    return VARNAM_ERROR;
-  }
-
   if (varnam_suggestions_dir != NULL) {
       learningsFilePath = strbuf_init (20);
       strbuf_add (learningsFilePath, strbuf_to_s (varnam_suggestions_dir));
@@ -374,7 +536,7 @@ varnam_init_from_id(const char *schemeIdentifier, varnam **handle, char **errorM
       learningsFilePath = find_learnings_file_path (schemeIdentifier);
   }
 
-  rc = varnam_init (strbuf_to_s (symbolsFilePath), handle, errorMessage);
+  rc = varnam_init (symbols_file, handle, errorMessage);
   if (rc == VARNAM_SUCCESS) {
     rc = varnam_config (*handle, VARNAM_CONFIG_ENABLE_SUGGESTIONS, strbuf_to_s (learningsFilePath));
     if (rc != VARNAM_SUCCESS) {
@@ -386,12 +548,43 @@ varnam_init_from_id(const char *schemeIdentifier, varnam **handle, char **errorM
     }
   }
 
-  strbuf_destroy (symbolsFilePath);
   strbuf_destroy (learningsFilePath);
 
   return rc;
 }
 
+static strbuf*
+find_indexed_symbols_file (const char *schemeIdentifier);
+
+int
+varnam_init_from_id(const char *schemeIdentifier, varnam **handle, char **errorMessage)
+{
+  strbuf *symbolsFilePath, *error;
+  int rc;
+
+  if (schemeIdentifier == NULL)
+    return VARNAM_ARGS_ERROR;
+
+  *handle = NULL;
+  *errorMessage = NULL;
+
+  symbolsFilePath = find_indexed_symbols_file (schemeIdentifier);
+  if (symbolsFilePath == NULL)
+    symbolsFilePath = find_symbols_file_path (schemeIdentifier);
+
+  if (symbolsFilePath == NULL) {
+    error = strbuf_init (20);
+    strbuf_addf (error, "Failed to find symbols file for: %s", schemeIdentifier);
+    *errorMessage = strbuf_detach (error);
+    return VARNAM_ERROR;
+  }
+
+  rc = init_with_learnings (strbuf_to_s (symbolsFilePath), schemeIdentifier, handle, errorMessage);
+  strbuf_destroy (symbolsFilePath);
+
+  return rc;
+}
+
 const char*
 varnam_version()
 {
@@ -404,6 +597,40 @@ varnam_register_renderer(
     const char *scheme_id,
     int (*tl)(varnam *handle, vtoken *previous, vtoken *current,  strbuf *output),
     int (*rtl)(varnam *handle, vtoken *previous, vtoken *current,  strbuf *output))
+{
+    return register_renderer (handle, scheme_id, tl, rtl);
+}
+
+/* Narrows down the tokens for which the renderer registered for scheme_id is called */
+static int
+set_renderer_dispatch(varnam *handle, const char *scheme_id,
+                      unsigned int tl_types, unsigned int tl_tags,
+                      unsigned int rtl_types, unsigned int rtl_tags)
+{
+    vtoken_renderer *r;
+    int i;
+
+    for (i = 0; i < varray_length (v_->renderers); i++)
+    {
+        r = varray_get (v_->renderers, i);
+        if (strcmp (r->scheme_id, scheme_id) == 0) {
+            r->tl_types = tl_types;
+            r->tl_tags = tl_tags;
+            r->rtl_types = rtl_types;
+            r->rtl_tags = rtl_tags;
+            return VARNAM_SUCCESS;
+        }
+    }
+
+    return VARNAM_ERROR;
+}
+
+static int
+register_renderer(
+    varnam *handle,
+    const char *scheme_id,
+    int (*tl)(varnam *handle, vtoken *previous, vtoken *current,  strbuf *output),
+    int (*rtl)(varnam *handle, vtoken *previous, vtoken *current,  strbuf *output))
 {
     vtoken_renderer *r;
 
@@ -420,8 +647,13 @@ varnam_register_renderer(
     r->scheme_id = scheme_id;
     r->tl = tl;
     r->rtl = rtl;
+    r->tl_types = r->tl_tags = VARNAM_RENDER_ALL;
+    r->rtl_types = r->rtl_tags = VARNAM_RENDER_ALL;
 
     varray_push (v_->renderers, r);
+    v_->renderer_resolved = 0;
+    v_->words_memo_stats.evictions += lru_trim_cache (&v_->words_memo, 0);
+    v_->rtl_memo_stats.evictions += lru_trim_cache (&v_->rtl_memo, 0);
     return VARNAM_SUCCESS;
 }
 
@@ -434,6 +666,7 @@ varnam_set_scheme_details(
 		strbuf *tmp;
 
     set_last_error (handle, NULL);
+    v_->renderer_resolved = 0;
 
     if (scheme_details->langCode != NULL && strlen(scheme_details->langCode) > 0)
     {
@@ -539,6 +772,22 @@ destroy_scheme_details(vscheme_details *details)
 	xfree(details);
 }
 
+/* Reads the next symbols file in dir into file. Returns false when there are no more */
+static bool
+next_symbols_file(tinydir_dir *dir, tinydir_file *file)
+{
+	bool found;
+
+	while (dir->has_next) {
+		found = tinydir_readfile (dir, file) != -1 && !file->is_dir && strcmp ("vst", file->extension) == 0;
+		tinydir_next (dir);
+		if (found)
+			return true;
+	}
+
+	return false;
+}
+
 varray*
 varnam_get_all_handles()
 {
@@ -557,23 +806,318 @@ varnam_get_all_handles()
 		return NULL;
 	}
 
-	while(dir.has_next) {
-		if (tinydir_readfile(&dir, &file) != -1) {
-			if (!file.is_dir && (strcmp("vst", file.extension) == 0)) {
-				rc = varnam_init(file.path, &handle, &msg);
-				if (rc == VARNAM_SUCCESS) {
-					handles = handles == NULL ? varray_init() : handles;
-					varray_push(handles, handle);
-				}
-			}
+	while(next_symbols_file(&dir, &file)) {
+		rc = varnam_init(file.path, &handle, &msg);
+		if (rc == VARNAM_SUCCESS) {
+			handles = handles == NULL ? varray_init() : handles;
+			varray_push(handles, handle);
 		}
-		tinydir_next(&dir);
 	}
 
 	tinydir_close(&dir);
 	return handles;
 }
 
+/* Registry keeps the schemes in a symbols directory indexed by identifier. Handles are
+ * opened on first use and the least recently used one which nobody is using is closed
+ * when max_open is reached */
+typedef struct {
+  vscheme_entry info;  /* points to the strings below */
+  char *identifier, *path, *langCode, *displayName;
+  varnam *handle;
+  int users;           /* callers holding handle, which can't be closed till they release it */
+  long last_used;
+  bool metadata_loaded;
+  UT_hash_handle hh;
+} vregistry_entry;
+
+struct varnam_registry_t {
+  vregistry_entry *entries;
+  int max_open;
+  int open_count;
+  long clock;
+};
+
+static int
+compare_registry_entries(vregistry_entry *left, vregistry_entry *right)
+{
+  return strcmp (left->info.identifier, right->info.identifier);
+}
+
+/* uthash needs a non-const key, so scheme_id is looked up using a copy */
+static vregistry_entry*
+find_registry_entry(varnam_registry *registry, const char *scheme_id)
+{
+  vregistry_entry *entry = NULL;
+  strbuf_sso key_buffer;
+  strbuf *key;
+
+  key = strbuf_sso_init (&key_buffer);
+  strbuf_add (key, scheme_id);
+  if (key->length <= UINT_MAX)
+    HASH_FIND (hh, registry->entries, key->buffer, (unsigned) key->length, entry);
+  strbuf_sso_release (&key_buffer);
+
+  return entry;
+}
+
+static void
+destroy_registry_entry(vregistry_entry *entry)
+{
+  if (entry->handle != NULL)
+    varnam_destroy (entry->handle);
+
+  xfree (entry->identifier);
+  xfree (entry->path);
+  xfree (entry->langCode);
+  xfree (entry->displayName);
+  xfree (entry);
+}
+
+int
+varnam_registry_create(const char *symbols_dir, int max_open, varnam_registry **registry)
+{
+  tinydir_dir dir;
+  tinydir_file file;
+  varnam_registry *r;
+  vregistry_entry *entry, *existing;
+  strbuf *identifier;
+  size_t len;
+
+  if (registry == NULL || max_open < 0)
+    return VARNAM_ARGS_ERROR;
+
+  *registry = NULL;
+
+  if (symbols_dir == NULL)
+    symbols_dir = varnam_find_symbols_file_directory ();
+
+  if (symbols_dir == NULL || tinydir_open (&dir, symbols_dir) == -1)
+    return VARNAM_ERROR;
+
+  r = (varnam_registry*) xmalloc (sizeof (varnam_registry));
+  if (r == NULL) {
+    tinydir_close (&dir);
+    return VARNAM_MEMORY_ERROR;
+  }
+
+  r->entries = NULL;
+  r->max_open = max_open;
+  r->open_count = 0;
+  r->clock = 0;
+
+  identifier = strbuf_init (16);
+  while (next_symbols_file (&dir, &file)) {
+    len = strlen (file.name) - strlen (".vst");
+    strbuf_clear (identifier);
+    strbuf_add_bytes (identifier, file.name, (int) len);
+
+    existing = find_registry_entry (r, strbuf_to_s (identifier));
+    if (existing == NULL) {
+      entry = (vregistry_entry*) xmalloc (sizeof (vregistry_entry));
+      memset (entry, 0, sizeof (vregistry_entry));
+      entry->identifier = strbuf_detach (strbuf_create_from (strbuf_to_s (identifier)));
+      entry->path = strbuf_detach (strbuf_create_from (file.path));
+      entry->info.identifier = entry->identifier;
+      entry->info.path = entry->path;
+      HASH_ADD_KEYPTR (hh, r->entries, entry->identifier, (unsigned) strlen (entry->identifier), entry);
+    }
+  }
+
+  strbuf_destroy (identifier);
+  tinydir_close (&dir);
+
+  HASH_SORT (r->entries, compare_registry_entries);
+
+  *registry = r;
+  return VARNAM_SUCCESS;
+}
+
+/* Reads language, display name and schema version directly from the symbols file */
+static void
+load_registry_metadata(vregistry_entry *entry)
+{
+  sqlite3 *db;
+  sqlite3_stmt *stmt;
+  const char *key, *value;
+
+  entry->metadata_loaded = true;
+
+  if (sqlite3_open_v2 (entry->info.path, &db, SQLITE_OPEN_READONLY, NULL) != SQLITE_OK) {
+    sqlite3_close (db);
+    return;
+  }
+
+  if (sqlite3_prepare_v2 (db, "select key, value from metadata;", -1, &stmt, NULL) == SQLITE_OK) {
+    while (sqlite3_step (stmt) == SQLITE_ROW) {
+      key = (const char*) sqlite3_column_text (stmt, 0);
+      value = (const char*) sqlite3_column_text (stmt, 1);
+      if (key == NULL || value == NULL)
+        continue;
+
+      if (entry->langCode == NULL && strcmp (key, VARNAM_METADATA_SCHEME_LANGUAGE_CODE) == 0)
+        entry->langCode = strbuf_detach (strbuf_create_from (value));
+      else if (entry->displayName == NULL && strcmp (key, VARNAM_METADATA_SCHEME_DISPLAY_NAME) == 0)
+        entry->displayName = strbuf_detach (strbuf_create_from (value));
+    }
+  }
+  sqlite3_finalize (stmt);
+
+  if (sqlite3_prepare_v2 (db, "pragma user_version;", -1, &stmt, NULL) == SQLITE_OK) {
+    if (sqlite3_step (stmt) == SQLITE_ROW)
+      entry->info.schemaVersion = sqlite3_column_int (stmt, 0);
+  }
+  sqlite3_finalize (stmt);
+
+  sqlite3_close (db);
+
+  entry->info.langCode = entry->langCode;
+  entry->info.displayName = entry->displayName;
+}
+
+int
+varnam_registry_get_schemes(varnam_registry *registry, varray **schemes)
+{
+  vregistry_entry *entry, *tmp;
+
+  if (registry == NULL || schemes == NULL)
+    return VARNAM_ARGS_ERROR;
+
+  *schemes = varray_init ();
+  HASH_ITER (hh, registry->entries, entry, tmp) {
+    if (!entry->metadata_loaded)
+      load_registry_metadata (entry);
+    entry->info.isOpen = entry->handle != NULL;
+    varray_push (*schemes, &entry->info);
+  }
+
+  return VARNAM_SUCCESS;
+}
+
+/* Closes the handle which was not used for the longest time and is not held by anyone.
+ * Returns false when all the open handles are held */
+static bool
+evict_least_recently_used(varnam_registry *registry)
+{
+  vregistry_entry *entry, *tmp, *oldest = NULL;
+
+  HASH_ITER (hh, registry->entries, entry, tmp) {
+    if (entry->handle != NULL && entry->users == 0 && (oldest == NULL || entry->last_used < oldest->last_used))
+      oldest = entry;
+  }
+
+  if (oldest == NULL)
+    return false;
+
+  varnam_destroy (oldest->handle);
+  oldest->handle = NULL;
+  --registry->open_count;
+  return true;
+}
+
+int
+varnam_registry_get_handle(varnam_registry *registry, const char *scheme_id, varnam **handle, char **msg)
+{
+  vregistry_entry *entry;
+  strbuf *error;
+  int rc;
+
+  if (registry == NULL || scheme_id == NULL || handle == NULL || msg == NULL)
+    return VARNAM_ARGS_ERROR;
+
+  *handle = NULL;
+  *msg = NULL;
+
+  entry = find_registry_entry (registry, scheme_id);
+  if (entry == NULL) {
+    error = strbuf_init (20);
+    strbuf_addf (error, "Failed to find symbols file for: %s", scheme_id);
+    *msg = strbuf_detach (error);
+    return VARNAM_ERROR;
+  }
+
+  if (entry->handle == NULL) {
+    /* When all the open handles are held, registry goes above max_open till they are released */
+    if (registry->max_open > 0 && registry->open_count >= registry->max_open)
+      evict_least_recently_used (registry);
+
+    rc = init_with_learnings (entry->path, entry->identifier, &entry->handle, msg);
+    if (rc != VARNAM_SUCCESS)
+      return rc;
+
+    ++registry->open_count;
+  }
+
+  entry->last_used = ++registry->clock;
+  ++entry->users;
+  *handle = entry->handle;
+
+  return VARNAM_SUCCESS;
+}
+
+int
+varnam_registry_release_handle(varnam_registry *registry, varnam *handle)
+{
+  vregistry_entry *entry, *tmp, *held = NULL;
+
+  if (registry == NULL || handle == NULL)
+    return VARNAM_ARGS_ERROR;
+
+  HASH_ITER (hh, registry->entries, entry, tmp) {
+    if (entry->handle == handle)
+      held = entry;
+  }
+
+  if (held == NULL || held->users == 0)
+    return VARNAM_ARGS_ERROR;
+
+  --held->users;
+  while (registry->max_open > 0 && registry->open_count > registry->max_open) {
+    if (!evict_least_recently_used (registry))
+      break;
+  }
+
+  return VARNAM_SUCCESS;
+}
+
+void
+varnam_registry_destroy(varnam_registry *registry)
+{
+  vregistry_entry *entry, *tmp;
+
+  if (registry == NULL)
+    return;
+
+  HASH_ITER (hh, registry->entries, entry, tmp) {
+    HASH_DEL (registry->entries, entry);
+    destroy_registry_entry (entry);
+  }
+
+  xfree (registry);
+}
+
+/* Looks up the symbols file in the index of the symbols directory. Schemes which are
+ * not indexed, like the ones added after the index was made, are left to the caller */
+static strbuf*
+find_indexed_symbols_file (const char *schemeIdentifier)
+{
+  vregistry_entry *entry;
+  strbuf *path = NULL;
+
+  lock_symbols_dir_index ();
+  if (symbols_dir_index == NULL)
+    varnam_registry_create (NULL, 0, &symbols_dir_index);
+
+  if (symbols_dir_index != NULL) {
+    entry = find_registry_entry (symbols_dir_index, schemeIdentifier);
+    if (entry != NULL && is_path_exists (entry->path))
+      path = strbuf_create_from (entry->path);
+  }
+  unlock_symbols_dir_index ();
+
+  return path;
+}
+
 int
 varnam_get_scheme_details(varnam *handle, vscheme_details **details)
 {
@@ -646,29 +1190,22 @@ static int can_generate_dead_consonant(const char *string, size_t len)
     return string[len - 2] != 'a' && string[len - 1] == 'a';
 }
 
-int
-varnam_create_token(
+static int
+validate_token(
     varnam *handle,
     const char *pattern,
     const char *value1,
     const char *value2,
     const char *value3,
     const char *tag,
-    int token_type,
     int match_type,
-    int priority,
-    int accept_condition,
-    int buffered)
+    int accept_condition)
 {
-    int rc;
-    size_t pattern_len;
-    char p[VARNAM_SYMBOL_MAX], v1[VARNAM_SYMBOL_MAX], v2[VARNAM_SYMBOL_MAX];
-    struct token *virama;
-
-    set_last_error (handle, NULL);
-
-    if (handle == NULL || pattern == NULL || value1 == NULL)
+    if (pattern == NULL || value1 == NULL)
+    {
+        set_last_error (handle, "pattern and value1 are required");
         return VARNAM_ARGS_ERROR;
+    }
 
     if (strlen(pattern) > VARNAM_SYMBOL_MAX ||
         strlen(value1) > VARNAM_SYMBOL_MAX  ||
@@ -694,12 +1231,49 @@ varnam_create_token(
         return VARNAM_ARGS_ERROR;
     }
 
-    if (buffered)
-    {
-        rc = vst_start_buffering (handle);
-        if (rc != VARNAM_SUCCESS)
-            return rc;
-    }
+    return VARNAM_SUCCESS;
+}
+
+static int
+persist_token(
+    varnam *handle,
+    vst_bulk *bulk,
+    const char *pattern,
+    const char *value1,
+    const char *value2,
+    const char *value3,
+    const char *tag,
+    int token_type,
+    int match_type,
+    int priority,
+    int accept_condition)
+{
+    if (bulk != NULL)
+        return vst_bulk_persist_token (handle, bulk, pattern, value1, value2, value3, tag, token_type, match_type, priority, accept_condition);
+
+    return vst_persist_token (handle, pattern, value1, value2, value3, tag, token_type, match_type, priority, accept_condition);
+}
+
+/* Persists the token along with the dead consonant inferred from it. bulk is NULL
+ * when the token is not created as part of varnam_create_tokens_bulk() */
+static int
+create_token(
+    varnam *handle,
+    vst_bulk *bulk,
+    const char *pattern,
+    const char *value1,
+    const char *value2,
+    const char *value3,
+    const char *tag,
+    int token_type,
+    int match_type,
+    int priority,
+    int accept_condition)
+{
+    int rc;
+    size_t pattern_len;
+    char p[VARNAM_SYMBOL_MAX], v1[VARNAM_SYMBOL_MAX], v2[VARNAM_SYMBOL_MAX];
+    struct token *virama;
 
     pattern_len = strlen(pattern);
 
@@ -729,12 +1303,9 @@ varnam_create_token(
             else
                 v2[0] = '\0';
 
-            rc = vst_persist_token (handle, p, v1, v2, value3, tag, VARNAM_TOKEN_DEAD_CONSONANT, match_type, priority, accept_condition);
+            rc = persist_token (handle, bulk, p, v1, v2, value3, tag, VARNAM_TOKEN_DEAD_CONSONANT, match_type, priority, accept_condition);
             if (rc != VARNAM_SUCCESS)
-            {
-                if (buffered) vst_discard_changes(handle);
                 return rc;
-            }
         }
     }
 
@@ -744,7 +1315,42 @@ varnam_create_token(
     if (token_type == VARNAM_TOKEN_JOINER)
         value1 = value2 = ZWJ();
 
-    rc = vst_persist_token (handle, pattern, value1, value2, value3, tag, token_type, match_type, priority, accept_condition);
+    return persist_token (handle, bulk, pattern, value1, value2, value3, tag, token_type, match_type, priority, accept_condition);
+}
+
+int
+varnam_create_token(
+    varnam *handle,
+    const char *pattern,
+    const char *value1,
+    const char *value2,
+    const char *value3,
+    const char *tag,
+    int token_type,
+    int match_type,
+    int priority,
+    int accept_condition,
+    int buffered)
+{
+    int rc;
+
+    set_last_error (handle, NULL);
+
+    if (handle == NULL || pattern == NULL || value1 == NULL)
+        return VARNAM_ARGS_ERROR;
+
+    rc = validate_token (handle, pattern, value1, value2, value3, tag, match_type, accept_condition);
+    if (rc != VARNAM_SUCCESS)
+        return rc;
+
+    if (buffered)
+    {
+        rc = vst_start_buffering (handle);
+        if (rc != VARNAM_SUCCESS)
+            return rc;
+    }
+
+    rc = create_token (handle, NULL, pattern, value1, value2, value3, tag, token_type, match_type, priority, accept_condition);
     if (rc != VARNAM_SUCCESS)
     {
         if (buffered) vst_discard_changes(handle);
@@ -762,6 +1368,127 @@ varnam_create_token(
     return rc;
 }
 
+int
+varnam_create_tokens_bulk(varnam *handle, vtoken_spec *specs, size_t count)
+{
+    int rc;
+    size_t i;
+    bool buffering;
+    vst_bulk *bulk;
+    vtoken_spec *spec;
+
+    set_last_error (handle, NULL);
+
+    if (handle == NULL || (specs == NULL && count > 0))
+        return VARNAM_ARGS_ERROR;
+
+    for (i = 0; i < count; i++)
+    {
+        spec = &specs[i];
+        rc = validate_token (handle, spec->pattern, spec->value1, spec->value2, spec->value3, spec->tag, spec->match_type, spec->accept_condition);
+        if (rc != VARNAM_SUCCESS)
+            return rc;
+    }
+
+    buffering = v_->vst_buffering ? true : false;
+    rc = vst_start_buffering (handle);
+    if (rc != VARNAM_SUCCESS)
+        return rc;
+
+    rc = vst_bulk_begin (handle, &bulk);
+    if (rc != VARNAM_SUCCESS) {
+        if (!buffering) vst_discard_changes (handle);
+        return rc;
+    }
+
+    for (i = 0; i < count && rc == VARNAM_SUCCESS; i++)
+    {
+        spec = &specs[i];
+        rc = create_token (handle, bulk, spec->pattern, spec->value1, spec->value2, spec->value3, spec->tag,
+                spec->type, spec->match_type, spec->priority, spec->accept_condition);
+    }
+
+    if (rc == VARNAM_SUCCESS)
+        rc = vst_bulk_finish (handle, bulk);
+
+    vst_bulk_destroy (bulk);
+
+    /* Only the tokens from this call are rolled back. Changes buffered by the caller are kept */
+    if (rc != VARNAM_SUCCESS) {
+        vst_bulk_discard_changes (handle);
+        if (!buffering) vst_discard_changes (handle);
+        return rc;
+    }
+
+    /* Changes buffered by the caller are written by varnam_flush_buffer() */
+    if (buffering)
+        return VARNAM_SUCCESS;
+
+    return varnam_flush_buffer (handle);
+}
+
+static const char*
+rule_text(const char *text)
+{
+    return text == NULL ? "" : text;
+}
+
+int
+varnam_create_rendering_rule(
+    varnam *handle,
+    int direction,
+    int token_type,
+    const char *tag,
+    const char *pattern,
+    int previous_type,
+    const char *previous_tag,
+    int output,
+    int previous_output,
+    const char *suffix)
+{
+    vrendering_rule rule;
+    int rc;
+
+    if (handle == NULL)
+        return VARNAM_ARGS_ERROR;
+
+    if (direction != VARNAM_RULE_TRANSLITERATION && direction != VARNAM_RULE_REVERSE_TRANSLITERATION) {
+        set_last_error (handle, "Invalid direction for rendering rule: %d", direction);
+        return VARNAM_ARGS_ERROR;
+    }
+
+    if (token_type < VARNAM_RULE_ANY || token_type > VARNAM_TOKEN_PERIOD ||
+        previous_type < VARNAM_RULE_ANY_PREVIOUS || previous_type > VARNAM_TOKEN_PERIOD) {
+        set_last_error (handle, "Invalid token type for rendering rule");
+        return VARNAM_ARGS_ERROR;
+    }
+
+    if (output < VARNAM_RULE_OUTPUT_NONE || output > VARNAM_RULE_OUTPUT_PATTERN ||
+        previous_output < VARNAM_RULE_OUTPUT_NONE || previous_output > VARNAM_RULE_OUTPUT_PATTERN) {
+        set_last_error (handle, "Invalid output for rendering rule");
+        return VARNAM_ARGS_ERROR;
+    }
+
+    rule.direction = direction;
+    rule.token_type = token_type;
+    rule.previous_type = previous_type;
+    rule.output = output;
+    rule.previous_output = previous_output;
+    rule.tag = rule_text (tag);
+    rule.pattern = rule_text (pattern);
+    rule.previous_tag = rule_text (previous_tag);
+    rule.suffix = rule_text (suffix);
+    rule.text = NULL;
+
+    rc = vst_persist_rendering_rule (handle, &rule);
+    if (rc != VARNAM_SUCCESS)
+        return rc;
+
+    /* rules are loaded again on next rendering */
+    v_->renderer_resolved = 0;
+    return VARNAM_SUCCESS;
+}
+
 /*adds a stem rule into the varnam symbol table*/
 int varnam_create_stemrule(varnam* handle, const char* old_ending, const char* new_ending)
 {
@@ -843,12 +1570,42 @@ varnam_flush_buffer(varnam *handle)
     return vst_flush_changes(handle);
 }
 
+/* Learning runs long transactions on known_words. Transliteration reads the committed
+ * learnings through a separate read only connection, so it never waits for them.
+ * In-memory databases can't be shared between connections and use known_words for both */
+static void
+open_learnings_reader(varnam *handle, const char *file)
+{
+    int rc;
+
+    if (*file == '\0' || strcmp (file, ":memory:") == 0 || strncmp (file, "file:", 5) == 0)
+        return;
+
+    rc = sqlite3_open_v2 (file, &v_->known_words_reader, SQLITE_OPEN_READONLY | SQLITE_OPEN_NOMUTEX, NULL);
+    if (rc != SQLITE_OK) {
+        sqlite3_close (v_->known_words_reader);
+        v_->known_words_reader = NULL;
+    }
+}
+
+static void
+close_learnings_reader(varnam *handle)
+{
+    vwt_finalize_reader_statements (handle);
+    if (v_->known_words_reader != NULL) {
+        sqlite3_close (v_->known_words_reader);
+        v_->known_words_reader = NULL;
+    }
+}
+
 static int
 enable_suggestions(varnam *handle, const char *file)
 {
     int rc;
     strbuf *tmp;
 
+    close_learnings_reader (handle);
+
     if (v_->known_words != NULL) {
         sqlite3_close (v_->known_words);
         v_->known_words = NULL;
@@ -870,6 +1627,9 @@ enable_suggestions(varnam *handle, const char *file)
       return rc;
     }
 
+    open_learnings_reader (handle, file);
+    install_statement_profiler (handle);
+
     tmp = strbuf_init (20);
     strbuf_add (tmp, file);
     handle->suggestions_file = strbuf_detach (tmp);
@@ -877,6 +1637,14 @@ enable_suggestions(varnam *handle, const char *file)
     return VARNAM_SUCCESS;
 }
 
+/* Memoized words may not be what the new configuration gives */
+static void
+forget_memoized_words(varnam *handle)
+{
+    v_->words_memo_stats.evictions += lru_trim_cache (&v_->words_memo, 0);
+    v_->rtl_memo_stats.evictions += lru_trim_cache (&v_->rtl_memo, 0);
+}
+
 int
 varnam_config(varnam *handle, int type, ...)
 {
@@ -892,17 +1660,65 @@ varnam_config(varnam *handle, int type, ...)
     switch (type)
     {
     case VARNAM_CONFIG_USE_DEAD_CONSONANTS:
-        v_->config_use_dead_consonants = va_arg(args, int);
+        rc = va_arg(args, int);
+        if (rc != v_->config_use_dead_consonants)
+            forget_memoized_words (handle);
+        v_->config_use_dead_consonants = rc;
+        rc = VARNAM_SUCCESS;
         break;
     case VARNAM_CONFIG_IGNORE_DUPLICATE_TOKEN:
         v_->config_ignore_duplicate_tokens = va_arg(args, int);
         break;
     case VARNAM_CONFIG_USE_INDIC_DIGITS:
-        v_->config_use_indic_digits = va_arg(args, int);
+        rc = va_arg(args, int);
+        if (rc != v_->config_use_indic_digits)
+            forget_memoized_words (handle);
+        v_->config_use_indic_digits = rc;
+        rc = VARNAM_SUCCESS;
         break;
     case VARNAM_CONFIG_ENABLE_SUGGESTIONS:
+        forget_memoized_words (handle);
         rc = enable_suggestions (handle, va_arg(args, const char*));
         break;
+    case VARNAM_CONFIG_POOL_HIGH_WATER_MARK:
+        rc = va_arg(args, int);
+        if (rc < 0) {
+            set_last_error (handle, "High water mark should be zero or a positive number of bytes");
+            rc = VARNAM_ARGS_ERROR;
+            break;
+        }
+        v_->config_pool_high_water_mark = (size_t) rc;
+        rc = VARNAM_SUCCESS;
+        break;
+    case VARNAM_CONFIG_AUTO_TRIM_BYTES:
+        rc = va_arg(args, int);
+        if (rc < 0) {
+            set_last_error (handle, "Auto trim target should be zero or a positive number of bytes");
+            rc = VARNAM_ARGS_ERROR;
+            break;
+        }
+        v_->config_auto_trim_bytes = (size_t) rc;
+        rc = VARNAM_SUCCESS;
+        break;
+    case VARNAM_CONFIG_MAX_CANDIDATES:
+        rc = va_arg(args, int);
+        if (rc < 0) {
+            set_last_error (handle, "Maximum candidates should be zero or a positive number");
+            rc = VARNAM_ARGS_ERROR;
+            break;
+        }
+        /* Words memo keeps the candidates after they are limited */
+        if (rc != v_->config_max_candidates)
+            v_->words_memo_stats.evictions += lru_trim_cache (&v_->words_memo, 0);
+        v_->config_max_candidates = rc;
+        rc = VARNAM_SUCCESS;
+        break;
+    case VARNAM_CONFIG_ENABLE_TRACING:
+        rc = enable_tracing (handle, va_arg(args, int));
+        break;
+    case VARNAM_CONFIG_ENABLE_PROFILING:
+        rc = enable_profiling (handle, va_arg(args, int));
+        break;
     default:
         set_last_error (handle, "Invalid configuration key");
         rc = VARNAM_INVALID_CONFIG;
@@ -913,31 +1729,145 @@ varnam_config(varnam *handle, int type, ...)
     return rc;
 }
 
+static size_t
+pooled_string_size(void *s)
+{
+    return ((strbuf*) s)->allocated;
+}
+
+static size_t
+pooled_array_size(void *a)
+{
+    return ((varray*) a)->allocated;
+}
+
+static size_t
+cached_tokens_size(void *a)
+{
+    return sizeof (varray) + ((varray*) a)->allocated;
+}
+
+static size_t
+cached_stem_size(void *s)
+{
+    return sizeof (strbuf) + ((strbuf*) s)->allocated;
+}
+
+static size_t
+memo_words_size(void *m)
+{
+    return ((memo_words*) m)->size;
+}
+
+static size_t
+memo_string_size(void *s)
+{
+    return strlen ((char*) s) + 1;
+}
+
+static double
+hit_ratio(long hits, long misses)
+{
+    if (hits + misses == 0)
+        return 0;
+
+    return (double) hits / (double) (hits + misses);
+}
+
+static void
+get_cache_info(vcache_entry **cache, vcache_stats *stats, size_t (*value_size)(void*),
+               bool detailed, vcache_info *info)
+{
+    if (detailed)
+        lru_cache_info (cache, value_size, info);
+    else {
+        info->entries = (int) HASH_COUNT (*cache);
+        info->bytes = 0;
+    }
+
+    info->hit_ratio = hit_ratio (stats->hits, stats->misses);
+    info->evictions = stats->evictions;
+}
+
+static void
+get_db_info(sqlite3 *db, vdb_info *info)
+{
+    int current, highwater, hits;
+    sqlite3_stmt *stmt = NULL;
+
+    if (db == NULL)
+        return;
+
+    while ((stmt = sqlite3_next_stmt (db, stmt)) != NULL)
+        ++info->prepared_statements;
+
+    sqlite3_db_status (db, SQLITE_DBSTATUS_CACHE_USED, &current, &highwater, 0);
+    info->cache_used = current;
+    sqlite3_db_status (db, SQLITE_DBSTATUS_SCHEMA_USED, &current, &highwater, 0);
+    info->schema_used = current;
+    sqlite3_db_status (db, SQLITE_DBSTATUS_STMT_USED, &current, &highwater, 0);
+    info->statements_used = current;
+    sqlite3_db_status (db, SQLITE_DBSTATUS_CACHE_HIT, &hits, &highwater, 0);
+    sqlite3_db_status (db, SQLITE_DBSTATUS_CACHE_MISS, &current, &highwater, 0);
+    info->cache_hit_ratio = hit_ratio (hits, current);
+}
+
 int
 varnam_get_info (varnam *handle, bool detailed, vinfo **info)
 {
-    /* only array details are implemeted */
-    vinfo *i = xmalloc (sizeof (vinfo));
+    int rc;
+    vinfo *i;
+
+    if (handle == NULL || info == NULL)
+        return VARNAM_ARGS_ERROR;
+
+    i = xmalloc (sizeof (vinfo));
+    memset (i, 0, sizeof (vinfo));
     i->scheme_file = handle->scheme_file;
-    i->symbols = 0;
-    i->words = 0;
 
-    i->tokens_in_memory = varray_length (v_->tokens_pool->array);
-    i->arrays_in_memory = varray_length (v_->arrays_pool->array);
+    if (detailed)
+    {
+        rc = vst_get_symbols_count (handle, &i->symbols);
+        if (rc) {
+            xfree (i);
+            return rc;
+        }
+
+        if (v_->known_words != NULL)
+        {
+            rc = vwt_get_words_count (handle, false, &i->words);
+            if (rc) {
+                xfree (i);
+                return rc;
+            }
+        }
+    }
+
+    vpool_get_info (v_->tokens_pool, NULL, &i->tokens_pool);
+    vpool_get_info (v_->arrays_pool, detailed ? &pooled_array_size : NULL, &i->arrays_pool);
+    vpool_get_info (v_->strings_pool, detailed ? &pooled_string_size : NULL, &i->strings_pool);
+    vpool_get_info (v_->words_pool, NULL, &i->words_pool);
+    i->tokens_in_memory = i->tokens_pool.objects;
+    i->arrays_in_memory = i->arrays_pool.objects;
+
+    get_cache_info (&v_->tokens_cache, &v_->tokens_cache_stats, &cached_tokens_size, detailed, &i->tokens_cache);
+    get_cache_info (&v_->noMatchesCache, &v_->no_matches_cache_stats, NULL, detailed, &i->no_matches_cache);
+    get_cache_info (&v_->tokenizationPossibility, &v_->tokenization_possibility_stats, NULL, detailed,
+                    &i->tokenization_possibility_cache);
+    get_cache_info (&v_->cached_stems, &v_->cached_stems_stats, &cached_stem_size, detailed, &i->stems_cache);
+    get_cache_info (&v_->words_memo, &v_->words_memo_stats, &memo_words_size, detailed, &i->words_memo);
+    get_cache_info (&v_->rtl_memo, &v_->rtl_memo_stats, &memo_string_size, detailed, &i->rtl_memo);
+    i->interned_tokens = (int) (HASH_COUNT (v_->interned_pattern_tokens) + HASH_COUNT (v_->interned_value_tokens));
+
+    get_db_info (v_->db, &i->symbols_db);
+    get_db_info (v_->known_words, &i->learnings_db);
+    sqlite3_status64 (SQLITE_STATUS_MEMORY_USED, &i->sqlite_memory_used, &i->sqlite_memory_highwater, 0);
 
     *info = i;
 
     return VARNAM_SUCCESS;
 }
 
-static void
-destroy_array(void *a)
-{
-    varray *array = (varray*) a;
-    if (array != NULL)
-        varray_free (array, NULL);
-}
-
 static void
 clear_cache (vcache_entry **cache)
 {
@@ -952,6 +1882,65 @@ clear_cache (vcache_entry **cache)
     }
 }
 
+static void
+trim_cache (vcache_entry **cache, vcache_stats *stats, bool release_all)
+{
+    if (release_all) {
+        stats->evictions += (long) HASH_COUNT (*cache);
+        clear_cache (cache);
+    }
+    else
+        stats->evictions += lru_trim_cache (cache, (int) HASH_COUNT (*cache) / 2);
+}
+
+int
+varnam_trim(varnam *handle, int level)
+{
+    bool release_all;
+
+    if (handle == NULL)
+        return VARNAM_ARGS_ERROR;
+
+    if (level != VARNAM_TRIM_POOLS && level != VARNAM_TRIM_CACHES && level != VARNAM_TRIM_ALL) {
+        set_last_error (handle, "Invalid trim level");
+        return VARNAM_ARGS_ERROR;
+    }
+
+    release_all = level == VARNAM_TRIM_ALL;
+
+    /* This holds pooled tokens */
+    varray_clear (v_->tokens);
+    trim_pools (handle, release_all);
+
+    if (level == VARNAM_TRIM_POOLS)
+        return VARNAM_SUCCESS;
+
+    trim_cache (&v_->tokens_cache, &v_->tokens_cache_stats, release_all);
+    trim_cache (&v_->noMatchesCache, &v_->no_matches_cache_stats, release_all);
+    trim_cache (&v_->tokenizationPossibility, &v_->tokenization_possibility_stats, release_all);
+    trim_cache (&v_->cached_stems, &v_->cached_stems_stats, release_all);
+    trim_cache (&v_->words_memo, &v_->words_memo_stats, release_all);
+    trim_cache (&v_->rtl_memo, &v_->rtl_memo_stats, release_all);
+
+    if (!release_all)
+        vst_release_unreferenced_tokens (handle);
+
+    if (release_all)
+    {
+        /* Nothing refers to the interned tokens once pools and tokens cache are empty */
+        destroy_interned_tokens (&v_->interned_pattern_tokens);
+        destroy_interned_tokens (&v_->interned_value_tokens);
+        destroy_candidates (&v_->candidates);
+        sqlite3_db_release_memory (v_->db);
+        if (v_->known_words != NULL)
+            sqlite3_db_release_memory (v_->known_words);
+        if (v_->known_words_reader != NULL)
+            sqlite3_db_release_memory (v_->known_words_reader);
+    }
+
+    return VARNAM_SUCCESS;
+}
+
 void
 varnam_destroy(varnam *handle)
 {
@@ -969,12 +1958,13 @@ destroy_varnam_internal(struct varnam_internal* vi)
 {
     destroy_all_statements (vi);
     destroy_token (vi->virama);
-    vpool_free (vi->tokens_pool, &destroy_token);
-    vpool_free (vi->strings_pool, &strbuf_destroy);
-    vpool_free (vi->words_pool, &destroy_word);
-    vpool_free (vi->arrays_pool, &destroy_array);
+    vpool_free (vi->tokens_pool, NULL);
+    vpool_free (vi->strings_pool, &destroy_pooled_string);
+    vpool_free (vi->words_pool, NULL);
+    vpool_free (vi->arrays_pool, &destroy_pooled_array);
     varray_free (vi->tokens, NULL);
     varray_free (vi->renderers, &xfree);
+    vst_destroy_rendering_rules (vi->rendering_rules, vi->rendering_rules_count);
     xfree(vi->message);
     strbuf_destroy (vi->last_error);
     strbuf_destroy (vi->scheme_language_code);
@@ -987,11 +1977,22 @@ destroy_varnam_internal(struct varnam_internal* vi)
     sqlite3_close(vi->db);
     if (vi->known_words != NULL)
         sqlite3_close(vi->known_words);
+    if (vi->known_words_reader != NULL)
+        sqlite3_close(vi->known_words_reader);
+    xfree (vi->statement_stats);
 
     clear_cache (&vi->tokens_cache);
     clear_cache (&vi->noMatchesCache);
     clear_cache (&vi->tokenizationPossibility);
     clear_cache (&vi->cached_stems);
+    clear_cache (&vi->words_memo);
+    clear_cache (&vi->rtl_memo);
+    xfree (vi->text_segments);
+    varray_free (vi->text_blocks, &xfree);
+    xfree (vi->timings);
+    destroy_interned_tokens (&vi->interned_pattern_tokens);
+    destroy_interned_tokens (&vi->interned_value_tokens);
+    destroy_candidates (&vi->candidates);
 		destroy_scheme_details (vi->scheme_details);
 		vi->scheme_details = NULL;
 		destroy_corpus_details (vi->corpus_details);
@@ -25,7 +25,8 @@ module VarnamLibrary
     :pattern, [:char, VARNAM_SYMBOL_MAX],
     :value1, [:char, VARNAM_SYMBOL_MAX],
     :value2, [:char, VARNAM_SYMBOL_MAX],
-    :value3, [:char, VARNAM_SYMBOL_MAX]
+    :value3, [:char, VARNAM_SYMBOL_MAX],
+    :tag_id, :int
   end
 
 	class SchemeDetails < FFI::Struct
@@ -37,23 +38,83 @@ module VarnamLibrary
 			:isStable, :int
 	end
 
+  class TokenSpec < FFI::Struct
+    layout :pattern, :pointer,
+    :value1, :pointer,
+    :value2, :pointer,
+    :value3, :pointer,
+    :tag, :pointer,
+    :type, :int,
+    :match_type, :int,
+    :priority, :int,
+    :accept_condition, :int
+  end
+
   class Word < FFI::Struct
     layout :text, :string,
     :confidence, :int
   end
 
+  class WordSpan < FFI::Struct
+    layout :text, :pointer,
+    :length, :size_t,
+    :confidence, :int
+  end
+
+  class TextSegment < FFI::Struct
+    layout :text, :string,
+    :transliterated, :int,
+    :count, :int,
+    :words, :pointer
+  end
+
+  class LangSpan < FFI::Struct
+    layout :language, :int,
+    :offset, :size_t,
+    :length, :size_t
+  end
+
+  class Timings < FFI::Struct
+    layout :count, :long,
+    :total_us, :long,
+    :min_us, :long,
+    :max_us, :long,
+    :p50_us, :long,
+    :p90_us, :long,
+    :p99_us, :long,
+    :p999_us, :long,
+    :buckets, [:long, 448]
+  end
+
+  class StatementStats < FFI::Struct
+    layout :name, :string,
+    :executions, :long,
+    :total_us, :long,
+    :rows, :long,
+    :fullscan_steps, :long,
+    :sorts, :long,
+    :autoindexes, :long,
+    :vm_steps, :long
+  end
+
   attach_function :varnam_set_symbols_dir, [:string], :int
   attach_function :varnam_init, [:string, :pointer, :pointer], :int
   attach_function :varnam_init_from_id, [:string, :pointer, :pointer], :int
   attach_function :varnam_version, [], :string
   attach_function :varnam_transliterate, [:pointer, :string, :pointer], :int
   attach_function :varnam_reverse_transliterate, [:pointer, :string, :pointer], :int
+  attach_function :varnam_transliterate_into, [:pointer, :string, :pointer, :size_t, :pointer, :size_t, :pointer, :pointer], :int
+  attach_function :varnam_transliterate_text, [:pointer, :string, :int, :pointer, :pointer], :int
+  attach_function :varnam_reverse_transliterate_text, [:pointer, :string, :pointer], :int
+  attach_function :varnam_reverse_transliterate_into, [:pointer, :string, :pointer, :size_t, :pointer], :int
   attach_function :varnam_detect_lang, [:pointer, :string], :int
+  attach_function :varnam_detect_lang_spans, [:pointer, :string, :pointer, :size_t, :pointer], :int
   attach_function :varnam_learn, [:pointer, :string], :int
   attach_function :varnam_train, [:pointer, :string, :string], :int
   attach_function :varnam_learn_from_file, [:pointer, :string, :pointer, :pointer, :pointer], :int
   attach_function :varnam_compact_learnings_file, [:pointer], :int
   attach_function :varnam_create_token, [:pointer, :string, :string, :string, :string, :string, :int, :int, :int, :int, :int], :int
+  attach_function :varnam_create_tokens_bulk, [:pointer, :pointer, :size_t], :int
   attach_function :varnam_set_scheme_details, [:pointer, :pointer], :int
   attach_function :varnam_get_all_handles, [], :pointer
   attach_function :varnam_get_scheme_details, [:pointer, :pointer], :int
@@ -67,7 +128,16 @@ module VarnamLibrary
   attach_function :varnam_import_learnings_from_file, [:pointer, :string, :pointer], :int
   attach_function :varnam_create_stemrule, [:pointer, :string, :string], :int
   attach_function :varnam_create_stem_exception, [:pointer, :string, :string], :int
+  attach_function :varnam_create_rendering_rule, [:pointer, :int, :int, :string, :string, :int, :string, :int, :int, :string], :int
   attach_function :varnam_enable_logging, [:pointer, :int, :pointer], :int
+  attach_function :varnam_get_timings, [:pointer, :int, :pointer], :int
+  attach_function :varnam_reset_timings, [:pointer], :int
+  attach_function :varnam_timing_bucket_limit, [:int], :long
+  attach_function :varnam_get_statement_stats, [:pointer, :pointer, :size_t, :pointer], :int
+  attach_function :varnam_reset_statement_stats, [:pointer], :int
+  callback :slow_query_callback, [:string, :string, :long], :void
+  attach_function :varnam_set_slow_query_callback, [:pointer, :long, :slow_query_callback], :int
+  attach_function :varnam_metrics_render, [:pointer, :pointer], :int
 end
 
 VarnamToken = Struct.new(:type, :pattern, :value1, :value2, :value3, :tag, :match_type, :priority, :accept_condition, :flags)
@@ -75,6 +145,9 @@ VarnamWord = Struct.new(:text, :confidence)
 VarnamSchemeDetails = Struct.new(:langCode, :identifier, :displayName, :author, :compiledDate, :isStable)
 
 module Varnam
+  VARNAM_SUCCESS               = 0
+  VARNAM_TRUNCATED             = 10
+
   VARNAM_TOKEN_VOWEL           = 1
   VARNAM_TOKEN_CONSONANT       = 2
   VARNAM_TOKEN_DEAD_CONSONANT  = 3
@@ -96,6 +169,38 @@ module Varnam
   VARNAM_CONFIG_IGNORE_DUPLICATE_TOKEN = 101
   VARNAM_CONFIG_ENABLE_SUGGESTIONS = 102
   VARNAM_CONFIG_USE_INDIC_DIGITS = 103
+  VARNAM_CONFIG_POOL_HIGH_WATER_MARK = 104
+  VARNAM_CONFIG_AUTO_TRIM_BYTES = 105
+  VARNAM_CONFIG_MAX_CANDIDATES = 106
+  VARNAM_CONFIG_ENABLE_TRACING = 107
+  VARNAM_CONFIG_ENABLE_PROFILING = 108
+  VARNAM_STATEMENTS = 25
+
+  VARNAM_STAGE_TRANSLITERATE = 0
+  VARNAM_STAGE_REVERSE_TRANSLITERATE = 1
+  VARNAM_STAGE_LEARN = 2
+  VARNAM_STAGE_SYMBOLS_TOKENIZE = 3
+  VARNAM_STAGE_BEST_MATCH = 4
+  VARNAM_STAGE_WORDS_TOKENIZE = 5
+  VARNAM_STAGE_RENDER = 6
+  VARNAM_STAGE_SUGGESTIONS = 7
+  VARNAM_STAGE_TRANSLITERATE_TEXT = 8
+  VARNAM_STAGE_REVERSE_TRANSLITERATE_TEXT = 9
+  VARNAM_STAGE_TRANSLITERATE_INTO = 10
+  VARNAM_STAGE_REVERSE_TRANSLITERATE_INTO = 11
+
+  VARNAM_RULE_TRANSLITERATION = 1
+  VARNAM_RULE_REVERSE_TRANSLITERATION = 2
+  VARNAM_RULE_ANY = 0
+  VARNAM_RULE_ANY_PREVIOUS = -1
+  VARNAM_RULE_OUTPUT_NONE = 0
+  VARNAM_RULE_OUTPUT_VALUE1 = 1
+  VARNAM_RULE_OUTPUT_VALUE2 = 2
+  VARNAM_RULE_OUTPUT_VALUE3 = 3
+  VARNAM_RULE_OUTPUT_PATTERN = 4
+
+  VARNAM_TEXT_BEST_CANDIDATE = 0
+  VARNAM_TEXT_ALL_CANDIDATES = 1
 
   VARNAM_LANG_CODE_HI = 1
   VARNAM_LANG_CODE_BN = 2
@@ -12,6 +12,7 @@
 #include <assert.h>
 #include "varray.h"
 #include "util.h"
+#include "api.h"
 
 varray*
 varray_init()
@@ -181,6 +182,99 @@ varray_exists (varray *array, void *item, bool (*equals)(void *left, void *right
     return false;
 }
 
+/* Alignment used for the arena allocations */
+typedef union
+{
+    long l;
+    double d;
+    void *p;
+} varena_align;
+
+#define VARENA_ALIGN(size) (((size) + sizeof (varena_align) - 1) & ~(sizeof (varena_align) - 1))
+
+varena*
+varena_init(size_t block_size)
+{
+    varena *arena = (varena*) xmalloc (sizeof(varena));
+
+    arena->blocks = varray_init ();
+    arena->block_size = block_size;
+    arena->offset = block_size;
+    arena->allocated = 0;
+
+    return arena;
+}
+
+void*
+varena_alloc(varena *arena, size_t size)
+{
+    char *block;
+    size_t block_size;
+
+    assert (arena);
+
+    size = VARENA_ALIGN (size);
+    if (arena->offset + size > arena->block_size || varray_is_empty (arena->blocks))
+    {
+        /* Blocks are never resized as items carved out of them are in use */
+        block_size = size > arena->block_size ? size : arena->block_size;
+        block = xmalloc (block_size);
+        varray_push (arena->blocks, block);
+        arena->allocated += block_size;
+        arena->offset = 0;
+        if (block_size > arena->block_size) {
+            /* Oversized block is used only for this item */
+            arena->offset = arena->block_size;
+            return block;
+        }
+    }
+
+    block = varray_get_last_item (arena->blocks);
+    block = block + arena->offset;
+    arena->offset += size;
+
+    return block;
+}
+
+/* Releases the memory carved out at and after item. Pools carve fixed size
+ * items which are smaller than a block, so every block is block_size long */
+void
+varena_release_from(varena *arena, void *item)
+{
+    char *block = NULL;
+    int i;
+
+    assert (arena);
+
+    for (i = varray_length (arena->blocks) - 1; i >= 0; i--)
+    {
+        block = varray_get (arena->blocks, i);
+        if ((char*) item >= block && (char*) item < block + arena->block_size)
+            break;
+    }
+
+    if (i < 0)
+        return;
+
+    while (varray_length (arena->blocks) > i + 1)
+    {
+        xfree (varray_pop_last_item (arena->blocks));
+        arena->allocated -= arena->block_size;
+    }
+
+    arena->offset = (size_t) ((char*) item - block);
+}
+
+void
+varena_free(varena *arena)
+{
+    if (arena == NULL)
+        return;
+
+    varray_free (arena->blocks, &xfree);
+    xfree (arena);
+}
+
 vpool*
 vpool_init()
 {
@@ -189,10 +283,31 @@ vpool_init()
     pool->array = varray_init();
     pool->free_pool = varray_init();
     pool->next_slot = 0;
+    pool->arena = NULL;
+    pool->high_water = 0;
 
     return pool;
 }
 
+void*
+vpool_alloc(vpool *pool, size_t size)
+{
+    assert (pool);
+
+    if (pool->arena == NULL)
+        pool->arena = varena_init (VARNAM_POOL_ARENA_BLOCK_SIZE);
+
+    return varena_alloc (pool->arena, size);
+}
+
+static void
+track_high_water(vpool *pool)
+{
+    int in_use = pool->next_slot - varray_length (pool->free_pool);
+    if (in_use > pool->high_water)
+        pool->high_water = in_use;
+}
+
 void*
 vpool_get(vpool *pool)
 {
@@ -208,6 +323,9 @@ vpool_get(vpool *pool)
             ++pool->next_slot;
     }
 
+    if (item != NULL)
+        track_high_water (pool);
+
     return item;
 }
 
@@ -218,6 +336,7 @@ vpool_add(vpool *pool, void *item)
     assert (item);
     varray_push (pool->array, item);
     ++pool->next_slot;
+    track_high_water (pool);
 }
 
 void
@@ -238,17 +357,112 @@ vpool_reset(vpool *pool)
     }
 }
 
+size_t
+vpool_arena_size(vpool *pool)
+{
+    if (pool == NULL || pool->arena == NULL)
+        return 0;
+
+    return pool->arena->allocated;
+}
+
+void
+vpool_get_info(vpool *pool, size_t (*item_size)(void*), vpool_info *info)
+{
+    int i;
+
+    info->objects = 0;
+    info->in_use = 0;
+    info->high_water = 0;
+    info->bytes = 0;
+    if (pool == NULL)
+        return;
+
+    info->objects = varray_length (pool->array);
+    info->in_use = pool->next_slot - varray_length (pool->free_pool);
+    info->high_water = pool->high_water;
+    info->bytes = sizeof (vpool) + vpool_arena_size (pool) +
+        pool->array->allocated + pool->free_pool->allocated;
+
+    if (item_size == NULL)
+        return;
+
+    for (i = 0; i < varray_length (pool->array); i++)
+        info->bytes += item_size (varray_get (pool->array, i));
+}
+
+static void
+release_items(vpool *pool, void (*destructor)(void*))
+{
+    int i;
+
+    if (destructor == NULL)
+        return;
+
+    for (i = 0; i < varray_length (pool->array); i++)
+        destructor (varray_get (pool->array, i));
+}
+
+void
+vpool_clear(vpool *pool, void (*destructor)(void*))
+{
+    if (pool == NULL)
+        return;
+
+    release_items (pool, destructor);
+    varray_clear (pool->array);
+    varray_clear (pool->free_pool);
+    pool->next_slot = 0;
+    varena_free (pool->arena);
+    pool->arena = NULL;
+}
+
+void
+vpool_trim(vpool *pool, void (*destructor)(void*), bool release_all)
+{
+    int keep, i;
+
+    if (pool == NULL)
+        return;
+
+    /* Items handed out in the current call are in use. Others are kept only
+     * till the most used at once since the last trim */
+    keep = pool->high_water > pool->next_slot ? pool->high_water : pool->next_slot;
+    if (release_all || keep == 0)
+    {
+        vpool_clear (pool, destructor);
+        pool->high_water = 0;
+        return;
+    }
+
+    if (varray_length (pool->array) > keep)
+    {
+        varena_release_from (pool->arena, varray_get (pool->array, keep));
+        for (i = varray_length (pool->array) - 1; i >= keep; i--)
+        {
+            if (destructor != NULL)
+                destructor (varray_get (pool->array, i));
+            varray_pop_last_item (pool->array);
+        }
+    }
+
+    pool->high_water = 0;
+}
+
 void
 vpool_free(vpool *pool, void (*destructor)(void*))
 {
     if (pool == NULL)
         return;
 
-    varray_free (pool->array, destructor);
+    release_items (pool, destructor);
+    varray_free (pool->array, NULL);
     varray_free (pool->free_pool, NULL);
+    varena_free (pool->arena);
     pool->next_slot = -1;
     pool->array = NULL;
     pool->free_pool = NULL;
+    pool->arena = NULL;
     xfree (pool);
 }
 
@@ -263,7 +477,11 @@ get_pooled_array (varnam *handle)
     array = vpool_get (v_->arrays_pool);
     if (array == NULL)
     {
-        array = varray_init ();
+        array = vpool_alloc (v_->arrays_pool, sizeof (varray));
+        array->memory = NULL;
+        array->allocated = 0;
+        array->used = 0;
+        array->index = -1;
         vpool_add (v_->arrays_pool, array);
     }
 
@@ -280,12 +498,125 @@ return_array_to_pool (varnam *handle, varray *array)
     vpool_return (v_->arrays_pool, array);
 }
 
+/* Pooled arrays live in the pool's arena. Only the memory they own is freed */
+void
+destroy_pooled_array(void *a)
+{
+    varray *array = (varray*) a;
+    if (array != NULL)
+        xfree (array->memory);
+}
+
+/* If the pool has grown past the configured high water mark, it is released
+ * and will be built up again on demand */
+static void
+reset_or_trim_pool(varnam *handle, vpool *pool, void (*destructor)(void*))
+{
+    if (pool == NULL)
+        return;
+
+    if (v_->config_pool_high_water_mark > 0 &&
+        vpool_arena_size (pool) > v_->config_pool_high_water_mark)
+        vpool_clear (pool, destructor);
+    else
+        vpool_reset (pool);
+}
+
+#define VARNAM_AUTO_TRIMMED_CACHES 6
+
+/* Caches which are trimmed when the handle goes past the memory target */
+static int
+auto_trimmed_caches(varnam *handle, vcache_entry ***caches, vcache_stats **stats)
+{
+    caches[0] = &v_->tokens_cache;            stats[0] = &v_->tokens_cache_stats;
+    caches[1] = &v_->noMatchesCache;          stats[1] = &v_->no_matches_cache_stats;
+    caches[2] = &v_->tokenizationPossibility; stats[2] = &v_->tokenization_possibility_stats;
+    caches[3] = &v_->cached_stems;            stats[3] = &v_->cached_stems_stats;
+    caches[4] = &v_->words_memo;              stats[4] = &v_->words_memo_stats;
+    caches[5] = &v_->rtl_memo;                stats[5] = &v_->rtl_memo_stats;
+    return VARNAM_AUTO_TRIMMED_CACHES;
+}
+
+/* Memory held by the pools and caches. Size of the cached values are not
+ * tracked, so an average is assumed for each cache entry */
+static size_t
+estimated_memory(varnam *handle, size_t *entries)
+{
+    vcache_entry **caches[VARNAM_AUTO_TRIMMED_CACHES];
+    vcache_stats *stats[VARNAM_AUTO_TRIMMED_CACHES];
+    int i, count;
+
+    *entries = 0;
+    count = auto_trimmed_caches (handle, caches, stats);
+    for (i = 0; i < count; i++)
+        *entries += HASH_COUNT (*caches[i]);
+
+    return vpool_arena_size (v_->tokens_pool) + vpool_arena_size (v_->arrays_pool) +
+           vpool_arena_size (v_->strings_pool) + vpool_arena_size (v_->words_pool) +
+           *entries * (sizeof (vcache_entry) + VARNAM_CACHE_ENTRY_ESTIMATE);
+}
+
 void
 reset_pool(varnam *handle)
 {
     assert(handle);
     assert(handle->internal);
-    vpool_reset (v_->tokens_pool);
-    vpool_reset (v_->arrays_pool);
-    vpool_reset (v_->strings_pool);
+
+    reset_or_trim_pool (handle, v_->tokens_pool, NULL);
+    reset_or_trim_pool (handle, v_->arrays_pool, &destroy_pooled_array);
+    reset_or_trim_pool (handle, v_->strings_pool, &destroy_pooled_string);
+    reset_or_trim_pool (handle, v_->words_pool, NULL);
+}
+
+void
+trim_to_memory_target(varnam *handle)
+{
+    vcache_entry **caches[VARNAM_AUTO_TRIMMED_CACHES];
+    vcache_stats *stats[VARNAM_AUTO_TRIMMED_CACHES];
+    size_t target, memory, entries, excess, cumulative, evicted, evict;
+    int i, count;
+
+    assert(handle);
+    assert(handle->internal);
+
+    target = v_->config_auto_trim_bytes;
+    if (target == 0 || estimated_memory (handle, &entries) <= target)
+        return;
+
+    /* Pooled objects which are not in use are cheaper to build again */
+    trim_pools (handle, false);
+    memory = estimated_memory (handle, &entries);
+    if (memory <= target || entries == 0)
+        return;
+
+    /* Least recently used entries are evicted from each cache in proportion to
+     * it's size, till the estimate comes down to the target */
+    excess = (memory - target + sizeof (vcache_entry) + VARNAM_CACHE_ENTRY_ESTIMATE - 1) /
+             (sizeof (vcache_entry) + VARNAM_CACHE_ENTRY_ESTIMATE);
+    if (excess > entries)
+        excess = entries;
+
+    cumulative = 0;
+    evicted = 0;
+    count = auto_trimmed_caches (handle, caches, stats);
+    for (i = 0; i < count; i++)
+    {
+        cumulative += HASH_COUNT (*caches[i]);
+        evict = excess * cumulative / entries - evicted;
+        evicted += evict;
+        if (evict > 0)
+            stats[i]->evictions += lru_trim_cache (caches[i],
+                                                   (int) (HASH_COUNT (*caches[i]) - evict));
+    }
+}
+
+void
+trim_pools(varnam *handle, bool release_all)
+{
+    assert(handle);
+    assert(handle->internal);
+    vpool_trim (v_->tokens_pool, NULL, release_all);
+    vpool_trim (v_->arrays_pool, &destroy_pooled_array, release_all);
+    vpool_trim (v_->strings_pool, &destroy_pooled_string, release_all);
+    vpool_trim (v_->words_pool, NULL, release_all);
 }
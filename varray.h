@@ -12,6 +12,12 @@
 #include "util.h"
 #include "vtypes.h"
 
+/* Size of the blocks pooled items are carved out of */
+#define VARNAM_POOL_ARENA_BLOCK_SIZE 8192
+
+/* Average bytes held by a cache entry's key and value. Used when estimating memory */
+#define VARNAM_CACHE_ENTRY_ESTIMATE 48
+
 /**
  * Array to hold pointers. This expands automatically.
  *
@@ -24,11 +30,25 @@ typedef struct varray_t
     int index;
 } varray;
 
+/**
+ * Bump allocator. Memory is carved out of large blocks and all of it is
+ * released together. Individual allocations can't be freed.
+ **/
+typedef struct varena_t
+{
+    varray *blocks;
+    size_t block_size;
+    size_t offset;      /* next free byte in the last block */
+    size_t allocated;   /* total bytes held by the blocks */
+} varena;
+
 typedef struct vpool_t
 {
     varray *array;
     int next_slot;
     varray *free_pool;
+    varena *arena;      /* storage for the pooled items */
+    int high_water;     /* most items in use at once since the last trim */
 } vpool;
 
 VARNAM_EXPORT extern varray* 
@@ -70,9 +90,36 @@ varray_insert(varray *array, int index, void *data);
 VARNAM_EXPORT extern void
 varray_free(varray *array, void (*destructor)(void*));
 
+VARNAM_EXPORT extern varena*
+varena_init(size_t block_size);
+
+/**
+ * Returns size bytes from the arena. Memory is aligned for any type
+ **/
+VARNAM_EXPORT extern void*
+varena_alloc(varena *arena, size_t size);
+
+/**
+ * Releases the memory carved out at and after item, which should be allocated
+ * from this arena. Memory allocated before item stays valid
+ **/
+VARNAM_EXPORT extern void
+varena_release_from(varena *arena, void *item);
+
+VARNAM_EXPORT extern void
+varena_free(varena *arena);
+
 VARNAM_EXPORT extern vpool*
 vpool_init();
 
+/**
+ * Allocates memory for a new item from the pool's arena. Items added to the
+ * pool should be allocated using this, so that they are laid out together
+ * and released along with the pool
+ **/
+VARNAM_EXPORT extern void*
+vpool_alloc(vpool *pool, size_t size);
+
 /**
  * Returns next item from the pool. NULL otherwise
  **/
@@ -92,7 +139,38 @@ VARNAM_EXPORT extern void
 vpool_reset(vpool *pool);
 
 /**
- * Free the items contained in the pool and finally the pool itself
+ * Number of bytes held by the pool's arena
+ **/
+VARNAM_EXPORT extern size_t
+vpool_arena_size(vpool *pool);
+
+/**
+ * Releases the items beyond the pool's high water mark and the items in use. All
+ * of them are released if release_all is set. High water mark is reset so that it
+ * tracks usage since this trim
+ **/
+VARNAM_EXPORT extern void
+vpool_trim(vpool *pool, void (*destructor)(void*), bool release_all);
+
+/**
+ * Fills object counts and bytes held by the pool. item_size returns the bytes
+ * owned by an item, excluding the item itself. It can be NULL
+ **/
+VARNAM_EXPORT extern void
+vpool_get_info(vpool *pool, size_t (*item_size)(void*), vpool_info *info);
+
+/**
+ * Releases all the items and the arena. Pool will be empty after this and
+ * can be used again. destructor should release only the memory owned by the
+ * item, not the item itself
+ **/
+VARNAM_EXPORT extern void
+vpool_clear(vpool *pool, void (*destructor)(void*));
+
+/**
+ * Free the items contained in the pool and finally the pool itself.
+ * destructor should release only the memory owned by the item, not the item
+ * itself
  *
  **/
 VARNAM_EXPORT extern void
@@ -104,7 +182,21 @@ get_pooled_array (varnam *handle);
 VARNAM_EXPORT extern void
 return_array_to_pool (varnam *handle, varray *array);
 
+VARNAM_EXPORT extern void
+destroy_pooled_array(void *array);
+
 VARNAM_EXPORT extern void
 reset_pool(varnam *handle);
 
+VARNAM_EXPORT extern void
+trim_pools(varnam *handle, bool release_all);
+
+/**
+ * Brings the estimated memory held by the pools and caches down to
+ * VARNAM_CONFIG_AUTO_TRIM_BYTES. Called at the end of the public calls, so
+ * the objects handed out by the call are kept
+ **/
+VARNAM_EXPORT extern void
+trim_to_memory_target(varnam *handle);
+
 #endif
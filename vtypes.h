@@ -40,6 +40,29 @@
 #define VARNAM_TOKEN_JOINER						 12
 #define VARNAM_TOKEN_PERIOD						 13
 
+/* Tags that renderers look for. Tokens carry the id of their tag, so
+   renderers don't have to compare strings */
+#define VARNAM_TAG_NONE							 0
+#define VARNAM_TAG_OTHER						 1
+#define VARNAM_TAG_RENDER_VALUE2				 2
+#define VARNAM_TAG_CHILL						 3
+
+/* Renderer is called for all tokens */
+#define VARNAM_RENDER_ALL						 (~0u)
+
+/* Rendering rules declared in the scheme */
+#define VARNAM_RULE_TRANSLITERATION				 1
+#define VARNAM_RULE_REVERSE_TRANSLITERATION		 2
+
+#define VARNAM_RULE_ANY							 0   /* matches any token type */
+#define VARNAM_RULE_ANY_PREVIOUS				 -1  /* there should be a previous token, of any type */
+
+#define VARNAM_RULE_OUTPUT_NONE					 0
+#define VARNAM_RULE_OUTPUT_VALUE1				 1
+#define VARNAM_RULE_OUTPUT_VALUE2				 2
+#define VARNAM_RULE_OUTPUT_VALUE3				 3
+#define VARNAM_RULE_OUTPUT_PATTERN				 4
+
 /* token flags */
 #define VARNAM_TOKEN_FLAGS_MORE_MATCHES_FOR_PATTERN (1 << 0)
 #define VARNAM_TOKEN_FLAGS_MORE_MATCHES_FOR_VALUE		(1 << 1)
@@ -49,6 +72,67 @@
 #define VARNAM_CONFIG_IGNORE_DUPLICATE_TOKEN	 101
 #define VARNAM_CONFIG_ENABLE_SUGGESTIONS			 102
 #define VARNAM_CONFIG_USE_INDIC_DIGITS				 103
+#define VARNAM_CONFIG_POOL_HIGH_WATER_MARK		 104
+#define VARNAM_CONFIG_AUTO_TRIM_BYTES				 105
+#define VARNAM_CONFIG_MAX_CANDIDATES				 106
+#define VARNAM_CONFIG_ENABLE_TRACING				 107
+#define VARNAM_CONFIG_ENABLE_PROFILING			 108
+
+/* levels for varnam_trim() */
+#define VARNAM_TRIM_POOLS						 1
+#define VARNAM_TRIM_CACHES						 2
+#define VARNAM_TRIM_ALL							 3
+
+/* Options for opening symbols file */
+#define VARNAM_OPEN_READONLY					 1
+#define VARNAM_OPEN_IN_MEMORY					 2
+
+/* Options for varnam_transliterate_text() */
+#define VARNAM_TEXT_BEST_CANDIDATE				 0
+#define VARNAM_TEXT_ALL_CANDIDATES				 1
+
+/* Stages timed by varnam_get_timings(). First three and the last four are whole public calls */
+#define VARNAM_STAGE_TRANSLITERATE				 0
+#define VARNAM_STAGE_REVERSE_TRANSLITERATE		 1
+#define VARNAM_STAGE_LEARN						 2
+#define VARNAM_STAGE_SYMBOLS_TOKENIZE			 3
+#define VARNAM_STAGE_BEST_MATCH					 4
+#define VARNAM_STAGE_WORDS_TOKENIZE				 5
+#define VARNAM_STAGE_RENDER						 6
+#define VARNAM_STAGE_SUGGESTIONS				 7
+#define VARNAM_STAGE_TRANSLITERATE_TEXT			 8
+#define VARNAM_STAGE_REVERSE_TRANSLITERATE_TEXT	 9
+#define VARNAM_STAGE_TRANSLITERATE_INTO			 10
+#define VARNAM_STAGE_REVERSE_TRANSLITERATE_INTO	 11
+#define VARNAM_STAGES							 12
+
+/* Public calls whose calls and errors are counted for varnam_metrics_render() */
+#define VARNAM_CALL_TRANSLITERATE				 0
+#define VARNAM_CALL_REVERSE_TRANSLITERATE		 1
+#define VARNAM_CALL_LEARN						 2
+#define VARNAM_CALL_TRAIN						 3
+#define VARNAM_CALL_TRANSLITERATE_TEXT			 4
+#define VARNAM_CALL_REVERSE_TRANSLITERATE_TEXT	 5
+#define VARNAM_CALL_TRANSLITERATE_INTO			 6
+#define VARNAM_CALL_REVERSE_TRANSLITERATE_INTO	 7
+#define VARNAM_CALL_LEARN_FROM_FILE				 8
+#define VARNAM_CALL_IMPORT_LEARNINGS			 9
+#define VARNAM_CALL_EXPORT_WORDS				 10
+#define VARNAM_CALL_DETECT_LANG_SPANS			 11
+#define VARNAM_CALLS							 12
+
+/* Buckets in a timings histogram. See varnam_timing_bucket_limit() */
+#define VARNAM_TIMING_BUCKETS					 448
+
+/* Prepared statements profiled by varnam_get_statement_stats(). The ones kept by the
+ * handle and one for rest of the statements */
+#define VARNAM_STATEMENTS						 25
+
+/* Statements the profiler can time at once. Others fall back to the time sqlite reports */
+#define VARNAM_RUNNING_STATEMENTS				 8
+
+/* Size of the memory map used for read only symbols files */
+#define VARNAM_SYMBOLS_MMAP_SIZE				 (64 * 1024 * 1024)
 
 /* Keys used in metadata*/
 #define VARNAM_METADATA_SCHEME_LANGUAGE_CODE		 "lang-code"
@@ -99,12 +183,33 @@ typedef struct scheme_details_t {
 	int isStable;
 } vscheme_details;
 
+/* Token to be created by varnam_create_tokens_bulk(). Fields are the same as the
+ * arguments of varnam_create_token(). value2, value3 and tag are optional */
+typedef struct token_spec_t {
+	const char *pattern;
+	const char *value1;
+	const char *value2;
+	const char *value3;
+	const char *tag;
+	int type;
+	int match_type;
+	int priority;
+	int accept_condition;
+} vtoken_spec;
+
 /* Live information about the current word corpus for a scheme */
 typedef struct corpus_details_t {
 	int wordsCount;
 } vcorpus_details;
 
 typedef void (*vcache_value_free_cb)(void*);
+
+/* Lookups served by a cache */
+typedef struct {
+	long hits;
+	long misses;
+	long evictions; /* entries dropped to make room or to release memory */
+} vcache_stats;
 typedef struct {
 	char *key;
 	void *value;
@@ -112,14 +217,59 @@ typedef struct {
 	UT_hash_handle hh;
 } vcache_entry;
 
+/* Candidates of a word as they are kept in the words memo */
+typedef struct {
+	size_t count;
+	size_t size; /* bytes of the whole allocation */
+} memo_words;
+
+/* Tokens read from the symbols table are interned by symbol id. Each symbol is
+ * materialized once per handle and caches hold pointers to the interned token.
+ * Writes to the symbols table invalidate them along with the caches.
+ * Interned tokens are full vtokens and not a compact form, because the tokenizer
+ * results, renderers and learning read vtoken fields directly. Since a symbol is
+ * kept only once, a compact form would save memory per symbol and not per lookup */
+typedef struct {
+	int id;
+	struct token *token;
+	int referenced; /* set while finding tokens no cache refers to */
+	UT_hash_handle hh;
+} vtoken_entry;
+
+/* A word collected by varnam_transliterate(). Candidates are deduplicated on the
+ * word text and ranked by source, then confidence, then the order they were added */
+typedef struct {
+	struct varnam_word_t *word;
+	int source;
+	int order;
+	char *key;       /* copy of the word's text, which the index is keyed on */
+	size_t key_size;
+	UT_hash_handle hh;
+} vcandidate;
+
+typedef struct {
+	vcandidate *index;        /* candidates in use, keyed by word text */
+	struct varray_t *entries; /* all the allocated candidates. Reused across calls */
+	int count;
+	int limit;                /* 0 means no limit */
+} vcandidates;
+
 struct varnam_internal
 {
 	/* file handles */
 	sqlite3 *db;
 	sqlite3 *known_words;
+	sqlite3 *known_words_reader; /* read only connection used while transliterating */
 	char *message;
 
 	struct varray_t *renderers;
+	struct varnam_token_rendering *renderer;  /* renderer for this scheme, looked up once */
+	int renderer_resolved;
+
+	/* rendering rules from the symbols table. Loaded along with the renderer */
+	struct varnam_rendering_rule_t *rendering_rules;
+	int rendering_rules_count;
+	unsigned int rules_types[3], rules_tags[3]; /* indexed by direction */
 	struct token *virama;
 	struct strbuf *last_error;
 
@@ -141,6 +291,9 @@ struct varnam_internal
 	int config_use_dead_consonants;
 	int config_ignore_duplicate_tokens;
 	int config_use_indic_digits;
+	size_t config_pool_high_water_mark;
+	size_t config_auto_trim_bytes;
+	int config_max_candidates;
 
 	/* internal configuration options */
 	int _config_mostly_learning_new_words;
@@ -190,6 +343,56 @@ struct varnam_internal
 	vcache_entry *noMatchesCache; /* Contains all the patterns which don't have a match */
 	vcache_entry *tokenizationPossibility; /* Contains patterns and a value indicating whether further tokenization is possible */
 	vcache_entry *cached_stems; 
+	vcache_stats tokens_cache_stats;
+	vcache_stats no_matches_cache_stats;
+	vcache_stats tokenization_possibility_stats;
+	vcache_stats cached_stems_stats;
+
+	/* Candidates of the words seen by varnam_transliterate_text(). Cleared when the
+	 * symbols, learnings or configuration changes */
+	vcache_entry *words_memo;
+	vcache_stats words_memo_stats;
+	int words_memo_symbols_changes;
+	int words_memo_learnings_changes;
+	int words_memo_data_version;
+
+	/* Words reverse transliterated by varnam_reverse_transliterate_text(). Cleared
+	 * when the symbols or configuration changes */
+	vcache_entry *rtl_memo;
+	vcache_stats rtl_memo_stats;
+	int rtl_memo_symbols_changes;
+
+	/* Output of varnam_transliterate_text(). Text is copied into blocks which don't
+	 * move when more is added, so segments can point into them */
+	struct varnam_text_segment_t *text_segments;
+	size_t text_segments_allocated;
+	struct varray_t *text_blocks;
+	size_t text_block_used;
+	size_t text_block_size;
+
+	/* indexed by VARNAM_CALL_XXX. Only the thread using the handle writes these */
+	long calls[VARNAM_CALLS];
+	long errors[VARNAM_CALLS];
+
+	/* timings of each stage, indexed by VARNAM_STAGE_XXX. NULL when tracing is off */
+	struct varnam_timings_t *timings;
+
+	/* cost of the prepared statements. NULL when profiling is off */
+	struct varnam_statement_stats_t *statement_stats;
+	void (*slow_query_callback)(const char *statement, const char *sql, long elapsed_us);
+	long slow_query_threshold_us;
+	struct {
+		sqlite3_stmt *stmt;
+		sqlite3_int64 started; /* monotonic_time_us() of the first step */
+	} running_statements[VARNAM_RUNNING_STATEMENTS];
+
+	/* interned tokens. Tokenizing using value lowercases the pattern, so it gets it's own table */
+	vtoken_entry *interned_pattern_tokens;
+	vtoken_entry *interned_value_tokens;
+	int interned_symbols_changes; /* sqlite3_total_changes() of the symbols table when they were read */
+
+	/* words collected while transliterating */
+	vcandidates candidates;
 
 	vscheme_details *scheme_details;
 	vcorpus_details *corpus_details;
@@ -208,6 +411,7 @@ typedef struct token {
 	char value1[VARNAM_SYMBOL_MAX];
 	char value2[VARNAM_SYMBOL_MAX];
 	char value3[VARNAM_SYMBOL_MAX];
+	int tag_id; /* one of VARNAM_TAG_*. Added in 4.0.0, see CHANGELOG */
 } vtoken;
 
 struct varnam_rule {
@@ -225,8 +429,55 @@ typedef struct varnam_token_rendering {
 	const char *scheme_id;
 	int (*tl)(varnam *handle, vtoken *previous, vtoken *current,	struct strbuf *output);
 	int (*rtl)(varnam *handle, vtoken *previous, vtoken *current,  struct strbuf *output);
+	/* Token types and tag ids, as bit masks, which the callbacks can render.
+	   Other tokens are rendered without calling them */
+	unsigned int tl_types, tl_tags;
+	unsigned int rtl_types, rtl_tags;
 } vtoken_renderer;
 
+/* A contextual rendering rule. When the token being rendered and the one before it
+ * match, output is used instead of the default rendering. Empty strings and
+ * VARNAM_RULE_ANY match anything */
+typedef struct varnam_rendering_rule_t {
+	int direction;
+	int token_type;
+	int tag_id;
+	int previous_type;    /* VARNAM_RULE_ANY, VARNAM_RULE_ANY_PREVIOUS or a token type */
+	int previous_tag_id;
+	int output;
+	int previous_output;  /* when set, rendering of the previous token is replaced with this */
+	const char *tag;
+	const char *pattern;
+	const char *previous_tag;
+	const char *suffix;
+	char *text;           /* holds the strings above for rules loaded from the symbols table */
+} vrendering_rule;
+
+/* Objects and memory held by an instance pool */
+typedef struct varnam_pool_info_t {
+	int objects;    /* objects owned by the pool */
+	int in_use;     /* objects handed out since the pool was last reset */
+	int high_water; /* most objects in use at once since the last trim */
+	size_t bytes;   /* bytes held by the pool's arena and the objects */
+} vpool_info;
+
+/* Entries and memory held by an in-memory cache and how well it is doing */
+typedef struct varnam_cache_info_t {
+	int entries;
+	size_t bytes;
+	double hit_ratio; /* hits out of all the lookups. 0 when there were no lookups */
+	long evictions;
+} vcache_info;
+
+/* Memory used by a sqlite connection. See sqlite3_db_status() */
+typedef struct varnam_db_info_t {
+	int prepared_statements;
+	int cache_used;
+	int schema_used;
+	int statements_used;
+	double cache_hit_ratio; /* page cache hits out of all the page lookups */
+} vdb_info;
+
 typedef struct varnam_info_t {
 	const char *scheme_file;
 	int symbols;
@@ -234,8 +485,82 @@ typedef struct varnam_info_t {
 
 	int tokens_in_memory;
 	int arrays_in_memory;
+
+	vpool_info tokens_pool;
+	vpool_info arrays_pool;
+	vpool_info strings_pool;
+	vpool_info words_pool;
+
+	vcache_info tokens_cache;
+	vcache_info no_matches_cache;
+	vcache_info tokenization_possibility_cache;
+	vcache_info stems_cache;
+	vcache_info words_memo;
+	vcache_info rtl_memo;
+	int interned_tokens;
+
+	vdb_info symbols_db;
+	vdb_info learnings_db;
+
+	/* memory used by sqlite for the whole process */
+	sqlite3_int64 sqlite_memory_used;
+	sqlite3_int64 sqlite_memory_highwater;
 } vinfo;
 
+/* Wall clock time taken by a stage, in microseconds */
+typedef struct varnam_timings_t {
+	long count;
+	long total_us;
+	long min_us;
+	long max_us;
+	long p50_us;
+	long p90_us;
+	long p99_us;
+	long p999_us;
+	long buckets[VARNAM_TIMING_BUCKETS]; /* times which fall in each bucket */
+} vtimings;
+
+/* What a prepared statement has cost since profiling was turned on */
+typedef struct varnam_statement_stats_t {
+	const char *name;
+	long executions;
+	long total_us;
+	long rows;
+	long fullscan_steps;  /* see sqlite3_stmt_status() */
+	long sorts;
+	long autoindexes;
+	long vm_steps;
+} vstatement_stats;
+
+/* A set of handles for one scheme that can be shared between threads */
+typedef struct varnam_pool_t varnam_pool;
+
+typedef struct varnam_pool_stats_t {
+	int size;
+	int available;
+	long checkouts;
+	long waits;        /* checkouts which had to wait for a handle */
+	long timeouts;
+	long wait_time_total_us;
+	long wait_time_max_us;
+} varnam_pool_stats;
+
+/* Index of the schemes available in a symbols directory */
+typedef struct varnam_registry_t varnam_registry;
+
+/* A scheme known to the registry. langCode, displayName and schemaVersion are read
+ * from the symbols file without opening a handle. schemaVersion is the format of the
+ * file (VARNAM_SCHEMA_SYMBOLS_VERSION), not a version of the scheme; the symbols file
+ * does not record one */
+typedef struct varnam_scheme_entry_t {
+	const char *identifier;
+	const char *path;
+	const char *langCode;
+	const char *displayName;
+	int schemaVersion;
+	int isOpen;
+} vscheme_entry;
+
 typedef struct varnam_learn_status_t {
 	int total_words;
 	int failed;
@@ -246,4 +571,27 @@ typedef struct varnam_word_t {
 	int confidence;
 } vword;
 
+/* A word written into caller provided memory. text points into the caller's buffer */
+typedef struct varnam_word_span_t {
+	const char *text;
+	size_t length;
+	int confidence;
+} vword_span;
+
+/* Part of the text given to varnam_transliterate_text(). words has the candidates,
+ * best first. Text which is not transliterated has itself as the only word */
+typedef struct varnam_text_segment_t {
+	const char *text;
+	int transliterated;
+	int count;
+	vword *words;
+} vtext_segment;
+
+/* Part of a text written in a single script. offset and length are in bytes */
+typedef struct varnam_lang_span_t {
+	int language;
+	size_t offset;
+	size_t length;
+} vlang_span;
+
 #endif
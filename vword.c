@@ -7,6 +7,7 @@
 
 
 #include <assert.h>
+#include <stdlib.h>
 #include <string.h>
 
 #include "vword.h"
@@ -46,11 +47,11 @@ get_pooled_word(varnam *handle, const char *text, int confidence)
     word = vpool_get (v_->words_pool);
     if (word == NULL)
     {
-        word = Word (handle, text, confidence);
+        word = vpool_alloc (v_->words_pool, sizeof (vword));
         vpool_add (v_->words_pool, word);
     }
-    else
-        initialize_word (handle, word, text, confidence);
+
+    initialize_word (handle, word, text, confidence);
 
     return word;
 }
@@ -80,3 +81,158 @@ destroy_word(void *word)
         xfree((vword*) word);
     }
 }
+
+void
+reset_candidates(vcandidates *candidates, int limit)
+{
+    assert (candidates);
+
+    HASH_CLEAR (hh, candidates->index);
+    candidates->count = 0;
+    candidates->limit = limit;
+}
+
+bool
+candidates_full(vcandidates *candidates)
+{
+    return candidates->limit > 0 && candidates->count >= candidates->limit;
+}
+
+static bool
+ranks_higher(vword *word, int source, vcandidate *candidate)
+{
+    if (source != candidate->source)
+        return source < candidate->source;
+
+    return word->confidence > candidate->word->confidence;
+}
+
+/* Candidate at the end of the ones in use. It is not in the index */
+static vcandidate*
+spare_candidate(vcandidates *candidates)
+{
+    vcandidate *candidate;
+
+    if (candidates->entries == NULL)
+        candidates->entries = varray_init ();
+
+    if (candidates->count < varray_length (candidates->entries))
+        return varray_get (candidates->entries, candidates->count);
+
+    candidate = xmalloc (sizeof (vcandidate));
+    candidate->key = NULL;
+    candidate->key_size = 0;
+    varray_push (candidates->entries, candidate);
+    return candidate;
+}
+
+/* uthash keys are not const. So the index is keyed on a copy of the text, which is
+ * kept with the candidate and reused across calls */
+static void
+set_key(vcandidate *candidate, const char *text, size_t length)
+{
+    if (candidate->key_size < length + 1)
+    {
+        xfree (candidate->key);
+        candidate->key = xmalloc (length + 1);
+        candidate->key_size = length + 1;
+    }
+
+    memcpy (candidate->key, text, length + 1);
+}
+
+bool
+add_candidate(vcandidates *candidates, vword *word, int source)
+{
+    vcandidate *candidate, *spare;
+    size_t length;
+
+    assert (candidates);
+    assert (word);
+
+    length = strlen (word->text);
+    spare = spare_candidate (candidates);
+    set_key (spare, word->text, length);
+    HASH_FIND (hh, candidates->index, spare->key, (unsigned) length, candidate);
+    if (candidate != NULL)
+    {
+        if (ranks_higher (word, source, candidate))
+        {
+            candidate->word = word;
+            candidate->source = source;
+        }
+        return false;
+    }
+
+    if (candidates_full (candidates))
+        return false;
+
+    spare->word = word;
+    spare->source = source;
+    spare->order = candidates->count++;
+    HASH_ADD_KEYPTR (hh, candidates->index, spare->key, (unsigned) length, spare);
+
+    return true;
+}
+
+static int
+compare_candidates(const void *left, const void *right)
+{
+    const vcandidate *lhs = *(vcandidate* const*) left;
+    const vcandidate *rhs = *(vcandidate* const*) right;
+
+    if (lhs->source != rhs->source)
+        return lhs->source < rhs->source ? -1 : 1;
+
+    if (lhs->word->confidence != rhs->word->confidence)
+        return lhs->word->confidence > rhs->word->confidence ? -1 : 1;
+
+    return lhs->order - rhs->order;
+}
+
+void
+sort_candidates(vcandidates *candidates)
+{
+    assert (candidates);
+
+    if (candidates->count == 0)
+        return;
+
+    /* Candidates in use are always at the front of entries */
+    qsort (candidates->entries->memory, (size_t) candidates->count, sizeof (void*), &compare_candidates);
+}
+
+void
+candidates_to_array(vcandidates *candidates, varray *words)
+{
+    int i;
+    vcandidate *candidate;
+
+    assert (candidates);
+    assert (words);
+
+    sort_candidates (candidates);
+    for (i = 0; i < candidates->count; i++)
+    {
+        candidate = varray_get (candidates->entries, i);
+        varray_push (words, candidate->word);
+    }
+}
+
+static void
+destroy_candidate(void *c)
+{
+    vcandidate *candidate = c;
+
+    xfree (candidate->key);
+    xfree (candidate);
+}
+
+void
+destroy_candidates(vcandidates *candidates)
+{
+    HASH_CLEAR (hh, candidates->index);
+    varray_free (candidates->entries, &destroy_candidate);
+    candidates->entries = NULL;
+    candidates->count = 0;
+}
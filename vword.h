@@ -12,6 +12,7 @@
 
 #include "vtypes.h"
 #include "util.h"
+#include "varray.h"
 
 /*
  * Constructor for vword
@@ -31,4 +32,43 @@ word_equals (void *left, void *right);
 void
 destroy_word(void *word);
 
+/* Sources of transliteration candidates, in the order they rank */
+#define VARNAM_CANDIDATE_BEST_MATCH       0
+#define VARNAM_CANDIDATE_WORDS_TOKENIZER  1
+#define VARNAM_CANDIDATE_SYMBOLS          2
+#define VARNAM_CANDIDATE_SUGGESTION       3
+
+/*
+ * Empties the candidate set and sets the maximum number of candidates it takes.
+ * Allocated candidates are kept for the next call
+ */
+void
+reset_candidates(vcandidates *candidates, int limit);
+
+/*
+ * Adds word to the candidates. When a word with same text is already present, the
+ * better ranked one is kept. Returns false when the word is a duplicate or the set is full.
+ * Sources should be added in the order they rank, so that a full set can't miss a better candidate
+ */
+bool
+add_candidate(vcandidates *candidates, vword *word, int source);
+
+bool
+candidates_full(vcandidates *candidates);
+
+/*
+ * Sorts the candidates by rank. Sorted candidates are at the front of entries
+ */
+void
+sort_candidates(vcandidates *candidates);
+
+/*
+ * Sorts the candidates by rank and pushes the words into words
+ */
+void
+candidates_to_array(vcandidates *candidates, varray *words);
+
+void
+destroy_candidates(vcandidates *candidates);
+
 #endif
@@ -22,6 +22,9 @@
 
 #define MINIMUM_CHARACTER_LENGTH_FOR_SUGGESTION 3
 
+/* Connection for the queries made while transliterating. See open_learnings_reader() */
+#define learnings_reader(v) ((v)->known_words_reader != NULL ? (v)->known_words_reader : (v)->known_words)
+
 int
 vwt_ensure_schema_exists(varnam *handle)
 {
@@ -58,6 +61,19 @@ vwt_ensure_schema_exists(varnam *handle)
     return VARNAM_SUCCESS;
 }
 
+void
+vwt_finalize_reader_statements(varnam *handle)
+{
+    sqlite3_finalize (v_->get_best_match);
+    sqlite3_finalize (v_->get_suggestions);
+    sqlite3_finalize (v_->get_matches_for_word);
+    sqlite3_finalize (v_->possible_to_find_matches);
+    v_->get_best_match = NULL;
+    v_->get_suggestions = NULL;
+    v_->get_matches_for_word = NULL;
+    v_->possible_to_find_matches = NULL;
+}
+
 static int
 execute_sql(varnam *handle, sqlite3 *db, const char *sql)
 {
@@ -228,27 +244,17 @@ vwt_get_word_id (varnam *handle, const char *word, sqlite3_int64 *word_id)
     return VARNAM_SUCCESS;
 }
 
-/* Learns the pattern. strbuf* is passed in because of memory optimizations.
- * See comments in the learn_prefixes() function */
+/* Learns the pattern for the word */
 static int
-learn_pattern (varnam *handle, varray *tokens, const char *word, strbuf *pattern, bool is_prefix)
+learn_pattern (varnam *handle, const char *word, const char *pattern, bool is_prefix)
 {
-    int rc, i;
+    int rc;
     sqlite3_int64 word_id;
-    vtoken *token;
 
     rc = vwt_get_word_id (handle, word, &word_id);
     if (rc) return rc;
 
-    strbuf_clear (pattern);
-    for (i = 0; i < varray_length (tokens); i++)
-    {
-        token = varray_get (tokens, i);
-        if (token->type != VARNAM_TOKEN_NON_JOINER && token->type != VARNAM_TOKEN_JOINER)
-            strbuf_add (pattern, token->pattern);
-    }
-
-    rc = vwt_persist_pattern(handle, strbuf_to_s (pattern), word_id, is_prefix);
+    rc = vwt_persist_pattern(handle, pattern, word_id, is_prefix);
     if (rc)
         return rc;
 
@@ -367,59 +373,6 @@ learn_word (varnam *handle, const char *word, int confidence, bool *new_word)
     return VARNAM_SUCCESS;
 }
 
-/* Learns all the prefixes. This won't learn single tokens and the word itself
- * tokens_tmp - Is passed is for memory usage optimization. This function gets
- * called inside a cartesion product finder which means there will be a lot of
- * instances of array required. To optimize this, we pass in this array which
- * will be allocated from cartesian product finder */
-static int
-learn_prefixes(varnam *handle, varray *tokens, strbuf *pattern, bool word_already_learned)
-{
-    int i, rc, tokens_len = 0;
-    vword *word;
-    vtoken *token;
-    bool new_word;
-
-    varray *tokens_tmp = get_pooled_array (handle);
-    for (i = 0; i < varray_length (tokens); i++)
-    {
-        token = varray_get (tokens, i);
-        assert (token != NULL);
-
-        varray_push (tokens_tmp, token);
-
-        tokens_len = varray_length (tokens_tmp);
-        /* We don't learn if it is only one token.
-         * We don't learn the full word here because it would have already learned before this method is called */
-        if (tokens_len > 1 && tokens_len != varray_length(tokens))
-        {
-            rc = resolve_tokens (handle, tokens_tmp, &word);
-            if (rc) {
-                return_array_to_pool (handle, tokens_tmp);
-                return rc;
-            }
-
-            if (!word_already_learned)
-            {
-                rc = learn_word (handle, word->text, 1, &new_word);
-                if (rc) {
-                    return_array_to_pool (handle, tokens_tmp);
-                    return rc;
-                }
-            }
-
-            rc = learn_pattern (handle, tokens_tmp, word->text, pattern, true);
-            if (rc) {
-                return_array_to_pool (handle, tokens_tmp);
-                return rc;
-            }
-        }
-    }
-
-    return_array_to_pool (handle, tokens_tmp);
-    return VARNAM_SUCCESS;
-}
-
 void
 print_tokens_array(varray *tokens)
 {
@@ -448,63 +401,142 @@ print_tokens_array(varray *tokens)
 
 }
 
-/* This function learns all possibilities of writing the word and it's prefixes.
- * It finds cartesian product of the tokens passed in and process each product.
- * tokens will be a multidimensional array */
+/* State shared while learning the paths in learn_all_possibilities().
+ * rendered[d], patterns[d] and previous[d] holds the rendered text, pattern and
+ * last rendered token for the prefix made of first d tokens in the current path */
+struct learn_walk
+{
+    const char *word;
+    int depth;
+    int learned;
+    strbuf **rendered;
+    strbuf **patterns;
+    vtoken **previous;
+};
+
+/* Learns the pattern of path and the prefixes of the word along it. The first shared
+ * tokens of path are the same as the path learned before, so those prefixes are already
+ * rendered and persisted. Rendering of a prefix extends the rendered text of it's parent */
 static int
-learn_all_possibilities(varnam *handle, varray *tokens, const char *word)
+learn_path(varnam *handle, varray *path, int shared, struct learn_walk *walk)
 {
-    int rc, array_cnt, *offsets, i, last_array_offset, total = 0;
-    varray *array, *tmp;
-    strbuf *pattern;
-    bool word_already_learned = false;
+    int rc, level, next;
+    vtoken *token;
+    bool new_word;
 
-    array_cnt = varray_length (tokens);
-    offsets = xmalloc(sizeof(int) * (size_t) array_cnt);
+    for (level = shared; level < walk->depth; level++)
+    {
+        next = level + 1;
+        token = varray_get (path, level);
+        assert (token);
 
-    for (i = 0; i < array_cnt; i++) offsets[i] = 0;
+        strbuf_clear (walk->patterns[next]);
+        strbuf_add (walk->patterns[next], strbuf_to_s (walk->patterns[level]));
+        if (token->type != VARNAM_TOKEN_NON_JOINER && token->type != VARNAM_TOKEN_JOINER)
+            strbuf_add (walk->patterns[next], token->pattern);
 
-    array = get_pooled_array (handle);
-    pattern = get_pooled_string (handle);
+        if (next == walk->depth)
+            return learn_pattern (handle, walk->word, strbuf_to_s (walk->patterns[next]), false);
 
-    for (;;)
-    {
-        varray_clear (array);
-        for (i = 0; i < array_cnt; i++)
+        strbuf_clear (walk->rendered[next]);
+        strbuf_add (walk->rendered[next], strbuf_to_s (walk->rendered[level]));
+        walk->previous[next] = walk->previous[level];
+        rc = resolve_token (handle, token, &walk->previous[next], walk->rendered[next]);
+        if (rc) return rc;
+
+        /* We don't learn if it is only one token. Prefix words are learned only
+         * along the first path, later paths just add patterns to them */
+        if (next > 1)
         {
-            tmp = varray_get (tokens, i);
-            assert (tmp);
-            varray_push (array, varray_get (tmp, offsets[i]));
+            if (walk->learned == 0)
+            {
+                rc = learn_word (handle, strbuf_to_s (walk->rendered[next]), 1, &new_word);
+                if (rc) return rc;
+            }
+
+            rc = learn_pattern (handle, strbuf_to_s (walk->rendered[next]),
+                    strbuf_to_s (walk->patterns[next]), true);
+            if (rc) return rc;
         }
+    }
 
-        rc = learn_pattern (handle, array, word, pattern, false);
-        if (rc)
-            goto finished;
+    return VARNAM_SUCCESS;
+}
 
-        rc = learn_prefixes (handle, array, pattern, word_already_learned);
-        if (rc)
-            goto finished;
+/* This function learns the possibilities of writing the word and it's prefixes.
+ * tokens will be a multidimensional array. Paths through the tokens are taken best
+ * first from a lattice, and only MAXIMUM_PATTERNS_TO_LEARN of them are learned, so
+ * the combinations of a long word are never enumerated */
+static int
+learn_all_possibilities(varnam *handle, varray *tokens, const char *word)
+{
+    int rc, i, shared;
+    struct learn_walk walk;
+    vlattice lattice;
+    varray *path, *last_path, *tmp;
+    bool found;
 
-        word_already_learned = true;
-        if (++total == MAXIMUM_PATTERNS_TO_LEARN) {
-            goto finished;
-        }
+    walk.word = word;
+    walk.depth = varray_length (tokens);
+    walk.learned = 0;
 
-        last_array_offset = array_cnt - 1;
-        offsets[last_array_offset]++;
+    if (walk.depth == 0)
+        return VARNAM_SUCCESS;
 
-        while (offsets[last_array_offset] == varray_length ((varray*) varray_get (tokens, last_array_offset)))
-        {
-            offsets[last_array_offset] = 0;
+    /* A position without alternatives leaves no path to learn */
+    for (i = 0; i < walk.depth; i++)
+    {
+        if (varray_is_empty (varray_get (tokens, i)))
+            return VARNAM_SUCCESS;
+    }
 
-            if (--last_array_offset < 0) goto finished;
+    rc = lattice_init (&lattice, tokens);
+    if (rc) return rc;
 
-            offsets[last_array_offset]++;
-        }
+    walk.rendered = xmalloc (sizeof (strbuf*) * (size_t) (walk.depth + 1));
+    walk.patterns = xmalloc (sizeof (strbuf*) * (size_t) (walk.depth + 1));
+    walk.previous = xmalloc (sizeof (vtoken*) * (size_t) (walk.depth + 1));
+    path = varray_init ();
+    last_path = varray_init ();
+
+    for (i = 0; i <= walk.depth; i++)
+    {
+        walk.rendered[i] = get_pooled_string (handle);
+        walk.patterns[i] = get_pooled_string (handle);
+        walk.previous[i] = NULL;
+    }
+
+    while (walk.learned < MAXIMUM_PATTERNS_TO_LEARN)
+    {
+        rc = lattice_next (&lattice, path, &found);
+        if (rc || !found) break;
+
+        shared = 0;
+        while (shared < varray_length (last_path) &&
+               varray_get (path, shared) == varray_get (last_path, shared))
+            shared++;
+
+        rc = learn_path (handle, path, shared, &walk);
+        if (rc) break;
+
+        ++walk.learned;
+        tmp = last_path;
+        last_path = path;
+        path = tmp;
+    }
+
+    for (i = 0; i <= walk.depth; i++)
+    {
+        return_string_to_pool (handle, walk.rendered[i]);
+        return_string_to_pool (handle, walk.patterns[i]);
     }
 
-finished:
-    xfree (offsets);
+    varray_free (path, NULL);
+    varray_free (last_path, NULL);
+    lattice_release (&lattice);
+    xfree (walk.rendered);
+    xfree (walk.patterns);
+    xfree (walk.previous);
     return rc;
 }
 
@@ -524,7 +556,7 @@ vwt_persist_possibilities(varnam *handle, varray *tokens, const char *word, int
 }
 
 int
-vwt_get_best_match (varnam *handle, const char *input, varray *words)
+vwt_get_best_match (varnam *handle, const char *input, vcandidates *candidates)
 {
     int rc;
     vword *word;
@@ -533,7 +565,7 @@ vwt_get_best_match (varnam *handle, const char *input, varray *words)
                       "order by confidence desc";
 
     assert (handle);
-    assert (words);
+    assert (candidates);
 
     if (v_->known_words == NULL)
         return VARNAM_SUCCESS;
@@ -543,9 +575,9 @@ vwt_get_best_match (varnam *handle, const char *input, varray *words)
 
     if (v_->get_best_match == NULL)
     {
-        rc = sqlite3_prepare_v2( v_->known_words, sql, -1, &v_->get_best_match, NULL );
+        rc = sqlite3_prepare_v2( learnings_reader (v_), sql, -1, &v_->get_best_match, NULL );
         if (rc != SQLITE_OK) {
-            set_last_error (handle, "Failed to get best matches : %s", sqlite3_errmsg(v_->known_words));
+            set_last_error (handle, "Failed to get best matches : %s", sqlite3_errmsg(learnings_reader (v_)));
             sqlite3_reset (v_->get_best_match);
             return VARNAM_ERROR;
         }
@@ -553,7 +585,7 @@ vwt_get_best_match (varnam *handle, const char *input, varray *words)
 
     sqlite3_bind_text (v_->get_best_match, 1, input, -1, NULL);
 
-    for (;;)
+    while (!candidates_full (candidates))
     {
         rc = sqlite3_step (v_->get_best_match);
         if (rc == SQLITE_ROW)
@@ -561,7 +593,7 @@ vwt_get_best_match (varnam *handle, const char *input, varray *words)
             word = get_pooled_word (handle,
                                     (const char*) sqlite3_column_text(v_->get_best_match, 0),
                                     (int) sqlite3_column_int(v_->get_best_match, 1));
-            varray_push (words, word);
+            add_candidate (candidates, word, VARNAM_CANDIDATE_BEST_MATCH);
         }
         else if (rc == SQLITE_DONE)
         {
@@ -569,7 +601,7 @@ vwt_get_best_match (varnam *handle, const char *input, varray *words)
         }
         else
         {
-            set_last_error (handle, "Failed to get best match : %s", sqlite3_errmsg(v_->known_words));
+            set_last_error (handle, "Failed to get best match : %s", sqlite3_errmsg(learnings_reader (v_)));
             sqlite3_reset (v_->get_best_match);
             return VARNAM_ERROR;
         }
@@ -581,7 +613,7 @@ vwt_get_best_match (varnam *handle, const char *input, varray *words)
 }
 
 int
-vwt_get_suggestions (varnam *handle, const char *input, varray *words)
+vwt_get_suggestions (varnam *handle, const char *input, vcandidates *candidates)
 {
     int rc;
     vword *word;
@@ -590,7 +622,7 @@ vwt_get_suggestions (varnam *handle, const char *input, varray *words)
                       "order by confidence desc";
 
     assert (handle);
-    assert (words);
+    assert (candidates);
 
     if (v_->known_words == NULL)
         return VARNAM_SUCCESS;
@@ -600,9 +632,9 @@ vwt_get_suggestions (varnam *handle, const char *input, varray *words)
 
     if (v_->get_suggestions == NULL)
     {
-        rc = sqlite3_prepare_v2( v_->known_words, sql, -1, &v_->get_suggestions, NULL );
+        rc = sqlite3_prepare_v2( learnings_reader (v_), sql, -1, &v_->get_suggestions, NULL );
         if (rc != SQLITE_OK) {
-            set_last_error (handle, "Failed to get suggestions : %s", sqlite3_errmsg(v_->known_words));
+            set_last_error (handle, "Failed to get suggestions : %s", sqlite3_errmsg(learnings_reader (v_)));
             sqlite3_reset (v_->get_suggestions);
             return VARNAM_ERROR;
         }
@@ -610,7 +642,7 @@ vwt_get_suggestions (varnam *handle, const char *input, varray *words)
 
     sqlite3_bind_text (v_->get_suggestions, 1, input, -1, NULL);
 
-    for (;;)
+    while (!candidates_full (candidates))
     {
         rc = sqlite3_step (v_->get_suggestions);
         if (rc == SQLITE_ROW)
@@ -618,10 +650,7 @@ vwt_get_suggestions (varnam *handle, const char *input, varray *words)
             word = get_pooled_word (handle,
                                     (const char*) sqlite3_column_text(v_->get_suggestions, 0),
                                     (int) sqlite3_column_int(v_->get_suggestions, 1));
-            if (!varray_exists (words, word, &word_equals))
-            {
-                varray_push (words, word);
-            }
+            add_candidate (candidates, word, VARNAM_CANDIDATE_SUGGESTION);
         }
         else if (rc == SQLITE_DONE)
         {
@@ -629,7 +658,7 @@ vwt_get_suggestions (varnam *handle, const char *input, varray *words)
         }
         else
         {
-            set_last_error (handle, "Failed to get suggestions : %s", sqlite3_errmsg(v_->known_words));
+            set_last_error (handle, "Failed to get suggestions : %s", sqlite3_errmsg(learnings_reader (v_)));
             sqlite3_reset (v_->get_suggestions);
             return VARNAM_ERROR;
         }
@@ -652,9 +681,9 @@ get_matches (varnam *handle, strbuf *lookup, varray *matches, bool *found)
 
     if (v_->get_matches_for_word == NULL)
     {
-        rc = sqlite3_prepare_v2( v_->known_words, sql, -1, &v_->get_matches_for_word, NULL );
+        rc = sqlite3_prepare_v2( learnings_reader (v_), sql, -1, &v_->get_matches_for_word, NULL );
         if (rc != SQLITE_OK) {
-            set_last_error (handle, "Failed to get matches : %s", sqlite3_errmsg(v_->known_words));
+            set_last_error (handle, "Failed to get matches : %s", sqlite3_errmsg(learnings_reader (v_)));
             sqlite3_reset (v_->get_matches_for_word);
             return VARNAM_ERROR;
         }
@@ -682,7 +711,7 @@ get_matches (varnam *handle, strbuf *lookup, varray *matches, bool *found)
         }
         else
         {
-            set_last_error (handle, "Failed to get matches : %s", sqlite3_errmsg(v_->known_words));
+            set_last_error (handle, "Failed to get matches : %s", sqlite3_errmsg(learnings_reader (v_)));
             sqlite3_reset (v_->get_matches_for_word);
             return VARNAM_ERROR;
         }
@@ -704,9 +733,9 @@ can_find_possible_matches (varnam *handle, strbuf *lookup, bool *possible)
 
     if (v_->possible_to_find_matches == NULL)
     {
-        rc = sqlite3_prepare_v2( v_->known_words, sql, -1, &v_->possible_to_find_matches, NULL );
+        rc = sqlite3_prepare_v2( learnings_reader (v_), sql, -1, &v_->possible_to_find_matches, NULL );
         if (rc != SQLITE_OK) {
-            set_last_error (handle, "Failed to check for possible matches : %s", sqlite3_errmsg(v_->known_words));
+            set_last_error (handle, "Failed to check for possible matches : %s", sqlite3_errmsg(learnings_reader (v_)));
             sqlite3_reset (v_->possible_to_find_matches);
             return VARNAM_ERROR;
         }
@@ -721,7 +750,7 @@ can_find_possible_matches (varnam *handle, strbuf *lookup, bool *possible)
     }
     else if (rc != SQLITE_DONE)
     {
-        set_last_error (handle, "Failed to check for possible matches : %s", sqlite3_errmsg(v_->known_words));
+        set_last_error (handle, "Failed to check for possible matches : %s", sqlite3_errmsg(learnings_reader (v_)));
         sqlite3_reset (v_->possible_to_find_matches);
         return VARNAM_ERROR;
     }
@@ -732,35 +761,23 @@ can_find_possible_matches (varnam *handle, strbuf *lookup, bool *possible)
     return VARNAM_SUCCESS;
 }
 
-/* Gets the first element of each array in the specified multidimensional array */
-static varray*
-get_first_elements(varnam *handle, varray *source)
-{
-    int i, j;
-    varray *a;
-    varray *result = get_pooled_array (handle);
-
-    for (i = 0; i < varray_length (source); i++)
-    {
-        a = varray_get (source, i);
-        for (j = 0; j < varray_length (a); j++)
-        {
-            varray_push (result, varray_get (a, j));
-            break;
-        }
-    }
-
-    return result;
-}
-
 /* tokens will be a multidimensional array */
 static void
 add_tokens (varnam *handle, varray *tokens, varray *result, bool first_match)
 {
-    varray *tmp, *item;
-    int j , k;
+    varray *tmp, *item, *position;
+    int i, j , k;
 
-    tmp = get_first_elements (handle, tokens);
+    /* Only the best path is needed here. Pattern tokenization gives the alternatives
+       of each position with the highest priority first, so that path is the first
+       alternative of each position */
+    tmp = get_pooled_array (handle);
+    for (i = 0; i < varray_length (tokens); i++)
+    {
+        position = varray_get (tokens, i);
+        if (varray_length (position) > 0)
+            varray_push (tmp, varray_get (position, 0));
+    }
     if (first_match) {
         varray_push (result, tmp);
     }
@@ -809,6 +826,7 @@ vwt_tokenize_pattern (varnam *handle, const char *pattern, varray *result)
 {
     int rc, matchpos = 0, pos = 0, i;
     strbuf *lookup, *for_symbols_tokenization, *match;
+    strbuf_sso lookup_buffer, for_symbols_tokenization_buffer;
     varray *matches;  /* contains strbuf* instances */
     varray *tokens;   /* Contains arrays that contains vtoken* instances */
     bool found = false, possible = false, first_match = true;
@@ -822,7 +840,7 @@ vwt_tokenize_pattern (varnam *handle, const char *pattern, varray *result)
     if (pattern == NULL || *pattern == '\0')
         return VARNAM_SUCCESS;
 
-    lookup     = get_pooled_string (handle);
+    lookup     = strbuf_sso_init (&lookup_buffer);
     matches    = get_pooled_array (handle);
     tokens     = get_pooled_array (handle);
 
@@ -835,15 +853,19 @@ vwt_tokenize_pattern (varnam *handle, const char *pattern, varray *result)
         ++pos; ++pc;
 
         rc = get_matches (handle, lookup, matches, &found);
-        if (rc != VARNAM_SUCCESS)
+        if (rc != VARNAM_SUCCESS) {
+            strbuf_sso_release (&lookup_buffer);
             return rc;
+        }
         if (found) {
             matchpos = pos;
         }
 
         rc = can_find_possible_matches (handle, lookup, &possible);
-        if (rc)
+        if (rc) {
+            strbuf_sso_release (&lookup_buffer);
             return rc;
+        }
         if (possible)
             continue;
         else
@@ -852,6 +874,7 @@ vwt_tokenize_pattern (varnam *handle, const char *pattern, varray *result)
 
     /* At this point we will have the longest possible match. If nothing is available,
      * there is no words that matches the prefix. In that case, exiting early */
+    strbuf_sso_release (&lookup_buffer);
     if (varray_length (matches) == 0 && varray_length(result) == 0) {
         return VARNAM_SUCCESS;
     }
@@ -873,14 +896,12 @@ vwt_tokenize_pattern (varnam *handle, const char *pattern, varray *result)
     pattern = pattern + matchpos;
 
     /* Remaining text will be tokenized literally */
-    for_symbols_tokenization = get_pooled_string (handle);
+    for_symbols_tokenization = strbuf_sso_init (&for_symbols_tokenization_buffer);
     strbuf_add (for_symbols_tokenization, pattern);
     rc = symbols_tokenize_add_to_result (handle, for_symbols_tokenization, result);
+    strbuf_sso_release (&for_symbols_tokenization_buffer);
     if (rc) return rc;
 
-    strbuf_clear (lookup);
-    strbuf_clear (for_symbols_tokenization);
-
     /* At this point, result will look like
      * [[t1,t2,t3], [t4,t5,t6]]*/
 
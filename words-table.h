@@ -18,6 +18,10 @@
 int
 vwt_ensure_schema_exists(varnam *handle);
 
+/* Finalizes the statements prepared on the learnings reader connection */
+void
+vwt_finalize_reader_statements(varnam *handle);
+
 int
 vwt_persist_possibilities(varnam *handle, varray *tokens, const char *word, int confidence);
 
@@ -39,14 +43,17 @@ vwt_optimize_for_huge_transaction(varnam *handle);
 int
 vwt_turn_off_optimization_for_huge_transaction(varnam *handle);
 
+/**
+ * Adds the learned words for input to candidates. Stops once candidates is full
+ **/
 int
-vwt_get_best_match (varnam *handle, const char *input, varray *words);
+vwt_get_best_match (varnam *handle, const char *input, vcandidates *candidates);
 
 /**
- * Gets the suggestions for input and store it in words array
+ * Gets the suggestions for input and adds them to candidates. Stops once candidates is full
  **/
 int
-vwt_get_suggestions (varnam *handle, const char *input, varray *words);
+vwt_get_suggestions (varnam *handle, const char *input, vcandidates *candidates);
 
 /**
  * Tokenizes the pattern based on words table. Result will be multidimensional